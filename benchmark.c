@@ -0,0 +1,2100 @@
+/**
+ * Benchmarks for the performance critical parts of the flight analysis.
+ *
+ * Usage: benchmark parse <spaceship_data.csv> [repetitions]
+ *        benchmark scaling <spaceship_data.csv> [max_threads]
+ *        benchmark kernels [num_elements]
+ *        benchmark generate <output.csv> <rows> [seed]
+ *        benchmark stages <spaceship_data.csv> [options]
+ *        benchmark suite [max_rows] [options]
+ *        benchmark integrators <spaceship_data.csv> [max_substeps]
+ *        benchmark spatial [max_points]
+ *        benchmark database <spaceship_data.csv> [windows]
+ *        benchmark rolling [num_steps]
+ *        benchmark fleet [ships] [steps]
+ *        benchmark telemetry <spaceship_data.csv> [repetitions]
+ *                  [min_temperature]
+ *        benchmark raster <spaceship_data.csv> [size] [repetitions]
+ *        benchmark compact <spaceship_data.csv> [repetitions]
+ */
+
+#include "compact_trajectory.h"
+#include "csv_parser.h"
+#include "fleet.h"
+#include "flight.h"
+#include "flight_analysis.h"
+#include "flight_database.h"
+#include "heatmap.h"
+#include "integrator.h"
+#include "latex_report.h"
+#include "parallel_analysis.h"
+#include "platform.h"
+#include "raster.h"
+#include "simd_kernels.h"
+#include "sliding_window.h"
+#include "spatial_index.h"
+#include "svg_writer.h"
+#include "synthetic_flight.h"
+#include "telemetry_file.h"
+#include "timing.h"
+#include "trajectory.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Prints one result line of a benchmark.
+ *
+ * @param name Name of the measured variant.
+ * @param seconds Best wall time of all repetitions.
+ * @param bytes Number of input bytes processed per repetition.
+ * @param rows Number of rows processed per repetition.
+ */
+void print_throughput(const char *name, double seconds, size_t bytes,
+                      size_t rows) {
+  printf("%-16s %10.3f ms %10.1f MB/s %12.0f rows/s\n", name, seconds * 1e3,
+         bytes / seconds / 1e6, rows / seconds);
+}
+
+/**
+ * @brief The parsing loop used before the memory mapped parser.
+ *
+ * @return The number of rows read.
+ */
+size_t parse_with_fscanf(const char *filename, double *checksum) {
+  FILE *csv = fopen(filename, "r");
+  if (!csv) {
+    return 0;
+  }
+  size_t rows = 0;
+  double acceleration, rotation, temperature;
+  while (fscanf(csv, "%lf,%lf,%lf\n", &acceleration, &rotation,
+                &temperature) == 3) {
+    *checksum += acceleration + rotation + temperature;
+    rows++;
+  }
+  fclose(csv);
+  return rows;
+}
+
+/**
+ * @brief Parses the file with the memory mapped parser, including the mapping
+ * itself.
+ *
+ * @return The number of rows read.
+ */
+size_t parse_with_mapping(const char *filename, TelemetryChunk *chunk,
+                          double *checksum) {
+  MappedFile csv;
+  if (!map_file(filename, &csv)) {
+    return 0;
+  }
+  CsvParser parser;
+  csv_parser_init(&parser, csv.data, csv.size);
+  size_t rows = 0;
+  while (csv_read_chunk(&parser, chunk) > 0) {
+    for (size_t i = 0; i < chunk->length; i++) {
+      *checksum +=
+          chunk->acceleration[i] + chunk->rotation[i] + chunk->temperature[i];
+    }
+    rows += chunk->length;
+  }
+  unmap_file(&csv);
+  return rows;
+}
+
+/**
+ * @brief Compares the throughput of the fscanf loop and the memory mapped
+ * parser. Both variants must produce the same checksum.
+ */
+int benchmark_parse(const char *filename, int repetitions) {
+  MappedFile csv;
+  if (!map_file(filename, &csv)) {
+    printf("Error: Could not read file %s\n", filename);
+    return 1;
+  }
+  size_t bytes = csv.size;
+  unmap_file(&csv);
+
+  TelemetryChunk *chunk = malloc(sizeof(*chunk));
+  if (!chunk) {
+    return 1;
+  }
+
+  double best_fscanf = 1e300, best_mapped = 1e300;
+  double checksum_fscanf = 0, checksum_mapped = 0;
+  size_t rows_fscanf = 0, rows_mapped = 0;
+
+  for (int i = 0; i < repetitions; i++) {
+    checksum_fscanf = 0;
+    double start = monotonic_seconds();
+    rows_fscanf = parse_with_fscanf(filename, &checksum_fscanf);
+    double elapsed = monotonic_seconds() - start;
+    if (elapsed < best_fscanf) {
+      best_fscanf = elapsed;
+    }
+
+    checksum_mapped = 0;
+    start = monotonic_seconds();
+    rows_mapped = parse_with_mapping(filename, chunk, &checksum_mapped);
+    elapsed = monotonic_seconds() - start;
+    if (elapsed < best_mapped) {
+      best_mapped = elapsed;
+    }
+  }
+  free(chunk);
+
+  printf("Input: %s (%zu bytes, %zu rows, best of %d)\n", filename, bytes,
+         rows_mapped, repetitions);
+  print_throughput("fscanf", best_fscanf, bytes, rows_fscanf);
+  print_throughput("mmap parser", best_mapped, bytes, rows_mapped);
+  printf("Speedup: %.2fx\n", best_fscanf / best_mapped);
+
+  if (rows_fscanf != rows_mapped || checksum_fscanf != checksum_mapped) {
+    printf("Error: Parsers disagree (%zu vs %zu rows)\n", rows_fscanf,
+           rows_mapped);
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Measures the full analysis (parse, integrate, reduce) of a file with
+ * 1 to `max_threads` threads and compares the result with the serial loop.
+ */
+int benchmark_scaling(const char *filename, int max_threads) {
+  MappedFile csv;
+  if (!map_file(filename, &csv)) {
+    printf("Error: Could not read file %s\n", filename);
+    return 1;
+  }
+
+  // Serial reference: the chunk loop of main()
+  TelemetryChunk *chunk = malloc(sizeof(*chunk));
+  ChunkKinematics *kinematics = malloc(sizeof(*kinematics));
+  if (!chunk || !kinematics) {
+    return 1;
+  }
+  FlightState serial;
+  Trajectory serial_trajectory;
+  flight_state_init(&serial);
+  trajectory_init(&serial_trajectory);
+  CsvParser parser;
+  csv_parser_init(&parser, csv.data, csv.size);
+
+  double start = monotonic_seconds();
+  while (csv_read_chunk(&parser, chunk) > 0) {
+    process_chunk(&serial, chunk, kinematics, &serial_trajectory);
+  }
+  double serial_seconds = monotonic_seconds() - start;
+  free(chunk);
+  free(kinematics);
+
+  printf("Input: %s (%zu bytes, %zu rows)\n", filename, csv.size,
+         serial_trajectory.length);
+  printf("%-16s %10.3f ms\n", "serial", serial_seconds * 1e3);
+
+  double one_thread_seconds = 0;
+  for (int threads = 1; threads <= max_threads; threads++) {
+    FlightState state;
+    Trajectory trajectory;
+    size_t malformed_rows;
+    trajectory_init(&trajectory);
+
+    start = monotonic_seconds();
+    int success =
+        analyze_parallel(&csv, threads, &state, &trajectory, &malformed_rows);
+    double seconds = monotonic_seconds() - start;
+    if (threads == 1) {
+      one_thread_seconds = seconds;
+    }
+
+    // Largest relative deviation of any position from the serial loop
+    double max_error = 0;
+    for (size_t i = 0; success && i < trajectory.length; i++) {
+      double bx = serial_trajectory.x[i], by = serial_trajectory.y[i];
+      double scale = fmax(1.0, fmax(fabs(bx), fabs(by)));
+      double error =
+          fmax(fabs(trajectory.x[i] - bx), fabs(trajectory.y[i] - by)) / scale;
+      if (error > max_error) {
+        max_error = error;
+      }
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "%d threads", threads);
+    printf("%-16s %10.3f ms %6.2fx speedup %12.0f rows/s  max rel. error "
+           "%.1e\n",
+           name, seconds * 1e3, one_thread_seconds / seconds,
+           trajectory.length / seconds, max_error);
+    trajectory_free(&trajectory);
+    if (!success) {
+      printf("Error: Analysis failed\n");
+      return 1;
+    }
+  }
+
+  trajectory_free(&serial_trajectory);
+  unmap_file(&csv);
+  return 0;
+}
+
+/**
+ * @brief Prints one result line of the kernel benchmark.
+ */
+void print_kernel_result(const char *kernel, const char *variant,
+                         double seconds, size_t n, double max_error) {
+  printf("%-16s %-8s %8.3f ns/element  max abs. error %.1e\n", kernel,
+         variant, seconds * 1e9 / n, max_error);
+}
+
+/**
+ * @brief Largest absolute difference between two columns.
+ */
+double max_difference(const double *a, const double *b, size_t n) {
+  double max_error = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (fabs(a[i] - b[i]) > max_error) {
+      max_error = fabs(a[i] - b[i]);
+    }
+  }
+  return max_error;
+}
+
+/**
+ * @brief Compares the batch kernels on every supported backend with the
+ * per-step functions (accelerate, calculate_speed, calculate_distance).
+ */
+int benchmark_kernels(size_t n) {
+  double *angles = malloc(n * sizeof(double));
+  double *deltas = malloc(n * sizeof(double));
+  double *x = malloc(n * sizeof(double));
+  double *y = malloc(n * sizeof(double));
+  double *reference_a = malloc(n * sizeof(double));
+  double *reference_b = malloc(n * sizeof(double));
+  double *result_a = malloc(n * sizeof(double));
+  double *result_b = malloc(n * sizeof(double));
+  if (!angles || !deltas || !x || !y || !reference_a || !reference_b ||
+      !result_a || !result_b) {
+    printf("Error: Could not allocate %zu elements\n", n);
+    return 1;
+  }
+
+  // Accumulated rotations and a random walk, like a real trajectory
+  srand(42);
+  double rotation = 0, px = 0, py = 0;
+  for (size_t i = 0; i < n; i++) {
+    deltas[i] = (rand() / (double)RAND_MAX - 0.5) * 0.6;
+    rotation += deltas[i];
+    px += (rand() / (double)RAND_MAX - 0.5) * 4;
+    py += (rand() / (double)RAND_MAX - 0.5) * 4;
+    angles[i] = rotation;
+    x[i] = px;
+    y[i] = py;
+  }
+  const Vec2D ZERO = {0, 0};
+  const Vec2D START_POS = {0, 0};
+
+  printf("%zu elements, detected backend: %s\n\n", n,
+         simd_backend_name(simd_detect_backend()));
+
+  // Per-step functions as called by the integration loop
+  double start = monotonic_seconds();
+  for (size_t i = 0; i < n; i++) {
+    Vec2D direction;
+    accelerate(ZERO, 1.0, angles[i], &direction);
+    reference_a[i] = direction.y;
+    reference_b[i] = direction.x;
+  }
+  print_kernel_result("sincos", "per-step", monotonic_seconds() - start, n, 0);
+  SimdBackend detected = simd_detect_backend();
+  for (int backend = SIMD_SCALAR; backend <= (int)detected; backend++) {
+    simd_set_backend(backend);
+    start = monotonic_seconds();
+    batch_sincos(angles, result_a, result_b, n);
+    double seconds = monotonic_seconds() - start;
+    double error = fmax(max_difference(result_a, reference_a, n),
+                        max_difference(result_b, reference_b, n));
+    print_kernel_result("sincos", simd_backend_name(backend), seconds, n,
+                        error);
+  }
+
+  // Fast heading: turned chunk by chunk like in integrate_chunk(), compared
+  // with sin and cos of the accumulated rotation
+  for (int backend = SIMD_SCALAR; backend <= (int)detected; backend++) {
+    simd_set_backend(backend);
+    start = monotonic_seconds();
+    for (size_t i = 0; i < n; i += CHUNK_SIZE) {
+      size_t length = n - i < CHUNK_SIZE ? n - i : CHUNK_SIZE;
+      batch_heading(deltas + i, i > 0 ? angles[i - 1] : 0, result_a + i,
+                    result_b + i, length);
+    }
+    double seconds = monotonic_seconds() - start;
+    double error = fmax(max_difference(result_a, reference_a, n),
+                        max_difference(result_b, reference_b, n));
+    print_kernel_result("heading", simd_backend_name(backend), seconds, n,
+                        error);
+  }
+
+  start = monotonic_seconds();
+  for (size_t i = 0; i < n; i++) {
+    Vec2D velocity = {x[i], y[i]};
+    reference_a[i] = calculate_speed(velocity);
+  }
+  print_kernel_result("speed", "per-step", monotonic_seconds() - start, n, 0);
+  for (int backend = SIMD_SCALAR; backend <= (int)detected; backend++) {
+    simd_set_backend(backend);
+    start = monotonic_seconds();
+    batch_length(x, y, result_a, n);
+    double seconds = monotonic_seconds() - start;
+    print_kernel_result("speed", simd_backend_name(backend), seconds, n,
+                        max_difference(result_a, reference_a, n));
+  }
+
+  start = monotonic_seconds();
+  for (size_t i = 0; i < n; i++) {
+    Vec2D position = {x[i], y[i]};
+    calculate_distance(START_POS, position, &reference_a[i]);
+  }
+  print_kernel_result("distance", "per-step", monotonic_seconds() - start, n,
+                      0);
+  for (int backend = SIMD_SCALAR; backend <= (int)detected; backend++) {
+    simd_set_backend(backend);
+    start = monotonic_seconds();
+    batch_length(x, y, result_a, n);
+    double seconds = monotonic_seconds() - start;
+    print_kernel_result("distance", simd_backend_name(backend), seconds, n,
+                        max_difference(result_a, reference_a, n));
+  }
+
+  start = monotonic_seconds();
+  for (size_t i = 0; i < n; i++) {
+    Vec2D previous = i > 0 ? (Vec2D){x[i - 1], y[i - 1]} : START_POS;
+    Vec2D position = {x[i], y[i]};
+    calculate_distance(previous, position, &reference_a[i]);
+  }
+  print_kernel_result("segment", "per-step", monotonic_seconds() - start, n,
+                      0);
+  for (int backend = SIMD_SCALAR; backend <= (int)detected; backend++) {
+    simd_set_backend(backend);
+    start = monotonic_seconds();
+    batch_segment_lengths(x, y, 0, 0, result_a, n);
+    double seconds = monotonic_seconds() - start;
+    print_kernel_result("segment", simd_backend_name(backend), seconds, n,
+                        max_difference(result_a, reference_a, n));
+  }
+
+  free(angles);
+  free(deltas);
+  free(x);
+  free(y);
+  free(reference_a);
+  free(reference_b);
+  free(result_a);
+  free(result_b);
+  return 0;
+}
+
+// Pipeline stages timed by "benchmark stages", in processing order
+typedef enum Stage {
+  STAGE_PARSE,
+  STAGE_INTEGRATE,
+  STAGE_STATS,
+  STAGE_HEATMAP,
+  STAGE_SVG_LINE,
+  STAGE_SVG_HEATMAP,
+  STAGE_REPORT,
+  NUM_STAGES
+} Stage;
+
+static const char *STAGE_NAMES[NUM_STAGES] = {
+    "parse",    "integrate",   "stats", "heatmap",
+    "svg_line", "svg_heatmap", "report"};
+
+typedef struct StageResult {
+  double seconds;   // Best of all repetitions
+  size_t bytes;     // Input bytes, or output bytes of the writers
+  size_t peak_rss;  // Peak memory of the process after the stage
+  int measured;
+} StageResult;
+
+// Results of all stages for one input file
+typedef struct StagesRun {
+  const char *filename;
+  size_t input_bytes;
+  size_t rows;
+  int repetitions;
+  StageResult stages[NUM_STAGES];
+} StagesRun;
+
+typedef enum OutputFormat {
+  FORMAT_TABLE,
+  FORMAT_JSON,
+  FORMAT_CSV
+} OutputFormat;
+
+typedef struct StagesOptions {
+  int repetitions;
+  int resolution;
+  int skip_report; // The report is by far the largest output
+  OutputFormat format;
+  size_t report_points; // Max. time steps in the report tables and plots
+} StagesOptions;
+
+static size_t file_size(const char *filename) {
+  MappedFile file;
+  if (!map_file(filename, &file)) {
+    return 0;
+  }
+  size_t size = file.size;
+  unmap_file(&file);
+  return size;
+}
+
+static void record_stage(StagesRun *run, Stage stage, double seconds,
+                         size_t bytes) {
+  StageResult *result = &run->stages[stage];
+  if (!result->measured || seconds < result->seconds) {
+    result->seconds = seconds;
+  }
+  result->bytes = bytes;
+  result->peak_rss = peak_memory_usage();
+  result->measured = 1;
+}
+
+/**
+ * @brief Runs the pipeline of main() once and adds the time of every stage
+ * to the run. Parse, integrate and stats are interleaved chunk by chunk like
+ * in main(), their times are summed over all chunks.
+ *
+ * @return 1 on success, 0 if the file could not be read or written.
+ */
+static int run_pipeline_once(StagesRun *run, const StagesOptions *options) {
+  MappedFile csv;
+  if (!map_file(run->filename, &csv)) {
+    printf("Error: Could not read file %s\n", run->filename);
+    return 0;
+  }
+  TelemetryChunk *chunk = malloc(sizeof(*chunk));
+  ChunkKinematics *kinematics = malloc(sizeof(*kinematics));
+  FlightState *state = malloc(sizeof(*state));
+  if (!chunk || !kinematics || !state) {
+    free(chunk);
+    free(kinematics);
+    free(state);
+    unmap_file(&csv);
+    return 0;
+  }
+  flight_state_init(state);
+  Trajectory trajectory;
+  trajectory_init(&trajectory);
+  CsvParser parser;
+  csv_parser_init(&parser, csv.data, csv.size);
+
+  int success = 1;
+  double parse = 0, integrate = 0, stats = 0;
+  while (1) {
+    double start = monotonic_seconds();
+    size_t rows = csv_read_chunk(&parser, chunk);
+    double parsed = monotonic_seconds();
+    parse += parsed - start;
+    if (rows == 0) {
+      break;
+    }
+
+    integrate_chunk(state, chunk, kinematics);
+    size_t offset = trajectory.length;
+    if (!trajectory_resize(&trajectory, offset + chunk->length)) {
+      success = 0;
+      break;
+    }
+    store_chunk(&trajectory, offset, chunk, kinematics);
+    double integrated = monotonic_seconds();
+    integrate += integrated - parsed;
+
+    for (size_t i = 0; i < chunk->length; i++) {
+      running_stats_add(&state->temperature_stats, chunk->temperature[i]);
+      tdigest_add(&state->temperature_digest, chunk->temperature[i]);
+    }
+    stats += monotonic_seconds() - integrated;
+  }
+  run->input_bytes = csv.size;
+  run->rows = trajectory.length;
+  unmap_file(&csv);
+  free(chunk);
+  free(kinematics);
+  record_stage(run, STAGE_PARSE, parse, run->input_bytes);
+  record_stage(run, STAGE_INTEGRATE, integrate, run->input_bytes);
+  record_stage(run, STAGE_STATS, stats, run->input_bytes);
+
+  Heatmap heatmap;
+  HeatmapPyramid pyramid;
+  pyramid.num_levels = 0;
+  double start = monotonic_seconds();
+  success = success &&
+            heatmap_from_trajectory(&heatmap, &trajectory,
+                                    options->resolution, NULL) &&
+            heatmap_build_pyramid(&heatmap, 1, &pyramid);
+  heatmap_free(&heatmap);
+  record_stage(run, STAGE_HEATMAP, monotonic_seconds() - start,
+               run->input_bytes);
+
+  SvgStats svg;
+  if (success) {
+    success = save_trajectory_svg("benchmark_line.svg", &trajectory,
+                                  state->max_distance, SVG_DEFAULT_TOLERANCE,
+                                  &svg);
+    record_stage(run, STAGE_SVG_LINE, svg.seconds, svg.bytes);
+  }
+  if (success) {
+    success = save_temperature_map_svg("benchmark_heatmap.svg",
+                                       &pyramid.levels[0], &svg);
+    record_stage(run, STAGE_SVG_HEATMAP, svg.seconds, svg.bytes);
+  }
+  heatmap_pyramid_free(&pyramid);
+  remove("benchmark_line.svg");
+  remove("benchmark_heatmap.svg");
+
+  if (success && !options->skip_report) {
+    start = monotonic_seconds();
+    TrajectoryBlocks blocks;
+    trajectory_blocks(&trajectory, &blocks);
+    success = generate_latex_report(
+        "benchmark_report.tex", &blocks, options->resolution,
+        options->report_points, 0, state->total_distance, state->max_distance,
+        state->temperature_stats.max, state->temperature_stats.min,
+        state->temperature_stats.mean,
+        running_stats_variance(&state->temperature_stats), state->max_speed);
+    double seconds = monotonic_seconds() - start;
+    record_stage(run, STAGE_REPORT, seconds,
+                 file_size("benchmark_report.tex"));
+    remove("benchmark_report.tex");
+  }
+
+  if (!success) {
+    printf("Error: Stage benchmark of %s failed\n", run->filename);
+  }
+  trajectory_free(&trajectory);
+  free(state);
+  return success;
+}
+
+/**
+ * @brief Times every stage of the pipeline, best of `repetitions` runs.
+ *
+ * @return 1 on success, 0 otherwise.
+ */
+static int benchmark_stages_of_file(const char *filename,
+                                    const StagesOptions *options,
+                                    StagesRun *run) {
+  memset(run, 0, sizeof(*run));
+  run->filename = filename;
+  run->repetitions = options->repetitions;
+  for (int i = 0; i < options->repetitions; i++) {
+    if (!run_pipeline_once(run, options)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// Escapes backslashes and quotes of file names (e.g. Windows paths)
+static void print_json_string(const char *text) {
+  putchar('"');
+  for (const char *c = text; *c; c++) {
+    if (*c == '"' || *c == '\\') {
+      putchar('\\');
+    }
+    putchar(*c);
+  }
+  putchar('"');
+}
+
+/**
+ * @brief Prints the stage times of all runs, as a table or machine-readable
+ * (one JSON object or CSV row per stage and file). Throughput is based on
+ * the input size for the analysis stages and on the output size for the
+ * writers.
+ */
+static void print_stage_results(const StagesRun *runs, size_t num_runs,
+                                OutputFormat format) {
+  const char *backend = simd_backend_name(simd_get_backend());
+  if (format == FORMAT_JSON) {
+    printf("{\n  \"backend\": \"%s\",\n  \"results\": [", backend);
+  } else if (format == FORMAT_CSV) {
+    printf("file,rows,input_bytes,stage,seconds,ns_per_row,bytes,mb_per_s,"
+           "peak_rss_bytes\n");
+  }
+
+  int first = 1;
+  for (size_t r = 0; r < num_runs; r++) {
+    const StagesRun *run = &runs[r];
+    if (format == FORMAT_TABLE) {
+      printf("Input: %s (%zu bytes, %zu rows, best of %d, backend %s)\n",
+             run->filename, run->input_bytes, run->rows, run->repetitions,
+             backend);
+      printf("%-12s %12s %10s %12s %14s\n", "stage", "ms", "ns/row", "MB/s",
+             "peak RSS MiB");
+    }
+    for (int s = 0; s < NUM_STAGES; s++) {
+      const StageResult *stage = &run->stages[s];
+      if (!stage->measured) {
+        continue;
+      }
+      double ns_per_row = run->rows ? stage->seconds * 1e9 / run->rows : 0;
+      double mb_per_s =
+          stage->seconds > 0 ? stage->bytes / stage->seconds / 1e6 : 0;
+      if (format == FORMAT_TABLE) {
+        printf("%-12s %12.3f %10.2f %12.1f %14.1f\n", STAGE_NAMES[s],
+               stage->seconds * 1e3, ns_per_row, mb_per_s,
+               stage->peak_rss / (1024.0 * 1024.0));
+      } else if (format == FORMAT_JSON) {
+        printf("%s\n    {\"file\": ", first ? "" : ",");
+        print_json_string(run->filename);
+        printf(", \"rows\": %zu, \"input_bytes\": %zu, \"stage\": \"%s\", "
+               "\"seconds\": %.9f, \"ns_per_row\": %.3f, \"bytes\": %zu, "
+               "\"mb_per_s\": %.3f, \"peak_rss_bytes\": %zu}",
+               run->rows, run->input_bytes, STAGE_NAMES[s], stage->seconds,
+               ns_per_row, stage->bytes, mb_per_s, stage->peak_rss);
+      } else {
+        printf("%s,%zu,%zu,%s,%.9f,%.3f,%zu,%.3f,%zu\n", run->filename,
+               run->rows, run->input_bytes, STAGE_NAMES[s], stage->seconds,
+               ns_per_row, stage->bytes, mb_per_s, stage->peak_rss);
+      }
+      first = 0;
+    }
+    if (format == FORMAT_TABLE) {
+      printf("\n");
+    }
+  }
+  if (format == FORMAT_JSON) {
+    printf("\n  ]\n}\n");
+  }
+}
+
+/**
+ * @brief Parses the options shared by "stages" and "suite".
+ *
+ * @return 1 if all options are valid, 0 otherwise.
+ */
+static int parse_stages_options(int argc, char *argv[], int first,
+                                StagesOptions *options) {
+  for (int i = first; i < argc; i++) {
+    if (strcmp(argv[i], "--repetitions") == 0 && i + 1 < argc) {
+      options->repetitions = atoi(argv[++i]);
+      if (options->repetitions < 1) {
+        printf("Error: --repetitions needs a positive number\n");
+        return 0;
+      }
+    } else if (strcmp(argv[i], "--resolution") == 0 && i + 1 < argc) {
+      options->resolution = atoi(argv[++i]);
+      if (options->resolution < 1 ||
+          options->resolution > HEATMAP_MAX_RESOLUTION) {
+        printf("Error: --resolution needs a number between 1 and %d\n",
+               HEATMAP_MAX_RESOLUTION);
+        return 0;
+      }
+    } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+      const char *format = argv[++i];
+      if (strcmp(format, "table") == 0) {
+        options->format = FORMAT_TABLE;
+      } else if (strcmp(format, "json") == 0) {
+        options->format = FORMAT_JSON;
+      } else if (strcmp(format, "csv") == 0) {
+        options->format = FORMAT_CSV;
+      } else {
+        printf("Error: --format needs table, json or csv\n");
+        return 0;
+      }
+    } else if (strcmp(argv[i], "--no-report") == 0) {
+      options->skip_report = 1;
+    } else if (strcmp(argv[i], "--report-points") == 0 && i + 1 < argc) {
+      // 0: every time step
+      options->report_points = (size_t)strtoull(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--no-simd") == 0) {
+      simd_set_backend(SIMD_SCALAR);
+    } else if (strcmp(argv[i], "--fast-heading") == 0) {
+      Integrator integrator = *integrator_get();
+      integrator.fast_heading = 1;
+      integrator_set(&integrator);
+    } else {
+      printf("Unknown option: %s\n", argv[i]);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * @brief Reads a row count like "1000000" or "1e6".
+ *
+ * @return 1 on success, 0 if the text is not a positive whole number.
+ */
+static int parse_rows(const char *text, uint64_t *rows) {
+  char *end;
+  double value = strtod(text, &end);
+  if (*end != '\0' || !(value >= 1) || value > 0x1p53 ||
+      value != floor(value)) {
+    printf("Error: Invalid number of rows: %s\n", text);
+    return 0;
+  }
+  *rows = (uint64_t)value;
+  return 1;
+}
+
+int benchmark_generate(const char *filename, uint64_t rows, uint64_t seed) {
+  double start = monotonic_seconds();
+  if (!generate_flight_csv(filename, rows, seed)) {
+    printf("Error: Could not write %s\n", filename);
+    return 1;
+  }
+  double seconds = monotonic_seconds() - start;
+  size_t bytes = file_size(filename);
+  printf("Generated %s: %llu rows, %zu bytes (seed %llu) in %.3f s, "
+         "%.1f MB/s\n",
+         filename, (unsigned long long)rows, bytes, (unsigned long long)seed,
+         seconds, bytes / seconds / 1e6);
+  return 0;
+}
+
+int benchmark_stages(const char *filename, const StagesOptions *options) {
+  StagesRun run;
+  if (!benchmark_stages_of_file(filename, options, &run)) {
+    return 1;
+  }
+  print_stage_results(&run, 1, options->format);
+  return 0;
+}
+
+#define SUITE_SEED 1
+#define SUITE_MAX_SIZES 13 // 1e3 to 1e15 rows
+
+/**
+ * @brief Runs the stage benchmark on synthetic files with 1e3, 1e4, ...,
+ * `max_rows` rows. The files (synthetic_<rows>.csv) are generated in the
+ * working directory, or reused if they already exist; the generator is
+ * deterministic, so their content is always the same.
+ */
+int benchmark_suite(uint64_t max_rows, const StagesOptions *options) {
+  char filenames[SUITE_MAX_SIZES][64];
+  StagesRun runs[SUITE_MAX_SIZES];
+  size_t num_runs = 0;
+  for (uint64_t rows = 1000; rows <= max_rows && num_runs < SUITE_MAX_SIZES;
+       rows *= 10) {
+    char *filename = filenames[num_runs];
+    snprintf(filename, sizeof(filenames[0]), "synthetic_%llu.csv",
+             (unsigned long long)rows);
+    if (!file_exists(filename)) {
+      if (options->format == FORMAT_TABLE) {
+        printf("Generating %s\n", filename);
+      }
+      if (!generate_flight_csv(filename, rows, SUITE_SEED)) {
+        printf("Error: Could not write %s\n", filename);
+        return 1;
+      }
+    }
+    if (!benchmark_stages_of_file(filename, options, &runs[num_runs])) {
+      return 1;
+    }
+    num_runs++;
+  }
+  if (options->format == FORMAT_TABLE) {
+    printf("\n");
+  }
+  print_stage_results(runs, num_runs, options->format);
+  return 0;
+}
+
+// Acceleration, rotation and temperature columns of a whole file
+typedef struct Controls {
+  double *acceleration;
+  double *rotation;
+  double *temperature;
+  size_t length;
+} Controls;
+
+static int read_controls(const char *filename, Controls *controls) {
+  MappedFile csv;
+  if (!map_file(filename, &csv)) {
+    printf("Error: Could not read file %s\n", filename);
+    return 0;
+  }
+  TelemetryChunk *chunk = malloc(sizeof(*chunk));
+  size_t capacity = 0;
+  controls->acceleration = NULL;
+  controls->rotation = NULL;
+  controls->temperature = NULL;
+  controls->length = 0;
+  CsvParser parser;
+  csv_parser_init(&parser, csv.data, csv.size);
+  int success = chunk != NULL;
+  while (success && csv_read_chunk(&parser, chunk) > 0) {
+    if (controls->length + chunk->length > capacity) {
+      capacity = 2 * (controls->length + chunk->length);
+      double *acceleration =
+          realloc(controls->acceleration, capacity * sizeof(double));
+      double *rotation = realloc(controls->rotation, capacity * sizeof(double));
+      double *temperature =
+          realloc(controls->temperature, capacity * sizeof(double));
+      if (acceleration) {
+        controls->acceleration = acceleration;
+      }
+      if (rotation) {
+        controls->rotation = rotation;
+      }
+      if (temperature) {
+        controls->temperature = temperature;
+      }
+      if (!acceleration || !rotation || !temperature) {
+        success = 0;
+        break;
+      }
+    }
+    size_t bytes = chunk->length * sizeof(double);
+    memcpy(controls->acceleration + controls->length, chunk->acceleration,
+           bytes);
+    memcpy(controls->rotation + controls->length, chunk->rotation, bytes);
+    memcpy(controls->temperature + controls->length, chunk->temperature,
+           bytes);
+    controls->length += chunk->length;
+  }
+  free(chunk);
+  unmap_file(&csv);
+  if (!success) {
+    printf("Error: Out of memory\n");
+  }
+  return success;
+}
+
+/**
+ * @brief Integrates all rows from the start state, writes the positions to
+ * `x` and `y` and measures the time it took.
+ *
+ * @return The largest distance of a position from the reference position, 0
+ * if `reference_x` is NULL.
+ */
+static double run_integrator(const Integrator *integrator,
+                             const Controls *controls, double *x, double *y,
+                             const double *reference_x,
+                             const double *reference_y, double *seconds,
+                             uint64_t *steps) {
+  IntegratorState state = {0, {0, 0}, {0, 0}};
+  *steps = 0;
+  double start = monotonic_seconds();
+  for (size_t i = 0; i < controls->length; i++) {
+    *steps += integrate_step(integrator, &state, controls->acceleration[i],
+                             controls->rotation[i]);
+    x[i] = state.position.x;
+    y[i] = state.position.y;
+  }
+  *seconds = monotonic_seconds() - start;
+
+  double max_error = 0;
+  for (size_t i = 0; reference_x && i < controls->length; i++) {
+    double error = hypot(x[i] - reference_x[i], y[i] - reference_y[i]);
+    if (error > max_error) {
+      max_error = error;
+    }
+  }
+  return max_error;
+}
+
+static void print_integrator_result(const Integrator *integrator,
+                                    const char *setting, double seconds,
+                                    uint64_t steps, size_t rows,
+                                    double max_error) {
+  printf("%-14s %-12s %10.1f %12.2f %14.3e\n",
+         integrator_name(integrator->scheme), setting, seconds * 1e9 / rows,
+         (double)steps / rows, max_error);
+}
+
+/**
+ * @brief Compares the runtime and the accuracy of the integrators. The
+ * reference is the closed form solution ("exact"); the error is the largest
+ * distance of any position from the reference position.
+ */
+int benchmark_integrators(const char *filename, int max_substeps) {
+  Controls controls;
+  if (!read_controls(filename, &controls)) {
+    return 1;
+  }
+  size_t n = controls.length;
+  double *reference_x = malloc(n * sizeof(double) + 1);
+  double *reference_y = malloc(n * sizeof(double) + 1);
+  double *x = malloc(n * sizeof(double) + 1);
+  double *y = malloc(n * sizeof(double) + 1);
+  if (n == 0 || !reference_x || !reference_y || !x || !y) {
+    printf("Error: No rows or out of memory\n");
+    return 1;
+  }
+
+  printf("Input: %s (%zu rows)\n", filename, n);
+  printf("%-14s %-12s %10s %12s %14s\n", "integrator", "setting", "ns/row",
+         "steps/row", "max. error");
+
+  Integrator integrator;
+  double seconds;
+  uint64_t steps;
+  integrator_init(&integrator, INTEGRATOR_EXACT);
+  run_integrator(&integrator, &controls, reference_x, reference_y, NULL, NULL,
+                 &seconds, &steps);
+  print_integrator_result(&integrator, "", seconds, steps, n, 0);
+
+  char setting[32];
+  IntegratorScheme fixed_step[] = {INTEGRATOR_SEMI_IMPLICIT_EULER,
+                                   INTEGRATOR_EXPLICIT_EULER, INTEGRATOR_RK4};
+  for (size_t s = 0; s < sizeof(fixed_step) / sizeof(fixed_step[0]); s++) {
+    integrator_init(&integrator, fixed_step[s]);
+    for (int substeps = 1; substeps <= max_substeps; substeps *= 2) {
+      integrator.substeps = substeps;
+      double error = run_integrator(&integrator, &controls, x, y, reference_x,
+                                    reference_y, &seconds, &steps);
+      snprintf(setting, sizeof(setting), "%d substeps", substeps);
+      print_integrator_result(&integrator, setting, seconds, steps, n, error);
+    }
+  }
+
+  integrator_init(&integrator, INTEGRATOR_ADAPTIVE);
+  for (double tolerance = 1e-2; tolerance >= 1e-12; tolerance *= 1e-2) {
+    integrator.tolerance = tolerance;
+    double error = run_integrator(&integrator, &controls, x, y, reference_x,
+                                  reference_y, &seconds, &steps);
+    snprintf(setting, sizeof(setting), "tol %.0e", tolerance);
+    print_integrator_result(&integrator, setting, seconds, steps, n, error);
+  }
+
+  // Regression: the rounding errors of a huge thrust used to keep the step
+  // size shrinking forever
+  static const double huge_rows[][2] = {
+      {1e14, 0.1}, {1, 0.1}, {1e20, 0.1}, {-1e300, 0.5}, {INFINITY, 0.1}};
+  size_t num_huge_rows = sizeof(huge_rows) / sizeof(huge_rows[0]);
+  IntegratorState state = {0, {0, 0}, {0, 0}};
+  integrator.tolerance = 1e-9;
+  steps = 0;
+  seconds = monotonic_seconds();
+  for (size_t i = 0; i < num_huge_rows; i++) {
+    steps += integrate_step(&integrator, &state, huge_rows[i][0],
+                            huge_rows[i][1]);
+  }
+  seconds = monotonic_seconds() - seconds;
+  printf("%-14s %-12s %10.1f %12.2f %14s\n", "adaptive", "huge thrust",
+         seconds * 1e9 / num_huge_rows, (double)steps / num_huge_rows, "-");
+
+  free(reference_x);
+  free(reference_y);
+  free(x);
+  free(y);
+  free(controls.acceleration);
+  free(controls.rotation);
+  free(controls.temperature);
+  return 0;
+}
+
+#define SPATIAL_QUERIES 1000
+#define SPATIAL_QUERY_SIZE 20.0 // Half width of boxes, radius
+#define SPATIAL_NEIGHBOURS 10
+
+// Random query point close to the trajectory
+static void spatial_query_point(const double *x, const double *y, size_t n,
+                                double *query_x, double *query_y) {
+  size_t step = (size_t)((double)rand() / ((double)RAND_MAX + 1) * n);
+  *query_x = x[step] + (rand() / (double)RAND_MAX - 0.5) * 100;
+  *query_y = y[step] + (rand() / (double)RAND_MAX - 0.5) * 100;
+}
+
+static void print_spatial_result(const char *query, double seconds,
+                                 size_t matches) {
+  printf("  %-16s %10.2f us/query %10.1f matches/query\n", query,
+         seconds * 1e6 / SPATIAL_QUERIES, (double)matches / SPATIAL_QUERIES);
+}
+
+/**
+ * @brief Build time and query latency of the spatial index for flights of
+ * 1e6, 1e7, ... up to `max_points` time steps, or of `max_points` time steps
+ * if that is less than 1e6. The flights are random walks with damped
+ * velocity, so that they cross their own path. A linear scan for the nearest
+ * point is measured for comparison.
+ */
+int benchmark_spatial(size_t max_points) {
+  // Below 1e6 only the one flight of max_points is measured
+  size_t first = max_points < 1000000 ? max_points : 1000000;
+  for (size_t n = first; n <= max_points; n *= 10) {
+    double *x = malloc(n * sizeof(double));
+    double *y = malloc(n * sizeof(double));
+    if (!x || !y) {
+      printf("Error: Could not allocate %zu points\n", n);
+      free(x);
+      free(y);
+      return 1;
+    }
+    srand(42);
+    double rotation = 0, vx = 0, vy = 0, px = 0, py = 0;
+    for (size_t i = 0; i < n; i++) {
+      rotation += (rand() / (double)RAND_MAX - 0.5) * 0.6;
+      double acceleration = (rand() / (double)RAND_MAX - 0.5) * 2;
+      vx = 0.99 * (vx + acceleration * cos(rotation));
+      vy = 0.99 * (vy + acceleration * sin(rotation));
+      px += vx;
+      py += vy;
+      x[i] = px;
+      y[i] = py;
+    }
+
+    SpatialIndex index;
+    double start = monotonic_seconds();
+    if (!spatial_index_build(&index, x, y, n)) {
+      printf("Error: Could not build the index of %zu points\n", n);
+      free(x);
+      free(y);
+      return 1;
+    }
+    double seconds = monotonic_seconds() - start;
+    printf("%zu points: built in %.1f ms (%.1f ns/point), %.1f MiB, peak "
+           "RSS %.1f MiB\n",
+           n, seconds * 1e3, seconds * 1e9 / n,
+           spatial_index_memory_usage(&index) / (1024.0 * 1024.0),
+           peak_memory_usage() / (1024.0 * 1024.0));
+
+    SpatialResults results;
+    spatial_results_init(&results);
+    const char *names[] = {"box", "radius", "nearest", "nearest (scan)"};
+    for (int query = 0; query < 4; query++) {
+      srand(7);
+      size_t matches = 0;
+      int success = 1;
+      int repetitions = query == 3 ? SPATIAL_QUERIES / 100 : SPATIAL_QUERIES;
+      start = monotonic_seconds();
+      for (int q = 0; q < repetitions && success; q++) {
+        double qx, qy;
+        spatial_query_point(x, y, n, &qx, &qy);
+        const double size = SPATIAL_QUERY_SIZE;
+        if (query == 0) {
+          success = spatial_query_box(&index, qx - size, qy - size, qx + size,
+                                      qy + size, &results);
+        } else if (query == 1) {
+          success = spatial_query_radius(&index, qx, qy, size, &results);
+        } else if (query == 2) {
+          success = spatial_query_nearest(&index, qx, qy, SPATIAL_NEIGHBOURS,
+                                          0, &results);
+        } else {
+          // Only the single nearest point, the index is faster even so
+          double best = INFINITY;
+          for (size_t i = 0; i < n; i++) {
+            best = fmin(best, (x[i] - qx) * (x[i] - qx) +
+                                  (y[i] - qy) * (y[i] - qy));
+          }
+          results.length = best < INFINITY;
+        }
+        matches += results.length;
+      }
+      seconds = monotonic_seconds() - start;
+      if (!success) {
+        printf("Error: Out of memory\n");
+        break;
+      }
+      print_spatial_result(names[query],
+                           seconds * SPATIAL_QUERIES / repetitions,
+                           matches * SPATIAL_QUERIES / repetitions);
+    }
+    spatial_results_free(&results);
+    spatial_index_free(&index);
+    free(x);
+    free(y);
+  }
+  return 0;
+}
+
+#define DATABASE_FILE "benchmark.flightdb"
+#define DATABASE_SCANS 1000 // Windows recomputed from the trajectory
+
+// The metrics of a window computed step by step, like the analysis does
+static void scan_window(const Trajectory *t, size_t first, size_t last,
+                        FlightWindow *window) {
+  RunningStats temperature;
+  running_stats_init(&temperature);
+  window->max_speed = 0;
+  window->distance = 0;
+  window->max_distance = 0;
+  for (size_t i = first; i <= last; i++) {
+    double dx = t->x[i] - (i > 0 ? t->x[i - 1] : 0);
+    double dy = t->y[i] - (i > 0 ? t->y[i - 1] : 0);
+    window->distance += sqrt(dx * dx + dy * dy);
+    window->max_speed = fmax(window->max_speed,
+                             sqrt(t->velocity_x[i] * t->velocity_x[i] +
+                                  t->velocity_y[i] * t->velocity_y[i]));
+    window->max_distance =
+        fmax(window->max_distance, sqrt(t->x[i] * t->x[i] + t->y[i] * t->y[i]));
+    running_stats_add(&temperature, t->temperature[i]);
+  }
+  window->length = last - first + 1;
+  window->temperature_mean = temperature.mean;
+  window->temperature_variance = temperature.m2 / temperature.count;
+  window->min_temperature = temperature.min;
+  window->max_temperature = temperature.max;
+}
+
+static double relative_error(double value, double reference) {
+  return fabs(value - reference) / fmax(1.0, fabs(reference));
+}
+
+// Largest relative deviation of any metric of a window
+static double window_error(const FlightWindow *a, const FlightWindow *b) {
+  double metrics[][2] = {{a->max_speed, b->max_speed},
+                         {a->distance, b->distance},
+                         {a->max_distance, b->max_distance},
+                         {a->temperature_mean, b->temperature_mean},
+                         {a->temperature_variance, b->temperature_variance},
+                         {a->min_temperature, b->min_temperature},
+                         {a->max_temperature, b->max_temperature}};
+  double error = 0;
+  for (size_t m = 0; m < sizeof(metrics) / sizeof(metrics[0]); m++) {
+    error = fmax(error, relative_error(metrics[m][0], metrics[m][1]));
+  }
+  return error;
+}
+
+/**
+ * @brief Compiles a flight into a database and measures random time window
+ * queries against recomputing the windows from the trajectory in memory.
+ */
+int benchmark_database(const char *filename, size_t num_windows) {
+  MappedFile csv;
+  if (!map_file(filename, &csv)) {
+    printf("Error: Could not read file %s\n", filename);
+    return 1;
+  }
+  FlightState state;
+  Trajectory trajectory;
+  size_t malformed_rows;
+  trajectory_init(&trajectory);
+  double start = monotonic_seconds();
+  int success = analyze_parallel(&csv, 1, &state, &trajectory,
+                                 &malformed_rows);
+  double analysis_seconds = monotonic_seconds() - start;
+  unmap_file(&csv);
+  if (!success || trajectory.length == 0) {
+    printf("Error: Could not analyze %s\n", filename);
+    trajectory_free(&trajectory);
+    return 1;
+  }
+
+  start = monotonic_seconds();
+  success = flight_database_save(DATABASE_FILE, &trajectory, &state);
+  double compile_seconds = monotonic_seconds() - start;
+  FlightDatabase database;
+  start = monotonic_seconds();
+  if (!success || !flight_database_open(&database, DATABASE_FILE)) {
+    printf("Error: Could not write %s\n", DATABASE_FILE);
+    trajectory_free(&trajectory);
+    return 1;
+  }
+  double open_seconds = monotonic_seconds() - start;
+  size_t n = trajectory.length;
+  printf("Input: %s (%zu rows)\n", filename, n);
+  printf("%-16s %10.3f ms %8.1f ns/row\n", "analysis",
+         analysis_seconds * 1e3, analysis_seconds * 1e9 / n);
+  printf("%-16s %10.3f ms %8.1f ns/row %8.1f MiB\n", "compile",
+         compile_seconds * 1e3, compile_seconds * 1e9 / n,
+         database.trajectory.mapping.size / (1024.0 * 1024.0));
+  printf("%-16s %10.3f ms\n", "open", open_seconds * 1e3);
+
+  // Random windows of any length
+  size_t *windows = malloc(2 * num_windows * sizeof(*windows));
+  if (!windows) {
+    printf("Error: Out of memory\n");
+    flight_database_close(&database);
+    trajectory_free(&trajectory);
+    return 1;
+  }
+  srand(1);
+  size_t total_length = 0;
+  for (size_t w = 0; w < num_windows; w++) {
+    size_t a = (size_t)((double)rand() / ((double)RAND_MAX + 1) * n);
+    size_t b = (size_t)((double)rand() / ((double)RAND_MAX + 1) * n);
+    windows[2 * w] = a < b ? a : b;
+    windows[2 * w + 1] = a < b ? b : a;
+    total_length += windows[2 * w + 1] - windows[2 * w] + 1;
+  }
+
+  FlightWindow window, reference;
+  double checksum = 0;
+  start = monotonic_seconds();
+  for (size_t w = 0; w < num_windows; w++) {
+    flight_database_window(&database, windows[2 * w], windows[2 * w + 1],
+                           &window);
+    checksum += window.temperature_mean + window.max_speed;
+  }
+  double query_seconds = monotonic_seconds() - start;
+
+  size_t num_scans = num_windows < DATABASE_SCANS ? num_windows
+                                                  : DATABASE_SCANS;
+  double max_error = 0;
+  double scan_seconds = 0;
+  for (size_t w = 0; w < num_scans; w++) {
+    start = monotonic_seconds();
+    scan_window(&trajectory, windows[2 * w], windows[2 * w + 1], &reference);
+    scan_seconds += monotonic_seconds() - start;
+    flight_database_window(&database, windows[2 * w], windows[2 * w + 1],
+                           &window);
+    max_error = fmax(max_error, window_error(&window, &reference));
+  }
+  printf("%-16s %10.3f us/window (%zu windows, %.0f steps on average)\n",
+         "window query", query_seconds * 1e6 / num_windows, num_windows,
+         (double)total_length / num_windows);
+  printf("%-16s %10.3f us/window  max rel. error %.1e (checksum %g)\n",
+         "window scan", scan_seconds * 1e6 / num_scans, max_error, checksum);
+
+  free(windows);
+  flight_database_close(&database);
+  trajectory_free(&trajectory);
+  remove(DATABASE_FILE);
+  return 0;
+}
+
+#define ROLLING_SCAN_STEPS 1000 // Windows recomputed from scratch
+
+/**
+ * @brief Time per step of the sliding window (adding a step and reading the
+ * metrics of the window) for window sizes from 10 to 1e5, compared with
+ * recomputing every window from its values.
+ */
+int benchmark_rolling(size_t num_steps) {
+  double *temperature = malloc(num_steps * sizeof(double));
+  double *speed = malloc(num_steps * sizeof(double));
+  if (!temperature || !speed) {
+    printf("Error: Out of memory\n");
+    free(temperature);
+    free(speed);
+    return 1;
+  }
+  srand(1);
+  for (size_t i = 0; i < num_steps; i++) {
+    temperature[i] = 20 + 10 * sin(i * 1e-4) + rand() / (double)RAND_MAX;
+    speed[i] = rand() / (double)RAND_MAX;
+  }
+
+  for (size_t size = 10; size <= 100000; size *= 10) {
+    SlidingWindow window;
+    if (!sliding_window_init(&window, size)) {
+      printf("Error: Out of memory\n");
+      break;
+    }
+    WindowMetrics metrics;
+    double checksum = 0;
+    double start = monotonic_seconds();
+    for (size_t i = 0; i < num_steps; i++) {
+      sliding_window_add(&window, temperature[i], speed[i], speed[i]);
+      sliding_window_metrics(&window, &metrics);
+      checksum += metrics.temperature_variance + metrics.max_speed;
+    }
+    double seconds = monotonic_seconds() - start;
+    sliding_window_free(&window);
+
+    // The last windows recomputed: max, min and two passes for the moments
+    size_t scans = num_steps < ROLLING_SCAN_STEPS ? num_steps
+                                                  : ROLLING_SCAN_STEPS;
+    start = monotonic_seconds();
+    for (size_t i = num_steps - scans; i < num_steps; i++) {
+      size_t first = i + 1 >= size ? i + 1 - size : 0;
+      double sum = 0, variance = 0, max_speed = 0;
+      double min = INFINITY, max = -INFINITY;
+      for (size_t j = first; j <= i; j++) {
+        sum += temperature[j];
+        min = fmin(min, temperature[j]);
+        max = fmax(max, temperature[j]);
+        max_speed = fmax(max_speed, speed[j]);
+      }
+      double mean = sum / (i - first + 1);
+      for (size_t j = first; j <= i; j++) {
+        variance += (temperature[j] - mean) * (temperature[j] - mean);
+      }
+      checksum += variance + min + max + max_speed;
+    }
+    double scan_seconds = monotonic_seconds() - start;
+    printf("window %6zu: sliding %8.1f ns/step, recomputed %10.1f ns/step "
+           "(checksum %g)\n",
+           size, seconds * 1e9 / num_steps, scan_seconds * 1e9 / scans,
+           checksum);
+  }
+  free(temperature);
+  free(speed);
+  return 0;
+}
+
+#define FLEET_REPETITIONS 3
+
+/**
+ * @brief Analyzes every ship on its own like a separate run would: parse,
+ * integrate_chunk() and the temperature statistics, chunk by chunk.
+ *
+ * @return The checksum of the metrics.
+ */
+static double run_ships_sequentially(const MappedFile *inputs,
+                                     size_t num_ships, TelemetryChunk *chunk,
+                                     ChunkKinematics *kinematics) {
+  double checksum = 0;
+  for (size_t s = 0; s < num_ships; s++) {
+    FlightState state;
+    flight_state_init(&state);
+    CsvParser parser;
+    csv_parser_init(&parser, inputs[s].data, inputs[s].size);
+    while (csv_read_chunk(&parser, chunk) > 0) {
+      integrate_chunk(&state, chunk, kinematics);
+      for (size_t i = 0; i < chunk->length; i++) {
+        running_stats_add(&state.temperature_stats, chunk->temperature[i]);
+      }
+    }
+    checksum += state.total_distance + state.temperature_stats.mean;
+  }
+  return checksum;
+}
+
+/**
+ * @brief The integration of all ships from parsed columns (ship-major, all
+ * ships equally long): one ship after another with integrate_chunk(), and
+ * all ships in lockstep with batch_ships_step() on blocks of step-major
+ * columns like fleet_analyze() uses.
+ */
+static void benchmark_fleet_compute(size_t num_ships, size_t num_steps) {
+  size_t num_lanes = fleet_num_lanes(num_ships);
+  size_t block_steps = fleet_block_steps(num_lanes);
+  size_t block_size = block_steps * num_lanes;
+  double *columns = malloc(3 * num_ships * num_steps * sizeof(double));
+  double *lanes = calloc(13 * num_lanes, sizeof(double));
+  double *block = malloc(6 * block_size * sizeof(double));
+  TelemetryChunk *chunk = malloc(sizeof(*chunk));
+  ChunkKinematics *kinematics = malloc(sizeof(*kinematics));
+  if (!columns || !lanes || !block || !chunk || !kinematics) {
+    printf("Error: Out of memory\n");
+    free(columns);
+    free(lanes);
+    free(block);
+    free(chunk);
+    free(kinematics);
+    return;
+  }
+  double *acceleration = columns;
+  double *rotation = columns + num_ships * num_steps;
+  double *temperature = columns + 2 * num_ships * num_steps;
+  srand(1);
+  for (size_t i = 0; i < num_ships * num_steps; i++) {
+    acceleration[i] = rand() / (double)RAND_MAX - 0.5;
+    rotation[i] = (rand() / (double)RAND_MAX - 0.5) * 0.1;
+    temperature[i] = 20 + 10 * rand() / (double)RAND_MAX;
+  }
+
+  double sequential = INFINITY, lockstep = INFINITY, checksum = 0;
+  for (int r = 0; r < FLEET_REPETITIONS; r++) {
+    double start = monotonic_seconds();
+    for (size_t s = 0; s < num_ships; s++) {
+      FlightState state;
+      flight_state_init(&state);
+      for (size_t t = 0; t < num_steps; t += CHUNK_SIZE) {
+        size_t offset = s * num_steps + t;
+        chunk->length = num_steps - t < CHUNK_SIZE ? num_steps - t
+                                                   : CHUNK_SIZE;
+        size_t bytes = chunk->length * sizeof(double);
+        memcpy(chunk->acceleration, acceleration + offset, bytes);
+        memcpy(chunk->rotation, rotation + offset, bytes);
+        memcpy(chunk->temperature, temperature + offset, bytes);
+        integrate_chunk(&state, chunk, kinematics);
+        for (size_t i = 0; i < chunk->length; i++) {
+          running_stats_add(&state.temperature_stats, chunk->temperature[i]);
+        }
+      }
+      checksum += state.total_distance;
+    }
+    sequential = fmin(sequential, monotonic_seconds() - start);
+
+    start = monotonic_seconds();
+    ShipLanes ships = {lanes,
+                       lanes + num_lanes,
+                       lanes + 2 * num_lanes,
+                       lanes + 3 * num_lanes,
+                       lanes + 4 * num_lanes,
+                       lanes + 5 * num_lanes,
+                       lanes + 6 * num_lanes,
+                       lanes + 7 * num_lanes,
+                       lanes + 8 * num_lanes,
+                       lanes + 9 * num_lanes,
+                       lanes + 10 * num_lanes,
+                       lanes + 11 * num_lanes};
+    double *angle = lanes + 12 * num_lanes;
+    memset(lanes, 0, 13 * num_lanes * sizeof(double));
+    double *block_acceleration = block, *block_angle = block + block_size;
+    double *block_temperature = block + 2 * block_size;
+    double *active = block + 3 * block_size, *sines = block + 4 * block_size;
+    double *cosines = block + 5 * block_size;
+    for (size_t i = 0; i < block_size; i++) {
+      active[i] = 0;
+      block_acceleration[i] = 0;
+      block_angle[i] = 0;
+      block_temperature[i] = 0;
+    }
+    for (size_t t = 0; t < num_steps; t += block_steps) {
+      size_t steps = num_steps - t < block_steps ? num_steps - t
+                                                 : block_steps;
+      for (size_t s = 0; s < num_ships; s++) {
+        for (size_t i = 0; i < steps; i++) {
+          size_t from = s * num_steps + t + i, to = i * num_lanes + s;
+          angle[s] += rotation[from];
+          block_acceleration[to] = acceleration[from];
+          block_angle[to] = angle[s];
+          block_temperature[to] = temperature[from];
+          active[to] = 1;
+        }
+      }
+      batch_sincos(block_angle, sines, cosines, steps * num_lanes);
+      for (size_t i = 0; i < steps; i++) {
+        size_t offset = i * num_lanes;
+        batch_ships_step(&ships, block_acceleration + offset, sines + offset,
+                         cosines + offset, block_temperature + offset,
+                         active + offset, num_lanes);
+      }
+    }
+    for (size_t s = 0; s < num_ships; s++) {
+      checksum -= ships.total_distance[s];
+    }
+    lockstep = fmin(lockstep, monotonic_seconds() - start);
+  }
+  double ship_steps = (double)num_ships * num_steps;
+  printf("Integration only (parsed columns):\n");
+  printf("  sequential %8.1f ms  %12.0f ship-steps/s\n", sequential * 1e3,
+         ship_steps / sequential);
+  printf("  lockstep   %8.1f ms  %12.0f ship-steps/s  (%.2fx, checksum "
+         "%g)\n",
+         lockstep * 1e3, ship_steps / lockstep, sequential / lockstep,
+         checksum / FLEET_REPETITIONS);
+  free(columns);
+  free(lanes);
+  free(block);
+  free(chunk);
+  free(kinematics);
+}
+
+/**
+ * @brief Compares the fleet analysis of `num_ships` synthetic flights with
+ * analyzing the flights one after another, from the CSV files and for the
+ * integration alone. The files (fleet_<steps>_<seed>.csv) are generated in
+ * the working directory, or reused if they already exist.
+ */
+int benchmark_fleet(size_t num_ships, size_t num_steps) {
+  MappedFile *inputs = calloc(num_ships, sizeof(*inputs));
+  ShipResult *results = malloc(num_ships * sizeof(*results));
+  TelemetryChunk *chunk = malloc(sizeof(*chunk));
+  ChunkKinematics *kinematics = malloc(sizeof(*kinematics));
+  size_t num_mapped = 0;
+  int success = inputs && results && chunk && kinematics;
+  if (!success) {
+    printf("Error: Out of memory\n");
+  }
+  for (; success && num_mapped < num_ships; num_mapped++) {
+    char filename[64];
+    snprintf(filename, sizeof(filename), "fleet_%zu_%zu.csv", num_steps,
+             num_mapped + 1);
+    if (!file_exists(filename) &&
+        !generate_flight_csv(filename, num_steps, num_mapped + 1)) {
+      printf("Error: Could not write %s\n", filename);
+      success = 0;
+    } else if (!map_file(filename, &inputs[num_mapped])) {
+      printf("Error: Could not read file %s\n", filename);
+      success = 0;
+    }
+    if (!success) {
+      break;
+    }
+  }
+
+  if (success) {
+    double sequential = INFINITY, fleet = INFINITY, checksum = 0;
+    for (int r = 0; r < FLEET_REPETITIONS; r++) {
+      double start = monotonic_seconds();
+      checksum += run_ships_sequentially(inputs, num_ships, chunk,
+                                         kinematics);
+      sequential = fmin(sequential, monotonic_seconds() - start);
+
+      start = monotonic_seconds();
+      if (!fleet_analyze(inputs, num_ships, NULL, results)) {
+        printf("Error: Out of memory\n");
+        success = 0;
+        break;
+      }
+      fleet = fmin(fleet, monotonic_seconds() - start);
+      for (size_t s = 0; s < num_ships; s++) {
+        checksum -= results[s].total_distance +
+                    results[s].temperature_stats.mean;
+      }
+    }
+    double ship_steps = (double)num_ships * num_steps;
+    printf("%zu ships x %zu time steps, SIMD backend %s\n", num_ships,
+           num_steps, simd_backend_name(simd_get_backend()));
+    printf("From the CSV files:\n");
+    printf("  sequential %8.1f ms  %12.0f ship-steps/s\n", sequential * 1e3,
+           ship_steps / sequential);
+    printf("  fleet      %8.1f ms  %12.0f ship-steps/s  (%.2fx, checksum "
+           "%g)\n",
+           fleet * 1e3, ship_steps / fleet, sequential / fleet,
+           checksum / FLEET_REPETITIONS);
+  }
+  for (size_t i = 0; i < num_mapped; i++) {
+    unmap_file(&inputs[i]);
+  }
+  free(inputs);
+  free(results);
+  free(chunk);
+  free(kinematics);
+  if (success) {
+    benchmark_fleet_compute(num_ships, num_steps);
+  }
+  return success ? 0 : 1;
+}
+
+#define TELEMETRY_FILE "benchmark.tlm"
+
+/**
+ * @brief Decodes a telemetry file, including the mapping itself, the
+ * counterpart of parse_with_mapping().
+ *
+ * @return The number of rows read.
+ */
+static size_t decode_with_mapping(const char *filename, TelemetryChunk *chunk,
+                                  double *checksum) {
+  MappedFile file;
+  if (!map_file(filename, &file)) {
+    return 0;
+  }
+  TelemetryReader reader;
+  size_t rows = 0;
+  if (telemetry_open(&reader, file.data, file.size)) {
+    while (telemetry_read_chunk(&reader, chunk) > 0) {
+      for (size_t i = 0; i < chunk->length; i++) {
+        *checksum += chunk->acceleration[i] + chunk->rotation[i] +
+                     chunk->temperature[i];
+      }
+      rows += chunk->length;
+    }
+  }
+  unmap_file(&file);
+  return rows;
+}
+
+// Best time of the single-threaded analysis of a CSV or telemetry file
+static double time_analysis(const char *filename, int repetitions) {
+  MappedFile file;
+  if (!map_file(filename, &file)) {
+    return 0;
+  }
+  double best = INFINITY;
+  for (int r = 0; r < repetitions; r++) {
+    FlightState state;
+    Trajectory trajectory;
+    size_t malformed_rows;
+    trajectory_init(&trajectory);
+    double start = monotonic_seconds();
+    analyze_parallel(&file, 1, &state, &trajectory, &malformed_rows);
+    best = fmin(best, monotonic_seconds() - start);
+    trajectory_free(&trajectory);
+  }
+  unmap_file(&file);
+  return best;
+}
+
+/**
+ * @brief Counts the time steps with a temperature of at least
+ * `min_temperature`, decoding the temperature column of every block or only
+ * of the blocks whose maximum reaches it.
+ *
+ * @param skipped Receives the number of skipped blocks.
+ * @return The number of time steps.
+ */
+static size_t count_hot_steps(const MappedFile *file, double min_temperature,
+                              int skip, size_t *skipped, double *values) {
+  TelemetryReader reader;
+  TelemetryBlock block;
+  size_t count = 0;
+  *skipped = 0;
+  telemetry_open(&reader, file->data, file->size);
+  while (telemetry_next_block(&reader, &block)) {
+    if (skip && block.max[TELEMETRY_TEMPERATURE] < min_temperature) {
+      (*skipped)++;
+      continue;
+    }
+    telemetry_decode_column(&block, TELEMETRY_TEMPERATURE, values);
+    for (size_t i = 0; i < block.rows; i++) {
+      count += values[i] >= min_temperature;
+    }
+  }
+  return count;
+}
+
+/**
+ * @brief Converts the CSV file into a telemetry file (benchmark.tlm, removed
+ * afterwards) and compares size, decoding and analysis with the CSV, plus a
+ * query that skips blocks by their temperature range.
+ */
+int benchmark_telemetry(const char *filename, int repetitions,
+                        double min_temperature) {
+  MappedFile csv;
+  if (!map_file(filename, &csv)) {
+    printf("Error: Could not read file %s\n", filename);
+    return 1;
+  }
+  size_t csv_bytes = csv.size, rows, malformed_rows;
+  double start = monotonic_seconds();
+  int converted = telemetry_convert(&csv, TELEMETRY_FILE, &rows,
+                                    &malformed_rows);
+  double convert_seconds = monotonic_seconds() - start;
+  unmap_file(&csv);
+  MappedFile telemetry;
+  TelemetryChunk *chunk = malloc(sizeof(*chunk));
+  if (!converted || !chunk || !map_file(TELEMETRY_FILE, &telemetry)) {
+    printf("Error: Could not write %s\n", TELEMETRY_FILE);
+    free(chunk);
+    remove(TELEMETRY_FILE);
+    return 1;
+  }
+
+  double best_parse = INFINITY, best_decode = INFINITY;
+  double checksum_csv = 0, checksum_telemetry = 0;
+  size_t rows_csv = 0, rows_telemetry = 0;
+  for (int r = 0; r < repetitions; r++) {
+    checksum_csv = 0;
+    start = monotonic_seconds();
+    rows_csv = parse_with_mapping(filename, chunk, &checksum_csv);
+    best_parse = fmin(best_parse, monotonic_seconds() - start);
+
+    checksum_telemetry = 0;
+    start = monotonic_seconds();
+    rows_telemetry =
+        decode_with_mapping(TELEMETRY_FILE, chunk, &checksum_telemetry);
+    best_decode = fmin(best_decode, monotonic_seconds() - start);
+  }
+  printf("Input: %s (%zu rows, best of %d)\n", filename, rows, repetitions);
+  printf("Size: %zu -> %zu bytes (%.1f -> %.1f bytes per row, %.2fx), "
+         "converted in %.1f ms\n",
+         csv_bytes, telemetry.size, rows > 0 ? (double)csv_bytes / rows : 0.0,
+         rows > 0 ? (double)telemetry.size / rows : 0.0,
+         (double)csv_bytes / telemetry.size, convert_seconds * 1e3);
+  print_throughput("csv parser", best_parse, csv_bytes, rows_csv);
+  print_throughput("telemetry", best_decode, telemetry.size, rows_telemetry);
+  printf("Decoding speedup: %.2fx\n", best_parse / best_decode);
+
+  double analysis_csv = time_analysis(filename, repetitions);
+  double analysis_telemetry = time_analysis(TELEMETRY_FILE, repetitions);
+  printf("Analysis: csv %.1f ms, telemetry %.1f ms (%.2fx)\n",
+         analysis_csv * 1e3, analysis_telemetry * 1e3,
+         analysis_csv / analysis_telemetry);
+
+  double *values = malloc(CHUNK_SIZE * sizeof(double));
+  size_t skipped = 0, counts[2] = {0, 0};
+  double seconds[2] = {INFINITY, INFINITY};
+  for (int r = 0; values && r < repetitions; r++) {
+    for (int skip = 0; skip < 2; skip++) {
+      start = monotonic_seconds();
+      counts[skip] = count_hot_steps(&telemetry, min_temperature, skip,
+                                     &skipped, values);
+      seconds[skip] = fmin(seconds[skip], monotonic_seconds() - start);
+    }
+  }
+  size_t num_blocks = (rows + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  printf("Temperature >= %g: %zu time steps, all blocks %.2f ms, %zu of %zu "
+         "blocks skipped %.2f ms\n",
+         min_temperature, counts[1], seconds[0] * 1e3, skipped, num_blocks,
+         seconds[1] * 1e3);
+  free(values);
+  free(chunk);
+  unmap_file(&telemetry);
+  remove(TELEMETRY_FILE);
+
+  if (rows_csv != rows_telemetry || checksum_csv != checksum_telemetry ||
+      counts[0] != counts[1]) {
+    printf("Error: CSV and telemetry file disagree (%zu vs %zu rows)\n",
+           rows_csv, rows_telemetry);
+    return 1;
+  }
+  return 0;
+}
+
+#define RASTER_FILE "benchmark_raster"
+
+// Best time of rendering the path with the given binning and threads
+static double time_trajectory_render(const Trajectory *trajectory,
+                                     double offset, int size, int binning,
+                                     ThreadPool *pool, int repetitions,
+                                     RgbImage *image, RasterStats *stats) {
+  double best = INFINITY;
+  for (int r = 0; r < repetitions; r++) {
+    rgb_image_free(image);
+    if (!render_trajectory(image, size, trajectory, offset, binning, pool,
+                           stats)) {
+      return 0;
+    }
+    best = fmin(best, stats->render_seconds);
+  }
+  return best;
+}
+
+/**
+ * @brief Compares the vector and raster outputs of a flight: line.svg against
+ * rendering the path without binning, with binning and with binning on one
+ * thread per CPU, the PNG and PPM encoding, and the heatmap SVG against its
+ * raster image. The files are removed afterwards.
+ */
+int benchmark_raster(const char *filename, int size, int repetitions) {
+  MappedFile file;
+  if (!map_file(filename, &file)) {
+    printf("Error: Could not read file %s\n", filename);
+    return 1;
+  }
+  FlightState state;
+  Trajectory trajectory;
+  size_t malformed_rows;
+  trajectory_init(&trajectory);
+  int analyzed =
+      analyze_parallel(&file, 1, &state, &trajectory, &malformed_rows);
+  unmap_file(&file);
+  Heatmap heatmap;
+  ThreadPool pool;
+  int num_threads = cpu_count();
+  if (!analyzed ||
+      !heatmap_from_trajectory(&heatmap, &trajectory, size / 4, NULL) ||
+      !thread_pool_create(&pool, num_threads - 1)) {
+    printf("Error: Not enough memory for %s\n", filename);
+    trajectory_free(&trajectory);
+    return 1;
+  }
+  printf("Input: %s (%zu time steps), %dx%d pixels, best of %d\n", filename,
+         trajectory.length, size, size, repetitions);
+
+  SvgStats svg;
+  double best_svg = INFINITY;
+  for (int r = 0; r < repetitions; r++) {
+    save_trajectory_svg(RASTER_FILE ".svg", &trajectory, state.max_distance,
+                        SVG_DEFAULT_TOLERANCE, &svg);
+    best_svg = fmin(best_svg, svg.seconds);
+  }
+  printf("%-24s %10.2f ms %10.1f KiB (%zu points)\n", "line.svg",
+         best_svg * 1e3, svg.bytes / 1024.0, svg.elements);
+
+  RgbImage reference = {0, 0, NULL}, image = {0, 0, NULL};
+  RasterStats stats;
+  double unbinned =
+      time_trajectory_render(&trajectory, state.max_distance, size, 0, NULL,
+                             repetitions, &reference, &stats);
+  printf("%-24s %10.2f ms (%zu of %zu segment/tile pairs drawn)\n",
+         "render, no binning", unbinned * 1e3, stats.tile_elements,
+         stats.elements * (size_t)stats.width / RASTER_TILE_SIZE *
+             stats.width / RASTER_TILE_SIZE);
+  double binned =
+      time_trajectory_render(&trajectory, state.max_distance, size, 1, NULL,
+                             repetitions, &image, &stats);
+  printf("%-24s %10.2f ms (%zu segment/tile pairs drawn, %.2fx)\n",
+         "render, binning", binned * 1e3, stats.tile_elements,
+         unbinned / binned);
+  int identical = reference.pixels && image.pixels &&
+                  memcmp(reference.pixels, image.pixels,
+                         (size_t)size * size * 3) == 0;
+  double threaded =
+      time_trajectory_render(&trajectory, state.max_distance, size, 1, &pool,
+                             repetitions, &image, &stats);
+  char label[64];
+  snprintf(label, sizeof(label), "render, %d threads", num_threads);
+  printf("%-24s %10.2f ms (%.2fx)\n", label, threaded * 1e3,
+         binned / threaded);
+  identical = identical && image.pixels &&
+              memcmp(reference.pixels, image.pixels,
+                     (size_t)size * size * 3) == 0;
+
+  const char *formats[2] = {RASTER_FILE ".png", RASTER_FILE ".ppm"};
+  for (int f = 0; f < 2 && image.pixels; f++) {
+    double best = INFINITY;
+    size_t bytes = 0;
+    for (int r = 0; r < repetitions; r++) {
+      double start = monotonic_seconds();
+      write_image(&image, formats[f], &bytes);
+      best = fmin(best, monotonic_seconds() - start);
+    }
+    snprintf(label, sizeof(label), "encode %s", f == 0 ? "png" : "ppm");
+    printf("%-24s %10.2f ms %10.1f KiB\n", label, best * 1e3, bytes / 1024.0);
+  }
+
+  HeatmapPyramid pyramid;
+  if (heatmap_build_pyramid(&heatmap, 1, &pyramid)) {
+    double best = INFINITY;
+    for (int r = 0; r < repetitions; r++) {
+      save_temperature_map_svg(RASTER_FILE ".svg", &pyramid.levels[0], &svg);
+      best = fmin(best, svg.seconds);
+    }
+    printf("%-24s %10.2f ms %10.1f KiB (%zu rects)\n", "heatmap svg",
+           best * 1e3, svg.bytes / 1024.0, svg.elements);
+    heatmap_pyramid_free(&pyramid);
+  }
+  double best = INFINITY;
+  for (int r = 0; r < repetitions; r++) {
+    RgbImage map = {0, 0, NULL};
+    if (render_temperature_map(&map, size, &heatmap, &pool, &stats)) {
+      best = fmin(best, stats.render_seconds);
+    }
+    rgb_image_free(&map);
+  }
+  printf("%-24s %10.2f ms (%zu cells)\n", "heatmap render", best * 1e3,
+         stats.elements);
+
+  rgb_image_free(&reference);
+  rgb_image_free(&image);
+  thread_pool_destroy(&pool);
+  heatmap_free(&heatmap);
+  trajectory_free(&trajectory);
+  remove(RASTER_FILE ".svg");
+  remove(RASTER_FILE ".png");
+  remove(RASTER_FILE ".ppm");
+  if (!identical) {
+    printf("Error: The renderings with and without binning differ\n");
+    return 1;
+  }
+  return 0;
+}
+
+// Analysis of the controls storing the time steps in the given format
+typedef struct CompactRun {
+  double analysis_seconds;
+  double heatmap_seconds; // Binning the stored positions and temperatures
+  size_t bytes;           // Stored time steps
+  double max_error[TRAJECTORY_NUM_COLUMNS];
+  double rms_error[TRAJECTORY_NUM_COLUMNS];
+} CompactRun;
+
+/**
+ * @brief Analyzes all rows with the library, keeping the trajectory in double
+ * precision for COMPACT_NONE and compact storage otherwise, and bins the
+ * stored time steps into a heatmap of the given resolution.
+ *
+ * @return 1 on success, 0 if out of memory.
+ */
+static int run_compact(const Controls *controls, CompactFormat format,
+                       int resolution, CompactRun *run) {
+  FlightAnalysisConfig config;
+  flight_analysis_config_init(&config);
+  config.keep_trajectory = format == COMPACT_NONE;
+  FlightAnalysis *analysis = flight_analysis_create(&config);
+  CompactTrajectory compact;
+  // Also clears the errors for COMPACT_NONE, which has nothing to allocate
+  int initialized = compact_trajectory_init(&compact, format);
+  if (!analysis || (format != COMPACT_NONE && !initialized)) {
+    flight_analysis_destroy(analysis);
+    compact_trajectory_free(&compact);
+    return 0;
+  }
+  if (format != COMPACT_NONE) {
+    flight_analysis_set_steps_sink(analysis, compact_trajectory_steps_sink,
+                                   &compact);
+  }
+  FlightMetrics metrics;
+  double start = monotonic_seconds();
+  int success =
+      flight_analysis_push_rows(analysis, controls->acceleration,
+                                controls->rotation, controls->temperature,
+                                controls->length) &&
+      flight_analysis_finish(analysis, &metrics) &&
+      (format == COMPACT_NONE || compact_trajectory_finish(&compact));
+  run->analysis_seconds = monotonic_seconds() - start;
+  Trajectory trajectory;
+  trajectory_init(&trajectory);
+  flight_analysis_take_trajectory(analysis, &trajectory);
+  flight_analysis_destroy(analysis);
+
+  Heatmap heatmap;
+  start = monotonic_seconds();
+  if (success && format == COMPACT_NONE) {
+    success = heatmap_from_trajectory(&heatmap, &trajectory, resolution, NULL);
+  } else if (success) {
+    success = compact_trajectory_heatmap(&heatmap, &compact, resolution, NULL);
+  }
+  run->heatmap_seconds = monotonic_seconds() - start;
+  if (success) {
+    heatmap_free(&heatmap);
+  }
+
+  // The used bytes in both cases, the allocations grow alike
+  run->bytes = format == COMPACT_NONE
+                   ? trajectory.length * TRAJECTORY_NUM_COLUMNS * sizeof(double)
+                   : compact_trajectory_memory_usage(&compact);
+  for (int c = 0; c < TRAJECTORY_NUM_COLUMNS; c++) {
+    run->max_error[c] = compact.max_error[c];
+    run->rms_error[c] = compact_trajectory_rms_error(&compact, c);
+  }
+  compact_trajectory_free(&compact);
+  trajectory_free(&trajectory);
+  return success;
+}
+
+/**
+ * @brief Compares storing the trajectory in double precision with the
+ * compact formats: the time of the analysis including storing, the memory of
+ * the stored time steps, the time of a heatmap pass over them and the error
+ * of the positions and temperatures.
+ */
+int benchmark_compact(const char *filename, int repetitions) {
+  Controls controls;
+  if (!read_controls(filename, &controls)) {
+    return 1;
+  }
+  size_t n = controls.length;
+  printf("Input: %s (%zu rows), best of %d\n", filename, n, repetitions);
+  printf("%-8s %12s %12s %8s %12s %12s %12s %12s\n", "format", "analysis",
+         "stored", "B/step", "heatmap", "max. err x", "RMS err x",
+         "max. err temp");
+
+  int success = 1;
+  for (int f = COMPACT_NONE; success && f < NUM_COMPACT_FORMATS; f++) {
+    CompactRun run = {0, 0, 0, {0}, {0}};
+    double best_analysis = INFINITY, best_heatmap = INFINITY;
+    for (int r = 0; success && r < repetitions; r++) {
+      success = run_compact(&controls, (CompactFormat)f, 25, &run);
+      best_analysis = fmin(best_analysis, run.analysis_seconds);
+      best_heatmap = fmin(best_heatmap, run.heatmap_seconds);
+    }
+    if (success) {
+      printf("%-8s %9.2f ms %8.2f MiB %8.2f %9.2f ms %12.3e %12.3e %12.3e\n",
+             compact_format_name((CompactFormat)f), best_analysis * 1e3,
+             run.bytes / (1024.0 * 1024.0), n ? (double)run.bytes / n : 0.0,
+             best_heatmap * 1e3, run.max_error[0], run.rms_error[0],
+             run.max_error[TRAJECTORY_NUM_COLUMNS - 1]);
+    }
+  }
+  free(controls.acceleration);
+  free(controls.rotation);
+  free(controls.temperature);
+  if (!success) {
+    printf("Error: Out of memory\n");
+    return 1;
+  }
+  return 0;
+}
+
+void print_usage(void) {
+  printf("Usage: benchmark parse <spaceship_data.csv> [repetitions]\n");
+  printf("       benchmark scaling <spaceship_data.csv> [max_threads]\n");
+  printf("       benchmark kernels [num_elements]\n");
+  printf("       benchmark generate <output.csv> <rows> [seed]\n");
+  printf("       benchmark stages <spaceship_data.csv> [options]\n");
+  printf("       benchmark suite [max_rows] [options]\n");
+  printf("       benchmark integrators <spaceship_data.csv> "
+         "[max_substeps]\n");
+  printf("       benchmark spatial [max_points]\n");
+  printf("       benchmark database <spaceship_data.csv> [windows]\n");
+  printf("       benchmark rolling [num_steps]\n");
+  printf("       benchmark fleet [ships] [steps]\n");
+  printf("       benchmark telemetry <spaceship_data.csv> [repetitions] "
+         "[min_temperature]\n");
+  printf("       benchmark raster <spaceship_data.csv> [size] "
+         "[repetitions]\n");
+  printf("       benchmark compact <spaceship_data.csv> [repetitions]\n");
+  printf("Options of stages/suite: [--repetitions N] [--resolution N] "
+         "[--format table|json|csv] [--no-report] [--report-points N] "
+         "[--no-simd] [--fast-heading]\n");
+}
+
+int main(int argc, char *argv[]) {
+  if (argc >= 3 && strcmp(argv[1], "parse") == 0) {
+    int repetitions = argc >= 4 ? atoi(argv[3]) : 5;
+    return benchmark_parse(argv[2], repetitions > 0 ? repetitions : 1);
+  }
+  if (argc >= 3 && strcmp(argv[1], "scaling") == 0) {
+    int max_threads = argc >= 4 ? atoi(argv[3]) : 8;
+    return benchmark_scaling(argv[2], max_threads > 0 ? max_threads : 1);
+  }
+  if (argc >= 2 && strcmp(argv[1], "kernels") == 0) {
+    long num_elements = argc >= 3 ? atol(argv[2]) : 1 << 22;
+    return benchmark_kernels(num_elements > 0 ? (size_t)num_elements : 1);
+  }
+  if (argc >= 4 && strcmp(argv[1], "generate") == 0) {
+    uint64_t rows;
+    uint64_t seed = argc >= 5 ? strtoull(argv[4], NULL, 10) : 0;
+    if (!parse_rows(argv[3], &rows)) {
+      return 1;
+    }
+    return benchmark_generate(argv[2], rows, seed);
+  }
+
+  if (argc >= 2 && strcmp(argv[1], "spatial") == 0) {
+    uint64_t max_points = 10000000;
+    if (argc >= 3 && !parse_rows(argv[2], &max_points)) {
+      return 1;
+    }
+    return benchmark_spatial((size_t)max_points);
+  }
+  if (argc >= 2 && strcmp(argv[1], "rolling") == 0) {
+    uint64_t num_steps = 10000000;
+    if (argc >= 3 && !parse_rows(argv[2], &num_steps)) {
+      return 1;
+    }
+    return benchmark_rolling(num_steps > 0 ? (size_t)num_steps : 1);
+  }
+  if (argc >= 2 && strcmp(argv[1], "fleet") == 0) {
+    long num_ships = argc >= 3 ? atol(argv[2]) : 64;
+    long num_steps = argc >= 4 ? atol(argv[3]) : 100000;
+    return benchmark_fleet(num_ships > 0 ? (size_t)num_ships : 1,
+                           num_steps > 0 ? (size_t)num_steps : 1);
+  }
+  if (argc >= 3 && strcmp(argv[1], "telemetry") == 0) {
+    int repetitions = argc >= 4 ? atoi(argv[3]) : 5;
+    double min_temperature = argc >= 5 ? atof(argv[4]) : 39.99;
+    return benchmark_telemetry(argv[2], repetitions > 0 ? repetitions : 1,
+                               min_temperature);
+  }
+  if (argc >= 3 && strcmp(argv[1], "raster") == 0) {
+    int size = argc >= 4 ? atoi(argv[3]) : 1024;
+    int repetitions = argc >= 5 ? atoi(argv[4]) : 3;
+    if (size < 4 || size > RASTER_MAX_SIZE) {
+      printf("Error: size needs a number between 4 and %d\n",
+             RASTER_MAX_SIZE);
+      return 1;
+    }
+    return benchmark_raster(argv[2], size, repetitions > 0 ? repetitions : 1);
+  }
+  if (argc >= 3 && strcmp(argv[1], "compact") == 0) {
+    int repetitions = argc >= 4 ? atoi(argv[3]) : 3;
+    return benchmark_compact(argv[2], repetitions > 0 ? repetitions : 1);
+  }
+  if (argc >= 3 && strcmp(argv[1], "database") == 0) {
+    long num_windows = argc >= 4 ? atol(argv[3]) : 100000;
+    return benchmark_database(argv[2], num_windows > 0 ? num_windows : 1);
+  }
+  if (argc >= 3 && strcmp(argv[1], "integrators") == 0) {
+    int max_substeps = argc >= 4 ? atoi(argv[3]) : 64;
+    if (max_substeps < 1 || max_substeps > INTEGRATOR_MAX_SUBSTEPS) {
+      printf("Error: max_substeps needs a number between 1 and %d\n",
+             INTEGRATOR_MAX_SUBSTEPS);
+      return 1;
+    }
+    return benchmark_integrators(argv[2], max_substeps);
+  }
+
+  StagesOptions options = {3, 25, 0, FORMAT_TABLE, REPORT_DEFAULT_MAX_POINTS};
+  if (argc >= 3 && strcmp(argv[1], "stages") == 0) {
+    if (!parse_stages_options(argc, argv, 3, &options)) {
+      return 1;
+    }
+    return benchmark_stages(argv[2], &options);
+  }
+  if (argc >= 2 && strcmp(argv[1], "suite") == 0) {
+    // The maximum is optional, options start with "--"
+    uint64_t max_rows = 1000000;
+    int first_option = 2;
+    if (argc >= 3 && strncmp(argv[2], "--", 2) != 0) {
+      if (!parse_rows(argv[2], &max_rows)) {
+        return 1;
+      }
+      first_option = 3;
+    }
+    if (!parse_stages_options(argc, argv, first_option, &options)) {
+      return 1;
+    }
+    return benchmark_suite(max_rows, &options);
+  }
+  print_usage();
+  return 1;
+}
@@ -0,0 +1,546 @@
+/**
+ * Reduced precision storage of the trajectory for large flights.
+ *
+ * float32 halves every column; its error grows with the magnitude of the
+ * values, e.g. with the distance from the start. The fixed point formats
+ * store every column of a block of COMPACT_BLOCK_SIZE steps as unsigned
+ * offsets from the smallest value of the block in steps of range /
+ * (2^bits - 1), so their error only depends on how far a column moves within
+ * a block. Fixed point needs finite values.
+ *
+ * Only the stored time steps lose precision: the integrator state and the
+ * metrics of the flight are computed in double precision as before.
+ */
+
+#include "compact_trajectory.h"
+#include "profiler.h"
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *const FORMAT_NAMES[NUM_COMPACT_FORMATS] = {
+    "double", "float32", "fixed16", "fixed32"};
+
+int compact_format_from_name(const char *name, CompactFormat *format) {
+  for (int f = 0; f < NUM_COMPACT_FORMATS; f++) {
+    if (strcmp(name, FORMAT_NAMES[f]) == 0) {
+      *format = (CompactFormat)f;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+const char *compact_format_name(CompactFormat format) {
+  return FORMAT_NAMES[format];
+}
+
+/**
+ * @brief Bytes per stored value.
+ */
+size_t compact_format_value_size(CompactFormat format) {
+  switch (format) {
+  case COMPACT_FLOAT32:
+    return sizeof(float);
+  case COMPACT_FIXED16:
+    return sizeof(uint16_t);
+  case COMPACT_FIXED32:
+    return sizeof(uint32_t);
+  default:
+    return sizeof(double);
+  }
+}
+
+static int is_fixed_point(CompactFormat format) {
+  return format == COMPACT_FIXED16 || format == COMPACT_FIXED32;
+}
+
+/**
+ * @brief Creates an empty trajectory in one of the reduced precision formats.
+ * Nothing is allocated until steps are appended.
+ *
+ * @return 1 on success, 0 if the format isn't a compact one.
+ */
+int compact_trajectory_init(CompactTrajectory *trajectory,
+                            CompactFormat format) {
+  trajectory->format = format;
+  trajectory->length = 0;
+  trajectory->capacity = 0;
+  trajectory->ranges = NULL;
+  trajectory->num_pending = 0;
+  trajectory->pending_capacity = 0;
+  trajectory->finished = 0;
+  for (int c = 0; c < TRAJECTORY_NUM_COLUMNS; c++) {
+    trajectory->columns[c] = NULL;
+    trajectory->pending[c] = NULL;
+    trajectory->max_error[c] = 0.0;
+    trajectory->sum_squared_error[c] = 0.0;
+  }
+  return format != COMPACT_NONE && format < NUM_COMPACT_FORMATS;
+}
+
+/**
+ * @brief Makes room for `needed` steps in `columns`, doubling the capacity
+ * up to `limit` but starting at `needed`, so short flights only take what
+ * they use.
+ *
+ * @return The new capacity, 0 if the memory could not be allocated.
+ */
+static size_t grow_columns(void **columns, size_t capacity, size_t needed,
+                           size_t limit, size_t value_size) {
+  size_t new_capacity = capacity * 2 > needed ? capacity * 2 : needed;
+  new_capacity = new_capacity < limit ? new_capacity : limit;
+  for (int c = 0; c < TRAJECTORY_NUM_COLUMNS; c++) {
+    void *column = realloc(columns[c], new_capacity * value_size);
+    if (!column) {
+      return 0;
+    }
+    columns[c] = column;
+    PROFILE_ALLOCATION(new_capacity * value_size);
+  }
+  return new_capacity;
+}
+
+// Makes room for `count` more pending steps, at most a whole block
+static int reserve_pending(CompactTrajectory *trajectory, size_t count) {
+  size_t needed = trajectory->num_pending + count;
+  if (needed <= trajectory->pending_capacity) {
+    return 1;
+  }
+  size_t capacity = grow_columns((void **)trajectory->pending,
+                                 trajectory->pending_capacity, needed,
+                                 COMPACT_BLOCK_SIZE, sizeof(double));
+  if (!capacity) {
+    return 0; // Like trajectory_reserve(), the capacity stays the old one
+  }
+  trajectory->pending_capacity = capacity;
+  return 1;
+}
+
+// Makes room for the encoded steps of `block` with `length` steps
+static int reserve_block(CompactTrajectory *trajectory, size_t block,
+                         size_t length) {
+  size_t needed = block * COMPACT_BLOCK_SIZE + length;
+  if (needed <= trajectory->capacity) {
+    return 1;
+  }
+  size_t value_size = compact_format_value_size(trajectory->format);
+  size_t capacity = grow_columns(trajectory->columns, trajectory->capacity,
+                                 needed, SIZE_MAX, value_size);
+  if (!capacity) {
+    return 0; // Like trajectory_reserve(), the capacity stays the old one
+  }
+  if (is_fixed_point(trajectory->format)) {
+    size_t bytes = (capacity + COMPACT_BLOCK_SIZE - 1) / COMPACT_BLOCK_SIZE *
+                   TRAJECTORY_NUM_COLUMNS * sizeof(CompactRange);
+    CompactRange *ranges = realloc(trajectory->ranges, bytes);
+    if (!ranges) {
+      return 0;
+    }
+    trajectory->ranges = ranges;
+    PROFILE_ALLOCATION(bytes);
+  }
+  trajectory->capacity = capacity;
+  return 1;
+}
+
+static void add_error(CompactTrajectory *trajectory, int column,
+                      double error) {
+  if (error > trajectory->max_error[column]) {
+    trajectory->max_error[column] = error;
+  }
+  trajectory->sum_squared_error[column] += error * error;
+}
+
+/**
+ * @brief Encodes the pending steps as the next block and measures the error
+ * of every stored value.
+ *
+ * @return 1 on success, 0 if the memory ran out or a fixed point column has
+ * non-finite values.
+ */
+static int encode_block(CompactTrajectory *trajectory) {
+  size_t n = trajectory->num_pending;
+  size_t first = trajectory->length - n; // A multiple of the block size
+  size_t block = first / COMPACT_BLOCK_SIZE;
+  if (!reserve_block(trajectory, block, n)) {
+    return 0;
+  }
+  for (int c = 0; c < TRAJECTORY_NUM_COLUMNS; c++) {
+    const double *values = trajectory->pending[c];
+    if (trajectory->format == COMPACT_FLOAT32) {
+      float *stored = (float *)trajectory->columns[c] + first;
+      for (size_t i = 0; i < n; i++) {
+        stored[i] = (float)values[i];
+        add_error(trajectory, c, fabs((double)stored[i] - values[i]));
+      }
+      continue;
+    }
+
+    double min = DBL_MAX, max = -DBL_MAX;
+    for (size_t i = 0; i < n; i++) {
+      if (!isfinite(values[i])) {
+        return 0;
+      }
+      min = fmin(min, values[i]);
+      max = fmax(max, values[i]);
+    }
+    double range = max - min;
+    if (!isfinite(range)) {
+      return 0;
+    }
+    double max_code =
+        trajectory->format == COMPACT_FIXED16 ? UINT16_MAX : UINT32_MAX;
+    CompactRange *stored_range =
+        &trajectory->ranges[block * TRAJECTORY_NUM_COLUMNS + c];
+    stored_range->offset = min;
+    stored_range->scale = range / max_code;
+    // A subnormal scale would overflow, the values are then all but equal
+    double inverse =
+        stored_range->scale >= DBL_MIN ? 1.0 / stored_range->scale : 0.0;
+    for (size_t i = 0; i < n; i++) {
+      double code = fmin(nearbyint((values[i] - min) * inverse), max_code);
+      if (trajectory->format == COMPACT_FIXED16) {
+        ((uint16_t *)trajectory->columns[c])[first + i] = (uint16_t)code;
+      } else {
+        ((uint32_t *)trajectory->columns[c])[first + i] = (uint32_t)code;
+      }
+      add_error(trajectory, c,
+                fabs(min + code * stored_range->scale - values[i]));
+    }
+  }
+  return 1;
+}
+
+// Encodes the pending steps, which are dropped if that fails
+static int encode_pending(CompactTrajectory *trajectory) {
+  int success = encode_block(trajectory);
+  if (!success) {
+    trajectory->length -= trajectory->num_pending;
+  }
+  trajectory->num_pending = 0;
+  return success;
+}
+
+/**
+ * @brief Appends time steps, given as one array per column in the order of
+ * the Trajectory (x, y, rotation, velocity x, velocity y, temperature).
+ *
+ * @return 1 on success, 0 if the trajectory is finished, the memory ran out
+ * or a fixed point column has non-finite values.
+ */
+int compact_trajectory_append(CompactTrajectory *trajectory,
+                              const double *const *columns, size_t count) {
+  if (trajectory->finished) {
+    return 0;
+  }
+  size_t i = 0;
+  while (i < count) {
+    size_t n = COMPACT_BLOCK_SIZE - trajectory->num_pending;
+    n = count - i < n ? count - i : n;
+    if (!reserve_pending(trajectory, n)) {
+      return 0;
+    }
+    for (int c = 0; c < TRAJECTORY_NUM_COLUMNS; c++) {
+      memcpy(trajectory->pending[c] + trajectory->num_pending, columns[c] + i,
+             n * sizeof(double));
+    }
+    trajectory->num_pending += n;
+    trajectory->length += n;
+    i += n;
+    if (trajectory->num_pending == COMPACT_BLOCK_SIZE &&
+        !encode_pending(trajectory)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * @brief Steps sink of a FlightAnalysis that appends the steps to the
+ * CompactTrajectory `context`.
+ */
+int compact_trajectory_steps_sink(void *context, const FlightSteps *steps) {
+  const double *columns[TRAJECTORY_NUM_COLUMNS] = {
+      steps->x,          steps->y,          steps->rotation,
+      steps->velocity_x, steps->velocity_y, steps->temperature};
+  return compact_trajectory_append(context, columns, steps->length);
+}
+
+/**
+ * @brief Encodes the last incomplete block. Afterwards the trajectory can be
+ * read, but nothing can be appended.
+ *
+ * @return 1 on success, 0 if the last block could not be encoded.
+ */
+int compact_trajectory_finish(CompactTrajectory *trajectory) {
+  int success = 1;
+  if (!trajectory->finished && trajectory->num_pending > 0) {
+    success = encode_pending(trajectory);
+  }
+  trajectory->finished = 1;
+  for (int c = 0; c < TRAJECTORY_NUM_COLUMNS; c++) {
+    free(trajectory->pending[c]);
+    trajectory->pending[c] = NULL;
+  }
+  trajectory->pending_capacity = 0;
+  return success;
+}
+
+size_t compact_trajectory_num_blocks(const CompactTrajectory *trajectory) {
+  return (trajectory->length + COMPACT_BLOCK_SIZE - 1) / COMPACT_BLOCK_SIZE;
+}
+
+/**
+ * @brief Decodes the steps of one block of a finished trajectory.
+ *
+ * @param columns One array of COMPACT_BLOCK_SIZE doubles per column, NULL
+ * for the columns that aren't needed.
+ * @return The number of steps in the block.
+ */
+size_t compact_trajectory_decode_block(const CompactTrajectory *trajectory,
+                                       size_t block, double *const *columns) {
+  size_t first = block * COMPACT_BLOCK_SIZE;
+  size_t n = trajectory->length - first < COMPACT_BLOCK_SIZE
+                 ? trajectory->length - first
+                 : COMPACT_BLOCK_SIZE;
+  for (int c = 0; c < TRAJECTORY_NUM_COLUMNS; c++) {
+    double *values = columns[c];
+    if (!values) {
+      continue;
+    }
+    if (trajectory->format == COMPACT_FLOAT32) {
+      const float *stored = (const float *)trajectory->columns[c] + first;
+      for (size_t i = 0; i < n; i++) {
+        values[i] = stored[i];
+      }
+      continue;
+    }
+    const CompactRange *range =
+        &trajectory->ranges[block * TRAJECTORY_NUM_COLUMNS + c];
+    if (trajectory->format == COMPACT_FIXED16) {
+      const uint16_t *stored = (const uint16_t *)trajectory->columns[c] + first;
+      for (size_t i = 0; i < n; i++) {
+        values[i] = range->offset + stored[i] * range->scale;
+      }
+    } else {
+      const uint32_t *stored = (const uint32_t *)trajectory->columns[c] + first;
+      for (size_t i = 0; i < n; i++) {
+        values[i] = range->offset + stored[i] * range->scale;
+      }
+    }
+  }
+  return n;
+}
+
+/**
+ * @brief Root mean square difference of the stored values of a column from
+ * the appended full precision values.
+ */
+double compact_trajectory_rms_error(const CompactTrajectory *trajectory,
+                                    int column) {
+  if (trajectory->length == 0) {
+    return 0.0;
+  }
+  return sqrt(trajectory->sum_squared_error[column] /
+              (double)trajectory->length);
+}
+
+/**
+ * @brief Number of bytes used by the encoded steps, their fixed point ranges
+ * and the steps of the incomplete block. Like the double precision columns,
+ * the allocations grow by doubling, so up to twice as much may be reserved.
+ */
+size_t compact_trajectory_memory_usage(const CompactTrajectory *trajectory) {
+  size_t encoded = trajectory->length - trajectory->num_pending;
+  size_t bytes = encoded * TRAJECTORY_NUM_COLUMNS *
+                 compact_format_value_size(trajectory->format);
+  if (is_fixed_point(trajectory->format)) {
+    bytes += (encoded + COMPACT_BLOCK_SIZE - 1) / COMPACT_BLOCK_SIZE *
+             TRAJECTORY_NUM_COLUMNS * sizeof(CompactRange);
+  }
+  return bytes + trajectory->num_pending * TRAJECTORY_NUM_COLUMNS *
+                     sizeof(double);
+}
+
+void compact_trajectory_free(CompactTrajectory *trajectory) {
+  for (int c = 0; c < TRAJECTORY_NUM_COLUMNS; c++) {
+    free(trajectory->columns[c]);
+    free(trajectory->pending[c]);
+    trajectory->columns[c] = NULL;
+    trajectory->pending[c] = NULL;
+  }
+  free(trajectory->ranges);
+  trajectory->ranges = NULL;
+  trajectory->length = 0;
+  trajectory->capacity = 0;
+  trajectory->num_pending = 0;
+  trajectory->pending_capacity = 0;
+}
+
+/**
+ * @brief Prepares decoding the blocks of a finished trajectory into a view.
+ *
+ * @return 1 on success, 0 if the memory ran out.
+ */
+int compact_block_reader_init(CompactBlockReader *reader,
+                              const CompactTrajectory *trajectory) {
+  reader->trajectory = trajectory;
+  reader->block = SIZE_MAX;
+  reader->values =
+      malloc(TRAJECTORY_NUM_COLUMNS * COMPACT_BLOCK_SIZE * sizeof(double));
+  trajectory_init(&reader->view);
+  if (!reader->values) {
+    return 0;
+  }
+  PROFILE_ALLOCATION(TRAJECTORY_NUM_COLUMNS * COMPACT_BLOCK_SIZE *
+                     sizeof(double));
+  Trajectory *view = &reader->view;
+  view->x = reader->values;
+  view->y = reader->values + COMPACT_BLOCK_SIZE;
+  view->rotation = reader->values + 2 * COMPACT_BLOCK_SIZE;
+  view->velocity_x = reader->values + 3 * COMPACT_BLOCK_SIZE;
+  view->velocity_y = reader->values + 4 * COMPACT_BLOCK_SIZE;
+  view->temperature = reader->values + 5 * COMPACT_BLOCK_SIZE;
+  return 1;
+}
+
+void compact_block_reader_free(CompactBlockReader *reader) {
+  free(reader->values);
+  reader->values = NULL;
+  reader->block = SIZE_MAX;
+}
+
+/**
+ * @brief Decodes the columns x, y and temperature (the others if
+ * `all_columns` is set) of a block into the view.
+ */
+static void decode_view(CompactBlockReader *reader, size_t block,
+                        int all_columns) {
+  Trajectory *view = &reader->view;
+  double *columns[TRAJECTORY_NUM_COLUMNS] = {
+      view->x,
+      view->y,
+      all_columns ? view->rotation : NULL,
+      all_columns ? view->velocity_x : NULL,
+      all_columns ? view->velocity_y : NULL,
+      view->temperature};
+  view->length =
+      compact_trajectory_decode_block(reader->trajectory, block, columns);
+  reader->block = all_columns ? block : SIZE_MAX;
+}
+
+static const Trajectory *read_compact_block(void *context, size_t block) {
+  CompactBlockReader *reader = context;
+  if (block != reader->block) {
+    decode_view(reader, block, 1);
+  }
+  return &reader->view;
+}
+
+/**
+ * @brief Reads the trajectory of an initialized reader as TrajectoryBlocks of
+ * COMPACT_BLOCK_SIZE steps, decoding each block when it is read. The blocks
+ * are valid as long as the reader.
+ */
+void compact_trajectory_blocks(CompactBlockReader *reader,
+                               TrajectoryBlocks *blocks) {
+  blocks->length = reader->trajectory->length;
+  blocks->block_size = COMPACT_BLOCK_SIZE;
+  blocks->read = read_compact_block;
+  blocks->context = reader;
+}
+
+/**
+ * @brief Writes the decoded positions in the format of positions.csv (without
+ * the header line), one block at a time, see trajectory_write_csv().
+ *
+ * @return 1 on success, 0 if the memory or the output failed.
+ */
+int compact_trajectory_write_csv(const CompactTrajectory *trajectory,
+                                 FILE *out) {
+  CompactBlockReader reader;
+  int success = compact_block_reader_init(&reader, trajectory);
+  for (size_t b = 0; success && b < compact_trajectory_num_blocks(trajectory);
+       b++) {
+    decode_view(&reader, b, 1);
+    success = trajectory_write_csv(&reader.view, out);
+  }
+  compact_block_reader_free(&reader);
+  return success;
+}
+
+/**
+ * @brief Builds the heatmap of the decoded positions, one block at a time,
+ * see heatmap_from_trajectory().
+ *
+ * @return 1 on success, 0 if the memory ran out.
+ */
+int compact_trajectory_heatmap(Heatmap *heatmap,
+                               const CompactTrajectory *trajectory,
+                               int matrix_resolution, const double *bounds) {
+  CompactBlockReader reader;
+  if (!compact_block_reader_init(&reader, trajectory)) {
+    heatmap_init(heatmap, matrix_resolution, 0, 0, 1, 1);
+    return 0;
+  }
+  size_t num_blocks = compact_trajectory_num_blocks(trajectory);
+  const Trajectory *view = &reader.view;
+  if (bounds) {
+    heatmap_init(heatmap, matrix_resolution, bounds[0], bounds[1], bounds[2],
+                 bounds[3]);
+  } else {
+    double min_x = DBL_MAX, min_y = DBL_MAX;
+    double max_x = -DBL_MAX, max_y = -DBL_MAX;
+    for (size_t b = 0; b < num_blocks; b++) {
+      decode_view(&reader, b, 0);
+      for (size_t i = 0; i < view->length; i++) {
+        min_x = view->x[i] < min_x ? view->x[i] : min_x;
+        min_y = view->y[i] < min_y ? view->y[i] : min_y;
+        max_x = view->x[i] > max_x ? view->x[i] : max_x;
+        max_y = view->y[i] > max_y ? view->y[i] : max_y;
+      }
+    }
+    heatmap_init(heatmap, matrix_resolution, min_x, min_y, max_x, max_y);
+  }
+
+  int success = 1;
+  for (size_t b = 0; success && b < num_blocks; b++) {
+    decode_view(&reader, b, 0);
+    for (size_t i = 0; success && i < view->length; i++) {
+      success = heatmap_add(heatmap, view->x[i], view->y[i],
+                            view->temperature[i]);
+    }
+  }
+  compact_block_reader_free(&reader);
+  return success;
+}
+
+/**
+ * @brief Saves the decoded flight path as SVG file, one block at a time, see
+ * write_trajectory_blocks_svg().
+ *
+ * @return 1 on success, 0 if the file could not be written.
+ */
+int compact_trajectory_save_svg(const char *filename,
+                                const CompactTrajectory *trajectory,
+                                double offset, double tolerance,
+                                SvgStats *stats) {
+  CompactBlockReader reader;
+  OutputBuffer out;
+  if (!compact_block_reader_init(&reader, trajectory)) {
+    return 0;
+  }
+  if (!output_buffer_open(&out, filename)) {
+    compact_block_reader_free(&reader);
+    return 0;
+  }
+  TrajectoryBlocks blocks;
+  compact_trajectory_blocks(&reader, &blocks);
+  int success =
+      write_trajectory_blocks_svg(&out, &blocks, offset, tolerance, stats);
+  compact_block_reader_free(&reader);
+  return success;
+}
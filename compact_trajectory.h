@@ -0,0 +1,87 @@
+#ifndef COMPACT_TRAJECTORY_H
+#define COMPACT_TRAJECTORY_H
+
+#include "flight_analysis.h"
+#include "heatmap.h"
+#include "svg_writer.h"
+#include "trajectory.h"
+#include <stddef.h>
+#include <stdio.h>
+
+#define COMPACT_BLOCK_SIZE CHUNK_SIZE // Time steps sharing a fixed point range
+
+typedef enum CompactFormat {
+  COMPACT_NONE,    // Full precision doubles, the Trajectory
+  COMPACT_FLOAT32, // 4 bytes, relative error 6e-8
+  COMPACT_FIXED16, // 2 bytes, error range/131070 per block and column
+  COMPACT_FIXED32, // 4 bytes, error range/8.6e9 per block and column
+  NUM_COMPACT_FORMATS
+} CompactFormat;
+
+// Fixed point: value = offset + code * scale
+typedef struct CompactRange {
+  double offset;
+  double scale;
+} CompactRange;
+
+// The columns of a Trajectory in reduced precision, block by block. Steps
+// are collected at full precision until a block is complete and then
+// encoded, which also measures the error against the full precision values.
+typedef struct CompactTrajectory {
+  CompactFormat format;
+  size_t length;   // Time steps, including the ones not encoded yet
+  size_t capacity; // Encoded time steps that fit
+  void *columns[TRAJECTORY_NUM_COLUMNS];   // float, uint16_t or uint32_t
+  CompactRange *ranges;                    // Fixed point, per block and column
+  double *pending[TRAJECTORY_NUM_COLUMNS]; // Steps of the incomplete block
+  size_t num_pending;
+  size_t pending_capacity; // At most one block
+  int finished;
+  double max_error[TRAJECTORY_NUM_COLUMNS];
+  double sum_squared_error[TRAJECTORY_NUM_COLUMNS];
+} CompactTrajectory;
+
+// Decodes one block at a time into a Trajectory view, e.g. for a
+// TrajectoryBlocks, see compact_trajectory_blocks()
+typedef struct CompactBlockReader {
+  const CompactTrajectory *trajectory;
+  double *values; // COMPACT_BLOCK_SIZE steps of every column
+  Trajectory view;
+  size_t block; // Block in the view with all columns, SIZE_MAX if none
+} CompactBlockReader;
+
+int compact_format_from_name(const char *name, CompactFormat *format);
+const char *compact_format_name(CompactFormat format);
+size_t compact_format_value_size(CompactFormat format);
+
+int compact_trajectory_init(CompactTrajectory *trajectory,
+                            CompactFormat format);
+int compact_trajectory_append(CompactTrajectory *trajectory,
+                              const double *const *columns, size_t count);
+int compact_trajectory_steps_sink(void *context, const FlightSteps *steps);
+int compact_trajectory_finish(CompactTrajectory *trajectory);
+size_t compact_trajectory_num_blocks(const CompactTrajectory *trajectory);
+size_t compact_trajectory_decode_block(const CompactTrajectory *trajectory,
+                                       size_t block, double *const *columns);
+double compact_trajectory_rms_error(const CompactTrajectory *trajectory,
+                                    int column);
+size_t compact_trajectory_memory_usage(const CompactTrajectory *trajectory);
+void compact_trajectory_free(CompactTrajectory *trajectory);
+
+int compact_block_reader_init(CompactBlockReader *reader,
+                              const CompactTrajectory *trajectory);
+void compact_block_reader_free(CompactBlockReader *reader);
+void compact_trajectory_blocks(CompactBlockReader *reader,
+                               TrajectoryBlocks *blocks);
+
+int compact_trajectory_write_csv(const CompactTrajectory *trajectory,
+                                 FILE *out);
+int compact_trajectory_heatmap(Heatmap *heatmap,
+                               const CompactTrajectory *trajectory,
+                               int matrix_resolution, const double *bounds);
+int compact_trajectory_save_svg(const char *filename,
+                                const CompactTrajectory *trajectory,
+                                double offset, double tolerance,
+                                SvgStats *stats);
+
+#endif // COMPACT_TRAJECTORY_H
@@ -0,0 +1,297 @@
+#include "csv_parser.h"
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Powers of ten that are exactly representable as a double
+static const double exact_powers_of_ten[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+#if LDBL_MANT_DIG == 64
+// Powers of ten that are exactly representable in the 64 bit mantissa of an
+// x87 long double (5^27 still fits into 64 bits)
+static const long double exact_long_powers_of_ten[] = {
+    1e0L,  1e1L,  1e2L,  1e3L,  1e4L,  1e5L,  1e6L,  1e7L,  1e8L,  1e9L,
+    1e10L, 1e11L, 1e12L, 1e13L, 1e14L, 1e15L, 1e16L, 1e17L, 1e18L, 1e19L,
+    1e20L, 1e21L, 1e22L, 1e23L, 1e24L, 1e25L, 1e26L, 1e27L};
+#endif
+
+/**
+ * @brief Converts a decimal mantissa and exponent into the correctly rounded
+ * double, if that is possible without arbitrary precision arithmetic.
+ *
+ * @return 1 if `value` was set, 0 if the caller has to fall back to strtod.
+ */
+static int decimal_to_double(uint64_t mantissa, int exponent, double *value) {
+  if (mantissa == 0) {
+    *value = 0.0;
+    return 1;
+  }
+
+  // Clinger's fast path: both operands are exact, so the single IEEE
+  // multiplication/division rounds correctly
+  if (mantissa <= (UINT64_C(1) << 53) && exponent >= -22 && exponent <= 22) {
+    if (exponent < 0) {
+      *value = (double)mantissa / exact_powers_of_ten[-exponent];
+    } else {
+      *value = (double)mantissa * exact_powers_of_ten[exponent];
+    }
+    return 1;
+  }
+
+#if LDBL_MANT_DIG == 64
+  // 17 to 19 significant digits (typical for values printed with full double
+  // precision): divide in extended precision, which rounds correctly to 64
+  // bits. Rounding that result to 53 bits is only ambiguous if it lies exactly
+  // halfway between two doubles.
+  if (exponent >= -27 && exponent <= 27) {
+    long double result = (long double)mantissa;
+    if (exponent < 0) {
+      result /= exact_long_powers_of_ten[-exponent];
+    } else {
+      result *= exact_long_powers_of_ten[exponent];
+    }
+
+    uint64_t bits;
+    memcpy(&bits, &result, sizeof(bits)); // Explicit 64 bit mantissa
+    if ((bits & 0x7FF) != 0x400) {
+      *value = (double)result;
+      return 1;
+    }
+  }
+#endif
+  return 0;
+}
+
+/**
+ * @brief Parses a decimal floating point number without depending on the
+ * current locale.
+ *
+ * Accepts an optional sign, digits with an optional '.' and an optional
+ * exponent ("1.5e-3"). Leading spaces and tabs are skipped. Numbers that can't
+ * be converted exactly with the fast paths are handed to strtod, so the result
+ * is always the correctly rounded double.
+ *
+ * @param begin First character to parse.
+ * @param end One past the last character that may be read.
+ * @param stop Receives the position of the first character after the number.
+ * @param value Receives the parsed number.
+ * @return 1 on success, 0 if no number starts at `begin` or it is out of the
+ * range of a double.
+ */
+int parse_double(const char *begin, const char *end, const char **stop,
+                 double *value) {
+  const char *p = begin;
+  while (p < end && (*p == ' ' || *p == '\t')) {
+    p++;
+  }
+  const char *number_start = p;
+
+  int negative = 0;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    p++;
+  }
+
+  uint64_t mantissa = 0;
+  int digits = 0;  // Significant digits stored in the mantissa
+  int exponent = 0;
+  int any_digit = 0;
+  int truncated = 0;
+
+  while (p < end && *p >= '0' && *p <= '9') {
+    any_digit = 1;
+    if (digits < 19) {
+      mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+      digits += mantissa != 0;
+    } else {
+      exponent++;
+      truncated |= *p != '0';
+    }
+    p++;
+  }
+  if (p < end && *p == '.') {
+    p++;
+    while (p < end && *p >= '0' && *p <= '9') {
+      any_digit = 1;
+      if (digits < 19) {
+        mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+        digits += mantissa != 0;
+        exponent--;
+      } else {
+        truncated |= *p != '0';
+      }
+      p++;
+    }
+  }
+  if (!any_digit) {
+    return 0;
+  }
+
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char *exponent_start = p;
+    p++;
+    int exponent_negative = 0;
+    if (p < end && (*p == '-' || *p == '+')) {
+      exponent_negative = *p == '-';
+      p++;
+    }
+    if (p < end && *p >= '0' && *p <= '9') {
+      int explicit_exponent = 0;
+      while (p < end && *p >= '0' && *p <= '9') {
+        if (explicit_exponent < 100000) {
+          explicit_exponent = explicit_exponent * 10 + (*p - '0');
+        }
+        p++;
+      }
+      exponent += exponent_negative ? -explicit_exponent : explicit_exponent;
+    } else {
+      p = exponent_start; // "1e" is the number 1 followed by an 'e'
+    }
+  }
+  *stop = p;
+
+  if (!truncated && decimal_to_double(mantissa, exponent, value)) {
+    if (negative) {
+      *value = -*value;
+    }
+    return 1;
+  }
+
+  // Slow path: strtod needs a terminated string. The program never calls
+  // setlocale, so strtod uses the "C" locale with '.' as decimal separator.
+  char buffer[512];
+  size_t length = (size_t)(p - number_start);
+  if (length >= sizeof(buffer)) {
+    return 0;
+  }
+  memcpy(buffer, number_start, length);
+  buffer[length] = '\0';
+  *value = strtod(buffer, NULL);
+  // "1e999" overflows to inf, which would spread through every result
+  return isfinite(*value);
+}
+
+void csv_parser_init(CsvParser *parser, const char *data, size_t size) {
+  parser->cursor = data;
+  parser->end = data + size;
+  parser->line_number = 0;
+  parser->malformed_rows = 0;
+  parser->quiet = 0;
+}
+
+/**
+ * @brief Returns the next line of the input without copying it.
+ *
+ * @param parser The parser state.
+ * @param line Receives a pointer to the first character of the line.
+ * @param length Receives the length of the line without the line break
+ * ("\n" or "\r\n").
+ * @return 1 if a line was returned, 0 at the end of the input.
+ */
+int csv_next_line(CsvParser *parser, const char **line, size_t *length) {
+  if (parser->cursor >= parser->end) {
+    return 0;
+  }
+
+  const char *begin = parser->cursor;
+  const char *newline = memchr(begin, '\n', (size_t)(parser->end - begin));
+  const char *line_end = newline ? newline : parser->end;
+  parser->cursor = newline ? newline + 1 : parser->end;
+  parser->line_number++;
+
+  if (line_end > begin && line_end[-1] == '\r') {
+    line_end--;
+  }
+  *line = begin;
+  *length = (size_t)(line_end - begin);
+  return 1;
+}
+
+/**
+ * @brief Parses a line consisting of exactly `num_fields` comma separated
+ * numbers.
+ *
+ * @return 1 if the line is well formed, 0 otherwise.
+ */
+int csv_parse_fields(const char *line, size_t length, double fields[],
+                     int num_fields) {
+  const char *p = line;
+  const char *end = line + length;
+
+  for (int i = 0; i < num_fields; i++) {
+    if (!parse_double(p, end, &p, &fields[i])) {
+      return 0;
+    }
+    while (p < end && (*p == ' ' || *p == '\t')) {
+      p++;
+    }
+    if (i < num_fields - 1) {
+      if (p >= end || *p != ',') {
+        return 0;
+      }
+      p++;
+    }
+  }
+  return p == end;
+}
+
+/**
+ * @brief Parses the next row of spaceship data (acceleration, rotation,
+ * temperature).
+ *
+ * Blank lines are skipped. Malformed rows are reported with their line number
+ * and skipped as well, instead of feeding undefined values into the
+ * integration.
+ *
+ * @param parser The parser state.
+ * @param fields Receives acceleration, rotation and temperature.
+ * @return 1 if a row was read, 0 at the end of the input.
+ */
+int csv_read_row(CsvParser *parser, double fields[3]) {
+  const char *line;
+  size_t length;
+  while (csv_next_line(parser, &line, &length)) {
+    if (csv_parse_fields(line, length, fields, 3)) {
+      return 1;
+    }
+
+    // Whitespace only lines (e.g. at the end of the file) are not an error
+    size_t i = 0;
+    while (i < length && (line[i] == ' ' || line[i] == '\t')) {
+      i++;
+    }
+    if (i < length) {
+      parser->malformed_rows++;
+      if (!parser->quiet) {
+        printf("Warning: Skipping malformed row in line %zu: \"%.*s\"\n",
+               parser->line_number, length > 60 ? 60 : (int)length, line);
+      }
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Parses the next rows of spaceship data into a chunk, see
+ * csv_read_row().
+ *
+ * @param parser The parser state.
+ * @param chunk Chunk that receives up to CHUNK_SIZE rows.
+ * @return The number of rows read, 0 once the end of the input is reached.
+ */
+size_t csv_read_chunk(CsvParser *parser, TelemetryChunk *chunk) {
+  double fields[3];
+  chunk->length = 0;
+  while (chunk->length < CHUNK_SIZE && csv_read_row(parser, fields)) {
+    chunk->acceleration[chunk->length] = fields[0];
+    chunk->rotation[chunk->length] = fields[1];
+    chunk->temperature[chunk->length] = fields[2];
+    chunk->length++;
+  }
+  return chunk->length;
+}
@@ -0,0 +1,26 @@
+#ifndef CSV_PARSER_H
+#define CSV_PARSER_H
+
+#include "mapped_file.h"
+#include "trajectory.h"
+#include <stddef.h>
+
+typedef struct CsvParser {
+  const char *cursor;
+  const char *end;
+  size_t line_number; // Line number of the last line returned
+  size_t malformed_rows;
+  int quiet; // Count malformed rows without printing a warning
+} CsvParser;
+
+int parse_double(const char *begin, const char *end, const char **stop,
+                 double *value);
+
+void csv_parser_init(CsvParser *parser, const char *data, size_t size);
+int csv_next_line(CsvParser *parser, const char **line, size_t *length);
+int csv_parse_fields(const char *line, size_t length, double fields[],
+                     int num_fields);
+int csv_read_row(CsvParser *parser, double fields[3]);
+size_t csv_read_chunk(CsvParser *parser, TelemetryChunk *chunk);
+
+#endif // CSV_PARSER_H
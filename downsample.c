@@ -0,0 +1,172 @@
+/**
+ * Selecting a limited number of representative time steps of a long flight,
+ * e.g. for the plots and tables of the LaTeX report.
+ *
+ * Both functions write the selected indices in increasing order to
+ * `indices`, which must have room for min(n, max_points) entries, and return
+ * their number. The first and the last time step are always selected. With
+ * max_points = 0 or at least n every time step is selected.
+ */
+
+#include "downsample.h"
+#include <math.h>
+#include <stdlib.h>
+
+static size_t select_all(size_t n, size_t *indices) {
+  for (size_t i = 0; i < n; i++) {
+    indices[i] = i;
+  }
+  return n;
+}
+
+// Index of the first point of an LTTB bucket, the first point is bucket -1
+static size_t bucket_start(double bucket_size, size_t bucket) {
+  return (size_t)(bucket * bucket_size) + 1;
+}
+
+/**
+ * @brief Largest-Triangle-Three-Buckets: splits the series (x = time step)
+ * into max_points - 2 buckets between the first and the last point and takes
+ * the point of every bucket that spans the largest triangle with the point
+ * selected before and the average of the next bucket. Peaks survive, unlike
+ * with every n-th point.
+ *
+ * The series is read in blocks of `block_size` values, twice: the first pass
+ * averages the buckets, the second selects the points. So a series that is
+ * decoded block by block never has to be in memory as a whole.
+ *
+ * @param read Returns `count` values from index `first` on, `first` is a
+ * multiple of `block_size`.
+ * @param n Number of values.
+ * @param max_points Number of points to select, at least 3 (or 0).
+ * @param indices Receives the indices of the selected values.
+ * @return The number of selected values, 0 if the memory ran out.
+ */
+size_t downsample_lttb_blocks(SeriesReader read, void *context, size_t n,
+                              size_t block_size, size_t max_points,
+                              size_t *indices) {
+  if (max_points == 0 || max_points >= n || max_points < 3) {
+    return select_all(n, indices);
+  }
+  size_t num_buckets = max_points - 2;
+  double bucket_size = (double)(n - 2) / num_buckets;
+  double *average_x = malloc(2 * num_buckets * sizeof(*average_x));
+  if (!average_x) {
+    return 0;
+  }
+  double *average_y = average_x + num_buckets;
+
+  // Average of the range after every bucket: the next bucket, or the last
+  // point for the last bucket. The ranges follow each other.
+  size_t bucket = 0;
+  size_t begin = bucket_start(bucket_size, 1);
+  size_t end = bucket_start(bucket_size, 2);
+  double sum_x = 0, sum_y = 0;
+  for (size_t first = 0; bucket < num_buckets && first < n;
+       first += block_size) {
+    size_t count = n - first < block_size ? n - first : block_size;
+    const double *values = read(context, first, count);
+    for (size_t i = first; i < first + count; i++) {
+      while (bucket < num_buckets && i >= (end < n ? end : n)) {
+        average_x[bucket] = sum_x / ((end < n ? end : n) - begin);
+        average_y[bucket] = sum_y / ((end < n ? end : n) - begin);
+        sum_x = sum_y = 0;
+        bucket++;
+        begin = end;
+        end = bucket_start(bucket_size, bucket + 2);
+      }
+      if (bucket < num_buckets && i >= begin) {
+        sum_x += i;
+        sum_y += values[i - first];
+      }
+    }
+  }
+  for (; bucket < num_buckets; bucket++) {
+    average_x[bucket] = sum_x / ((end < n ? end : n) - begin);
+    average_y[bucket] = sum_y / ((end < n ? end : n) - begin);
+    sum_x = sum_y = 0;
+    begin = end;
+    end = bucket_start(bucket_size, bucket + 2);
+  }
+
+  // Selection, bucket by bucket
+  size_t selected = 0; // Point selected in the previous bucket
+  double selected_y = 0, previous_y = 0, max_area = -1;
+  size_t count = 0;
+  indices[count++] = 0;
+  bucket = 0;
+  end = bucket_start(bucket_size, 1);
+  for (size_t first = 0; bucket < num_buckets && first < n;
+       first += block_size) {
+    size_t block_length = n - first < block_size ? n - first : block_size;
+    const double *values = read(context, first, block_length);
+    for (size_t i = first; i < first + block_length; i++) {
+      double value = values[i - first];
+      while (bucket < num_buckets && i >= end) {
+        indices[count++] = selected;
+        previous_y = selected_y;
+        max_area = -1;
+        bucket++;
+        end = bucket_start(bucket_size, bucket + 1);
+      }
+      if (bucket == num_buckets) {
+        break;
+      }
+      if (i == 0) {
+        selected_y = previous_y = value;
+        continue;
+      }
+      // Twice the triangle area
+      double previous_x = indices[count - 1];
+      double area =
+          fabs((previous_x - average_x[bucket]) * (value - previous_y) -
+               (previous_x - i) * (average_y[bucket] - previous_y));
+      if (area > max_area) {
+        max_area = area;
+        selected = i;
+        selected_y = value;
+      }
+    }
+  }
+  for (; bucket < num_buckets; bucket++) {
+    indices[count++] = selected;
+  }
+  indices[count++] = n - 1;
+  free(average_x);
+  return count;
+}
+
+static const double *read_array(void *context, size_t first, size_t count) {
+  (void)count;
+  return (const double *)context + first;
+}
+
+/**
+ * @brief LTTB of a series in memory, see downsample_lttb_blocks().
+ *
+ * @param values The series, e.g. the temperatures.
+ * @return The number of selected values, 0 if the memory ran out.
+ */
+size_t downsample_lttb(const double *values, size_t n, size_t max_points,
+                       size_t *indices) {
+  return downsample_lttb_blocks(read_array, (void *)values, n,
+                                n > 0 ? n : 1, max_points, indices);
+}
+
+/**
+ * @brief Selects evenly spaced time steps, e.g. for tables where every row
+ * should stand for the same time span.
+ *
+ * @return The number of selected time steps.
+ */
+size_t downsample_uniform(size_t n, size_t max_points, size_t *indices) {
+  if (max_points == 0 || max_points >= n || max_points < 2) {
+    return select_all(n, indices);
+  }
+  double step = (double)(n - 1) / (max_points - 1);
+  for (size_t i = 0; i < max_points; i++) {
+    indices[i] = (size_t)llround(i * step);
+  }
+  indices[max_points - 1] = n - 1;
+  return max_points;
+}
@@ -0,0 +1,18 @@
+#ifndef DOWNSAMPLE_H
+#define DOWNSAMPLE_H
+
+#include <stddef.h>
+
+// Returns `count` values of a series from index `first` on, valid until the
+// next call
+typedef const double *(*SeriesReader)(void *context, size_t first,
+                                      size_t count);
+
+size_t downsample_lttb_blocks(SeriesReader read, void *context, size_t n,
+                              size_t block_size, size_t max_points,
+                              size_t *indices);
+size_t downsample_lttb(const double *values, size_t n, size_t max_points,
+                       size_t *indices);
+size_t downsample_uniform(size_t n, size_t max_points, size_t *indices);
+
+#endif // DOWNSAMPLE_H
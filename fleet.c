@@ -0,0 +1,195 @@
+/**
+ * Fleet analysis: many flights integrated in lockstep.
+ *
+ * The ships are the columns and the time steps the rows of every array
+ * (step t of ship s at index t * num_lanes + s), so one time step of all
+ * ships is a contiguous run that batch_ships_step() processes with one SIMD
+ * lane per ship. Blocks of fleet_block_steps() time steps are parsed from
+ * every file, then the sines and cosines of the whole block are computed at
+ * once.
+ * Ships whose flight has ended keep running with inactive (zero) steps until
+ * the longest flight is done, so the kernel needs no branches.
+ */
+
+#include "fleet.h"
+#include "csv_parser.h"
+#include "flight.h"
+#include "simd_kernels.h"
+#include <math.h>
+#include <stdlib.h>
+
+// Columns of the ShipLanes, one value per lane
+#define FLEET_LANE_COLUMNS 12
+
+// Columns of a block, block steps * num_lanes values each
+typedef struct FleetBlock {
+  double *acceleration;
+  double *rotation;
+  double *temperature;
+  double *active;
+  double *sine;
+  double *cosine;
+} FleetBlock;
+
+// Ships rounded up to whole SIMD vectors
+size_t fleet_num_lanes(size_t num_ships) {
+  return (num_ships + FLEET_LANE_MULTIPLE - 1) / FLEET_LANE_MULTIPLE *
+         FLEET_LANE_MULTIPLE;
+}
+
+// Time steps per block, at least one
+size_t fleet_block_steps(size_t num_lanes) {
+  return num_lanes < FLEET_BLOCK_VALUES ? FLEET_BLOCK_VALUES / num_lanes : 1;
+}
+
+static void lanes_init(ShipLanes *ships, double *memory, size_t num_lanes) {
+  double **columns[FLEET_LANE_COLUMNS] = {
+      &ships->velocity_x,        &ships->velocity_y,
+      &ships->x,                 &ships->y,
+      &ships->max_speed,         &ships->max_distance,
+      &ships->total_distance,    &ships->temperature_count,
+      &ships->temperature_mean,  &ships->temperature_m2,
+      &ships->min_temperature,   &ships->max_temperature};
+  for (int i = 0; i < FLEET_LANE_COLUMNS; i++) {
+    *columns[i] = memory + i * num_lanes;
+  }
+  for (size_t i = 0; i < FLEET_LANE_COLUMNS * num_lanes; i++) {
+    memory[i] = 0;
+  }
+  for (size_t i = 0; i < num_lanes; i++) {
+    ships->min_temperature[i] = INFINITY;
+    ships->max_temperature[i] = -INFINITY;
+  }
+}
+
+/**
+ * @brief Parses the next block of every ship into the step-major columns.
+ * The rotation column receives the accumulated rotation, as rotate() would.
+ *
+ * @param rotation The rotation of every ship, carried over between blocks.
+ * @param last_temperature The latest temperature of every ship, used for the
+ * inactive steps.
+ * @return The number of time steps in the block in which at least one ship
+ * is active.
+ */
+static size_t parse_block(CsvParser *parsers, size_t num_ships,
+                          size_t num_lanes, size_t block_steps,
+                          double *rotation, double *last_temperature,
+                          ShipResult *results, FleetBlock *block) {
+  size_t num_steps = 0;
+  for (size_t s = 0; s < num_lanes; s++) {
+    for (size_t t = 0; t < block_steps; t++) {
+      size_t i = t * num_lanes + s;
+      double fields[3];
+      if (s < num_ships && csv_read_row(&parsers[s], fields)) {
+        rotate(fields[1], rotation[s], &rotation[s]);
+        last_temperature[s] = fields[2];
+        block->acceleration[i] = fields[0];
+        block->active[i] = 1;
+        results[s].time_steps++;
+        num_steps = t + 1 > num_steps ? t + 1 : num_steps;
+      } else {
+        block->acceleration[i] = 0;
+        block->active[i] = 0;
+      }
+      block->rotation[i] = rotation[s];
+      block->temperature[i] = last_temperature[s];
+    }
+  }
+  return num_steps;
+}
+
+/**
+ * @brief Analyzes the flights of many ships at once with the default
+ * integrator: every time step is computed for all ships together, one SIMD
+ * lane per ship.
+ *
+ * With the scalar backend the metrics of every ship are identical to those
+ * of a separate analysis of its file. Temperature percentiles are not
+ * computed.
+ *
+ * @param inputs The CSV files, one per ship.
+ * @param heatmap Receives the positions and temperatures of all ships, or
+ * NULL. Must be initialized.
+ * @param results Receives the metrics of every ship.
+ * @return 1 on success, 0 if the memory ran out.
+ */
+int fleet_analyze(const MappedFile *inputs, size_t num_ships, Heatmap *heatmap,
+                  ShipResult *results) {
+  size_t num_lanes = fleet_num_lanes(num_ships);
+  size_t block_steps = fleet_block_steps(num_lanes);
+  size_t block_size = block_steps * num_lanes;
+  CsvParser *parsers = malloc(num_ships * sizeof(*parsers));
+  double *lane_memory = malloc((FLEET_LANE_COLUMNS + 2) * num_lanes *
+                               sizeof(double));
+  double *block_memory = malloc(6 * block_size * sizeof(double));
+  if (!parsers || !lane_memory || !block_memory) {
+    free(parsers);
+    free(lane_memory);
+    free(block_memory);
+    return 0;
+  }
+
+  ShipLanes ships;
+  lanes_init(&ships, lane_memory, num_lanes);
+  double *rotation = lane_memory + FLEET_LANE_COLUMNS * num_lanes;
+  double *last_temperature = rotation + num_lanes;
+  for (size_t s = 0; s < num_lanes; s++) {
+    rotation[s] = 0;
+    last_temperature[s] = 0;
+  }
+  FleetBlock block = {block_memory,
+                      block_memory + block_size,
+                      block_memory + 2 * block_size,
+                      block_memory + 3 * block_size,
+                      block_memory + 4 * block_size,
+                      block_memory + 5 * block_size};
+  for (size_t s = 0; s < num_ships; s++) {
+    csv_parser_init(&parsers[s], inputs[s].data, inputs[s].size);
+    results[s].time_steps = 0;
+  }
+
+  int success = 1;
+  size_t num_steps;
+  while (success &&
+         (num_steps = parse_block(parsers, num_ships, num_lanes, block_steps,
+                                  rotation, last_temperature, results,
+                                  &block)) > 0) {
+    batch_sincos(block.rotation, block.sine, block.cosine,
+                 num_steps * num_lanes);
+    for (size_t t = 0; t < num_steps; t++) {
+      size_t offset = t * num_lanes;
+      batch_ships_step(&ships, block.acceleration + offset,
+                       block.sine + offset, block.cosine + offset,
+                       block.temperature + offset, block.active + offset,
+                       num_lanes);
+      for (size_t s = 0; heatmap && s < num_ships; s++) {
+        if (block.active[offset + s] &&
+            !heatmap_add(heatmap, ships.x[s], ships.y[s],
+                         block.temperature[offset + s])) {
+          success = 0;
+        }
+      }
+    }
+  }
+
+  for (size_t s = 0; s < num_ships; s++) {
+    ShipResult *result = &results[s];
+    result->malformed_rows = parsers[s].malformed_rows;
+    result->max_speed = ships.max_speed[s];
+    result->max_distance = ships.max_distance[s];
+    result->total_distance = ships.total_distance[s];
+    running_stats_init(&result->temperature_stats);
+    if (result->time_steps > 0) {
+      result->temperature_stats.count = result->time_steps;
+      result->temperature_stats.mean = ships.temperature_mean[s];
+      result->temperature_stats.m2 = ships.temperature_m2[s];
+      result->temperature_stats.min = ships.min_temperature[s];
+      result->temperature_stats.max = ships.max_temperature[s];
+    }
+  }
+  free(parsers);
+  free(lane_memory);
+  free(block_memory);
+  return success;
+}
@@ -0,0 +1,29 @@
+#ifndef FLEET_H
+#define FLEET_H
+
+#include "heatmap.h"
+#include "mapped_file.h"
+#include "statistics.h"
+#include <stddef.h>
+
+// Values per column of a block (time steps times lanes), so that the six
+// columns of a block stay in the L2 cache
+#define FLEET_BLOCK_VALUES 8192
+#define FLEET_LANE_MULTIPLE 4 // Ships are padded to full AVX2 vectors
+
+// Metrics of one ship of a fleet
+typedef struct ShipResult {
+  size_t time_steps;
+  size_t malformed_rows;
+  double max_speed;
+  double max_distance; // From the start
+  double total_distance;
+  RunningStats temperature_stats;
+} ShipResult;
+
+size_t fleet_num_lanes(size_t num_ships);
+size_t fleet_block_steps(size_t num_lanes);
+int fleet_analyze(const MappedFile *inputs, size_t num_ships, Heatmap *heatmap,
+                  ShipResult *results);
+
+#endif // FLEET_H
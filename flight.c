@@ -0,0 +1,237 @@
+#include "flight.h"
+#include "integrator.h"
+#include "profiler.h"
+#include "simd_kernels.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @brief Computes the distance between two points using the pythagorean
+ * theorem.
+ *
+ * @param pos1 The starting position as a 2D Vector.
+ * @param pos2 The ending position as a 2D Vector.
+ * @param dst Pointer to a double where the computed distance will be stored.
+ */
+void calculate_distance(Vec2D pos1, Vec2D pos2, double *dst) {
+  *dst = sqrt(pow(pos2.x - pos1.x, 2) + pow(pos2.y - pos1.y, 2));
+}
+
+double calculate_speed(Vec2D current_velocity) {
+  return sqrt(current_velocity.x * current_velocity.x +
+              current_velocity.y * current_velocity.y);
+}
+
+void rotate(double change_in_rotation, double current_rotation,
+            double *new_rotation) {
+  *new_rotation = current_rotation + change_in_rotation;
+}
+
+/**
+ * @brief Calculates the new velocity depending on the spaceships orientation
+ *
+ * @param current_velocity The current velocity of the spaceship as a 2D Vector.
+ * @param acceleration The acceleration to apply to the spaceship.
+ * @param rotation The current rotation of the spaceship in radians.
+ * @param new_velocity Pointer to a 2D Vector where the new velocity will be
+ * saved.
+ */
+void accelerate(Vec2D current_velocity, double acceleration, double rotation,
+                Vec2D *new_velocity) {
+  new_velocity->x = current_velocity.x + (cos(rotation) * acceleration);
+  new_velocity->y = current_velocity.y + (sin(rotation) * acceleration);
+}
+
+/**
+ * @brief Resets the integrator to the start position (origin, at rest) and
+ * clears all metrics.
+ */
+void flight_state_init(FlightState *state) {
+  state->current_position.x = 0;
+  state->current_position.y = 0;
+  state->current_velocity.x = 0;
+  state->current_velocity.y = 0;
+  state->current_rotation = 0;
+  state->max_speed = 0;
+  state->max_distance = 0;
+  state->total_distance = 0;
+  running_stats_init(&state->temperature_stats);
+  tdigest_init(&state->temperature_digest);
+  state->integrator = NULL;
+}
+
+/**
+ * @brief The default integrator (one semi-implicit Euler step per row) in
+ * phases over whole columns: the rotation, velocity and position prefix sums
+ * are plain loops, the trigonometry is computed by the batch kernels.
+ *
+ * With the fast heading the direction of every step is turned from the
+ * previous one instead of taking sin and cos of the accumulated rotation. It
+ * starts from the rotation at the beginning of the chunk, so the rounding
+ * errors of the rotations don't add up over more than one chunk.
+ */
+static void integrate_default(int fast_heading, FlightState *state,
+                              const TelemetryChunk *chunk,
+                              ChunkKinematics *k) {
+  size_t n = chunk->length;
+  double rotation = state->current_rotation;
+  for (size_t i = 0; i < n; i++) {
+    rotate(chunk->rotation[i], rotation, &rotation);
+    k->rotation[i] = rotation;
+  }
+  if (fast_heading) {
+    batch_heading(chunk->rotation, state->current_rotation, k->sine,
+                  k->cosine, n);
+  } else {
+    batch_sincos(k->rotation, k->sine, k->cosine, n);
+  }
+
+  Vec2D velocity = state->current_velocity;
+  Vec2D position = state->current_position;
+  for (size_t i = 0; i < n; i++) {
+    velocity.x += k->cosine[i] * chunk->acceleration[i];
+    velocity.y += k->sine[i] * chunk->acceleration[i];
+    position.x += velocity.x;
+    position.y += velocity.y;
+    k->velocity_x[i] = velocity.x;
+    k->velocity_y[i] = velocity.y;
+    k->x[i] = position.x;
+    k->y[i] = position.y;
+  }
+
+  state->current_rotation = rotation;
+  state->current_velocity = velocity;
+  // current_position is still needed by integrate_chunk()
+}
+
+/**
+ * @brief Any other integrator, row by row with integrate_step().
+ */
+static void integrate_rows(const Integrator *integrator, FlightState *state,
+                           const TelemetryChunk *chunk, ChunkKinematics *k) {
+  IntegratorState step = {state->current_rotation, state->current_velocity,
+                          state->current_position};
+  for (size_t i = 0; i < chunk->length; i++) {
+    integrate_step(integrator, &step, chunk->acceleration[i],
+                   chunk->rotation[i]);
+    k->rotation[i] = step.rotation;
+    k->velocity_x[i] = step.velocity.x;
+    k->velocity_y[i] = step.velocity.y;
+    k->x[i] = step.position.x;
+    k->y[i] = step.position.y;
+  }
+  state->current_rotation = step.rotation;
+  state->current_velocity = step.velocity;
+}
+
+/**
+ * @brief Integrates all time steps of a chunk with the integrator of the
+ * state, or the one selected by integrator_set(), and updates max speed, max
+ * distance and total distance.
+ *
+ * The vector lengths are computed by the batch kernels. With the default
+ * integrator and the scalar backend the results are identical to calling
+ * rotate() and accelerate() for every step and moving by the new velocity.
+ *
+ * @param state Integrator state and metrics, carried over from the previous
+ * chunk.
+ * @param chunk The rows to process.
+ * @param kinematics Receives rotation, velocity and position of every step,
+ * and the length of the path segment of every step in `lengths`.
+ */
+void integrate_chunk(FlightState *state, const TelemetryChunk *chunk,
+                     ChunkKinematics *kinematics) {
+  size_t n = chunk->length;
+  ChunkKinematics *k = kinematics;
+
+  const Integrator *integrator =
+      state->integrator ? state->integrator : integrator_get();
+  if (integrator_is_default(integrator)) {
+    integrate_default(integrator->fast_heading, state, chunk, k);
+  } else {
+    integrate_rows(integrator, state, chunk, k);
+  }
+
+  batch_length(k->velocity_x, k->velocity_y, k->lengths, n);
+  for (size_t i = 0; i < n; i++) {
+    if (k->lengths[i] > state->max_speed) {
+      state->max_speed = k->lengths[i];
+    }
+  }
+
+  // Distance to the start position (origin)
+  batch_length(k->x, k->y, k->lengths, n);
+  for (size_t i = 0; i < n; i++) {
+    if (k->lengths[i] > state->max_distance) {
+      state->max_distance = k->lengths[i];
+    }
+  }
+
+  batch_segment_lengths(k->x, k->y, state->current_position.x,
+                        state->current_position.y, k->lengths, n);
+  for (size_t i = 0; i < n; i++) {
+    state->total_distance += k->lengths[i];
+  }
+
+  if (n > 0) {
+    state->current_position.x = k->x[n - 1];
+    state->current_position.y = k->y[n - 1];
+  }
+}
+
+/**
+ * @brief Copies the integrated time steps of a chunk into the trajectory
+ * columns, starting at time step `offset`. The trajectory must already be
+ * long enough.
+ */
+void store_chunk(Trajectory *trajectory, size_t offset,
+                 const TelemetryChunk *chunk,
+                 const ChunkKinematics *kinematics) {
+  size_t bytes = chunk->length * sizeof(double);
+  memcpy(trajectory->x + offset, kinematics->x, bytes);
+  memcpy(trajectory->y + offset, kinematics->y, bytes);
+  memcpy(trajectory->rotation + offset, kinematics->rotation, bytes);
+  memcpy(trajectory->velocity_x + offset, kinematics->velocity_x, bytes);
+  memcpy(trajectory->velocity_y + offset, kinematics->velocity_y, bytes);
+  memcpy(trajectory->temperature + offset, chunk->temperature, bytes);
+}
+
+/**
+ * @brief Integrates all time steps of a chunk and updates the flight metrics.
+ *
+ * @param state Integrator state and metrics, carried over from the previous
+ * chunk.
+ * @param chunk The rows to process.
+ * @param kinematics Scratch space for the per-step quantities.
+ * @param trajectory Receives the state after every time step, NULL to only
+ * update the metrics.
+ * @return 1 on success, 0 if the trajectory could not grow.
+ */
+int process_chunk(FlightState *state, const TelemetryChunk *chunk,
+                  ChunkKinematics *kinematics, Trajectory *trajectory) {
+  PROFILE_BEGIN(integrate_scope, PROFILE_INTEGRATE);
+  integrate_chunk(state, chunk, kinematics);
+  PROFILE_END(integrate_scope, chunk->length, 0, 0);
+
+  PROFILE_BEGIN(stats_scope, PROFILE_STATS);
+  for (size_t i = 0; i < chunk->length; i++) {
+    running_stats_add(&state->temperature_stats, chunk->temperature[i]);
+    tdigest_add(&state->temperature_digest, chunk->temperature[i]);
+  }
+  PROFILE_END(stats_scope, chunk->length, 0, 0);
+  if (!trajectory) {
+    return 1;
+  }
+
+  PROFILE_BEGIN(store_scope, PROFILE_STORE);
+  size_t offset = trajectory->length;
+  if (!trajectory_resize(trajectory, offset + chunk->length)) {
+    PROFILE_END(store_scope, 0, 0, 0);
+    return 0;
+  }
+  store_chunk(trajectory, offset, chunk, kinematics);
+  PROFILE_END(store_scope, chunk->length, 0,
+              chunk->length * TRAJECTORY_NUM_COLUMNS * sizeof(double));
+  return 1;
+}
@@ -0,0 +1,50 @@
+#ifndef FLIGHT_H
+#define FLIGHT_H
+
+#include "integrator.h"
+#include "statistics.h"
+#include "trajectory.h"
+
+typedef struct FlightState {
+  Vec2D current_position;
+  Vec2D current_velocity;
+  double current_rotation;
+  double max_speed;
+  double max_distance;
+  double total_distance;
+  RunningStats temperature_stats;
+  TDigest temperature_digest; // Temperature percentiles
+  // Integrator of this flight, NULL for the one selected by integrator_set()
+  const Integrator *integrator;
+} FlightState;
+
+// Per-step quantities of one chunk, stored column by column for the batch
+// kernels
+typedef struct ChunkKinematics {
+  double rotation[CHUNK_SIZE];
+  double sine[CHUNK_SIZE];
+  double cosine[CHUNK_SIZE];
+  double velocity_x[CHUNK_SIZE];
+  double velocity_y[CHUNK_SIZE];
+  double x[CHUNK_SIZE];
+  double y[CHUNK_SIZE];
+  double lengths[CHUNK_SIZE]; // Speeds, distances or segment lengths
+} ChunkKinematics;
+
+void calculate_distance(Vec2D pos1, Vec2D pos2, double *dst);
+double calculate_speed(Vec2D current_velocity);
+void rotate(double change_in_rotation, double current_rotation,
+            double *new_rotation);
+void accelerate(Vec2D current_velocity, double acceleration, double rotation,
+                Vec2D *new_velocity);
+
+void flight_state_init(FlightState *state);
+void integrate_chunk(FlightState *state, const TelemetryChunk *chunk,
+                     ChunkKinematics *kinematics);
+void store_chunk(Trajectory *trajectory, size_t offset,
+                 const TelemetryChunk *chunk,
+                 const ChunkKinematics *kinematics);
+int process_chunk(FlightState *state, const TelemetryChunk *chunk,
+                  ChunkKinematics *kinematics, Trajectory *trajectory);
+
+#endif // FLIGHT_H
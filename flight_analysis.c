@@ -0,0 +1,414 @@
+/**
+ * Flight analysis as a library: the caller pushes rows (parsed or as CSV
+ * text, split anywhere) and gets the metrics, the trajectory and the SVG and
+ * LaTeX outputs back through sinks, without any file I/O.
+ *
+ * All state lives in the FlightAnalysis, so analyses on different threads
+ * don't share anything but read-only tables. The rows are integrated in
+ * chunks of CHUNK_SIZE like the serial analysis of the program, so both give
+ * bit-identical results.
+ */
+
+#include "flight_analysis.h"
+#include "csv_parser.h"
+#include "latex_report.h"
+#include "profiler.h"
+#include "svg_writer.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct FlightAnalysis {
+  FlightAnalysisConfig config;
+  FlightState state;
+  Trajectory trajectory;
+  Heatmap heatmap;
+  int heatmap_streamed; // Filled while pushing instead of at the end
+  int heatmap_ready;
+  TelemetryChunk chunk; // Rows not integrated yet
+  ChunkKinematics kinematics;
+  char *pending; // Incomplete last line of the CSV text
+  size_t pending_length;
+  size_t pending_capacity;
+  size_t line_number; // CSV lines parsed so far
+  size_t malformed_rows;
+  size_t time_steps;
+  FlightStepsSink steps_sink;
+  void *steps_context;
+  int failed; // Out of memory or stopped by the sink
+  int finished;
+};
+
+/**
+ * @brief The defaults: keep the trajectory, a 25x25 heatmap with the bounds
+ * of the flight and the report limits of the program, no warnings.
+ */
+void flight_analysis_config_init(FlightAnalysisConfig *config) {
+  config->integrator = NULL;
+  config->keep_trajectory = 1;
+  config->heatmap_resolution = 25;
+  config->has_bounds = 0;
+  for (int i = 0; i < 4; i++) {
+    config->bounds[i] = 0.0;
+  }
+  config->svg_tolerance = SVG_DEFAULT_TOLERANCE;
+  config->report_points = REPORT_DEFAULT_MAX_POINTS;
+  config->warn_malformed_rows = 0;
+}
+
+/**
+ * @brief Starts the analysis of a flight.
+ *
+ * @return The analysis, NULL if the memory ran out or the heatmap resolution
+ * is out of range.
+ */
+FlightAnalysis *flight_analysis_create(const FlightAnalysisConfig *config) {
+  if (config->heatmap_resolution < 0 ||
+      config->heatmap_resolution > HEATMAP_MAX_RESOLUTION) {
+    return NULL;
+  }
+  FlightAnalysis *analysis = calloc(1, sizeof(*analysis));
+  if (!analysis) {
+    return NULL;
+  }
+  PROFILE_ALLOCATION(sizeof(*analysis));
+  analysis->config = *config;
+  flight_state_init(&analysis->state);
+  analysis->state.integrator = config->integrator;
+  trajectory_init(&analysis->trajectory);
+
+  // Without the trajectory the heatmap can't be built at the end. Fixed
+  // bounds give the same cells either way.
+  analysis->heatmap_streamed =
+      config->heatmap_resolution > 0 &&
+      (config->has_bounds || !config->keep_trajectory);
+  if (analysis->heatmap_streamed && config->has_bounds) {
+    heatmap_init(&analysis->heatmap, config->heatmap_resolution,
+                 config->bounds[0], config->bounds[1], config->bounds[2],
+                 config->bounds[3]);
+  } else if (analysis->heatmap_streamed) {
+    heatmap_init_auto(&analysis->heatmap, config->heatmap_resolution);
+  }
+  analysis->heatmap_ready = analysis->heatmap_streamed;
+  return analysis;
+}
+
+/**
+ * @brief Hands every integrated chunk of time steps to `sink`, e.g. to write
+ * the positions without keeping the trajectory.
+ */
+void flight_analysis_set_steps_sink(FlightAnalysis *analysis,
+                                    FlightStepsSink sink, void *context) {
+  analysis->steps_sink = sink;
+  analysis->steps_context = context;
+}
+
+// Integrates the rows of the chunk and feeds the steps to the heatmap and the
+// sink
+static int analyze_chunk(FlightAnalysis *analysis) {
+  TelemetryChunk *chunk = &analysis->chunk;
+  const ChunkKinematics *k = &analysis->kinematics;
+  int success = process_chunk(
+      &analysis->state, chunk, &analysis->kinematics,
+      analysis->config.keep_trajectory ? &analysis->trajectory : NULL);
+  if (success && analysis->heatmap_streamed) {
+    for (size_t i = 0; i < chunk->length && success; i++) {
+      success = heatmap_add(&analysis->heatmap, k->x[i], k->y[i],
+                            chunk->temperature[i]);
+    }
+    analysis->heatmap_ready = success;
+  }
+  if (success && analysis->steps_sink) {
+    FlightSteps steps = {analysis->time_steps, chunk->length, k->x, k->y,
+                         k->rotation, k->velocity_x, k->velocity_y,
+                         chunk->temperature};
+    success = analysis->steps_sink(analysis->steps_context, &steps);
+  }
+  analysis->time_steps += chunk->length;
+  chunk->length = 0;
+  analysis->failed = !success;
+  return success;
+}
+
+/**
+ * @brief Adds rows of spaceship data, given column by column.
+ *
+ * @return 1 on success, 0 if the memory ran out, the sink stopped the
+ * analysis or it is already finished.
+ */
+int flight_analysis_push_rows(FlightAnalysis *analysis,
+                              const double *acceleration,
+                              const double *rotation,
+                              const double *temperature, size_t count) {
+  if (analysis->failed || analysis->finished) {
+    return 0;
+  }
+  TelemetryChunk *chunk = &analysis->chunk;
+  size_t i = 0;
+  while (i < count) {
+    size_t n = CHUNK_SIZE - chunk->length;
+    n = count - i < n ? count - i : n;
+    memcpy(chunk->acceleration + chunk->length, acceleration + i,
+           n * sizeof(double));
+    memcpy(chunk->rotation + chunk->length, rotation + i, n * sizeof(double));
+    memcpy(chunk->temperature + chunk->length, temperature + i,
+           n * sizeof(double));
+    chunk->length += n;
+    i += n;
+    if (chunk->length == CHUNK_SIZE && !analyze_chunk(analysis)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// Parses complete CSV lines into the chunk, see csv_read_row()
+static int parse_lines(FlightAnalysis *analysis, const char *text,
+                       size_t length) {
+  CsvParser parser;
+  csv_parser_init(&parser, text, length);
+  parser.line_number = analysis->line_number;
+  parser.quiet = !analysis->config.warn_malformed_rows;
+  TelemetryChunk *chunk = &analysis->chunk;
+  int success = 1;
+  while (success) {
+    PROFILE_BEGIN(parse_scope, PROFILE_PARSE);
+    const char *chunk_start = parser.cursor;
+    size_t rows = chunk->length;
+    double fields[3];
+    while (chunk->length < CHUNK_SIZE && csv_read_row(&parser, fields)) {
+      chunk->acceleration[chunk->length] = fields[0];
+      chunk->rotation[chunk->length] = fields[1];
+      chunk->temperature[chunk->length] = fields[2];
+      chunk->length++;
+    }
+    PROFILE_END(parse_scope, chunk->length - rows,
+                (uint64_t)(parser.cursor - chunk_start), 0);
+    (void)chunk_start; // Only used while profiling
+    (void)rows;
+    if (chunk->length < CHUNK_SIZE) {
+      break; // The rest is integrated once the chunk is full
+    }
+    success = analyze_chunk(analysis);
+  }
+  analysis->line_number = parser.line_number;
+  analysis->malformed_rows += parser.malformed_rows;
+  return success;
+}
+
+static int append_pending(FlightAnalysis *analysis, const char *data,
+                          size_t size) {
+  if (size == 0) {
+    return 1; // pending may still be NULL, memcpy must not see it
+  }
+  if (analysis->pending_capacity - analysis->pending_length < size) {
+    size_t capacity = analysis->pending_capacity > 0
+                          ? analysis->pending_capacity
+                          : 256;
+    while (capacity - analysis->pending_length < size) {
+      capacity *= 2;
+    }
+    char *pending = realloc(analysis->pending, capacity);
+    if (!pending) {
+      analysis->failed = 1;
+      return 0;
+    }
+    analysis->pending = pending;
+    analysis->pending_capacity = capacity;
+  }
+  memcpy(analysis->pending + analysis->pending_length, data, size);
+  analysis->pending_length += size;
+  return 1;
+}
+
+/**
+ * @brief Adds CSV text (acceleration, rotation, temperature per line). The
+ * text may end in the middle of a line, which is completed by the next call
+ * or by flight_analysis_finish(). Malformed rows are counted and skipped.
+ *
+ * @return 1 on success, 0 if the memory ran out, the sink stopped the
+ * analysis or it is already finished.
+ */
+int flight_analysis_push_csv(FlightAnalysis *analysis, const char *data,
+                             size_t size) {
+  if (analysis->failed || analysis->finished) {
+    return 0;
+  }
+  if (size == 0) {
+    return 1;
+  }
+  const char *end = data + size;
+  if (analysis->pending_length > 0) {
+    const char *newline = memchr(data, '\n', size);
+    size_t line_rest = newline ? (size_t)(newline + 1 - data) : size;
+    if (!append_pending(analysis, data, line_rest)) {
+      return 0;
+    }
+    if (!newline) {
+      return 1;
+    }
+    data += line_rest;
+    if (!parse_lines(analysis, analysis->pending, analysis->pending_length)) {
+      return 0;
+    }
+    analysis->pending_length = 0;
+  }
+
+  const char *complete = end;
+  while (complete > data && complete[-1] != '\n') {
+    complete--;
+  }
+  return parse_lines(analysis, data, (size_t)(complete - data)) &&
+         append_pending(analysis, complete, (size_t)(end - complete));
+}
+
+/**
+ * @brief Integrates the remaining rows and completes the heatmap. Nothing can
+ * be pushed afterwards.
+ *
+ * @param metrics Receives the metrics of the flight, also on failure.
+ * @return 1 on success, 0 if a push or the heatmap failed.
+ */
+int flight_analysis_finish(FlightAnalysis *analysis, FlightMetrics *metrics) {
+  int success = !analysis->failed && !analysis->finished;
+  if (success && analysis->pending_length > 0) {
+    // A last line without line break
+    success = parse_lines(analysis, analysis->pending,
+                          analysis->pending_length);
+    analysis->pending_length = 0;
+  }
+  if (success && analysis->chunk.length > 0) {
+    success = analyze_chunk(analysis);
+  }
+  if (success && analysis->config.heatmap_resolution > 0 &&
+      !analysis->heatmap_streamed) {
+    PROFILE_BEGIN(heatmap_scope, PROFILE_HEATMAP);
+    analysis->heatmap_ready = heatmap_from_trajectory(
+        &analysis->heatmap, &analysis->trajectory,
+        analysis->config.heatmap_resolution, NULL);
+    PROFILE_END(heatmap_scope, analysis->trajectory.length, 0, 0);
+    success = analysis->heatmap_ready;
+  }
+  analysis->finished = 1;
+
+  FlightState *state = &analysis->state;
+  metrics->time_steps = analysis->time_steps;
+  metrics->malformed_rows = analysis->malformed_rows;
+  metrics->max_speed = state->max_speed;
+  metrics->max_distance = state->max_distance;
+  metrics->total_distance = state->total_distance;
+  metrics->min_temperature = state->temperature_stats.min;
+  metrics->max_temperature = state->temperature_stats.max;
+  metrics->mean_temperature = state->temperature_stats.mean;
+  metrics->temperature_variance =
+      running_stats_variance(&state->temperature_stats);
+  metrics->temperature_median =
+      tdigest_quantile(&state->temperature_digest, 0.5);
+  metrics->temperature_p5 = tdigest_quantile(&state->temperature_digest, 0.05);
+  metrics->temperature_p95 =
+      tdigest_quantile(&state->temperature_digest, 0.95);
+  return success;
+}
+
+const FlightState *flight_analysis_state(const FlightAnalysis *analysis) {
+  return &analysis->state;
+}
+
+/**
+ * @brief The time steps pushed so far, empty unless the trajectory is kept.
+ */
+const Trajectory *flight_analysis_trajectory(const FlightAnalysis *analysis) {
+  return &analysis->trajectory;
+}
+
+/**
+ * @return The heatmap of the finished analysis, NULL if it has none.
+ */
+const Heatmap *flight_analysis_heatmap(const FlightAnalysis *analysis) {
+  return analysis->finished && analysis->heatmap_ready ? &analysis->heatmap
+                                                       : NULL;
+}
+
+/**
+ * @brief Moves the trajectory to the caller, who frees it with
+ * trajectory_free(). The analysis is left with an empty trajectory.
+ */
+void flight_analysis_take_trajectory(FlightAnalysis *analysis,
+                                     Trajectory *trajectory) {
+  *trajectory = analysis->trajectory;
+  trajectory_init(&analysis->trajectory);
+}
+
+/**
+ * @brief Writes the flight path as SVG, see write_trajectory_svg().
+ *
+ * @return 1 on success, 0 if the analysis isn't finished, the trajectory
+ * wasn't kept or the sink failed.
+ */
+int flight_analysis_write_line_svg(const FlightAnalysis *analysis,
+                                   OutputSink sink, void *context) {
+  OutputBuffer out;
+  if (!analysis->finished || !analysis->config.keep_trajectory ||
+      !output_buffer_open_sink(&out, sink, context)) {
+    return 0;
+  }
+  SvgStats stats;
+  return write_trajectory_svg(&out, &analysis->trajectory,
+                              analysis->state.max_distance,
+                              analysis->config.svg_tolerance, &stats);
+}
+
+/**
+ * @brief Writes the temperature map as SVG, see write_temperature_map_svg().
+ *
+ * @return 1 on success, 0 if there is no heatmap, the memory ran out or the
+ * sink failed.
+ */
+int flight_analysis_write_heatmap_svg(const FlightAnalysis *analysis,
+                                      OutputSink sink, void *context) {
+  const Heatmap *heatmap = flight_analysis_heatmap(analysis);
+  HeatmapPyramid pyramid;
+  if (!heatmap || !heatmap_build_pyramid(heatmap, 1, &pyramid)) {
+    return 0;
+  }
+  OutputBuffer out;
+  SvgStats stats;
+  int success =
+      output_buffer_open_sink(&out, sink, context) &&
+      write_temperature_map_svg(&out, &pyramid.levels[0], &stats);
+  heatmap_pyramid_free(&pyramid);
+  return success;
+}
+
+/**
+ * @brief Writes the LaTeX report, see write_latex_report(). It includes the
+ * SVG files line.svg and temperature_map.svg.
+ *
+ * @return 1 on success, 0 if the analysis isn't finished, the trajectory
+ * wasn't kept or the sink failed.
+ */
+int flight_analysis_write_report(const FlightAnalysis *analysis,
+                                 OutputSink sink, void *context) {
+  OutputBuffer out;
+  if (!analysis->finished || !analysis->config.keep_trajectory ||
+      !output_buffer_open_sink(&out, sink, context)) {
+    return 0;
+  }
+  const FlightState *state = &analysis->state;
+  return write_latex_report(
+      &out, &analysis->trajectory, analysis->config.heatmap_resolution,
+      analysis->config.report_points, 0, state->total_distance,
+      state->max_distance, state->temperature_stats.max,
+      state->temperature_stats.min, state->temperature_stats.mean,
+      running_stats_variance(&state->temperature_stats), state->max_speed);
+}
+
+void flight_analysis_destroy(FlightAnalysis *analysis) {
+  if (!analysis) {
+    return;
+  }
+  heatmap_free(&analysis->heatmap);
+  trajectory_free(&analysis->trajectory);
+  free(analysis->pending);
+  free(analysis);
+}
@@ -0,0 +1,80 @@
+#ifndef FLIGHT_ANALYSIS_H
+#define FLIGHT_ANALYSIS_H
+
+#include "flight.h"
+#include "heatmap.h"
+#include "integrator.h"
+#include "output_buffer.h"
+#include "trajectory.h"
+#include <stddef.h>
+
+typedef struct FlightAnalysisConfig {
+  const Integrator *integrator; // NULL: the one selected by integrator_set()
+  int keep_trajectory;    // Needed for the line SVG and the report
+  int heatmap_resolution; // 0: no heatmap
+  int has_bounds;         // Fixed heatmap bounds instead of the flight bounds
+  double bounds[4];       // min x, min y, max x, max y
+  double svg_tolerance;   // Path simplification of the line SVG
+  size_t report_points;   // Max. time steps in the report tables and plots
+  int warn_malformed_rows; // Print a warning for every malformed CSV row
+} FlightAnalysisConfig;
+
+typedef struct FlightMetrics {
+  size_t time_steps;
+  size_t malformed_rows;
+  double max_speed;
+  double max_distance; // From the start
+  double total_distance;
+  double min_temperature;
+  double max_temperature;
+  double mean_temperature;
+  double temperature_variance;
+  double temperature_median;
+  double temperature_p5;
+  double temperature_p95;
+} FlightMetrics;
+
+// Integrated time steps handed to the steps sink, valid during the call
+typedef struct FlightSteps {
+  size_t first_step; // Index of the first step in the whole flight
+  size_t length;
+  const double *x;
+  const double *y;
+  const double *rotation;
+  const double *velocity_x;
+  const double *velocity_y;
+  const double *temperature;
+} FlightSteps;
+
+// Returns 0 to stop the analysis, flight_analysis_push_*() then fail
+typedef int (*FlightStepsSink)(void *context, const FlightSteps *steps);
+
+// One flight analyzed from rows pushed by the caller. An analysis is used by
+// one thread at a time, separate analyses can run on any number of threads.
+typedef struct FlightAnalysis FlightAnalysis;
+
+void flight_analysis_config_init(FlightAnalysisConfig *config);
+FlightAnalysis *flight_analysis_create(const FlightAnalysisConfig *config);
+void flight_analysis_set_steps_sink(FlightAnalysis *analysis,
+                                    FlightStepsSink sink, void *context);
+int flight_analysis_push_rows(FlightAnalysis *analysis,
+                              const double *acceleration,
+                              const double *rotation,
+                              const double *temperature, size_t count);
+int flight_analysis_push_csv(FlightAnalysis *analysis, const char *data,
+                             size_t size);
+int flight_analysis_finish(FlightAnalysis *analysis, FlightMetrics *metrics);
+const FlightState *flight_analysis_state(const FlightAnalysis *analysis);
+const Trajectory *flight_analysis_trajectory(const FlightAnalysis *analysis);
+const Heatmap *flight_analysis_heatmap(const FlightAnalysis *analysis);
+void flight_analysis_take_trajectory(FlightAnalysis *analysis,
+                                     Trajectory *trajectory);
+int flight_analysis_write_line_svg(const FlightAnalysis *analysis,
+                                   OutputSink sink, void *context);
+int flight_analysis_write_heatmap_svg(const FlightAnalysis *analysis,
+                                      OutputSink sink, void *context);
+int flight_analysis_write_report(const FlightAnalysis *analysis,
+                                 OutputSink sink, void *context);
+void flight_analysis_destroy(FlightAnalysis *analysis);
+
+#endif // FLIGHT_ANALYSIS_H
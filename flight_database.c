@@ -0,0 +1,402 @@
+/**
+ * Compiled flights for repeated analysis without parsing and integrating.
+ *
+ * File format (native byte order, like the checkpoint):
+ *   8192 byte header: magic "SPCFLDB1", uint32 version, uint32
+ *     sizeof(double), uint64 rows, uint64 fanout, uint64 digest centroids,
+ *     uint64 digest buffered values, then doubles: max speed, max distance,
+ *     total distance, temperature mean, m2, min, max, temperature reference,
+ *     digest total weight, min, max. The digest centroids (mean, weight)
+ *     start at byte 256, the buffered values after room for
+ *     TDIGEST_MAX_CENTROIDS centroids.
+ *   columns: x, y, rotation, velocity x, velocity y, temperature (rows
+ *     doubles each, like trajectory.bin), path length, temperature sum and
+ *     sum of squares (rows + 1 doubles each, prefix sums starting at 0)
+ *   block summaries of all levels, finest first (4 doubles each)
+ *
+ * Every section starts at a multiple of 8 bytes, so the mapped file is used
+ * in place. A window query takes two lookups per prefix sum and reads at most
+ * 2 * (FLIGHT_DATABASE_FANOUT - 1) time steps or blocks per level for the
+ * extremes, so it costs O(log n) however long the window is.
+ */
+
+#include "flight_database.h"
+#include "mapped_file.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DATABASE_MAGIC "SPCFLDB1"
+#define DATABASE_VERSION 1
+#define HEADER_SIZE 8192
+#define HEADER_DOUBLES 11
+#define CENTROIDS_OFFSET 256
+#define BUFFER_OFFSET                                                         \
+  (CENTROIDS_OFFSET + TDIGEST_MAX_CENTROIDS * sizeof(Centroid))
+#define NUM_PREFIX_COLUMNS 3
+
+typedef enum PrefixColumn {
+  PREFIX_PATH_LENGTH,
+  PREFIX_TEMPERATURE,
+  PREFIX_TEMPERATURE_SQUARES
+} PrefixColumn;
+
+/**
+ * @brief Number of blocks on each level for `rows` time steps.
+ *
+ * @param offsets Receives the index of the first block of every level.
+ * @return The number of blocks of all levels.
+ */
+static size_t plan_levels(size_t rows, size_t offsets[], size_t *num_levels) {
+  size_t total = 0;
+  size_t count = rows;
+  *num_levels = 0;
+  while (count > 1 || (*num_levels == 0 && count == 1)) {
+    count = (count + FLIGHT_DATABASE_FANOUT - 1) / FLIGHT_DATABASE_FANOUT;
+    offsets[(*num_levels)++] = total;
+    total += count;
+  }
+  return total;
+}
+
+static void summary_init(FlightSummary *summary) {
+  summary->max_speed = -INFINITY;
+  summary->max_distance = -INFINITY;
+  summary->min_temperature = INFINITY;
+  summary->max_temperature = -INFINITY;
+}
+
+static void summary_merge(FlightSummary *summary, const FlightSummary *other) {
+  if (other->max_speed > summary->max_speed) {
+    summary->max_speed = other->max_speed;
+  }
+  if (other->max_distance > summary->max_distance) {
+    summary->max_distance = other->max_distance;
+  }
+  if (other->min_temperature < summary->min_temperature) {
+    summary->min_temperature = other->min_temperature;
+  }
+  if (other->max_temperature > summary->max_temperature) {
+    summary->max_temperature = other->max_temperature;
+  }
+}
+
+// Speed, distance from the start and temperature after step i
+static void add_step(FlightSummary *summary, const Trajectory *trajectory,
+                     size_t i) {
+  double vx = trajectory->velocity_x[i], vy = trajectory->velocity_y[i];
+  double x = trajectory->x[i], y = trajectory->y[i];
+  FlightSummary step = {sqrt(vx * vx + vy * vy), sqrt(x * x + y * y),
+                        trajectory->temperature[i],
+                        trajectory->temperature[i]};
+  summary_merge(summary, &step);
+}
+
+/**
+ * @brief Summarizes the trajectory level by level.
+ *
+ * @return The summaries of all levels, finest first, NULL if the memory could
+ * not be allocated.
+ */
+static FlightSummary *build_summaries(const Trajectory *trajectory,
+                                      size_t *num_summaries) {
+  size_t offsets[FLIGHT_DATABASE_MAX_LEVELS];
+  size_t num_levels;
+  *num_summaries = plan_levels(trajectory->length, offsets, &num_levels);
+  FlightSummary *summaries =
+      malloc((*num_summaries + 1) * sizeof(*summaries));
+  if (!summaries) {
+    return NULL;
+  }
+
+  size_t below = trajectory->length; // Items on the level below
+  for (size_t level = 0; level < num_levels; level++) {
+    FlightSummary *blocks = summaries + offsets[level];
+    size_t count =
+        (below + FLIGHT_DATABASE_FANOUT - 1) / FLIGHT_DATABASE_FANOUT;
+    for (size_t b = 0; b < count; b++) {
+      size_t first = b * FLIGHT_DATABASE_FANOUT;
+      size_t end = first + FLIGHT_DATABASE_FANOUT < below
+                       ? first + FLIGHT_DATABASE_FANOUT
+                       : below;
+      summary_init(&blocks[b]);
+      for (size_t i = first; i < end; i++) {
+        if (level == 0) {
+          add_step(&blocks[b], trajectory, i);
+        } else {
+          summary_merge(&blocks[b], &summaries[offsets[level - 1] + i]);
+        }
+      }
+    }
+    below = count;
+  }
+  return summaries;
+}
+
+// Value of step i that is summed up in a prefix column
+static double prefix_term(const Trajectory *trajectory, PrefixColumn column,
+                          size_t i, double reference) {
+  if (column == PREFIX_PATH_LENGTH) {
+    double dx = trajectory->x[i] - (i > 0 ? trajectory->x[i - 1] : 0);
+    double dy = trajectory->y[i] - (i > 0 ? trajectory->y[i - 1] : 0);
+    return sqrt(dx * dx + dy * dy);
+  }
+  double deviation = trajectory->temperature[i] - reference;
+  return column == PREFIX_TEMPERATURE ? deviation : deviation * deviation;
+}
+
+/**
+ * @brief Writes the rows + 1 prefix sums of a column. The sums are
+ * compensated (Kahan), so the only error of a window sum is the rounding of
+ * the two stored values.
+ */
+static int write_prefix_column(FILE *file, const Trajectory *trajectory,
+                               PrefixColumn column, double reference) {
+  double buffer[CHUNK_SIZE];
+  double sum = 0, compensation = 0;
+  size_t used = 0;
+  buffer[used++] = 0;
+  for (size_t i = 0; i < trajectory->length; i++) {
+    if (used == CHUNK_SIZE) {
+      if (fwrite(buffer, sizeof(double), used, file) != used) {
+        return 0;
+      }
+      used = 0;
+    }
+    double term = prefix_term(trajectory, column, i, reference) - compensation;
+    double new_sum = sum + term;
+    compensation = (new_sum - sum) - term;
+    sum = new_sum;
+    buffer[used++] = sum;
+  }
+  return fwrite(buffer, sizeof(double), used, file) == used;
+}
+
+/**
+ * @brief Compiles an analyzed flight into a database file. The file is
+ * written to "<filename>.tmp" first and then renamed.
+ *
+ * @param trajectory The trajectory of the analysis.
+ * @param state The metrics of the analysis.
+ * @return 1 on success, 0 if the memory or the file could not be written.
+ */
+int flight_database_save(const char *filename, const Trajectory *trajectory,
+                         const FlightState *state) {
+  char temporary[1024];
+  if (snprintf(temporary, sizeof(temporary), "%s.tmp", filename) >=
+      (int)sizeof(temporary)) {
+    return 0;
+  }
+  size_t num_summaries;
+  FlightSummary *summaries = build_summaries(trajectory, &num_summaries);
+  if (!summaries) {
+    return 0;
+  }
+  FILE *file = fopen(temporary, "wb");
+  if (!file) {
+    free(summaries);
+    return 0;
+  }
+
+  const RunningStats *stats = &state->temperature_stats;
+  const TDigest *digest = &state->temperature_digest;
+  double reference = stats->count > 0 ? stats->mean : 0;
+  unsigned char header[HEADER_SIZE] = {0};
+  uint32_t version = DATABASE_VERSION;
+  uint32_t double_size = sizeof(double);
+  uint64_t counts[] = {trajectory->length, FLIGHT_DATABASE_FANOUT,
+                       digest->num_centroids, digest->num_buffered};
+  double doubles[HEADER_DOUBLES] = {
+      state->max_speed, state->max_distance, state->total_distance,
+      stats->mean,      stats->m2,           stats->min,
+      stats->max,       reference,           digest->total_weight,
+      digest->min,      digest->max};
+  memcpy(header, DATABASE_MAGIC, 8);
+  memcpy(header + 8, &version, sizeof(version));
+  memcpy(header + 12, &double_size, sizeof(double_size));
+  memcpy(header + 16, counts, sizeof(counts));
+  memcpy(header + 48, doubles, sizeof(doubles));
+  memcpy(header + CENTROIDS_OFFSET, digest->centroids,
+         digest->num_centroids * sizeof(Centroid));
+  memcpy(header + BUFFER_OFFSET, digest->buffer,
+         digest->num_buffered * sizeof(double));
+  int ok = fwrite(header, 1, HEADER_SIZE, file) == HEADER_SIZE;
+
+  const double *columns[] = {trajectory->x,          trajectory->y,
+                             trajectory->rotation,   trajectory->velocity_x,
+                             trajectory->velocity_y, trajectory->temperature};
+  for (int c = 0; ok && c < TRAJECTORY_NUM_COLUMNS; c++) {
+    ok = fwrite(columns[c], sizeof(double), trajectory->length, file) ==
+         trajectory->length;
+  }
+  for (int c = 0; ok && c < NUM_PREFIX_COLUMNS; c++) {
+    ok = write_prefix_column(file, trajectory, (PrefixColumn)c, reference);
+  }
+  ok = ok && fwrite(summaries, sizeof(*summaries), num_summaries, file) ==
+                 num_summaries;
+  free(summaries);
+
+  ok = (fclose(file) == 0) && ok;
+#ifdef _WIN32
+  remove(filename); // rename() doesn't replace existing files on Windows
+#endif
+  if (!ok || rename(temporary, filename) != 0) {
+    remove(temporary);
+    return 0;
+  }
+  return 1;
+}
+
+/**
+ * @brief Maps a database file. The columns are used in place until
+ * flight_database_close() is called.
+ *
+ * @return 1 on success, 0 if the file could not be mapped or is not a valid
+ * database of this machine.
+ */
+int flight_database_open(FlightDatabase *database, const char *filename) {
+  trajectory_init(&database->trajectory);
+  MappedFile file;
+  if (!map_file(filename, &file)) {
+    return 0;
+  }
+  const char *data = file.data;
+  uint32_t version, double_size;
+  uint64_t counts[4];
+  double doubles[HEADER_DOUBLES];
+  int ok = file.size >= HEADER_SIZE && memcmp(data, DATABASE_MAGIC, 8) == 0;
+  if (ok) {
+    memcpy(&version, data + 8, sizeof(version));
+    memcpy(&double_size, data + 12, sizeof(double_size));
+    memcpy(counts, data + 16, sizeof(counts));
+    memcpy(doubles, data + 48, sizeof(doubles));
+    ok = version == DATABASE_VERSION && double_size == sizeof(double) &&
+         counts[1] == FLIGHT_DATABASE_FANOUT &&
+         counts[2] <= TDIGEST_MAX_CENTROIDS &&
+         counts[3] <= TDIGEST_BUFFER_SIZE &&
+         counts[0] < (file.size - HEADER_SIZE) / sizeof(double) /
+                         (TRAJECTORY_NUM_COLUMNS + NUM_PREFIX_COLUMNS);
+  }
+  size_t rows = ok ? (size_t)counts[0] : 0;
+  size_t num_summaries = plan_levels(rows, database->level_offsets,
+                                     &database->num_levels);
+  size_t num_doubles = TRAJECTORY_NUM_COLUMNS * rows +
+                       NUM_PREFIX_COLUMNS * (rows + 1) + 4 * num_summaries;
+  if (!ok || num_doubles > (file.size - HEADER_SIZE) / sizeof(double)) {
+    unmap_file(&file);
+    return 0;
+  }
+
+  FlightState *state = &database->state;
+  flight_state_init(state);
+  state->max_speed = doubles[0];
+  state->max_distance = doubles[1];
+  state->total_distance = doubles[2];
+  state->temperature_stats.count = rows;
+  state->temperature_stats.mean = doubles[3];
+  state->temperature_stats.m2 = doubles[4];
+  state->temperature_stats.min = doubles[5];
+  state->temperature_stats.max = doubles[6];
+  database->temperature_reference = doubles[7];
+  TDigest *digest = &state->temperature_digest;
+  digest->num_centroids = (size_t)counts[2];
+  digest->num_buffered = (size_t)counts[3];
+  digest->total_weight = doubles[8];
+  digest->min = doubles[9];
+  digest->max = doubles[10];
+  memcpy(digest->centroids, data + CENTROIDS_OFFSET,
+         digest->num_centroids * sizeof(Centroid));
+  memcpy(digest->buffer, data + BUFFER_OFFSET,
+         digest->num_buffered * sizeof(double));
+
+  const double *column = (const double *)(data + HEADER_SIZE);
+  double **columns[] = {&database->trajectory.x,
+                        &database->trajectory.y,
+                        &database->trajectory.rotation,
+                        &database->trajectory.velocity_x,
+                        &database->trajectory.velocity_y,
+                        &database->trajectory.temperature};
+  for (int c = 0; c < TRAJECTORY_NUM_COLUMNS; c++) {
+    *columns[c] = (double *)column;
+    column += rows;
+  }
+  database->path_length = column;
+  database->temperature_sum = column + rows + 1;
+  database->temperature_squares = column + 2 * (rows + 1);
+  database->summaries =
+      (const FlightSummary *)(column + NUM_PREFIX_COLUMNS * (rows + 1));
+
+  // The last position, velocity and rotation, e.g. to continue integrating
+  if (rows > 0) {
+    const Trajectory *t = &database->trajectory;
+    state->current_position.x = t->x[rows - 1];
+    state->current_position.y = t->y[rows - 1];
+    state->current_velocity.x = t->velocity_x[rows - 1];
+    state->current_velocity.y = t->velocity_y[rows - 1];
+    state->current_rotation = t->rotation[rows - 1];
+  }
+  database->trajectory.length = rows;
+  database->trajectory.capacity = rows;
+  database->trajectory.mapping = file;
+  return 1;
+}
+
+void flight_database_close(FlightDatabase *database) {
+  trajectory_free(&database->trajectory);
+}
+
+/**
+ * @brief Computes the metrics of the time steps [first, last] (counted from
+ * 0) from the prefix sums and block summaries.
+ *
+ * @return 1 on success, 0 if the window is empty or outside the flight.
+ */
+int flight_database_window(const FlightDatabase *database, size_t first,
+                           size_t last, FlightWindow *window) {
+  const Trajectory *trajectory = &database->trajectory;
+  if (first > last || last >= trajectory->length) {
+    return 0;
+  }
+  size_t length = last - first + 1;
+  double sum = database->temperature_sum[last + 1] -
+               database->temperature_sum[first];
+  double squares = database->temperature_squares[last + 1] -
+                   database->temperature_squares[first];
+  double variance = (squares - sum * sum / length) / length;
+  window->length = length;
+  window->distance =
+      database->path_length[last + 1] - database->path_length[first];
+  window->temperature_mean = database->temperature_reference + sum / length;
+  window->temperature_variance = variance > 0 ? variance : 0;
+
+  // Single steps up to the next block boundary at both ends, then the same
+  // with the blocks of every level
+  FlightSummary summary;
+  summary_init(&summary);
+  size_t begin = first, end = last + 1;
+  while (begin < end && begin % FLIGHT_DATABASE_FANOUT != 0) {
+    add_step(&summary, trajectory, begin++);
+  }
+  while (end > begin && end % FLIGHT_DATABASE_FANOUT != 0) {
+    add_step(&summary, trajectory, --end);
+  }
+  for (size_t level = 0; begin < end; level++) {
+    begin /= FLIGHT_DATABASE_FANOUT;
+    end /= FLIGHT_DATABASE_FANOUT;
+    const FlightSummary *blocks =
+        database->summaries + database->level_offsets[level];
+    while (begin < end && begin % FLIGHT_DATABASE_FANOUT != 0) {
+      summary_merge(&summary, &blocks[begin++]);
+    }
+    while (end > begin && end % FLIGHT_DATABASE_FANOUT != 0) {
+      summary_merge(&summary, &blocks[--end]);
+    }
+  }
+  window->max_speed = summary.max_speed;
+  window->max_distance = summary.max_distance;
+  window->min_temperature = summary.min_temperature;
+  window->max_temperature = summary.max_temperature;
+  return 1;
+}
@@ -0,0 +1,57 @@
+#ifndef FLIGHT_DATABASE_H
+#define FLIGHT_DATABASE_H
+
+#include "flight.h"
+#include "trajectory.h"
+#include <stddef.h>
+
+#define FLIGHT_DATABASE_FANOUT 16     // Time steps or blocks per block
+#define FLIGHT_DATABASE_MAX_LEVELS 17 // Enough for 2^64 time steps
+
+// Extremes of a block of time steps
+typedef struct FlightSummary {
+  double max_speed;
+  double max_distance; // From the start
+  double min_temperature;
+  double max_temperature;
+} FlightSummary;
+
+// A compiled flight: the trajectory and metrics of the analysis plus prefix
+// sums and block extremes for time window queries. Everything points into
+// the mapped file, which the trajectory owns.
+typedef struct FlightDatabase {
+  Trajectory trajectory;
+  FlightState state; // Metrics of the whole flight
+  const double *path_length; // Before every step and at the end (rows + 1)
+  // Temperatures minus the reference before every step (rows + 1), shifted
+  // so that the sums stay small and the variance accurate
+  const double *temperature_sum;
+  const double *temperature_squares;
+  double temperature_reference;
+  // Level 0 summarizes FLIGHT_DATABASE_FANOUT time steps per block, every
+  // further level FLIGHT_DATABASE_FANOUT blocks of the level below
+  const FlightSummary *summaries;
+  size_t level_offsets[FLIGHT_DATABASE_MAX_LEVELS];
+  size_t num_levels;
+} FlightDatabase;
+
+// Metrics of the time steps [first, last]
+typedef struct FlightWindow {
+  size_t length;
+  double max_speed;
+  double distance; // Path length
+  double max_distance;
+  double temperature_mean;
+  double temperature_variance;
+  double min_temperature;
+  double max_temperature;
+} FlightWindow;
+
+int flight_database_save(const char *filename, const Trajectory *trajectory,
+                         const FlightState *state);
+int flight_database_open(FlightDatabase *database, const char *filename);
+void flight_database_close(FlightDatabase *database);
+int flight_database_window(const FlightDatabase *database, size_t first,
+                           size_t last, FlightWindow *window);
+
+#endif // FLIGHT_DATABASE_H
@@ -0,0 +1,477 @@
+#include "heatmap.h"
+#include "profiler.h"
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+
+#define INITIAL_CAPACITY 1024
+
+static size_t hash_cell(int64_t x, int64_t y) {
+  uint64_t hash = (uint64_t)x * UINT64_C(0x9E3779B97F4A7C15) ^
+                  (uint64_t)y * UINT64_C(0xC2B2AE3D27D4EB4F);
+  return (size_t)(hash ^ (hash >> 29));
+}
+
+/**
+ * @brief Linear probing: returns the slot of cell (x, y), or the free slot
+ * where it belongs.
+ */
+static HeatmapCell *find_slot(HeatmapCell *cells, size_t capacity, int64_t x,
+                              int64_t y) {
+  size_t i = hash_cell(x, y) & (capacity - 1);
+  while (cells[i].count > 0 && (cells[i].x != x || cells[i].y != y)) {
+    i = (i + 1) & (capacity - 1);
+  }
+  return &cells[i];
+}
+
+/**
+ * @brief Divides a cell index by 2^shift, rounded down.
+ */
+static int64_t shift_index(int64_t index, int shift) {
+  // Arithmetic shifts round down for negative indices as well
+  return shift < 63 ? index >> shift : (index < 0 ? -1 : 0);
+}
+
+/**
+ * @brief Moves all cells into a new table of `capacity` slots, with the
+ * indices divided by 2^shift_x and 2^shift_y (rounded down). Cells that end up
+ * with the same indices are merged.
+ */
+static int rehash(Heatmap *heatmap, size_t capacity, int shift_x,
+                  int shift_y) {
+  HeatmapCell *cells = calloc(capacity, sizeof(*cells));
+  if (!cells) {
+    return 0;
+  }
+  PROFILE_ALLOCATION(capacity * sizeof(*cells));
+
+  size_t num_cells = 0;
+  for (size_t i = 0; i < heatmap->capacity; i++) {
+    HeatmapCell cell = heatmap->cells[i];
+    if (cell.count == 0) {
+      continue;
+    }
+    cell.x = shift_index(cell.x, shift_x);
+    cell.y = shift_index(cell.y, shift_y);
+    HeatmapCell *slot = find_slot(cells, capacity, cell.x, cell.y);
+    if (slot->count == 0) {
+      *slot = cell;
+      num_cells++;
+    } else {
+      slot->sum += cell.sum;
+      slot->count += cell.count;
+    }
+  }
+
+  free(heatmap->cells);
+  heatmap->cells = cells;
+  heatmap->capacity = capacity;
+  heatmap->num_cells = num_cells;
+  return 1;
+}
+
+/**
+ * @brief Adds `sum` and `count` to cell (x, y), creating it if necessary.
+ *
+ * @return 1 on success, 0 if the memory ran out.
+ */
+static int accumulate(Heatmap *heatmap, int64_t x, int64_t y, double sum,
+                      uint64_t count) {
+  // Keep the load factor at or below 1/2
+  if ((heatmap->num_cells + 1) * 2 > heatmap->capacity &&
+      !rehash(heatmap,
+              heatmap->capacity ? heatmap->capacity * 2 : INITIAL_CAPACITY, 0,
+              0)) {
+    return 0;
+  }
+
+  HeatmapCell *cell = find_slot(heatmap->cells, heatmap->capacity, x, y);
+  if (cell->count == 0) {
+    cell->x = x;
+    cell->y = y;
+    cell->sum = 0.0;
+    heatmap->num_cells++;
+  }
+  cell->sum += sum;
+  cell->count += count;
+  return 1;
+}
+
+/**
+ * @brief Initializes an empty heatmap with fixed bounds
+ * [min_x, max_x) x [min_y, max_y).
+ *
+ * Degenerate bounds (e.g. a single point) are widened by one unit on each
+ * side, so every cell has a positive size. No memory is allocated until the
+ * first point is added.
+ */
+void heatmap_init(Heatmap *heatmap, int resolution, double min_x, double min_y,
+                  double max_x, double max_y) {
+  if (!(max_x > min_x)) {
+    min_x -= 1.0;
+    max_x = min_x + 2.0;
+  }
+  if (!(max_y > min_y)) {
+    min_y -= 1.0;
+    max_y = min_y + 2.0;
+  }
+
+  heatmap->resolution = resolution;
+  heatmap->auto_bounds = 0;
+  heatmap->origin_x = min_x;
+  heatmap->origin_y = min_y;
+  heatmap->cell_width = (max_x - min_x) / resolution;
+  heatmap->cell_height = (max_y - min_y) / resolution;
+  heatmap->min_cell_x = 0;
+  heatmap->max_cell_x = resolution - 1;
+  heatmap->min_cell_y = 0;
+  heatmap->max_cell_y = resolution - 1;
+  heatmap->min_x = min_x;
+  heatmap->min_y = min_y;
+  heatmap->max_x = max_x;
+  heatmap->max_y = max_y;
+  heatmap->cells = NULL;
+  heatmap->num_cells = 0;
+  heatmap->capacity = 0;
+  heatmap->outside = 0;
+}
+
+/**
+ * @brief Initializes an empty heatmap whose bounds follow the added points.
+ */
+void heatmap_init_auto(Heatmap *heatmap, int resolution) {
+  heatmap_init(heatmap, resolution, 0, 0, 0, 0);
+  heatmap->auto_bounds = 1;
+  heatmap->cell_width = HEATMAP_INITIAL_CELL_SIZE;
+  heatmap->cell_height = HEATMAP_INITIAL_CELL_SIZE;
+  // Empty index range until the first point arrives
+  heatmap->min_cell_x = 0;
+  heatmap->max_cell_x = -1;
+  heatmap->min_cell_y = 0;
+  heatmap->max_cell_y = -1;
+}
+
+/**
+ * @brief Number of times the cell size has to be doubled, so that the index
+ * range [min_index, max_index] extended by `index` spans at most `limit`
+ * cells.
+ */
+static int doublings_needed(double index, int64_t min_index,
+                            int64_t max_index, double limit) {
+  double low = fmin(index, (double)min_index);
+  double high = fmax(index, (double)max_index);
+  int doublings = 0;
+  while (high - low + 1 > limit) {
+    low = floor(low / 2);
+    high = floor(high / 2);
+    doublings++;
+  }
+  return doublings;
+}
+
+/**
+ * @brief Adds a point with auto bounds, rebinning the cells if the point lies
+ * too far away from the points so far.
+ */
+static int add_auto(Heatmap *heatmap, double x, double y, double temperature) {
+  if (heatmap->max_cell_x < heatmap->min_cell_x) {
+    // First point: it defines the grid origin
+    heatmap->origin_x = x;
+    heatmap->origin_y = y;
+    heatmap->min_cell_x = heatmap->max_cell_x = 0;
+    heatmap->min_cell_y = heatmap->max_cell_y = 0;
+    heatmap->min_x = heatmap->max_x = x;
+    heatmap->min_y = heatmap->max_y = y;
+  }
+
+  // Dividing by a power of two is exact, so rebinning the cells gives the
+  // same indices as computing them with the larger cell size
+  double limit = (double)heatmap->resolution * HEATMAP_OVERSAMPLING;
+  double grid_x = floor((x - heatmap->origin_x) / heatmap->cell_width);
+  double grid_y = floor((y - heatmap->origin_y) / heatmap->cell_height);
+  int shift_x = doublings_needed(grid_x, heatmap->min_cell_x,
+                                 heatmap->max_cell_x, limit);
+  int shift_y = doublings_needed(grid_y, heatmap->min_cell_y,
+                                 heatmap->max_cell_y, limit);
+  if (shift_x > 0 || shift_y > 0) {
+    if (heatmap->capacity > 0 &&
+        !rehash(heatmap, heatmap->capacity, shift_x, shift_y)) {
+      return 0;
+    }
+    heatmap->cell_width = ldexp(heatmap->cell_width, shift_x);
+    heatmap->cell_height = ldexp(heatmap->cell_height, shift_y);
+    heatmap->min_cell_x = shift_index(heatmap->min_cell_x, shift_x);
+    heatmap->max_cell_x = shift_index(heatmap->max_cell_x, shift_x);
+    heatmap->min_cell_y = shift_index(heatmap->min_cell_y, shift_y);
+    heatmap->max_cell_y = shift_index(heatmap->max_cell_y, shift_y);
+    grid_x = floor((x - heatmap->origin_x) / heatmap->cell_width);
+    grid_y = floor((y - heatmap->origin_y) / heatmap->cell_height);
+  }
+
+  int64_t cell_x = (int64_t)grid_x;
+  int64_t cell_y = (int64_t)grid_y;
+  if (!accumulate(heatmap, cell_x, cell_y, temperature, 1)) {
+    return 0;
+  }
+  heatmap->min_cell_x = cell_x < heatmap->min_cell_x ? cell_x
+                                                     : heatmap->min_cell_x;
+  heatmap->max_cell_x = cell_x > heatmap->max_cell_x ? cell_x
+                                                     : heatmap->max_cell_x;
+  heatmap->min_cell_y = cell_y < heatmap->min_cell_y ? cell_y
+                                                     : heatmap->min_cell_y;
+  heatmap->max_cell_y = cell_y > heatmap->max_cell_y ? cell_y
+                                                     : heatmap->max_cell_y;
+  heatmap->min_x = fmin(heatmap->min_x, x);
+  heatmap->min_y = fmin(heatmap->min_y, y);
+  heatmap->max_x = fmax(heatmap->max_x, x);
+  heatmap->max_y = fmax(heatmap->max_y, y);
+  return 1;
+}
+
+/**
+ * @brief Adds a temperature measured at (x, y).
+ *
+ * With fixed bounds, points outside of them are only counted (as are points
+ * with infinite or NaN coordinates in both modes).
+ *
+ * @return 1 on success, 0 if the memory ran out.
+ */
+int heatmap_add(Heatmap *heatmap, double x, double y, double temperature) {
+  if (!isfinite(x) || !isfinite(y)) {
+    heatmap->outside++;
+    return 1;
+  }
+  if (heatmap->auto_bounds) {
+    return add_auto(heatmap, x, y, temperature);
+  }
+
+  // Same cell assignment as the former dense temperature map: the cells are
+  // half open, the upper bounds belong to no cell
+  double grid_x = (x - heatmap->origin_x) / heatmap->cell_width;
+  double grid_y = (y - heatmap->origin_y) / heatmap->cell_height;
+  if (!(grid_x >= 0 && grid_x < heatmap->resolution && grid_y >= 0 &&
+        grid_y < heatmap->resolution)) {
+    heatmap->outside++;
+    return 1;
+  }
+  return accumulate(heatmap, (int64_t)grid_x, (int64_t)grid_y, temperature,
+                    1);
+}
+
+/**
+ * @brief Calculates a temperature map from the trajectory.
+ *
+ * @param heatmap Receives the temperature sums and counts of every cell.
+ * @param trajectory Positions and temperature values of every time step.
+ * @param matrix_resolution Resolution of the map.
+ * @param bounds World bounds (min x, min y, max x, max y) covered by the map,
+ * or NULL to use the bounds of the trajectory.
+ * @return 1 on success, 0 if the memory ran out.
+ */
+int heatmap_from_trajectory(Heatmap *heatmap, const Trajectory *trajectory,
+                            int matrix_resolution, const double *bounds) {
+  if (bounds) {
+    heatmap_init(heatmap, matrix_resolution, bounds[0], bounds[1], bounds[2],
+                 bounds[3]);
+  } else {
+    // Find min/max coordinates
+    // DBL_MAX is the biggest number a "double" can hold (provided by float.h)
+    double min_x = DBL_MAX, min_y = DBL_MAX;
+    double max_x = -DBL_MAX, max_y = -DBL_MAX;
+
+    for (size_t i = 0; i < trajectory->length; i++) {
+      if (trajectory->x[i] < min_x)
+        min_x = trajectory->x[i];
+      if (trajectory->y[i] < min_y)
+        min_y = trajectory->y[i];
+      if (trajectory->x[i] > max_x)
+        max_x = trajectory->x[i];
+      if (trajectory->y[i] > max_y)
+        max_y = trajectory->y[i];
+    }
+    heatmap_init(heatmap, matrix_resolution, min_x, min_y, max_x, max_y);
+  }
+
+  // Assign points to grid cells
+  for (size_t i = 0; i < trajectory->length; i++) {
+    if (!heatmap_add(heatmap, trajectory->x[i], trajectory->y[i],
+                     trajectory->temperature[i])) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * @brief Adds the sum and count of a cell, e.g. when restoring a saved
+ * heatmap. The indices and bounds of the heatmap aren't changed.
+ */
+int heatmap_insert_cell(Heatmap *heatmap, const HeatmapCell *cell) {
+  return accumulate(heatmap, cell->x, cell->y, cell->sum, cell->count);
+}
+
+static int compare_cells(const void *a, const void *b) {
+  const HeatmapCell *first = a;
+  const HeatmapCell *second = b;
+  if (first->x != second->x) {
+    return first->x < second->x ? -1 : 1;
+  }
+  if (first->y != second->y) {
+    return first->y < second->y ? -1 : 1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Copies the occupied cells of a table into a new array, sorted by x
+ * and then by y index.
+ */
+static int sorted_cells(const Heatmap *heatmap, HeatmapCell **cells,
+                        size_t *num_cells) {
+  *num_cells = 0;
+  *cells = malloc((heatmap->num_cells ? heatmap->num_cells : 1) *
+                  sizeof(**cells));
+  if (!*cells) {
+    return 0;
+  }
+  PROFILE_ALLOCATION(heatmap->num_cells * sizeof(**cells));
+  for (size_t i = 0; i < heatmap->capacity; i++) {
+    if (heatmap->cells[i].count > 0) {
+      (*cells)[(*num_cells)++] = heatmap->cells[i];
+    }
+  }
+  qsort(*cells, *num_cells, sizeof(**cells), compare_cells);
+  return 1;
+}
+
+/**
+ * @brief Returns the occupied cells of the resolution x resolution output
+ * grid, sorted by x and then by y index.
+ *
+ * With auto bounds the output grid spans the bounds of all added points, and
+ * every internal cell is assigned to the output cell that contains its
+ * center.
+ *
+ * @param heatmap The heatmap.
+ * @param cells Receives an array that has to be freed by the caller.
+ * @param num_cells Receives the number of occupied output cells.
+ * @return 1 on success, 0 if the memory ran out.
+ */
+int heatmap_collect(const Heatmap *heatmap, HeatmapCell **cells,
+                    size_t *num_cells) {
+  if (!heatmap->auto_bounds) {
+    return sorted_cells(heatmap, cells, num_cells);
+  }
+
+  Heatmap output;
+  heatmap_init(&output, heatmap->resolution, heatmap->min_x, heatmap->min_y,
+               heatmap->max_x, heatmap->max_y);
+  int last = heatmap->resolution - 1;
+  for (size_t i = 0; i < heatmap->capacity; i++) {
+    const HeatmapCell *cell = &heatmap->cells[i];
+    if (cell->count == 0) {
+      continue;
+    }
+    double center_x =
+        heatmap->origin_x + ((double)cell->x + 0.5) * heatmap->cell_width;
+    double center_y =
+        heatmap->origin_y + ((double)cell->y + 0.5) * heatmap->cell_height;
+    double grid_x = floor((center_x - output.origin_x) / output.cell_width);
+    double grid_y = floor((center_y - output.origin_y) / output.cell_height);
+    // Cells on the border have their center slightly outside of the bounds
+    int64_t x = grid_x < 0 ? 0 : grid_x > last ? last : (int64_t)grid_x;
+    int64_t y = grid_y < 0 ? 0 : grid_y > last ? last : (int64_t)grid_y;
+    if (!accumulate(&output, x, y, cell->sum, cell->count)) {
+      heatmap_free(&output);
+      return 0;
+    }
+  }
+
+  int success = sorted_cells(&output, cells, num_cells);
+  heatmap_free(&output);
+  return success;
+}
+
+void heatmap_free(Heatmap *heatmap) {
+  free(heatmap->cells);
+  heatmap->cells = NULL;
+  heatmap->num_cells = 0;
+  heatmap->capacity = 0;
+}
+
+/**
+ * @brief Derives the next coarser level by summing 2x2 blocks of cells.
+ */
+static int coarsen_level(const HeatmapLevel *fine, HeatmapLevel *coarse) {
+  coarse->resolution = (fine->resolution + 1) / 2;
+  coarse->num_cells = 0;
+  coarse->cells = malloc((fine->num_cells ? fine->num_cells : 1) *
+                         sizeof(*coarse->cells));
+  if (!coarse->cells) {
+    return 0;
+  }
+  PROFILE_ALLOCATION(fine->num_cells * sizeof(*coarse->cells));
+  for (size_t i = 0; i < fine->num_cells; i++) {
+    coarse->cells[i] = fine->cells[i];
+    coarse->cells[i].x >>= 1;
+    coarse->cells[i].y >>= 1;
+  }
+  qsort(coarse->cells, fine->num_cells, sizeof(*coarse->cells),
+        compare_cells);
+
+  // Merge the (up to four) cells that ended up with the same indices
+  for (size_t i = 0; i < fine->num_cells; i++) {
+    const HeatmapCell *cell = &coarse->cells[i];
+    if (coarse->num_cells > 0) {
+      HeatmapCell *last = &coarse->cells[coarse->num_cells - 1];
+      if (last->x == cell->x && last->y == cell->y) {
+        last->sum += cell->sum;
+        last->count += cell->count;
+        continue;
+      }
+    }
+    coarse->cells[coarse->num_cells++] = *cell;
+  }
+  return 1;
+}
+
+/**
+ * @brief Builds zoom levels of the heatmap from its finest grid, so that the
+ * points only have to be added once.
+ *
+ * @param heatmap The heatmap, level 0 is its output grid.
+ * @param num_levels Number of levels to build, 0 for all levels down to a
+ * single cell. Limited to the levels that exist.
+ * @param pyramid Receives the levels, free them with heatmap_pyramid_free().
+ * @return 1 on success, 0 if the memory ran out.
+ */
+int heatmap_build_pyramid(const Heatmap *heatmap, int num_levels,
+                          HeatmapPyramid *pyramid) {
+  pyramid->num_levels = 0;
+  HeatmapLevel *levels = pyramid->levels;
+  levels[0].resolution = heatmap->resolution;
+  if (!heatmap_collect(heatmap, &levels[0].cells, &levels[0].num_cells)) {
+    return 0;
+  }
+  pyramid->num_levels = 1;
+
+  while ((num_levels == 0 || pyramid->num_levels < num_levels) &&
+         pyramid->num_levels < HEATMAP_MAX_LEVELS &&
+         levels[pyramid->num_levels - 1].resolution > 1) {
+    if (!coarsen_level(&levels[pyramid->num_levels - 1],
+                       &levels[pyramid->num_levels])) {
+      heatmap_pyramid_free(pyramid);
+      return 0;
+    }
+    pyramid->num_levels++;
+  }
+  return 1;
+}
+
+void heatmap_pyramid_free(HeatmapPyramid *pyramid) {
+  for (int i = 0; i < pyramid->num_levels; i++) {
+    free(pyramid->levels[i].cells);
+  }
+  pyramid->num_levels = 0;
+}
@@ -0,0 +1,83 @@
+#ifndef HEATMAP_H
+#define HEATMAP_H
+
+#include "trajectory.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Auto bounds: cells are this many times smaller than the output cells, so
+// that rebinning them to the final data bounds is accurate to 1/8 cell
+#define HEATMAP_OVERSAMPLING 8
+#define HEATMAP_MAX_RESOLUTION 1000000
+#define HEATMAP_MAX_LEVELS 21 // Zoom levels down to 1x1 at the max resolution
+#define HEATMAP_INITIAL_CELL_SIZE 0x1p-30 // Auto bounds, before rebinning
+
+typedef struct HeatmapCell {
+  int64_t x; // Grid indices
+  int64_t y;
+  double sum; // Sum of the temperatures
+  uint64_t count;
+} HeatmapCell;
+
+// Temperature sums and counts of the occupied grid cells, kept in a hash map
+// so that memory grows with the number of occupied cells, not with the
+// resolution. Cell (x, y) covers [origin_x + x * cell_width, origin_x +
+// (x + 1) * cell_width) and the same in y direction.
+//
+// With fixed bounds the grid is the output grid and points outside the bounds
+// are only counted. With auto bounds the grid starts at the first point with
+// tiny cells, and whenever the occupied cells would span more than
+// resolution * HEATMAP_OVERSAMPLING cells in one direction, the cell size is
+// doubled and neighbouring cells are merged. The output grid is fitted to the
+// bounds of all points at the end.
+typedef struct Heatmap {
+  int resolution;
+  int auto_bounds;
+  double origin_x;
+  double origin_y;
+  double cell_width;
+  double cell_height;
+  int64_t min_cell_x; // Occupied index range (auto bounds)
+  int64_t max_cell_x;
+  int64_t min_cell_y;
+  int64_t max_cell_y;
+  double min_x; // Bounds of the added points (auto bounds)
+  double min_y;
+  double max_x;
+  double max_y;
+  HeatmapCell *cells; // Hash map, free slots have a count of 0
+  size_t num_cells;
+  size_t capacity;  // Power of two
+  uint64_t outside; // Points that fell outside the bounds
+} Heatmap;
+
+void heatmap_init(Heatmap *heatmap, int resolution, double min_x, double min_y,
+                  double max_x, double max_y);
+void heatmap_init_auto(Heatmap *heatmap, int resolution);
+int heatmap_add(Heatmap *heatmap, double x, double y, double temperature);
+int heatmap_from_trajectory(Heatmap *heatmap, const Trajectory *trajectory,
+                            int matrix_resolution, const double *bounds);
+int heatmap_insert_cell(Heatmap *heatmap, const HeatmapCell *cell);
+int heatmap_collect(const Heatmap *heatmap, HeatmapCell **cells,
+                    size_t *num_cells);
+void heatmap_free(Heatmap *heatmap);
+
+// Occupied cells of one zoom level of the output grid, sorted by x and y index
+typedef struct HeatmapLevel {
+  int resolution;
+  HeatmapCell *cells;
+  size_t num_cells;
+} HeatmapLevel;
+
+// Mipmap style zoom levels: level 0 is the output grid of the heatmap, every
+// further level halves the resolution (rounded up) by merging 2x2 blocks
+typedef struct HeatmapPyramid {
+  int num_levels;
+  HeatmapLevel levels[HEATMAP_MAX_LEVELS];
+} HeatmapPyramid;
+
+int heatmap_build_pyramid(const Heatmap *heatmap, int num_levels,
+                          HeatmapPyramid *pyramid);
+void heatmap_pyramid_free(HeatmapPyramid *pyramid);
+
+#endif // HEATMAP_H
@@ -0,0 +1,298 @@
+/**
+ * PPM and PNG files without external libraries.
+ *
+ * The PNG encoder stores the rows unfiltered and compresses them with a small
+ * deflate encoder: greedy LZ77 matching with a hash table of the last position
+ * of every 3 byte sequence, coded with the fixed Huffman codes of deflate. The
+ * rendered images are mostly runs of the background colour, which become
+ * 258 byte matches, so this gets close to zlib without its code size.
+ */
+
+#include "image_writer.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MIN_MATCH 3
+#define MAX_MATCH 258
+
+static const uint16_t LENGTH_BASE[29] = {
+    3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+    31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                         1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                         4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t DISTANCE_BASE[30] = {
+    1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+    33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+    1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t DISTANCE_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2,  2,  3,  3,
+                                           4, 4, 5, 5, 6, 6, 7,  7,  8,  8,
+                                           9, 9, 10, 10, 11, 11, 12, 12, 13,
+                                           13};
+
+// CRC-32 of PNG chunks, four bits at a time
+static const uint32_t CRC_TABLE[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4,
+    0x4DB26158, 0x5005713C, 0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+    0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+
+/**
+ * @brief Allocates a black image.
+ *
+ * @return 1 on success, 0 if the memory could not be allocated.
+ */
+int rgb_image_init(RgbImage *image, int width, int height) {
+  image->width = width;
+  image->height = height;
+  image->pixels = calloc((size_t)width * height, 3);
+  return image->pixels != NULL;
+}
+
+void rgb_image_free(RgbImage *image) {
+  free(image->pixels);
+  image->pixels = NULL;
+}
+
+/**
+ * @brief Saves the image as binary PPM (P6).
+ *
+ * @param bytes Receives the file size.
+ * @return 1 on success, 0 if the file could not be written.
+ */
+int write_ppm(const RgbImage *image, const char *filename, size_t *bytes) {
+  FILE *file = fopen(filename, "wb");
+  if (!file) {
+    return 0;
+  }
+  size_t size = (size_t)image->width * image->height * 3;
+  int header = fprintf(file, "P6\n%d %d\n255\n", image->width, image->height);
+  int success = header > 0 && fwrite(image->pixels, 1, size, file) == size;
+  success = fclose(file) == 0 && success;
+  *bytes = header > 0 ? (size_t)header + size : 0;
+  return success;
+}
+
+// Deflate output, bits are filled in from the least significant bit
+typedef struct BitWriter {
+  unsigned char *data;
+  size_t size;
+  uint64_t bits;
+  int count;
+} BitWriter;
+
+static void put_bits(BitWriter *writer, uint32_t value, int count) {
+  writer->bits |= (uint64_t)value << writer->count;
+  writer->count += count;
+  while (writer->count >= 8) {
+    writer->data[writer->size++] = (unsigned char)writer->bits;
+    writer->bits >>= 8;
+    writer->count -= 8;
+  }
+}
+
+// Huffman codes are stored starting with their most significant bit
+static void put_code(BitWriter *writer, uint32_t code, int length) {
+  uint32_t reversed = 0;
+  for (int i = 0; i < length; i++) {
+    reversed = (reversed << 1) | ((code >> i) & 1);
+  }
+  put_bits(writer, reversed, length);
+}
+
+// Literal/length symbol with the fixed Huffman code
+static void put_symbol(BitWriter *writer, int symbol) {
+  if (symbol < 144) {
+    put_code(writer, 0x30 + symbol, 8);
+  } else if (symbol < 256) {
+    put_code(writer, 0x190 + symbol - 144, 9);
+  } else if (symbol < 280) {
+    put_code(writer, symbol - 256, 7);
+  } else {
+    put_code(writer, 0xC0 + symbol - 280, 8);
+  }
+}
+
+static void put_match(BitWriter *writer, size_t length, size_t distance) {
+  int code = 28;
+  while (LENGTH_BASE[code] > length) {
+    code--;
+  }
+  put_symbol(writer, 257 + code);
+  put_bits(writer, (uint32_t)(length - LENGTH_BASE[code]),
+           LENGTH_EXTRA[code]);
+  code = 29;
+  while (DISTANCE_BASE[code] > distance) {
+    code--;
+  }
+  put_code(writer, code, 5);
+  put_bits(writer, (uint32_t)(distance - DISTANCE_BASE[code]),
+           DISTANCE_EXTRA[code]);
+}
+
+static uint32_t hash3(const unsigned char *data) {
+  uint32_t value = data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16;
+  return (value * 2654435761u) >> (32 - PNG_HASH_BITS);
+}
+
+/**
+ * @brief Compresses `data` into a zlib stream with a single fixed Huffman
+ * block.
+ *
+ * @param output At least size * 9 / 8 + 16 bytes: every literal takes at most
+ * 9 bits.
+ * @return The size of the stream, 0 if the memory ran out.
+ */
+static size_t zlib_compress(const unsigned char *data, size_t size,
+                            unsigned char *output) {
+  long *head = malloc(((size_t)1 << PNG_HASH_BITS) * sizeof(*head));
+  if (!head) {
+    return 0;
+  }
+  for (size_t i = 0; i < (size_t)1 << PNG_HASH_BITS; i++) {
+    head[i] = -1;
+  }
+  BitWriter writer = {output, 0, 0, 0};
+  put_bits(&writer, 0x78, 8); // Deflate, 32 KiB window
+  put_bits(&writer, 0x01, 8); // Header check bits
+  put_bits(&writer, 1, 1);    // Last block
+  put_bits(&writer, 1, 2);    // Fixed Huffman codes
+
+  size_t i = 0;
+  while (i + MIN_MATCH <= size) {
+    uint32_t hash = hash3(data + i);
+    long candidate = head[hash];
+    head[hash] = (long)i;
+    size_t length = 0;
+    if (candidate >= 0 && i - (size_t)candidate <= PNG_WINDOW_SIZE) {
+      size_t limit = size - i < MAX_MATCH ? size - i : MAX_MATCH;
+      while (length < limit && data[candidate + length] == data[i + length]) {
+        length++;
+      }
+    }
+    if (length < MIN_MATCH) {
+      put_symbol(&writer, data[i++]);
+      continue;
+    }
+    put_match(&writer, length, i - (size_t)candidate);
+    for (size_t j = i + 1; j < i + length && j + MIN_MATCH <= size; j++) {
+      head[hash3(data + j)] = (long)j;
+    }
+    i += length;
+  }
+  for (; i < size; i++) {
+    put_symbol(&writer, data[i]);
+  }
+  put_symbol(&writer, 256); // End of block
+  put_bits(&writer, 0, 7);  // Flush the last byte
+  free(head);
+
+  uint32_t a = 1, b = 0; // Adler-32 of the uncompressed data
+  for (size_t j = 0; j < size; j++) {
+    a += data[j];
+    b += a;
+    if (j % 5552 == 5551) { // Before b can overflow
+      a %= 65521;
+      b %= 65521;
+    }
+  }
+  a %= 65521;
+  b %= 65521;
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    output[writer.size++] = (unsigned char)(((b << 16 | a) >> shift) & 0xFF);
+  }
+  return writer.size;
+}
+
+static uint32_t crc32_update(uint32_t crc, const unsigned char *data,
+                             size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    crc = CRC_TABLE[(crc ^ data[i]) & 15] ^ (crc >> 4);
+    crc = CRC_TABLE[(crc ^ (data[i] >> 4)) & 15] ^ (crc >> 4);
+  }
+  return crc;
+}
+
+static void store_u32(unsigned char *bytes, uint32_t value) {
+  bytes[0] = (unsigned char)(value >> 24);
+  bytes[1] = (unsigned char)(value >> 16);
+  bytes[2] = (unsigned char)(value >> 8);
+  bytes[3] = (unsigned char)value;
+}
+
+static int write_chunk(FILE *file, const char *type, const unsigned char *data,
+                       size_t size) {
+  unsigned char header[8], footer[4];
+  store_u32(header, (uint32_t)size);
+  memcpy(header + 4, type, 4);
+  uint32_t crc = crc32_update(0xFFFFFFFFu, header + 4, 4);
+  // IEND has no payload and passes NULL
+  if (size > 0) {
+    crc = crc32_update(crc, data, size);
+  }
+  store_u32(footer, crc ^ 0xFFFFFFFFu);
+  return fwrite(header, 1, 8, file) == 8 &&
+         (size == 0 || fwrite(data, 1, size, file) == size) &&
+         fwrite(footer, 1, 4, file) == 4;
+}
+
+/**
+ * @brief Saves the image as 8 bit RGB PNG.
+ *
+ * @param bytes Receives the file size.
+ * @return 1 on success, 0 if the file could not be written or the memory ran
+ * out.
+ */
+int write_png(const RgbImage *image, const char *filename, size_t *bytes) {
+  size_t row_bytes = (size_t)image->width * 3 + 1; // With the filter byte
+  size_t raw_size = row_bytes * image->height;
+  unsigned char *raw = malloc(raw_size);
+  unsigned char *compressed = malloc(raw_size + raw_size / 8 + 16);
+  size_t compressed_size = 0;
+  if (raw && compressed) {
+    for (int y = 0; y < image->height; y++) {
+      raw[y * row_bytes] = 0; // Filter type None
+      memcpy(raw + y * row_bytes + 1,
+             image->pixels + (size_t)y * image->width * 3, row_bytes - 1);
+    }
+    compressed_size = zlib_compress(raw, raw_size, compressed);
+  }
+  free(raw);
+  FILE *file = compressed_size > 0 ? fopen(filename, "wb") : NULL;
+  if (!file) {
+    free(compressed);
+    return 0;
+  }
+
+  static const unsigned char SIGNATURE[8] = {0x89, 'P',  'N',  'G',
+                                             '\r', '\n', 0x1A, '\n'};
+  unsigned char header[13];
+  store_u32(header, (uint32_t)image->width);
+  store_u32(header + 4, (uint32_t)image->height);
+  header[8] = 8;  // Bits per channel
+  header[9] = 2;  // RGB
+  header[10] = 0; // Deflate
+  header[11] = 0; // Adaptive filtering
+  header[12] = 0; // Not interlaced
+  int success = fwrite(SIGNATURE, 1, 8, file) == 8 &&
+                write_chunk(file, "IHDR", header, sizeof(header)) &&
+                write_chunk(file, "IDAT", compressed, compressed_size) &&
+                write_chunk(file, "IEND", NULL, 0);
+  success = fclose(file) == 0 && success;
+  free(compressed);
+  *bytes = 8 + 25 + compressed_size + 12 + 12;
+  return success;
+}
+
+/**
+ * @brief Saves the image as PPM if the filename ends in ".ppm", otherwise as
+ * PNG.
+ */
+int write_image(const RgbImage *image, const char *filename, size_t *bytes) {
+  size_t length = strlen(filename);
+  if (length >= 4 && strcmp(filename + length - 4, ".ppm") == 0) {
+    return write_ppm(image, filename, bytes);
+  }
+  return write_png(image, filename, bytes);
+}
@@ -0,0 +1,22 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include <stddef.h>
+
+#define PNG_WINDOW_SIZE 32768 // Largest match distance of deflate
+#define PNG_HASH_BITS 15
+
+// 8 bit RGB pixels, row by row from the top
+typedef struct RgbImage {
+  int width;
+  int height;
+  unsigned char *pixels;
+} RgbImage;
+
+int rgb_image_init(RgbImage *image, int width, int height);
+void rgb_image_free(RgbImage *image);
+int write_ppm(const RgbImage *image, const char *filename, size_t *bytes);
+int write_png(const RgbImage *image, const char *filename, size_t *bytes);
+int write_image(const RgbImage *image, const char *filename, size_t *bytes);
+
+#endif // IMAGE_WRITER_H
@@ -0,0 +1,404 @@
+/**
+ * Incremental analysis of a growing telemetry file.
+ *
+ * Checkpoint file format (native byte order, not meant to be moved between
+ * machines):
+ *   magic "SPCCKPT1", uint32 version, uint32 sizeof(double)
+ *   uint64 byte offset, line number, time steps, malformed rows,
+ *          fingerprint, fingerprint length
+ *   integrator state: position x/y, velocity x/y, rotation (doubles)
+ *   metrics: max speed, max distance, total distance (doubles)
+ *   temperature moments: uint64 count, mean, m2, min, max
+ *   temperature digest: uint64 centroids, uint64 buffered, total weight, min,
+ *                       max, centroids (mean, weight), buffered values
+ *   heatmap: int32 resolution, int32 auto bounds, origin x/y, cell
+ *            width/height, min/max x, min/max y (doubles), int64 min/max
+ *            cell x, min/max cell y, uint64 points outside, uint64 number
+ *            of cells, cells (int64 x, int64 y, sum, uint64 count)
+ */
+
+// fseeko() and off_t are POSIX, not part of strict ISO C builds (-std=c11)
+#define _POSIX_C_SOURCE 200809L
+
+#include "incremental.h"
+#include "csv_parser.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECKPOINT_MAGIC "SPCCKPT1"
+#define CHECKPOINT_VERSION 2
+#define READ_BLOCK_SIZE (1 << 20)
+
+static int seek_to(FILE *file, uint64_t offset) {
+#ifdef _WIN32
+  return _fseeki64(file, (long long)offset, SEEK_SET) == 0;
+#else
+  return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+/**
+ * @brief FNV-1a hash of the first `length` bytes of a file.
+ *
+ * @return 1 on success, 0 if the file is shorter than `length`.
+ */
+static int hash_prefix(FILE *file, uint64_t length, uint64_t *hash) {
+  unsigned char bytes[FINGERPRINT_BYTES];
+  if (length > sizeof(bytes) || !seek_to(file, 0) ||
+      fread(bytes, 1, (size_t)length, file) != length) {
+    return 0;
+  }
+
+  *hash = UINT64_C(14695981039346656037);
+  for (size_t i = 0; i < length; i++) {
+    *hash = (*hash ^ bytes[i]) * UINT64_C(1099511628211);
+  }
+  return 1;
+}
+
+void incremental_init(IncrementalAnalysis *analysis, int resolution) {
+  flight_state_init(&analysis->state);
+  analysis->byte_offset = 0;
+  analysis->line_number = 0;
+  analysis->time_steps = 0;
+  analysis->malformed_rows = 0;
+  analysis->fingerprint = 0;
+  analysis->fingerprint_length = 0;
+  heatmap_init_auto(&analysis->heatmap, resolution);
+}
+
+/**
+ * @brief Replaces the auto bounds of the heatmap by fixed bounds. Only
+ * allowed before the first update, later points outside of the bounds are
+ * not drawn.
+ */
+void incremental_set_bounds(IncrementalAnalysis *analysis, double min_x,
+                            double min_y, double max_x, double max_y) {
+  int resolution = analysis->heatmap.resolution;
+  heatmap_free(&analysis->heatmap);
+  heatmap_init(&analysis->heatmap, resolution, min_x, min_y, max_x, max_y);
+}
+
+/**
+ * @brief Checks whether the analysis state belongs to the input file, i.e.
+ * the file still starts with the same bytes and hasn't been truncated.
+ */
+int incremental_matches_input(const IncrementalAnalysis *analysis,
+                              FILE *input) {
+  uint64_t hash;
+  if (!hash_prefix(input, analysis->fingerprint_length, &hash) ||
+      hash != analysis->fingerprint) {
+    return 0;
+  }
+  // The last consumed byte must still exist
+  unsigned char byte;
+  return analysis->byte_offset == 0 ||
+         (seek_to(input, analysis->byte_offset - 1) &&
+          fread(&byte, 1, 1, input) == 1);
+}
+
+/**
+ * @brief Processes all complete lines appended to the input since the last
+ * update.
+ *
+ * The rows are integrated with the same chunk functions as a full run, so the
+ * results only differ from it where the batch kernels handle the chunk
+ * boundaries differently (at most a few ulp, none with the scalar backend).
+ *
+ * @param analysis State of the previous updates.
+ * @param input The telemetry file, opened in binary mode.
+ * @param new_rows Receives the number of time steps added.
+ * @return 1 on success, 0 if the memory ran out or the file couldn't be read.
+ * The analysis is inconsistent after a failure and must not be saved.
+ */
+int incremental_update(IncrementalAnalysis *analysis, FILE *input,
+                       size_t *new_rows) {
+  *new_rows = 0;
+  if (!seek_to(input, analysis->byte_offset)) {
+    return 0;
+  }
+
+  size_t buffer_size = READ_BLOCK_SIZE;
+  char *buffer = malloc(buffer_size);
+  TelemetryChunk *chunk = malloc(sizeof(*chunk));
+  ChunkKinematics *kinematics = malloc(sizeof(*kinematics));
+  Trajectory points; // Positions of the current chunk
+  trajectory_init(&points);
+  int success = buffer && chunk && kinematics;
+
+  size_t pending = 0; // Bytes of an incomplete line at the buffer start
+  while (success) {
+    if (pending == buffer_size) {
+      // A single line doesn't fit into the buffer
+      char *larger = realloc(buffer, buffer_size * 2);
+      if (!larger) {
+        success = 0;
+        break;
+      }
+      buffer = larger;
+      buffer_size *= 2;
+    }
+    size_t bytes_read =
+        fread(buffer + pending, 1, buffer_size - pending, input);
+    if (bytes_read == 0) {
+      break;
+    }
+
+    size_t filled = pending + bytes_read;
+    size_t complete = filled;
+    while (complete > 0 && buffer[complete - 1] != '\n') {
+      complete--;
+    }
+
+    CsvParser parser;
+    csv_parser_init(&parser, buffer, complete);
+    parser.line_number = (size_t)analysis->line_number;
+    while (success && csv_read_chunk(&parser, chunk) > 0) {
+      points.length = 0;
+      if (!process_chunk(&analysis->state, chunk, kinematics, &points)) {
+        success = 0;
+        break;
+      }
+      for (size_t i = 0; i < points.length && success; i++) {
+        success = heatmap_add(&analysis->heatmap, points.x[i], points.y[i],
+                              points.temperature[i]);
+      }
+      analysis->time_steps += chunk->length;
+      *new_rows += chunk->length;
+    }
+    analysis->line_number = parser.line_number;
+    analysis->malformed_rows += parser.malformed_rows;
+    analysis->byte_offset += complete;
+
+    memmove(buffer, buffer + complete, filled - complete);
+    pending = filled - complete;
+  }
+
+  if (success && analysis->fingerprint_length < FINGERPRINT_BYTES &&
+      analysis->byte_offset > analysis->fingerprint_length) {
+    analysis->fingerprint_length = analysis->byte_offset < FINGERPRINT_BYTES
+                                       ? analysis->byte_offset
+                                       : FINGERPRINT_BYTES;
+    success = hash_prefix(input, analysis->fingerprint_length,
+                          &analysis->fingerprint);
+  }
+
+  trajectory_free(&points);
+  free(buffer);
+  free(chunk);
+  free(kinematics);
+  return success;
+}
+
+void incremental_free(IncrementalAnalysis *analysis) {
+  heatmap_free(&analysis->heatmap);
+}
+
+static int write_bytes(FILE *file, const void *data, size_t size) {
+  return fwrite(data, 1, size, file) == size;
+}
+
+static int read_bytes(FILE *file, void *data, size_t size) {
+  return fread(data, 1, size, file) == size;
+}
+
+/**
+ * @brief Writes the analysis state to a checkpoint file.
+ *
+ * The state is written to "<filename>.tmp" first and then renamed, so an
+ * interrupted run never leaves a damaged checkpoint behind.
+ *
+ * @return 1 on success, 0 if the file could not be written.
+ */
+int checkpoint_save(const IncrementalAnalysis *analysis, const char *filename) {
+  char temporary[1024];
+  if (snprintf(temporary, sizeof(temporary), "%s.tmp", filename) >=
+      (int)sizeof(temporary)) {
+    return 0;
+  }
+  FILE *file = fopen(temporary, "wb");
+  if (!file) {
+    return 0;
+  }
+
+  const FlightState *s = &analysis->state;
+  const TDigest *digest = &s->temperature_digest;
+  uint32_t version = CHECKPOINT_VERSION;
+  uint32_t double_size = sizeof(double);
+  uint64_t count = s->temperature_stats.count;
+  uint64_t num_centroids = digest->num_centroids;
+  uint64_t num_buffered = digest->num_buffered;
+  const Heatmap *h = &analysis->heatmap;
+  int32_t heatmap_flags[] = {h->resolution, h->auto_bounds};
+  double heatmap_bounds[] = {h->origin_x, h->origin_y, h->cell_width,
+                             h->cell_height, h->min_x, h->min_y,
+                             h->max_x, h->max_y};
+  int64_t cell_range[] = {h->min_cell_x, h->max_cell_x, h->min_cell_y,
+                          h->max_cell_y};
+  uint64_t num_cells = h->num_cells;
+  double doubles[] = {s->current_position.x,
+                      s->current_position.y,
+                      s->current_velocity.x,
+                      s->current_velocity.y,
+                      s->current_rotation,
+                      s->max_speed,
+                      s->max_distance,
+                      s->total_distance};
+
+  int ok = write_bytes(file, CHECKPOINT_MAGIC, 8) &&
+           write_bytes(file, &version, sizeof(version)) &&
+           write_bytes(file, &double_size, sizeof(double_size)) &&
+           write_bytes(file, &analysis->byte_offset, sizeof(uint64_t)) &&
+           write_bytes(file, &analysis->line_number, sizeof(uint64_t)) &&
+           write_bytes(file, &analysis->time_steps, sizeof(uint64_t)) &&
+           write_bytes(file, &analysis->malformed_rows, sizeof(uint64_t)) &&
+           write_bytes(file, &analysis->fingerprint, sizeof(uint64_t)) &&
+           write_bytes(file, &analysis->fingerprint_length,
+                       sizeof(uint64_t)) &&
+           write_bytes(file, doubles, sizeof(doubles)) &&
+           write_bytes(file, &count, sizeof(count)) &&
+           write_bytes(file, &s->temperature_stats.mean, sizeof(double)) &&
+           write_bytes(file, &s->temperature_stats.m2, sizeof(double)) &&
+           write_bytes(file, &s->temperature_stats.min, sizeof(double)) &&
+           write_bytes(file, &s->temperature_stats.max, sizeof(double)) &&
+           write_bytes(file, &num_centroids, sizeof(num_centroids)) &&
+           write_bytes(file, &num_buffered, sizeof(num_buffered)) &&
+           write_bytes(file, &digest->total_weight, sizeof(double)) &&
+           write_bytes(file, &digest->min, sizeof(double)) &&
+           write_bytes(file, &digest->max, sizeof(double)) &&
+           write_bytes(file, digest->centroids,
+                       digest->num_centroids * sizeof(Centroid)) &&
+           write_bytes(file, digest->buffer,
+                       digest->num_buffered * sizeof(double)) &&
+           write_bytes(file, heatmap_flags, sizeof(heatmap_flags)) &&
+           write_bytes(file, heatmap_bounds, sizeof(heatmap_bounds)) &&
+           write_bytes(file, cell_range, sizeof(cell_range)) &&
+           write_bytes(file, &h->outside, sizeof(uint64_t)) &&
+           write_bytes(file, &num_cells, sizeof(num_cells));
+
+  // Only the occupied slots of the hash map
+  for (size_t i = 0; ok && i < h->capacity; i++) {
+    if (h->cells[i].count > 0) {
+      ok = write_bytes(file, &h->cells[i], sizeof(HeatmapCell));
+    }
+  }
+
+  ok = (fclose(file) == 0) && ok;
+#ifdef _WIN32
+  remove(filename); // rename() doesn't replace existing files on Windows
+#endif
+  if (!ok || rename(temporary, filename) != 0) {
+    remove(temporary);
+    return 0;
+  }
+  return 1;
+}
+
+/**
+ * @brief Restores the analysis state from a checkpoint file.
+ *
+ * @param analysis An initialized analysis. On failure it is reset to an empty
+ * analysis with its previous heatmap resolution.
+ * @return 1 on success, 0 if the file doesn't exist or isn't a valid
+ * checkpoint.
+ */
+int checkpoint_load(IncrementalAnalysis *analysis, const char *filename) {
+  int resolution_before = analysis->heatmap.resolution;
+  incremental_free(analysis);
+  incremental_init(analysis, resolution_before);
+  FILE *file = fopen(filename, "rb");
+  if (!file) {
+    return 0;
+  }
+
+  FlightState *s = &analysis->state;
+  TDigest *digest = &s->temperature_digest;
+  char magic[8];
+  uint32_t version, double_size;
+  uint64_t count, num_centroids, num_buffered, num_cells;
+  Heatmap *h = &analysis->heatmap;
+  int32_t heatmap_flags[2];
+  double heatmap_bounds[8];
+  int64_t cell_range[4];
+  double doubles[8];
+
+  int ok = read_bytes(file, magic, sizeof(magic)) &&
+           memcmp(magic, CHECKPOINT_MAGIC, 8) == 0 &&
+           read_bytes(file, &version, sizeof(version)) &&
+           version == CHECKPOINT_VERSION &&
+           read_bytes(file, &double_size, sizeof(double_size)) &&
+           double_size == sizeof(double) &&
+           read_bytes(file, &analysis->byte_offset, sizeof(uint64_t)) &&
+           read_bytes(file, &analysis->line_number, sizeof(uint64_t)) &&
+           read_bytes(file, &analysis->time_steps, sizeof(uint64_t)) &&
+           read_bytes(file, &analysis->malformed_rows, sizeof(uint64_t)) &&
+           read_bytes(file, &analysis->fingerprint, sizeof(uint64_t)) &&
+           read_bytes(file, &analysis->fingerprint_length,
+                      sizeof(uint64_t)) &&
+           analysis->fingerprint_length <= FINGERPRINT_BYTES &&
+           read_bytes(file, doubles, sizeof(doubles)) &&
+           read_bytes(file, &count, sizeof(count)) &&
+           read_bytes(file, &s->temperature_stats.mean, sizeof(double)) &&
+           read_bytes(file, &s->temperature_stats.m2, sizeof(double)) &&
+           read_bytes(file, &s->temperature_stats.min, sizeof(double)) &&
+           read_bytes(file, &s->temperature_stats.max, sizeof(double)) &&
+           read_bytes(file, &num_centroids, sizeof(num_centroids)) &&
+           num_centroids <= TDIGEST_MAX_CENTROIDS &&
+           read_bytes(file, &num_buffered, sizeof(num_buffered)) &&
+           num_buffered <= TDIGEST_BUFFER_SIZE &&
+           read_bytes(file, &digest->total_weight, sizeof(double)) &&
+           read_bytes(file, &digest->min, sizeof(double)) &&
+           read_bytes(file, &digest->max, sizeof(double)) &&
+           read_bytes(file, digest->centroids,
+                      (size_t)num_centroids * sizeof(Centroid)) &&
+           read_bytes(file, digest->buffer,
+                      (size_t)num_buffered * sizeof(double)) &&
+           read_bytes(file, heatmap_flags, sizeof(heatmap_flags)) &&
+           heatmap_flags[0] > 0 &&
+           heatmap_flags[0] <= HEATMAP_MAX_RESOLUTION &&
+           read_bytes(file, heatmap_bounds, sizeof(heatmap_bounds)) &&
+           read_bytes(file, cell_range, sizeof(cell_range)) &&
+           read_bytes(file, &h->outside, sizeof(uint64_t)) &&
+           read_bytes(file, &num_cells, sizeof(num_cells));
+
+  if (ok) {
+    s->current_position.x = doubles[0];
+    s->current_position.y = doubles[1];
+    s->current_velocity.x = doubles[2];
+    s->current_velocity.y = doubles[3];
+    s->current_rotation = doubles[4];
+    s->max_speed = doubles[5];
+    s->max_distance = doubles[6];
+    s->total_distance = doubles[7];
+    s->temperature_stats.count = (size_t)count;
+    digest->num_centroids = (size_t)num_centroids;
+    digest->num_buffered = (size_t)num_buffered;
+    h->resolution = heatmap_flags[0];
+    h->auto_bounds = heatmap_flags[1];
+    h->origin_x = heatmap_bounds[0];
+    h->origin_y = heatmap_bounds[1];
+    h->cell_width = heatmap_bounds[2];
+    h->cell_height = heatmap_bounds[3];
+    h->min_x = heatmap_bounds[4];
+    h->min_y = heatmap_bounds[5];
+    h->max_x = heatmap_bounds[6];
+    h->max_y = heatmap_bounds[7];
+    h->min_cell_x = cell_range[0];
+    h->max_cell_x = cell_range[1];
+    h->min_cell_y = cell_range[2];
+    h->max_cell_y = cell_range[3];
+  }
+
+  for (uint64_t i = 0; ok && i < num_cells; i++) {
+    HeatmapCell cell;
+    ok = read_bytes(file, &cell, sizeof(cell)) && cell.count > 0 &&
+         heatmap_insert_cell(h, &cell);
+  }
+  fclose(file);
+
+  if (!ok) {
+    incremental_free(analysis);
+    incremental_init(analysis, resolution_before);
+  }
+  return ok;
+}
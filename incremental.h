@@ -0,0 +1,37 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include "flight.h"
+#include "heatmap.h"
+#include <stdint.h>
+#include <stdio.h>
+
+#define FINGERPRINT_BYTES 4096 // Input prefix that identifies the file
+
+// Everything needed to continue the analysis of a growing input file where
+// the previous run stopped. Only complete lines (terminated by '\n') are
+// consumed, an unterminated last line is left for the next update.
+typedef struct IncrementalAnalysis {
+  FlightState state;
+  uint64_t byte_offset; // Input bytes consumed so far
+  uint64_t line_number; // Input lines consumed so far
+  uint64_t time_steps;
+  uint64_t malformed_rows;
+  uint64_t fingerprint; // Hash of the first `fingerprint_length` input bytes
+  uint64_t fingerprint_length;
+  Heatmap heatmap;
+} IncrementalAnalysis;
+
+void incremental_init(IncrementalAnalysis *analysis, int resolution);
+void incremental_set_bounds(IncrementalAnalysis *analysis, double min_x,
+                            double min_y, double max_x, double max_y);
+int incremental_matches_input(const IncrementalAnalysis *analysis,
+                              FILE *input);
+int incremental_update(IncrementalAnalysis *analysis, FILE *input,
+                       size_t *new_rows);
+void incremental_free(IncrementalAnalysis *analysis);
+
+int checkpoint_save(const IncrementalAnalysis *analysis, const char *filename);
+int checkpoint_load(IncrementalAnalysis *analysis, const char *filename);
+
+#endif // INCREMENTAL_H
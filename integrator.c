@@ -0,0 +1,277 @@
+/**
+ * Integration schemes for a single time step.
+ *
+ * Within a time step of length 1 the rotation changes linearly from r0 to
+ * r0 + w (w: rotation value of the row) and the thrust a (acceleration value
+ * of the row) points in the current rotation:
+ *
+ *   rotation' = w,  velocity' = a * (cos(rotation), sin(rotation)),
+ *   position' = velocity
+ *
+ * The start velocity only moves the position by v0 * t, so every scheme
+ * integrates the change of velocity u and the displacement caused by the
+ * thrust s from zero, and the state is updated with
+ *   velocity += u,  position += v0 + s.
+ * This keeps the error estimate of the adaptive scheme independent of the
+ * magnitude of position and velocity.
+ *
+ * The original loop (rotate, then accelerate with the new rotation, then
+ * translate with the new velocity) is one semi-implicit Euler step per row.
+ */
+
+#include "integrator.h"
+#include <math.h>
+#include <string.h>
+
+#define MIN_ADAPTIVE_STEP 1e-6
+#define MAX_STEP_GROWTH 4.0
+#define MIN_STEP_SHRINK 0.2
+
+static const char *SCHEME_NAMES[NUM_INTEGRATOR_SCHEMES] = {
+    "semi-implicit", "euler", "rk4", "adaptive", "exact"};
+
+static Integrator active_integrator = {INTEGRATOR_SEMI_IMPLICIT_EULER, 1,
+                                       INTEGRATOR_DEFAULT_TOLERANCE, 0};
+
+// Velocity change and thrust displacement since the start of the time step
+typedef struct StepDelta {
+  double rotation; // Rotation at the current time
+  Vec2D velocity;
+  Vec2D displacement;
+} StepDelta;
+
+void integrator_init(Integrator *integrator, IntegratorScheme scheme) {
+  integrator->scheme = scheme;
+  integrator->substeps = 1;
+  integrator->tolerance = INTEGRATOR_DEFAULT_TOLERANCE;
+  integrator->fast_heading = 0;
+}
+
+/**
+ * @brief Whether the integrator is the original one step semi-implicit
+ * Euler, for which integrate_chunk() uses the batch kernels (with or without
+ * the fast heading).
+ */
+int integrator_is_default(const Integrator *integrator) {
+  return integrator->scheme == INTEGRATOR_SEMI_IMPLICIT_EULER &&
+         integrator->substeps == 1;
+}
+
+/**
+ * @return 1 if `name` is the name of a scheme, 0 otherwise.
+ */
+int integrator_from_name(const char *name, IntegratorScheme *scheme) {
+  for (int i = 0; i < NUM_INTEGRATOR_SCHEMES; i++) {
+    if (strcmp(name, SCHEME_NAMES[i]) == 0) {
+      *scheme = (IntegratorScheme)i;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+const char *integrator_name(IntegratorScheme scheme) {
+  return scheme < NUM_INTEGRATOR_SCHEMES ? SCHEME_NAMES[scheme] : "unknown";
+}
+
+/**
+ * @brief Selects the integrator used by integrate_chunk(). Must be called
+ * before any analysis starts, it is shared by all threads.
+ */
+void integrator_set(const Integrator *integrator) {
+  active_integrator = *integrator;
+}
+
+const Integrator *integrator_get(void) { return &active_integrator; }
+
+static void add_scaled(Vec2D *vector, double factor, double angle) {
+  vector->x += factor * cos(angle);
+  vector->y += factor * sin(angle);
+}
+
+static void semi_implicit_euler_step(StepDelta *d, double acceleration,
+                                     double rotation_change, double h) {
+  d->rotation += rotation_change * h;
+  add_scaled(&d->velocity, acceleration * h, d->rotation);
+  d->displacement.x += d->velocity.x * h;
+  d->displacement.y += d->velocity.y * h;
+}
+
+static void explicit_euler_step(StepDelta *d, double acceleration,
+                                double rotation_change, double h) {
+  d->displacement.x += d->velocity.x * h;
+  d->displacement.y += d->velocity.y * h;
+  add_scaled(&d->velocity, acceleration * h, d->rotation);
+  d->rotation += rotation_change * h;
+}
+
+/**
+ * @brief Classic Runge-Kutta step. The rotation is linear in time, so the
+ * four stages only need the thrust direction at the start, the middle and
+ * the end of the step.
+ */
+static void rk4_step(StepDelta *d, double acceleration, double rotation_change,
+                     double h) {
+  double start = d->rotation;
+  double middle = start + 0.5 * h * rotation_change;
+  double end = start + h * rotation_change;
+  double c0 = cos(start), s0 = sin(start);
+  double cm = cos(middle), sm = sin(middle);
+  double c1 = cos(end), s1 = sin(end);
+
+  double position_factor = h * h * acceleration / 6.0;
+  d->displacement.x += h * d->velocity.x + position_factor * (c0 + 2 * cm);
+  d->displacement.y += h * d->velocity.y + position_factor * (s0 + 2 * sm);
+  double velocity_factor = h * acceleration / 6.0;
+  d->velocity.x += velocity_factor * (c0 + 4 * cm + c1);
+  d->velocity.y += velocity_factor * (s0 + 4 * sm + s1);
+  d->rotation = end;
+}
+
+/**
+ * @brief RK4 with step doubling: every step is done once with size h and
+ * twice with h / 2. The difference estimates the error, the step is repeated
+ * with a smaller size if it exceeds the tolerance.
+ *
+ * The tolerance is relative to the thrust (at least 1), the size the velocity
+ * change reaches in the time step, so rounding errors of a huge acceleration
+ * don't count as truncation errors. Steps of MIN_ADAPTIVE_STEP and steps
+ * without a finite error estimate (inf or NaN input) are always accepted.
+ *
+ * @return The number of accepted steps.
+ */
+static int adaptive_steps(StepDelta *d, double acceleration,
+                          double rotation_change, double tolerance) {
+  double t = 0, h = 1;
+  int steps = 0;
+  double max_error = tolerance * fmax(1.0, fabs(acceleration));
+  while (t < 1) {
+    if (h > 1 - t) {
+      h = 1 - t;
+    }
+    StepDelta full = *d, half = *d;
+    rk4_step(&full, acceleration, rotation_change, h);
+    rk4_step(&half, acceleration, rotation_change, 0.5 * h);
+    rk4_step(&half, acceleration, rotation_change, 0.5 * h);
+
+    // The error of the half steps is about 1/15 of the difference
+    double error =
+        fmax(fmax(fabs(half.velocity.x - full.velocity.x),
+                  fabs(half.velocity.y - full.velocity.y)),
+             fmax(fabs(half.displacement.x - full.displacement.x),
+                  fabs(half.displacement.y - full.displacement.y))) /
+        15.0;
+    if (error <= max_error || h <= MIN_ADAPTIVE_STEP || !isfinite(error)) {
+      // Richardson extrapolation removes the leading error term
+      const Vec2D *v = &half.velocity, *s = &half.displacement;
+      d->velocity.x = v->x + (v->x - full.velocity.x) / 15;
+      d->velocity.y = v->y + (v->y - full.velocity.y) / 15;
+      d->displacement.x = s->x + (s->x - full.displacement.x) / 15;
+      d->displacement.y = s->y + (s->y - full.displacement.y) / 15;
+      d->rotation = half.rotation;
+      t += h;
+      steps++;
+    }
+
+    // The local error of RK4 grows with h^5
+    double factor =
+        error > 0 ? 0.9 * pow(max_error / error, 0.2) : MAX_STEP_GROWTH;
+    h *= fmin(MAX_STEP_GROWTH, fmax(MIN_STEP_SHRINK, factor));
+    h = fmax(h, MIN_ADAPTIVE_STEP);
+  }
+  return steps;
+}
+
+/**
+ * @brief Closed form solution of a whole time step. With the rotation
+ * r(t) = r0 + w * t and e(r) = (cos r, sin r), treated as complex numbers:
+ *   u = a * e(r0) * (sin w / w + i (1 - cos w) / w)
+ *   s = a * e(r0) * ((1 - cos w) / w^2 + i (w - sin w) / w^2)
+ * For small w the fractions are evaluated as power series to avoid
+ * cancellation.
+ */
+static void exact_step(StepDelta *d, double acceleration,
+                       double rotation_change) {
+  double w = rotation_change;
+  double velocity_real, velocity_imaginary; // sin w / w, (1 - cos w) / w
+  double position_real, position_imaginary; // (1 - cos w) / w^2, ...
+  if (fabs(w) < 0.5) {
+    // Taylor series, the terms are below 1e-17 after w^12
+    double w2 = w * w;
+    position_real = 0, position_imaginary = 0, velocity_real = 0;
+    double term = 1.0, sign = 1.0;
+    for (int k = 0; k <= 6; k++) {
+      // term = w^(2k) / (2k)!
+      velocity_real += sign * term / (2 * k + 1);
+      position_real += sign * term / ((2 * k + 1) * (2 * k + 2));
+      position_imaginary +=
+          sign * term * w / ((2 * k + 1) * (2 * k + 2) * (2 * k + 3));
+      term *= w2 / ((2 * k + 1) * (2 * k + 2));
+      sign = -sign;
+    }
+    velocity_imaginary = w * position_real;
+  } else {
+    double s = sin(w), c = cos(w);
+    velocity_real = s / w;
+    velocity_imaginary = (1 - c) / w;
+    position_real = (1 - c) / (w * w);
+    position_imaginary = (w - s) / (w * w);
+  }
+
+  double c0 = acceleration * cos(d->rotation);
+  double s0 = acceleration * sin(d->rotation);
+  d->displacement.x += c0 * position_real - s0 * position_imaginary;
+  d->displacement.y += s0 * position_real + c0 * position_imaginary;
+  d->velocity.x += c0 * velocity_real - s0 * velocity_imaginary;
+  d->velocity.y += s0 * velocity_real + c0 * velocity_imaginary;
+  d->rotation += w;
+}
+
+/**
+ * @brief Advances the state by one time step (one CSV row).
+ *
+ * @param integrator Scheme and its step size or tolerance.
+ * @param state Rotation, velocity and position, updated in place.
+ * @param acceleration Thrust during the time step.
+ * @param rotation_change Change of the rotation during the time step.
+ * @return The number of steps the time step was divided into.
+ */
+int integrate_step(const Integrator *integrator, IntegratorState *state,
+                   double acceleration, double rotation_change) {
+  StepDelta d = {state->rotation, {0, 0}, {0, 0}};
+  int steps = integrator->substeps > 0 ? integrator->substeps : 1;
+  double h = 1.0 / steps;
+
+  switch (integrator->scheme) {
+  case INTEGRATOR_EXPLICIT_EULER:
+    for (int i = 0; i < steps; i++) {
+      explicit_euler_step(&d, acceleration, rotation_change, h);
+    }
+    break;
+  case INTEGRATOR_RK4:
+    for (int i = 0; i < steps; i++) {
+      rk4_step(&d, acceleration, rotation_change, h);
+    }
+    break;
+  case INTEGRATOR_ADAPTIVE:
+    steps = adaptive_steps(&d, acceleration, rotation_change,
+                           integrator->tolerance);
+    break;
+  case INTEGRATOR_EXACT:
+    exact_step(&d, acceleration, rotation_change);
+    steps = 1;
+    break;
+  default:
+    for (int i = 0; i < steps; i++) {
+      semi_implicit_euler_step(&d, acceleration, rotation_change, h);
+    }
+    break;
+  }
+
+  state->position.x += state->velocity.x + d.displacement.x;
+  state->position.y += state->velocity.y + d.displacement.y;
+  state->velocity.x += d.velocity.x;
+  state->velocity.y += d.velocity.y;
+  state->rotation = d.rotation;
+  return steps;
+}
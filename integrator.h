@@ -0,0 +1,45 @@
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+
+#include "trajectory.h"
+
+// Every CSV row is one time step of length 1. Within a step the rotation
+// changes linearly by the rotation value of the row and the thrust
+// (acceleration value of the row) points in the current rotation.
+typedef enum IntegratorScheme {
+  INTEGRATOR_SEMI_IMPLICIT_EULER, // Default: rotate, accelerate, translate
+  INTEGRATOR_EXPLICIT_EULER,
+  INTEGRATOR_RK4,
+  INTEGRATOR_ADAPTIVE, // RK4 with step doubling and error control
+  INTEGRATOR_EXACT,    // Closed form solution of a time step
+  NUM_INTEGRATOR_SCHEMES
+} IntegratorScheme;
+
+typedef struct Integrator {
+  IntegratorScheme scheme;
+  int substeps;     // Steps per time step of the fixed step schemes
+  double tolerance; // Adaptive: max. local error of position and velocity
+  int fast_heading; // Default scheme: batch_heading() instead of sin/cos
+} Integrator;
+
+#define INTEGRATOR_DEFAULT_TOLERANCE 1e-6
+#define INTEGRATOR_MAX_SUBSTEPS 1000000
+
+// The integrated state at the end of a time step
+typedef struct IntegratorState {
+  double rotation;
+  Vec2D velocity;
+  Vec2D position;
+} IntegratorState;
+
+void integrator_init(Integrator *integrator, IntegratorScheme scheme);
+int integrator_is_default(const Integrator *integrator);
+int integrator_from_name(const char *name, IntegratorScheme *scheme);
+const char *integrator_name(IntegratorScheme scheme);
+void integrator_set(const Integrator *integrator);
+const Integrator *integrator_get(void);
+
+int integrate_step(const Integrator *integrator, IntegratorState *state,
+                   double acceleration, double rotation_change);
+
+#endif // INTEGRATOR_H
@@ -1,151 +1,276 @@
 #include "latex_report.h"
+#include "downsample.h"
+#include "output_buffer.h"
+#include "profiler.h"
 #include <stdio.h>
+#include <stdlib.h>
 
-void generate_pgfplots_plot(const char *spaceship_data_filename,
-                            FILE *latex_report) {
-  FILE *spaceship_data_file = fopen(spaceship_data_filename, "r");
-  if (!spaceship_data_file) {
-    perror("Error opening file");
-    return;
+// The time step i of the trajectory, reading its block
+static const Trajectory *read_step(const TrajectoryBlocks *blocks, size_t *i) {
+  const Trajectory *steps =
+      trajectory_blocks_read(blocks, *i / blocks->block_size);
+  *i %= blocks->block_size;
+  return steps;
+}
+
+static const double *read_temperatures(void *context, size_t first,
+                                       size_t count) {
+  const TrajectoryBlocks *blocks = context;
+  (void)count; // Always the whole block
+  return read_step(blocks, &first)->temperature + first;
+}
+
+/**
+ * @brief Writes the temperature plot. Long flights are reduced to
+ * `max_points` coordinates with LTTB, so that pgfplots stays within the
+ * memory limits of TeX.
+ *
+ * @param indices Scratch space for min(length, max_points) indices.
+ * @return 1 on success, 0 if the memory ran out.
+ */
+static int generate_pgfplots_plot(const TrajectoryBlocks *blocks,
+                                  size_t max_points, size_t *indices,
+                                  OutputBuffer *out) {
+  size_t num_points =
+      downsample_lttb_blocks(read_temperatures, (void *)blocks, blocks->length,
+                             blocks->block_size, max_points, indices);
+  if (num_points == 0 && blocks->length > 0) {
+    return 0;
+  }
+
+  output_buffer_puts(out, "\\begin{center}");
+  output_buffer_puts(out, "\\begin{tikzpicture}\n");
+  output_buffer_puts(out, "\t\\begin{axis}[\n");
+  output_buffer_puts(out, "\t\txlabel={Seconds},\n");
+  output_buffer_puts(out, "\t\tylabel={Temperature},\n");
+  output_buffer_puts(out, "\t\tgrid=major\n");
+  output_buffer_puts(out, "\t]\n");
+  output_buffer_puts(out, "\t\t\\addplot[smooth, thick, blue] coordinates {");
+
+  for (size_t point = 0; point < num_points; point++) {
+    size_t i = indices[point];
+    const Trajectory *steps = read_step(blocks, &i);
+    output_buffer_puts(out, "(");
+    output_buffer_int(out, (long long)indices[point] + 1);
+    output_buffer_puts(out, ",");
+    output_buffer_fixed(out, steps->temperature[i], 2);
+    output_buffer_puts(out, ") ");
   }
 
-  fprintf(latex_report, "\\begin{center}");
-  fprintf(latex_report, "\\begin{tikzpicture}\n");
-  fprintf(latex_report, "\t\\begin{axis}[\n");
-  fprintf(latex_report, "\t\txlabel={Seconds},\n");
-  fprintf(latex_report, "\t\tylabel={Temperature},\n");
-  fprintf(latex_report, "\t\tgrid=major\n");
-  fprintf(latex_report, "\t]\n");
-  fprintf(latex_report, "\t\t\\addplot[smooth, thick, blue] coordinates {");
-
-  int counter = 1;
-  double temperature;
-
-  // The * in %*lf supresses assignment, the values are read but not assigned to
-  // any memory location, as acceleration and relative rotation aren't needed
-  // right now (for the temperature plot)
-  while (fscanf(spaceship_data_file, "%*lf,%*lf,%lf", &temperature) == 1) {
-    fprintf(latex_report, "(%d,%.2f) ", counter, temperature);
-    counter++;
+  output_buffer_puts(out, "};\n");
+  output_buffer_puts(out, "\t\\end{axis}\n");
+  output_buffer_puts(out, "\\end{tikzpicture}");
+  output_buffer_puts(out, "\\end{center}");
+  return 1;
+}
+
+/**
+ * @brief Writes the table of positions and rotations. Long flights are
+ * reduced to `max_points` evenly spaced time steps.
+ *
+ * @param indices Scratch space for min(length, max_points) indices.
+ */
+static void write_position_table(const TrajectoryBlocks *blocks,
+                                 size_t max_points, size_t *indices,
+                                 OutputBuffer *out) {
+  size_t num_rows = downsample_uniform(blocks->length, max_points, indices);
+  output_buffer_puts(out, "\\subsection*{Position \\& Orientation}\n");
+  output_buffer_puts(out, "\\begin{longtable}{|c|c|c|c|}\n");
+  if (num_rows < blocks->length) {
+    output_buffer_printf(out,
+                         "\\caption{Position and Rotation (%zu of %zu time "
+                         "steps)} \\label{tab:coordinates}\n\n",
+                         num_rows, blocks->length);
+  } else {
+    output_buffer_puts(
+        out, "\\caption{Position and Rotation} \\label{tab:coordinates}\n\n");
   }
+  output_buffer_puts(out, "\\\\\\hline\n");
+  output_buffer_puts(out, "\\textbf{Time} & \\textbf{X-COORD} & "
+                          "\\textbf{Y-COORD} & "
+                          "\\textbf{Rotation (radians)} \\\\  \n");
+  output_buffer_puts(out, "\\hline\n");
+  output_buffer_puts(out, "\\endfirsthead\n");
+  output_buffer_puts(out, "\n");
+  output_buffer_puts(out, "\\hline\n");
+  output_buffer_puts(out, "\\textbf{Time} & \\textbf{X-COORD} & "
+                          "\\textbf{Y-COORD} & "
+                          "\\textbf{Rotation (radians)} \\\\  \n");
+  output_buffer_puts(out, "\\hline\n");
+  output_buffer_puts(out, "\\endhead");
 
-  fprintf(latex_report, "};\n");
-  fprintf(latex_report, "\t\\end{axis}\n");
-  fprintf(latex_report, "\\end{tikzpicture}");
-  fprintf(latex_report, "\\end{center}");
+  for (size_t row = 0; row < num_rows; row++) {
+    size_t i = indices[row];
+    const Trajectory *steps = read_step(blocks, &i);
+    output_buffer_int(out, (long long)indices[row] + 1);
+    output_buffer_puts(out, " & ");
+    output_buffer_fixed(out, steps->x[i], 6);
+    output_buffer_puts(out, " & ");
+    output_buffer_fixed(out, steps->y[i], 6);
+    output_buffer_puts(out, " & ");
+    output_buffer_fixed(out, steps->rotation[i], 6);
+    output_buffer_puts(out, " \\\\ \\hline\n");
+  }
+  output_buffer_puts(out, "\\hline\n");
+  output_buffer_puts(out, "\\end{longtable}");
 }
 
-void generate_latex_report(const char *filename,
-                           const char *spaceship_data_filename, int resolution,
-                           double total_distance, double farthest_from_start,
-                           double max_temp, double min_temp, double avg_temp,
-                           double var_temp, double max_speed) {
-  FILE *file = fopen(filename, "w");
-  if (!file) {
-    perror("Error opening file");
-    return;
+/**
+ * @brief Writes the LaTeX report from the results of the analysis. The time
+ * steps are read block by block, twice for the temperature plot.
+ *
+ * @param out An open output buffer, closed by this function.
+ * @param blocks Positions, rotations and temperatures of all time steps.
+ * @param resolution Resolution of the temperature map.
+ * @param max_points Max. number of time steps in the position table and the
+ * temperature plot, 0 for all.
+ * @param raster_images Include line.png and temperature_map.png instead of
+ * the SVG files, which need Inkscape.
+ * @return 1 on success, 0 if the memory ran out or the output could not be
+ * written.
+ */
+int write_latex_report_blocks(OutputBuffer *out,
+                              const TrajectoryBlocks *blocks, int resolution,
+                              size_t max_points, int raster_images,
+                              double total_distance,
+                              double farthest_from_start, double max_temp,
+                              double min_temp, double avg_temp,
+                              double var_temp, double max_speed) {
+  size_t num_indices = max_points > 0 && max_points < blocks->length
+                           ? max_points
+                           : blocks->length;
+  size_t *indices = malloc((num_indices + 1) * sizeof(*indices));
+  if (!indices) {
+    output_buffer_close(out);
+    return 0;
   }
+  PROFILE_ALLOCATION((num_indices + 1) * sizeof(*indices));
 
   // Start LaTeX document
-  fprintf(file, "\\documentclass[12pt]{article}\n\n");
-  fprintf(file, "\\usepackage[utf8]{inputenc}\n");
-  fprintf(file, "\\usepackage{latexsym,amsmath}\n");
-  fprintf(file, "\\usepackage{longtable}\n");
-  fprintf(file, "\\usepackage{svg}\n");
-  fprintf(file, "\\usepackage{pgfplots}\n\n");
-  fprintf(file, "\\pgfplotsset{compat=1.18}\n\n");
-  fprintf(file, "\\setlength{\\parindent}{0in}\n");
-  fprintf(file, "\\setlength{\\oddsidemargin}{0in}\n");
-  fprintf(file, "\\setlength{\\textwidth}{6.5in}\n");
-  fprintf(file, "\\setlength{\\textheight}{8.8in}\n");
-  fprintf(file, "\\setlength{\\topmargin}{0in}\n");
-  fprintf(file, "\\setlength{\\headheight}{18pt}\n");
-
-  fprintf(file, "\\title{Flight report}\n");
-  fprintf(file, "\\author{Navigator Nelly McDetour}\n");
-  fprintf(file, "\\begin{document}\n");
-  fprintf(file, "\\maketitle\n");
-  fprintf(file, "\\begin{figure}[htp]\n");
-  fprintf(file, "\\centering\n");
-  fprintf(file, "\\includesvg{line.svg}\n");
-  fprintf(file, "\\caption{Trajectory}\n");
-  fprintf(file, "\\end{figure}\n\n");
-
-  fprintf(file, "\\newpage\n");
-  fprintf(file, "\\subsection*{Position \\& Orientation}\n");
-  fprintf(file, "\\begin{longtable}{|c|c|c|c|}\n");
-  fprintf(file,
-          "\\caption{Position and Rotation} \\label{tab:coordinates}\n\n");
-  fprintf(file, "\\\\\\hline\n");
-  fprintf(file, "\\textbf{Time} & \\textbf{X-COORD} & \\textbf{Y-COORD} & "
-                "\\textbf{Rotation (radians)} \\\\  \n");
-  fprintf(file, "\\hline\n");
-  fprintf(file, "\\endfirsthead\n");
-  fprintf(file, "\n");
-  fprintf(file, "\\hline\n");
-  fprintf(file, "\\textbf{Time} & \\textbf{X-COORD} & \\textbf{Y-COORD} & "
-                "\\textbf{Rotation (radians)} \\\\  \n");
-  fprintf(file, "\\hline\n");
-  fprintf(file, "\\endhead");
-
-  FILE *orientation_file = fopen("positions.csv", "r");
-  if (!orientation_file) {
-    perror("Error opening positions.csv - unable to generate LaTeX report");
-    fclose(file);
-    return;
+  output_buffer_puts(out, "\\documentclass[12pt]{article}\n\n");
+  output_buffer_puts(out, "\\usepackage[utf8]{inputenc}\n");
+  output_buffer_puts(out, "\\usepackage{latexsym,amsmath}\n");
+  output_buffer_puts(out, "\\usepackage{longtable}\n");
+  output_buffer_puts(out, raster_images ? "\\usepackage{graphicx}\n"
+                                         : "\\usepackage{svg}\n");
+  output_buffer_puts(out, "\\usepackage{pgfplots}\n\n");
+  output_buffer_puts(out, "\\pgfplotsset{compat=1.18}\n\n");
+  output_buffer_puts(out, "\\setlength{\\parindent}{0in}\n");
+  output_buffer_puts(out, "\\setlength{\\oddsidemargin}{0in}\n");
+  output_buffer_puts(out, "\\setlength{\\textwidth}{6.5in}\n");
+  output_buffer_puts(out, "\\setlength{\\textheight}{8.8in}\n");
+  output_buffer_puts(out, "\\setlength{\\topmargin}{0in}\n");
+  output_buffer_puts(out, "\\setlength{\\headheight}{18pt}\n");
+
+  output_buffer_puts(out, "\\title{Flight report}\n");
+  output_buffer_puts(out, "\\author{Navigator Nelly McDetour}\n");
+  output_buffer_puts(out, "\\begin{document}\n");
+  output_buffer_puts(out, "\\maketitle\n");
+  output_buffer_puts(out, "\\begin{figure}[htp]\n");
+  output_buffer_puts(out, "\\centering\n");
+  output_buffer_puts(out,
+                     raster_images
+                         ? "\\includegraphics[width=\\linewidth]{line.png}\n"
+                         : "\\includesvg{line.svg}\n");
+  output_buffer_puts(out, "\\caption{Trajectory}\n");
+  output_buffer_puts(out, "\\end{figure}\n\n");
+
+  output_buffer_puts(out, "\\newpage\n");
+  write_position_table(blocks, max_points, indices, out);
+
+  output_buffer_puts(out, "\\newpage\n");
+  output_buffer_puts(out, "\\subsection*{Temperature readings}\n");
+  output_buffer_puts(out, "\\begin{figure}[htp]\n");
+  output_buffer_puts(out, "\t\\centering\n");
+  if (raster_images) {
+    // The image is already drawn north up
+    output_buffer_puts(out, "    "
+                             "\\includegraphics[width=0.5\\linewidth]"
+                             "{temperature_map.png}\n");
+  } else {
+    output_buffer_puts(out, "    "
+                             "\\includesvg[width=0.5\\linewidth,angle=90,"
+                             "origin=c]{temperature_map.svg}\n");
   }
+  output_buffer_printf(out, "\t\\caption{Temperature heatmap %ix%i}\n",
+                       resolution, resolution);
+  output_buffer_puts(out, "\\end{figure}\n");
+  output_buffer_puts(out, "\\begin{align*}\n");
+  output_buffer_printf(
+      out, "\t\\text{Temperature Average:} & \\quad %.2lf \\\\\n", avg_temp);
+  output_buffer_printf(
+      out, "\t\\text{Temperature Variance:} & \\quad %.2lf \\\\\n", var_temp);
+  output_buffer_puts(out, "\\end{align*}\n");
+  if (!generate_pgfplots_plot(blocks, max_points, indices, out)) {
+    free(indices);
+    output_buffer_close(out);
+    return 0;
+  }
+
+  output_buffer_puts(out, "\\subsection*{Mission Summary}\n");
+  output_buffer_puts(out, "\\begin{align*}\n");
+  output_buffer_printf(out, "\t\\text{Top Speed:} & \\quad %.3lf \\\\\n",
+                       max_speed);
+  output_buffer_printf(
+      out, "\t\\text{Total distance covered:} & \\quad %.3lf \\\\\n",
+      total_distance);
+  output_buffer_printf(out,
+                       "\t\\text{Farthest recorded distance from start:} & "
+                       "\\quad %.3lf \\\\\n",
+                       farthest_from_start);
+  output_buffer_printf(
+      out, "\t\\text{Peak temperature recorded:} & \\quad %.2lf \\\\\n",
+      max_temp);
+  output_buffer_printf(
+      out, "\t\\text{Minimum temperature recorded:} & \\quad %.2lf\n",
+      min_temp);
+
+  output_buffer_puts(out, "\\end{align*}\n");
+  output_buffer_puts(out, "\\end{document}");
+  free(indices);
+  return output_buffer_close(out);
+}
+
+/**
+ * @brief Writes the LaTeX report from a trajectory in memory, see
+ * write_latex_report_blocks().
+ */
+int write_latex_report(OutputBuffer *out, const Trajectory *trajectory,
+                       int resolution, size_t max_points, int raster_images,
+                       double total_distance, double farthest_from_start,
+                       double max_temp, double min_temp, double avg_temp,
+                       double var_temp, double max_speed) {
+  TrajectoryBlocks blocks;
+  trajectory_blocks(trajectory, &blocks);
+  return write_latex_report_blocks(out, &blocks, resolution, max_points,
+                                   raster_images, total_distance,
+                                   farthest_from_start, max_temp, min_temp,
+                                   avg_temp, var_temp, max_speed);
+}
 
-  // Discard the column names by saving them to a buffer and in doing so
-  // incrementing the position offset
-  char header[100]; // Buffer to hold the first line (column names)
-  fgets(header, sizeof(header),
-        orientation_file); // Read (and discard) the header line
-
-  int counter = 1;
-  double x, y, rotation;
-  // Using feof(*FILE) == 0 is bad practice!
-  while (fscanf(orientation_file, " %lf,%lf,%lf", &x, &y, &rotation) == 3) {
-    fprintf(file, "%d & %.6f & %.6f & %.6f \\\\ \\hline\n", counter, x, y,
-            rotation);
-    counter++;
+/**
+ * @brief Saves the LaTeX report as .tex file, see
+ * write_latex_report_blocks().
+ *
+ * @param filename The .tex file to create.
+ * @return 1 on success, 0 if the file could not be written.
+ */
+int generate_latex_report(const char *filename, const TrajectoryBlocks *blocks,
+                          int resolution, size_t max_points, int raster_images,
+                          double total_distance, double farthest_from_start,
+                          double max_temp, double min_temp, double avg_temp,
+                          double var_temp, double max_speed) {
+  PROFILE_BEGIN(scope, PROFILE_REPORT);
+  OutputBuffer out;
+  int success = output_buffer_open(&out, filename) &&
+                write_latex_report_blocks(&out, blocks, resolution, max_points,
+                                          raster_images, total_distance,
+                                          farthest_from_start, max_temp,
+                                          min_temp, avg_temp, var_temp,
+                                          max_speed);
+  PROFILE_END(scope, blocks->length, 0, success ? out.bytes_written : 0);
+  if (!success) {
+    printf("Error: Could not write %s\n", filename);
   }
-  fclose(orientation_file);
-  fprintf(file, "\\hline\n");
-  fprintf(file, "\\end{longtable}");
-
-  fprintf(file, "\\newpage\n");
-  fprintf(file, "\\subsection*{Temperature readings}\n");
-  fprintf(file, "\\begin{figure}[htp]\n");
-  fprintf(file, "\t\\centering\n");
-  fprintf(file, "    "
-                "\\includesvg[width=0.5\\linewidth,angle=90,origin=c]{"
-                "temperature_map.svg}\n");
-  fprintf(file, "\t\\caption{Temperature heatmap %ix%i}\n", resolution,
-          resolution);
-  fprintf(file, "\\end{figure}\n");
-  fprintf(file, "\\begin{align*}\n");
-  fprintf(file, "\t\\text{Temperature Average:} & \\quad %.2lf \\\\\n",
-          avg_temp);
-  fprintf(file, "\t\\text{Temperature Variance:} & \\quad %.2lf \\\\\n",
-          var_temp);
-  fprintf(file, "\\end{align*}\n");
-  generate_pgfplots_plot(spaceship_data_filename, file);
-
-  fprintf(file, "\\subsection*{Mission Summary}\n");
-  fprintf(file, "\\begin{align*}\n");
-  fprintf(file, "\t\\text{Top Speed:} & \\quad %.3lf \\\\\n", max_speed);
-  fprintf(file, "\t\\text{Total distance covered:} & \\quad %.3lf \\\\\n",
-          total_distance);
-  fprintf(file,
-          "\t\\text{Farthest recorded distance from start:} & \\quad %.3lf "
-          "\\\\\n",
-          farthest_from_start);
-  fprintf(file, "\t\\text{Peak temperature recorded:} & \\quad %.2lf \\\\\n",
-          max_temp);
-  fprintf(file, "\t\\text{Minimum temperature recorded:} & \\quad %.2lf\n",
-          min_temp);
-
-  fprintf(file, "\\end{align*}\n");
-  fprintf(file, "\\end{document}");
-  fclose(file);
+  return success;
 }
@@ -1,10 +1,30 @@
 #ifndef LATEX_REPORT_H
 #define LATEX_REPORT_H
 
-void generate_latex_report(const char *filename,
-                           const char *spaceship_data_filename, int resolution,
-                           double total_distance, double farthest_from_start,
-                           double max_temp, double min_temp, double avg_temp,
-                           double var_temp, double max_speed);
+#include "output_buffer.h"
+#include "trajectory.h"
+#include <stddef.h>
 
-#endif // LATEX_REPORT_H
\ No newline at end of file
+// Time steps in the position table and the temperature plot; TeX runs out of
+// memory long before a 1e6 row table
+#define REPORT_DEFAULT_MAX_POINTS 1000
+
+int write_latex_report(OutputBuffer *out, const Trajectory *trajectory,
+                       int resolution, size_t max_points, int raster_images,
+                       double total_distance, double farthest_from_start,
+                       double max_temp, double min_temp, double avg_temp,
+                       double var_temp, double max_speed);
+int write_latex_report_blocks(OutputBuffer *out,
+                              const TrajectoryBlocks *blocks, int resolution,
+                              size_t max_points, int raster_images,
+                              double total_distance,
+                              double farthest_from_start, double max_temp,
+                              double min_temp, double avg_temp,
+                              double var_temp, double max_speed);
+int generate_latex_report(const char *filename, const TrajectoryBlocks *blocks,
+                          int resolution, size_t max_points, int raster_images,
+                          double total_distance, double farthest_from_start,
+                          double max_temp, double min_temp, double avg_temp,
+                          double var_temp, double max_speed);
+
+#endif // LATEX_REPORT_H
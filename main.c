@@ -4,427 +4,1921 @@
  * Due: 2025-02-23
  */
 
+#include "compact_trajectory.h"
+#include "csv_parser.h"
+#include "fleet.h"
+#include "flight.h"
+#include "flight_analysis.h"
+#include "flight_database.h"
+#include "heatmap.h"
+#include "incremental.h"
+#include "integrator.h"
 #include "latex_report.h"
-#include <conio.h>
-#include <float.h>
-#include <io.h>
+#include "output_buffer.h"
+#include "parallel_analysis.h"
+#include "pipeline.h"
+#include "platform.h"
+#include "profiler.h"
+#include "raster.h"
+#include "simd_kernels.h"
+#include "sliding_window.h"
+#include "spatial_index.h"
+#include "statistics.h"
+#include "svg_writer.h"
+#include "telemetry_file.h"
+#include "thread_pool.h"
+#include "timing.h"
+#include "trajectory.h"
 #include <math.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+// Order in which the console map is printed: columns from right to left, rows
+// top to bottom
+static int compare_print_order(const void *a, const void *b) {
+  const HeatmapCell *first = a;
+  const HeatmapCell *second = b;
+  if (first->y != second->y) {
+    return first->y > second->y ? -1 : 1;
+  }
+  return (first->x > second->x) - (first->x < second->x);
+}
 
-typedef struct Vector2D {
-  double x;
-  double y;
-} Vec2D;
+/**
+ * @brief Prints the occupied cells of the temperature map to the console.
+ *
+ * @param cells Occupied cells, reordered by this function.
+ * @param num_cells Number of occupied cells.
+ * @param resolution Resolution of the map.
+ */
+void print_temperature_map(HeatmapCell *cells, size_t num_cells,
+                           int resolution) {
+  // The direction of iteration is predetermined by how the trajectory is
+  // expected to be oriented
+  qsort(cells, num_cells, sizeof(*cells), compare_print_order);
+  size_t next = 0;
+  for (int j = resolution - 1; j >= 0; j--) {
+    for (int i = 0; i < resolution; i++) {
+      int occupied = next < num_cells && cells[next].x == i &&
+                     cells[next].y == j;
+      printf(occupied ? " # " : "   ");
+      next += occupied;
+    }
+    printf("\n");
+  }
+}
 
 /**
- * @brief Computes the distance between two points using the pythagorean
- * theorem.
+ * @brief Reports where an SVG file was written, its size and the write time.
  *
- * @param pos1 The starting position as a 2D Vector.
- * @param pos2 The ending position as a 2D Vector.
- * @param dst Pointer to a double where the computed distance will be stored.
+ * @param filename Name of the SVG file.
+ * @param success Result of the writer.
+ * @param element What the writer counted ("points" or "rects").
+ * @param stats Statistics returned by the writer.
+ * @param verbose Also report successful writes, errors are always reported.
  */
-void calculate_distance(Vec2D pos1, Vec2D pos2, double *dst) {
-  *dst = sqrt(pow(pos2.x - pos1.x, 2) + pow(pos2.y - pos1.y, 2));
+void print_svg_stats(const char *filename, int success, const char *element,
+                     const SvgStats *stats, int verbose) {
+  if (!success) {
+    printf("Error: Could not write %s\n", filename);
+    return;
+  }
+  if (!verbose) {
+    return;
+  }
+  printf("SVG file saved as %s (%zu %s from %zu, %.1f KiB in %.1f ms)\n",
+         filename, stats->elements, element, stats->input_elements,
+         stats->bytes / 1024.0, stats->seconds * 1000.0);
 }
 
-double calculate_speed(Vec2D current_velocity) {
-  return sqrt(current_velocity.x * current_velocity.x +
-              current_velocity.y * current_velocity.y);
+/**
+ * @brief Reports where a raster image was written, its size and the time.
+ *
+ * @param element What the renderer counted ("segments" or "cells").
+ */
+static void print_raster_stats(const char *filename, int success,
+                               const char *element, const RasterStats *stats) {
+  if (!success) {
+    printf("Error: Could not write %s\n", filename);
+    return;
+  }
+  printf("Image saved as %s (%dx%d, %zu %s, %.1f KiB in %.1f ms, %.1f ms "
+         "rendering)\n",
+         filename, stats->width, stats->height, stats->elements, element,
+         stats->bytes / 1024.0, stats->seconds * 1000.0,
+         stats->render_seconds * 1000.0);
 }
 
 /**
- * @brief Calculates the variance of an array of doubles.
+ * @brief Writes line.png and temperature_map.png, rendered tile by tile on
+ * one thread per CPU.
  *
- * @param values Pointer to an array of doubles.
- * @param size The number of elements in the array (num of timesteps).
- * @return The computed variance of the given array.
+ * @param size Width and height in pixels.
+ * @param heatmap The temperature map, NULL to skip it.
+ * @return The number of bytes written.
  */
-double Variance(double values[], int size) {
-  if (size <= 1) {
-    // Variance cannot be calculated for arrays with 0 or 1 element
-    return 0.0;
+static size_t save_raster_images(int size, const TrajectoryBlocks *blocks,
+                                 double max_distance, const Heatmap *heatmap) {
+  ThreadPool pool;
+  int threaded = thread_pool_create(&pool, cpu_count() - 1);
+  RasterStats stats;
+  size_t bytes = 0;
+  int success = save_trajectory_raster("line.png", size, blocks, max_distance,
+                                       threaded ? &pool : NULL, &stats);
+  print_raster_stats("line.png", success, "segments", &stats);
+  bytes += success ? stats.bytes : 0;
+  if (heatmap) {
+    success = save_temperature_map_raster("temperature_map.png", size,
+                                          heatmap, threaded ? &pool : NULL,
+                                          &stats);
+    print_raster_stats("temperature_map.png", success, "cells", &stats);
+    bytes += success ? stats.bytes : 0;
+  }
+  if (threaded) {
+    thread_pool_destroy(&pool);
   }
+  return bytes;
+}
 
-  double sum = 0.0;
-  double sumOfSquares = 0.0;
+/**
+ * @brief Writes temperature_map.svg and optionally prints the map.
+ *
+ * Coarser zoom levels are derived from the same cells and saved as
+ * temperature_map_level1.svg (half the resolution), temperature_map_level2.svg
+ * and so on.
+ *
+ * @param heatmap The temperature map.
+ * @param directory Directory of the SVG files, "" for the working directory.
+ * @param print_map Print the map to the console.
+ * @param num_levels Number of zoom levels to save, 0 for all levels down to a
+ * single cell.
+ * @param verbose Report every written file.
+ * @return 1 on success, 0 if a file could not be written or the memory ran
+ * out.
+ */
+int save_temperature_map(const Heatmap *heatmap, const char *directory,
+                         int print_map, int num_levels, int verbose) {
+  HeatmapPyramid pyramid;
+  if (!heatmap_build_pyramid(heatmap, num_levels, &pyramid)) {
+    printf("Error: Not enough memory for the temperature map.\n");
+    return 0;
+  }
+  int all_saved = 1;
+  PROFILE_BEGIN(svg_scope, PROFILE_SVG_HEATMAP);
+  size_t bytes_written = 0;
+  for (int i = 0; i < pyramid.num_levels; i++) {
+    char name[64], filename[4096];
+    if (i == 0) {
+      snprintf(name, sizeof(name), "temperature_map.svg");
+    } else {
+      snprintf(name, sizeof(name), "temperature_map_level%d.svg", i);
+    }
+    SvgStats stats;
+    int success = join_path(filename, sizeof(filename), directory, name) &&
+                  save_temperature_map_svg(filename, &pyramid.levels[i],
+                                           &stats);
+    print_svg_stats(filename, success, "rects", &stats, verbose);
+    all_saved &= success;
+    bytes_written += success ? stats.bytes : 0;
+  }
+  PROFILE_END(svg_scope, pyramid.levels[0].num_cells, 0, bytes_written);
+  if (print_map) {
+    print_temperature_map(pyramid.levels[0].cells,
+                          pyramid.levels[0].num_cells, heatmap->resolution);
+  }
+  heatmap_pyramid_free(&pyramid);
+  return all_saved;
+}
 
-  for (int i = 0; i < size; i++) {
-    sum += values[i];
-    sumOfSquares += values[i] * values[i];
+void print_points_outside(const Heatmap *heatmap) {
+  if (heatmap->outside > 0) {
+    printf("%llu time steps outside of the heatmap bounds were not drawn.\n",
+           (unsigned long long)heatmap->outside);
   }
+}
 
-  double mean = sum / size;
-  double variance = (sumOfSquares / size) - (mean * mean);
+/**
+ * @brief Reads keys until one of the controls is pressed and applies it.
+ *
+ * @return 1 on success, 0 if the input ended.
+ */
+int checkInput(int *cursor_position, int option_state[], int len_options) {
+  int ch;
 
-  return variance;
+  while (1) {
+    ch = read_key();
+    // printf("Key pressed (ASCII %d): %c\n", ch, ch);
+    if (ch == EOF) {
+      return 0;
+    } else if (ch == 43) { // ASCII Code for '+'
+      if (*cursor_position > 0) {
+        (*cursor_position)--;
+      }
+      break;
+    } else if (ch == 45) { // ASCII Code for '-'
+      if (*cursor_position < len_options - 1) {
+        (*cursor_position)++;
+      }
+      break;
+    } else if (ch == 13 || ch == '\n') { // '\r' from a terminal, '\n' piped
+      // Enter pressed, toggle current option.
+      option_state[*cursor_position] = !option_state[*cursor_position];
+      break;
+    }
+    // else {
+    //   printf("Unexpected character: %c (ASCII %d)\n", ch, ch);
+    // }
+  }
+  return 1;
 }
 
-void rotate(double change_in_rotation, double current_rotation,
-            double *new_rotation) {
-  *new_rotation = current_rotation + change_in_rotation;
+#define LEN_CLI_OPTIONS 5 // Compile-time constant
+
+void print_interface(char *options[], int option_state[], int cursor_position) {
+  printf("--- MISSION CONTROL PANEL ---\n\n");
+  for (int i = 0; i < LEN_CLI_OPTIONS; i++) {
+    printf(cursor_position == i ? " ? " : "   ");
+    printf(option_state[i] == 1 ? "[X]" : "[ ]");
+    printf(" %s\n", options[i]);
+  }
+  printf("\nControls: +/- [Enter]\n");
 }
 
 /**
- * @brief Calculates the new velocity depending on the spaceships orientation
+ * @brief Shows the menu until "Liftoff!" is selected.
  *
- * @param current_velocity The current velocity of the spaceship as a 2D Vector.
- * @param acceleration The acceleration to apply to the spaceship.
- * @param rotation The current rotation of the spaceship in radians.
- * @param new_velocity Pointer to a 2D Vector where the new velocity will be
- * saved.
+ * @return 1 on success, 0 if the input ended before.
  */
-void accelerate(Vec2D current_velocity, double acceleration, double rotation,
-                Vec2D *new_velocity) {
-  new_velocity->x = current_velocity.x + (cos(rotation) * acceleration);
-  new_velocity->y = current_velocity.y + (sin(rotation) * acceleration);
+int cli(int option_state[]) {
+  char *options[LEN_CLI_OPTIONS] = {"Print Trajectory", "Print Metrics",
+                                    "Generate LaTeX Report",
+                                    "Export positions.csv", "Liftoff!"};
+  int cursor_position = 0;
+  while (option_state[LEN_CLI_OPTIONS - 1] != 1) { // Check for "liftoff!"
+    print_interface(options, option_state, cursor_position);
+    if (!checkInput(&cursor_position, option_state, LEN_CLI_OPTIONS)) {
+      printf("\nError: The input ended before Liftoff.\n");
+      return 0;
+    }
+    clear_screen();
+  }
+  return 1;
 }
 
 /**
- * @brief Calculates the new position of the spaceship.
+ * @brief Asks for the input file until an existing one is entered.
  *
- * @param current_velocity The current velocity of the spaceship as a 2D Vector.
- * @param current_position The current position of the spaceship as a 2D Vector.
- * @param new_position     Pointer to a 2D Vector where the new position will be
- * saved.
- * @param total_distance   Pointer to a double where the total distance traveled
- * will be saved.
+ * @return 1 on success, 0 if the input ended.
  */
-void translate(Vec2D current_velocity, Vec2D current_position,
-               Vec2D *new_position, double *total_distance) {
-  Vec2D previous_position = current_position;
-  double distance;
+int get_filepath(char *filePath) {
+  while (1) {
+    printf("Enter filename: ");
+    if (scanf("%1023s", filePath) != 1) {
+      printf("\nError: No filename entered.\n");
+      return 0;
+    }
+    // Drop the rest of the line, the menu reads single key presses
+    int ch;
+    while ((ch = getchar()) != '\n' && ch != EOF) {
+    }
+    if (file_exists(filePath)) {
+      break;
+    } else {
+      printf("File does not exist: %s\n\n", filePath);
+    }
+  }
+  clear_screen();
+  return 1;
+}
 
-  new_position->x = current_position.x + current_velocity.x;
-  new_position->y = current_position.y + current_velocity.y;
+// Heatmap cells per side accepted by "--resolution" and the prompt
+int valid_resolution(int resolution) {
+  return resolution >= 1 && resolution <= HEATMAP_MAX_RESOLUTION;
+}
 
-  calculate_distance(previous_position, *new_position, &distance);
-  *total_distance += distance;
+/**
+ * @brief Asks for the heatmap resolution until a valid one is entered, or
+ * uses the default if no number is entered.
+ */
+void resolution_input(int *matrix_resolution) {
+  while (1) {
+    printf("Enter desired resolution: ");
+    if (scanf("%d", matrix_resolution) != 1) {
+      *matrix_resolution = 25; // Default value
+      printf("No input provided, using default value: %d\n",
+             *matrix_resolution);
+      wait_for_key();
+      clear_screen();
+      return;
+    }
+    if (valid_resolution(*matrix_resolution)) {
+      return;
+    }
+    printf("The resolution needs a number between 1 and %d\n",
+           HEATMAP_MAX_RESOLUTION);
+  }
 }
 
 /**
- * @brief Logs positional and temperature data, updating min/max values.
+ * @brief Analyzes the spaceship data chunk by chunk on the calling thread,
+ * with the flight analysis library.
  *
- * @param current_position The current position as a 2D Vector.
- * @param temperature The current temperature reading.
- * @param temperature_set Pointer to an integer flag indicating whether
- * temperature values have been initialized (1 = set, 0 = unset).
- * @param max_distance Pointer to the maximum recorded Euclidean distance of the
- * spaceship to origin, updated if the new distance is greater.
- * @param max_temperature Pointer to the maximum recorded temperature, updated
- * if the new temperature is higher.
- * @param min_temperature Pointer to the minimum recorded temperature, updated
- * if the new temperature is lower.
+ * @param csv The memory mapped spaceship data file, CSV or telemetry file.
+ * @param state Integrator state and metrics.
+ * @param trajectory Receives every time step.
+ * @param compact Receives every time step instead of the trajectory if not
+ * NULL, see compact_trajectory_finish().
+ * @param malformed_rows Receives the number of skipped rows.
+ * @return 1 on success, 0 if the memory ran out or the time steps could not
+ * be stored in the compact format.
  */
-void log_data(Vec2D current_position, double temperature, int *temperature_set,
-              double *max_distance, double *max_temperature,
-              double *min_temperature) {
-  const Vec2D START_POS = {0, 0};
-  double distance;
-  calculate_distance(START_POS, current_position, &distance);
-  if (distance > *max_distance) {
-    *max_distance = distance;
+int analyze_serial(const MappedFile *csv, FlightState *state,
+                   Trajectory *trajectory, CompactTrajectory *compact,
+                   size_t *malformed_rows) {
+  // The heatmap and the outputs are made by the caller
+  FlightAnalysisConfig config;
+  flight_analysis_config_init(&config);
+  config.integrator = state->integrator;
+  config.keep_trajectory = compact == NULL;
+  config.heatmap_resolution = 0;
+  config.warn_malformed_rows = 1;
+  FlightAnalysis *analysis = flight_analysis_create(&config);
+  if (analysis && compact) {
+    flight_analysis_set_steps_sink(analysis, compact_trajectory_steps_sink,
+                                   compact);
+  }
+  TelemetryChunk *chunk = malloc(sizeof(*chunk));
+  if (!analysis || !chunk) {
+    flight_analysis_destroy(analysis);
+    free(chunk);
+    return 0;
+  }
+  PROFILE_ALLOCATION(sizeof(*chunk));
+
+  int success = 1;
+  TelemetryReader reader;
+  int binary = telemetry_open(&reader, csv->data, csv->size);
+  if (binary) {
+    // Only the rows of one block are decoded at a time
+    while (success) {
+      PROFILE_BEGIN(parse_scope, PROFILE_PARSE);
+      const char *chunk_start = reader.cursor;
+      size_t rows = telemetry_read_chunk(&reader, chunk);
+      PROFILE_END(parse_scope, rows, (uint64_t)(reader.cursor - chunk_start),
+                  0);
+      (void)chunk_start; // Only used while profiling
+      if (rows == 0) {
+        break;
+      }
+      success = flight_analysis_push_rows(analysis, chunk->acceleration,
+                                          chunk->rotation, chunk->temperature,
+                                          rows);
+    }
+  } else {
+    success = flight_analysis_push_csv(analysis, csv->data, csv->size);
+  }
+  FlightMetrics metrics;
+  success = flight_analysis_finish(analysis, &metrics) && success;
+  if (compact) {
+    success = compact_trajectory_finish(compact) && success;
   }
+  *state = *flight_analysis_state(analysis);
+  flight_analysis_take_trajectory(analysis, trajectory);
+  *malformed_rows = binary ? reader.malformed_rows : metrics.malformed_rows;
+  flight_analysis_destroy(analysis);
+  free(chunk);
+  return success;
+}
+
+void print_metrics(FlightState *state) {
+  printf("Top Speed: %lf\n", state->max_speed);
+  printf("Max. Temperature: %lf\nMin. Temperature: %lf\n",
+         state->temperature_stats.max, state->temperature_stats.min);
+  printf("Temperature avg: %lf\n", state->temperature_stats.mean);
+  printf("Temperature variance: %lf\n",
+         running_stats_variance(&state->temperature_stats));
+  printf("Temperature median: %lf (5th/95th percentile: %lf/%lf)\n\n",
+         tdigest_quantile(&state->temperature_digest, 0.5),
+         tdigest_quantile(&state->temperature_digest, 0.05),
+         tdigest_quantile(&state->temperature_digest, 0.95));
+  printf("Max. Euclidean distance to start: %lf\n", state->max_distance);
+  printf("Total distance: %lf\n", state->total_distance);
+}
 
-  if (temperature < *min_temperature || !*temperature_set) {
-    *min_temperature = temperature;
-  } else if (temperature > *max_temperature || !*temperature_set) {
-    *max_temperature = temperature;
+/**
+ * @brief Prints the memory of a compact trajectory and the error of its
+ * columns against the full precision values.
+ */
+void print_compact_stats(const CompactTrajectory *compact) {
+  static const char *const COLUMN_NAMES[TRAJECTORY_NUM_COLUMNS] = {
+      "x", "y", "rotation", "velocity x", "velocity y", "temperature"};
+  size_t full_bytes = compact->length * TRAJECTORY_NUM_COLUMNS * sizeof(double);
+  printf("Trajectory stored as %s: %.2f MiB instead of %.2f MiB in double "
+         "precision\n",
+         compact_format_name(compact->format),
+         compact_trajectory_memory_usage(compact) / (1024.0 * 1024.0),
+         full_bytes / (1024.0 * 1024.0));
+  for (int c = 0; c < TRAJECTORY_NUM_COLUMNS; c++) {
+    printf("  %-12s max. error %.3e, RMS error %.3e\n", COLUMN_NAMES[c],
+           compact->max_error[c], compact_trajectory_rms_error(compact, c));
   }
-  *temperature_set = 1;
+  printf("\n");
+}
+
+// Command line options
+typedef struct ProgramOptions {
+  int num_threads;
+  const char *input; // "--update"/"--follow" file, NULL: interactive mode
+  const char *checkpoint;
+  int follow;
+  int poll_interval_ms;
+  int resolution;   // Heatmap resolution, unless asked for in the menu
+  int has_bounds;   // Fixed heatmap bounds instead of the trajectory bounds
+  double bounds[4]; // min x, min y, max x, max y
+  int heatmap_levels; // Zoom levels of the heatmap to save, 0: all
+  double svg_tolerance; // Path simplification of line.svg
+  int raster_size; // "--raster N": also write N x N pixel PNG images, 0: off
+  const char *batch_output; // "--batch" output directory
+  // Arguments that are not options: the files and directories of "--batch",
+  // the queries of "--query"
+  const char **batch_inputs;
+  int num_batch_inputs;
+  const char *query_input; // "--query" CSV or trajectory.bin
+  int compile; // "--compile": a flight database for every input file
+  int convert; // "--convert": a telemetry file for every input file
+  const char *database; // "--database" file for time window queries
+  const char *rolling_input; // "--rolling" file
+  size_t window_size;   // Time steps per rolling window
+  size_t window_stride; // Time steps between two rolling windows, 0: auto
+  int fleet; // "--fleet": all input files at once, one ship per file
+  int num_jobs;     // Files processed at once in batch mode, 0: one per CPU
+  int batch_report; // Also write report.tex for every file
+  size_t report_points; // Max. time steps in the report tables and plots
+  int pipeline; // "--pipeline": read, integrate and write on separate threads
+  CompactFormat compact; // "--compact": reduced precision trajectory storage
+  int profile;  // Print the time spent in each stage
+  const char *trace_file; // Chrome trace of the stages, NULL: none
+  Integrator integrator;
+} ProgramOptions;
+
+#define CHECKPOINT_SAVE_INTERVAL 1.0 // Seconds between checkpoints in --follow
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void request_stop(int signal_number) {
+  (void)signal_number;
+  stop_requested = 1;
+}
+
+// checkpoint_save(), measured by the profiler
+static int save_checkpoint(const IncrementalAnalysis *analysis,
+                           const char *filename) {
+  PROFILE_BEGIN(scope, PROFILE_CHECKPOINT);
+  int saved = checkpoint_save(analysis, filename);
+  PROFILE_END(scope, 0, 0, 0);
+  return saved;
 }
 
 /**
- * @brief Calculates the average of an array of doubles.
+ * @brief Analyzes only the bytes appended to the input since the last
+ * checkpoint, and keeps doing so while the file grows in "--follow" mode.
+ *
+ * The reported update time is the time between noticing new lines and
+ * printing the updated metrics; a line appended to the input shows up after
+ * at most one poll interval plus that time. Without "--bounds" the heatmap
+ * bounds follow the positions (auto bounds with rebinning).
  *
- * @param values Pointer to an array of doubles.
- * @param size The number of elements in the array (num of timesteps).
+ * @return The exit code of the program.
  */
-double Average(double values[], int size) {
-  double sum = 0;
-  for (int i = 0; i < size; i++) {
-    sum += values[i];
+int run_incremental(const ProgramOptions *options) {
+  FILE *input = fopen(options->input, "rb");
+  if (!input) {
+    printf("Error: Could not read file %s\n", options->input);
+    return 1;
   }
-  return sum / size;
+
+  IncrementalAnalysis analysis;
+  incremental_init(&analysis, options->resolution);
+  if (checkpoint_load(&analysis, options->checkpoint)) {
+    if (incremental_matches_input(&analysis, input)) {
+      printf("Resuming %s after %llu time steps (byte %llu).\n",
+             options->input, (unsigned long long)analysis.time_steps,
+             (unsigned long long)analysis.byte_offset);
+    } else {
+      printf("Warning: %s belongs to a different or truncated input, "
+             "starting over.\n",
+             options->checkpoint);
+      incremental_free(&analysis);
+      incremental_init(&analysis, options->resolution);
+    }
+  }
+  if (options->has_bounds) {
+    if (analysis.time_steps == 0) {
+      incremental_set_bounds(&analysis, options->bounds[0], options->bounds[1],
+                             options->bounds[2], options->bounds[3]);
+    } else {
+      printf("Note: --bounds is ignored, the bounds of the checkpoint are "
+             "kept.\n");
+    }
+  }
+
+  signal(SIGINT, request_stop);
+  int exit_code = 0;
+  int first_update = 1;
+  double last_save = monotonic_seconds();
+  while (1) {
+    double start = monotonic_seconds();
+    size_t new_rows;
+    uint64_t offset = analysis.byte_offset;
+    PROFILE_BEGIN(update_scope, PROFILE_ANALYSIS);
+    int updated = incremental_update(&analysis, input, &new_rows);
+    PROFILE_END(update_scope, new_rows, analysis.byte_offset - offset, 0);
+    (void)offset; // Only used while profiling
+    if (!updated) {
+      printf("Error: Could not process %s after %llu time steps.\n",
+             options->input, (unsigned long long)analysis.time_steps);
+      exit_code = 1;
+      break;
+    }
+
+    if (!options->follow) {
+      printf("Processed %zu new time steps (%llu in total).\n\n", new_rows,
+             (unsigned long long)analysis.time_steps);
+      print_metrics(&analysis.state);
+    } else if (new_rows > 0 || first_update) {
+      printf("%llu time steps (+%zu): top speed %lf, max. distance %lf, "
+             "total distance %lf, temperature avg %lf [update %.2f ms]\n",
+             (unsigned long long)analysis.time_steps, new_rows,
+             analysis.state.max_speed, analysis.state.max_distance,
+             analysis.state.total_distance,
+             analysis.state.temperature_stats.mean,
+             (monotonic_seconds() - start) * 1000.0);
+      fflush(stdout);
+    }
+    first_update = 0;
+
+    if (!options->follow || stop_requested) {
+      break;
+    }
+    if (new_rows > 0 &&
+        monotonic_seconds() - last_save >= CHECKPOINT_SAVE_INTERVAL) {
+      if (!save_checkpoint(&analysis, options->checkpoint)) {
+        printf("Error: Could not write %s\n", options->checkpoint);
+      }
+      last_save = monotonic_seconds();
+    }
+    sleep_milliseconds(options->poll_interval_ms);
+  }
+
+  if (exit_code == 0) {
+    if (analysis.malformed_rows > 0) {
+      printf("Skipped %llu malformed rows.\n",
+             (unsigned long long)analysis.malformed_rows);
+    }
+    if (!save_checkpoint(&analysis, options->checkpoint)) {
+      printf("Error: Could not write %s\n", options->checkpoint);
+      exit_code = 1;
+    }
+    save_temperature_map(&analysis.heatmap, "", 0, options->heatmap_levels,
+                         1);
+    print_points_outside(&analysis.heatmap);
+  }
+  incremental_free(&analysis);
+  fclose(input);
+  return exit_code;
 }
 
+// One input file of a batch run and its results
+typedef struct BatchFile {
+  const char *input;
+  char output_directory[4096];
+  int success;
+  size_t input_bytes;
+  size_t time_steps;
+  size_t malformed_rows;
+  double seconds;
+  double max_speed;
+  double max_distance;
+  double total_distance;
+  RunningStats temperature_stats;
+} BatchFile;
+
+typedef struct BatchJob {
+  const ProgramOptions *options;
+  BatchFile *files;
+  size_t num_files;
+} BatchJob;
+
 /**
- * @brief Saves a path defined by 2D Coordinates in SVG format.
+ * @brief Writes line.svg, temperature_map.svg and optionally the PNG images
+ * and report.tex of one analyzed file to its output directory.
  *
- * @param positions Array of 2D coordinates representing the path.
- * @param offset Offset value to position the path within the visible area.
+ * @return NULL on success, otherwise a description of the error.
  */
-void save_svg(Vec2D positions[], double offset) {
-  FILE *path_line_svg = fopen("line.svg", "w");
+static const char *save_batch_outputs(const BatchFile *file,
+                                      const ProgramOptions *options,
+                                      const Trajectory *trajectory,
+                                      const FlightState *state) {
+  const char *directory = file->output_directory;
+  char filename[4096 + 32];
+  TrajectoryBlocks blocks;
+  trajectory_blocks(trajectory, &blocks);
+  if (!make_directory(directory)) {
+    return "Could not create the output directory";
+  }
+
+  SvgStats stats;
+  join_path(filename, sizeof(filename), directory, "line.svg");
+  if (!save_trajectory_svg(filename, trajectory, state->max_distance,
+                           options->svg_tolerance, &stats)) {
+    return "Could not write line.svg";
+  }
 
-  fprintf(path_line_svg,
-          "<svg width=\"%f\" height=\"%f\" version=\"1.1\" "
-          "xmlns=\"http://www.w3.org/2000/svg\">",
-          2 * offset, 2 * offset);
+  Heatmap heatmap;
+  int heatmap_saved =
+      heatmap_from_trajectory(&heatmap, trajectory, options->resolution,
+                              options->has_bounds ? options->bounds : NULL) &&
+      save_temperature_map(&heatmap, directory, 0, options->heatmap_levels, 0);
+  // The files are already processed in parallel, the images are rendered on
+  // the worker of the file
+  RasterStats raster_stats;
+  int raster_saved =
+      options->raster_size == 0 ||
+      (heatmap_saved &&
+       join_path(filename, sizeof(filename), directory,
+                 "temperature_map.png") &&
+       save_temperature_map_raster(filename, options->raster_size, &heatmap,
+                                   NULL, &raster_stats) &&
+       join_path(filename, sizeof(filename), directory, "line.png") &&
+       save_trajectory_raster(filename, options->raster_size, &blocks,
+                              state->max_distance, NULL, &raster_stats));
+  heatmap_free(&heatmap);
+  if (!heatmap_saved) {
+    return "Could not write the temperature map";
+  }
+  if (!raster_saved) {
+    return "Could not write the PNG images";
+  }
 
-  for (int i = 0; i < 99; i++) {
-    double x1, x2, y1, y2 = 0;
-    // Invert y-axis coordinates: SVGs positive y points downwards
-    // Offset values: to keep the elements within the visible area
-    x1 = positions[i].x + offset;
-    y1 = -positions[i].y + offset;
-    x2 = positions[i + 1].x + offset;
-    y2 = -positions[i + 1].y + offset;
-    fprintf(path_line_svg,
-            "<line x1=\"%f\" y1=\"%f\" x2=\"%f\" y2=\"%f\" stroke=\"%s\" "
-            "stroke-width=\"%d\"/>\n",
-            x1, y1, x2, y2, "orange", 5);
+  if (options->batch_report) {
+    join_path(filename, sizeof(filename), directory, "report.tex");
+    if (!generate_latex_report(
+            filename, &blocks, options->resolution, options->report_points,
+            options->raster_size > 0, state->total_distance,
+            state->max_distance, state->temperature_stats.max,
+            state->temperature_stats.min, state->temperature_stats.mean,
+            running_stats_variance(&state->temperature_stats),
+            state->max_speed)) {
+      return "Could not write the report";
+    }
   }
-  fprintf(path_line_svg, "</svg>");
+  return NULL;
 }
 
 /**
- * @brief Calculates a temperature map in form of a multidimensional Array.
+ * @brief Analyzes one file of a batch run, called on the worker threads. The
+ * result is stored in the BatchFile and reported with a single line.
+ */
+static void process_batch_file(void *context, size_t task_index) {
+  BatchJob *job = context;
+  BatchFile *file = &job->files[task_index];
+  double start = monotonic_seconds();
+  file->success = 0;
+
+  MappedFile csv;
+  if (!map_file(file->input, &csv)) {
+    printf("Error: Could not read file %s\n", file->input);
+    return;
+  }
+  FlightState state;
+  flight_state_init(&state);
+  Trajectory trajectory;
+  trajectory_init(&trajectory);
+  int analyzed;
+  if (job->options->num_threads > 1) {
+    analyzed = analyze_parallel(&csv, job->options->num_threads, &state,
+                                &trajectory, &file->malformed_rows);
+  } else {
+    analyzed = analyze_serial(&csv, &state, &trajectory, NULL,
+                              &file->malformed_rows);
+  }
+  file->input_bytes = csv.size;
+  unmap_file(&csv);
+
+  const char *error = analyzed ? save_batch_outputs(file, job->options,
+                                                    &trajectory, &state)
+                               : "Out of memory";
+  file->time_steps = trajectory.length;
+  file->max_speed = state.max_speed;
+  file->max_distance = state.max_distance;
+  file->total_distance = state.total_distance;
+  file->temperature_stats = state.temperature_stats;
+  trajectory_free(&trajectory);
+  file->seconds = monotonic_seconds() - start;
+
+  if (error) {
+    printf("Error: %s: %s\n", file->input, error);
+  } else {
+    file->success = 1;
+    printf("%s: %zu time steps in %.1f ms -> %s\n", file->input,
+           file->time_steps, file->seconds * 1000.0, file->output_directory);
+  }
+}
+
+/**
+ * @brief Collects the files to process: files given directly, and the .csv
+ * files of the given directories.
  *
- * @param positions Array of 2D coordinates.
- * @param temperatures Array of temperature values at each position.
- * @param total_timesteps Total number of recorded values ("lines in csv").
- * @param matrix_resolution Resolution of the output matrix.
- * @param matrix 2D matrix storing temperature values (for avg calculation).
- */
-void temperature_map(Vec2D positions[], double temperatures[],
-                     int total_timesteps, int matrix_resolution,
-                     double matrix[matrix_resolution][matrix_resolution],
-                     int print_trajectory) {
-
-  int count[matrix_resolution][matrix_resolution]; // Number of values per cell
-
-  // Initialize arrays
-  for (int i = 0; i < matrix_resolution; i++) {
-    for (int j = 0; j < matrix_resolution; j++) {
-      matrix[i][j] = -DBL_MAX; // Uninitialized marker
-      count[i][j] = 0;
-    }
-  }
-
-  // Find min/max coordinates
-  // DBL_MAX is the biggest number a "double" can hold (provided by float.h)
-  double min_x = DBL_MAX, min_y = DBL_MAX;
-  double max_x = -DBL_MAX, max_y = -DBL_MAX;
-
-  for (int i = 0; i < total_timesteps; i++) {
-    if (positions[i].x < min_x)
-      min_x = positions[i].x;
-    if (positions[i].y < min_y)
-      min_y = positions[i].y;
-    if (positions[i].x > max_x)
-      max_x = positions[i].x;
-    if (positions[i].y > max_y)
-      max_y = positions[i].y;
-  }
-
-  // Calculate the span of one grid cell
-  double grid_width = (max_x - min_x) / matrix_resolution;
-  double grid_height = (max_y - min_y) / matrix_resolution;
-
-  // Assign points to grid cells
-  for (int i = 0; i < total_timesteps; i++) {
-    // Determine to which grid cell a measuring point belongs
-    int grid_x = (int)((positions[i].x - min_x) / grid_width);
-    int grid_y = (int)((positions[i].y - min_y) / grid_height);
-
-    // Ensure within bounds
-    if (grid_x >= 0 && grid_x < matrix_resolution && grid_y >= 0 &&
-        grid_y < matrix_resolution) {
-      if (matrix[grid_x][grid_y] == -DBL_MAX) {
-        // First time a value would be added to a grid cell, set it to that
-        // temperature value
-        matrix[grid_x][grid_y] = temperatures[i];
-      } else {
-        matrix[grid_x][grid_y] += temperatures[i]; // Sum up temperature
+ * @return 1 on success, 0 if a directory could not be read or the memory ran
+ * out.
+ */
+static int collect_batch_inputs(const ProgramOptions *options,
+                                char ***directory_files,
+                                size_t *num_directory_files, BatchFile **files,
+                                size_t *num_files) {
+  // Paths of all directory entries, owned by the caller
+  *directory_files = NULL;
+  *num_directory_files = 0;
+  *files = NULL;
+  *num_files = 0;
+  size_t capacity = 0;
+  for (int i = 0; i < options->num_batch_inputs; i++) {
+    const char *input = options->batch_inputs[i];
+    char **listed = NULL;
+    size_t num_listed = 1;
+    if (is_directory(input)) {
+      if (!list_directory(input, ".csv", &listed, &num_listed)) {
+        printf("Error: Could not read directory %s\n", input);
+        return 0;
+      }
+      if (num_listed == 0) {
+        printf("Note: %s contains no .csv files.\n", input);
+        continue;
+      }
+      char **all = realloc(*directory_files, (*num_directory_files +
+                                              num_listed) * sizeof(*all));
+      if (!all) {
+        free_file_list(listed, num_listed);
+        return 0;
+      }
+      memcpy(all + *num_directory_files, listed, num_listed * sizeof(*all));
+      *directory_files = all;
+      *num_directory_files += num_listed;
+      free(listed); // The paths are owned by directory_files now
+      listed = all + *num_directory_files - num_listed;
+    }
+
+    if (*num_files + num_listed > capacity) {
+      capacity = 2 * (*num_files + num_listed);
+      BatchFile *grown = realloc(*files, capacity * sizeof(*grown));
+      if (!grown) {
+        return 0;
       }
-      // Increase "number of added values" - used to calculate the avg
-      count[grid_x][grid_y]++;
+      *files = grown;
+    }
+    for (size_t j = 0; j < num_listed; j++) {
+      BatchFile *file = &(*files)[(*num_files)++];
+      memset(file, 0, sizeof(*file));
+      file->input = listed ? listed[j] : input;
     }
   }
+  return 1;
+}
 
-  // Compute averages
-  // The direction of iteration is predetermined by how the trajectory is
-  // expected to be oriented
-  for (int j = matrix_resolution - 1; j >= 0; j--) {
-    // Go through columns from right to left
-    for (int i = 0; i < matrix_resolution; i++) {
-      // Go through rows top to bottom
-      if (count[i][j] > 0) {
-        matrix[i][j] /= count[i][j]; // calculate average temperature
+// Length of the file name without extension ("data/flight.csv" -> 6)
+static size_t stem_length(const char *name) {
+  const char *extension = strrchr(name, '.');
+  return extension && extension != name ? (size_t)(extension - name)
+                                        : strlen(name);
+}
+
+// Whether the file name without extension is `name`
+static int has_stem(const char *input, const char *name) {
+  const char *base = path_basename(input);
+  size_t length = stem_length(base);
+  return strlen(name) == length && strncmp(base, name, length) == 0;
+}
+
+/**
+ * @brief Whether the directory `name` can't be used for file `current`:
+ * an earlier file already got it, or it is numbered ("flight_2") and a later
+ * file is named like that, which needs the name for itself.
+ */
+static int output_name_taken(const BatchFile *files, size_t num_files,
+                             size_t current, const char *path,
+                             const char *name, int numbered) {
+  for (size_t j = 0; j < current; j++) {
+    if (strcmp(files[j].output_directory, path) == 0) {
+      return 1;
+    }
+  }
+  for (size_t j = current + 1; numbered && j < num_files; j++) {
+    if (has_stem(files[j].input, name)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Assigns every file its own output directory, named after the input
+ * file without extension. Files with the same name get a numbered suffix
+ * that no other file uses ("flight_2", or "flight_3" if there also is a
+ * "flight_2.csv").
+ *
+ * @return 1 on success, 0 if a path is too long.
+ */
+static int assign_output_directories(BatchFile *files, size_t num_files,
+                                     const char *output) {
+  for (size_t i = 0; i < num_files; i++) {
+    const char *base = path_basename(files[i].input);
+    char stem[1024], name[1100];
+    snprintf(stem, sizeof(stem), "%.*s", (int)stem_length(base), base);
+    snprintf(name, sizeof(name), "%s", stem);
+    for (int copies = 1;; copies++) {
+      if (copies > 1) {
+        snprintf(name, sizeof(name), "%s_%d", stem, copies);
+      }
+      if (!join_path(files[i].output_directory,
+                     sizeof(files[i].output_directory), output, name)) {
+        printf("Error: Output path for %s is too long\n", files[i].input);
+        return 0;
       }
-      if (print_trajectory) {
-        printf(matrix[i][j] > -DBL_MAX ? " # " : "   ");
-        // Code below could be used instead of the line above to print avg
-        // temperature values printf(matrix[i][j] > -DBL_MAX ? " %.1lf " : " ?
-        // ", matrix[i][j]);
+      if (!output_name_taken(files, num_files, i, files[i].output_directory,
+                             name, copies > 1)) {
+        break;
       }
     }
-    printf("\n");
   }
+  return 1;
 }
 
 /**
- * @brief Saves the temperature map in SVG format.
+ * @brief Writes one line per file with its metrics to summary.csv in the
+ * output directory.
  *
- * @param matrix Multidimensional Array containing the average values calculated
- * by the ´temperature_map´ function.
- * @param resolution Matrix Resolution to traverse the multidimensional array.
- */
-void save_temperature_map_svg(double *matrix, int resolution) {
-  const char *filename = "temperature_map.svg";
-  FILE *file = fopen(filename, "w");
-  if (!file) {
-    printf("Error: Could not open file %s for writing.\n", filename);
-    return;
+ * @return 1 on success, 0 if the file could not be written.
+ */
+static int save_batch_summary(const char *output, const BatchFile *files,
+                              size_t num_files) {
+  char filename[4096];
+  if (!join_path(filename, sizeof(filename), output, "summary.csv")) {
+    return 0;
+  }
+  FILE *out = fopen(filename, "w");
+  if (!out) {
+    return 0;
   }
+  fprintf(out, "file,status,output,time_steps,malformed_rows,top_speed,"
+               "max_distance,total_distance,min_temperature,max_temperature,"
+               "avg_temperature,temperature_variance,seconds\n");
+  for (size_t i = 0; i < num_files; i++) {
+    const BatchFile *file = &files[i];
+    if (!file->success) {
+      fprintf(out, "%s,failed,%s,,,,,,,,,,%.6f\n", file->input,
+              file->output_directory, file->seconds);
+      continue;
+    }
+    fprintf(out, "%s,ok,%s,%zu,%zu,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f\n",
+            file->input, file->output_directory, file->time_steps,
+            file->malformed_rows, file->max_speed, file->max_distance,
+            file->total_distance, file->temperature_stats.min,
+            file->temperature_stats.max, file->temperature_stats.mean,
+            running_stats_variance(&file->temperature_stats), file->seconds);
+  }
+  return fclose(out) == 0;
+}
 
-  int cell_size = 20;
+/**
+ * @brief Analyzes many files without any interaction ("--batch"). The files
+ * are processed concurrently, one file per worker, and every file gets its
+ * own output directory. Prints the throughput at the end.
+ *
+ * @return The exit code of the program: 0 if all files were processed.
+ */
+int run_batch(const ProgramOptions *options) {
+  if (options->num_batch_inputs == 0) {
+    printf("Error: --batch needs at least one input file or directory\n");
+    return 1;
+  }
+  if (!make_directory(options->batch_output)) {
+    printf("Error: Could not create directory %s\n", options->batch_output);
+    return 1;
+  }
+
+  char **directory_files;
+  size_t num_directory_files;
+  BatchFile *files;
+  size_t num_files;
+  if (!collect_batch_inputs(options, &directory_files, &num_directory_files,
+                            &files, &num_files) ||
+      !assign_output_directories(files, num_files, options->batch_output)) {
+    free_file_list(directory_files, num_directory_files);
+    free(files);
+    return 1;
+  }
+
+  int num_jobs = options->num_jobs > 0 ? options->num_jobs : cpu_count();
+  if ((size_t)num_jobs > num_files) {
+    num_jobs = num_files > 0 ? (int)num_files : 1;
+  }
+  printf("Processing %zu files with %d workers.\n", num_files, num_jobs);
+  fflush(stdout);
+
+  // Select the SIMD backend before the workers use it
+  simd_get_backend();
+  double start = monotonic_seconds();
+  ThreadPool pool;
+  if (!thread_pool_create(&pool, num_jobs - 1)) {
+    printf("Error: Could not start the worker threads\n");
+    free_file_list(directory_files, num_directory_files);
+    free(files);
+    return 1;
+  }
+  BatchJob job = {options, files, num_files};
+  thread_pool_run(&pool, num_files, process_batch_file, &job);
+  thread_pool_destroy(&pool);
+  double seconds = monotonic_seconds() - start;
+
+  size_t failed = 0, time_steps = 0, input_bytes = 0;
+  for (size_t i = 0; i < num_files; i++) {
+    failed += !files[i].success;
+    time_steps += files[i].time_steps;
+    input_bytes += files[i].input_bytes;
+  }
+  int exit_code = failed > 0;
+  if (!save_batch_summary(options->batch_output, files, num_files)) {
+    printf("Error: Could not write the summary to %s\n",
+           options->batch_output);
+    exit_code = 1;
+  }
+  if (seconds <= 0) {
+    seconds = 1e-9;
+  }
+  printf("\nProcessed %zu files (%zu failed), %zu time steps, %.1f MiB in "
+         "%.2f s\n",
+         num_files, failed, time_steps, input_bytes / (1024.0 * 1024.0),
+         seconds);
+  printf("Throughput: %.1f files/s, %.0f rows/s, %.1f MiB/s\n",
+         num_files / seconds, time_steps / seconds,
+         input_bytes / (1024.0 * 1024.0) / seconds);
+
+  free_file_list(directory_files, num_directory_files);
+  free(files);
+  return exit_code;
+}
 
-  // calculate required svg width/height
-  int width = resolution * cell_size;
-  int height = resolution * cell_size;
+static int has_extension(const char *filename, const char *extension) {
+  size_t length = strlen(filename), extension_length = strlen(extension);
+  return length >= extension_length &&
+         strcmp(filename + length - extension_length, extension) == 0;
+}
 
-  fprintf(
-      file,
-      "<svg width=\"%d\" height=\"%d\" xmlns=\"http://www.w3.org/2000/svg\" "
-      "style=\"transform:rotate(-90deg)\">\n",
-      width, height);
+/**
+ * @brief Analyzes a spaceship data file with the threads of the options.
+ *
+ * @return 1 on success, 0 if the file could not be read or the memory ran
+ * out.
+ */
+static int analyze_file(const char *filename, const ProgramOptions *options,
+                        FlightState *state, Trajectory *trajectory) {
+  MappedFile csv;
+  if (!map_file(filename, &csv)) {
+    printf("Error: Could not read file %s\n", filename);
+    return 0;
+  }
+  flight_state_init(state);
+  size_t malformed_rows;
+  int analyzed =
+      options->num_threads > 1
+          ? analyze_parallel(&csv, options->num_threads, state, trajectory,
+                             &malformed_rows)
+          : analyze_serial(&csv, state, trajectory, NULL, &malformed_rows);
+  unmap_file(&csv);
+  if (!analyzed) {
+    printf("Error: Not enough memory for the trajectory of %s\n", filename);
+  }
+  return analyzed;
+}
 
-  double min_temp = DBL_MAX, max_temp = -DBL_MAX;
+/**
+ * @brief Opens a flight database and hands its trajectory (which owns the
+ * mapping, free it with trajectory_free()) and metrics to the caller.
+ *
+ * @return 1 on success, 0 if the file is not a valid database.
+ */
+static int open_flight_database(const char *filename, FlightState *state,
+                                Trajectory *trajectory) {
+  FlightDatabase database;
+  if (!flight_database_open(&database, filename)) {
+    printf("Error: Could not open flight database %s\n", filename);
+    return 0;
+  }
+  *state = database.state;
+  *trajectory = database.trajectory;
+  return 1;
+}
 
-  // Find min/max temperatures
-  for (int i = 0; i < resolution; i++) {
-    for (int j = 0; j < resolution; j++) {
-      double temp = matrix[i * resolution + j];
-      if (temp > -DBL_MAX) { // Ignore "uninitialized" (-DBL_MAX)
-        if (temp < min_temp)
-          min_temp = temp;
-        if (temp > max_temp)
-          max_temp = temp;
-      }
+/**
+ * @brief Reads the trajectory of a query: trajectory.bin files and flight
+ * databases are mapped, anything else is analyzed as spaceship data.
+ *
+ * @return 1 on success, 0 otherwise.
+ */
+static int load_query_trajectory(const ProgramOptions *options,
+                                 Trajectory *trajectory) {
+  const char *input = options->query_input;
+  FlightState state;
+  if (has_extension(input, ".bin")) {
+    if (!trajectory_load(trajectory, input)) {
+      printf("Error: Could not load trajectory %s\n", input);
+      return 0;
     }
+    return 1;
   }
+  if (has_extension(input, ".flightdb")) {
+    return open_flight_database(input, &state, trajectory);
+  }
+  return analyze_file(input, options, &state, trajectory);
+}
+
+/**
+ * @brief Whether an argument is a number, e.g. a negative coordinate of a
+ * query, rather than an option.
+ */
+static int is_number(const char *text) {
+  char *end;
+  strtod(text, &end);
+  return end != text && *end == '\0';
+}
 
-  // Prevent division by zero (when calculating normalized temperature)
-  if (max_temp == min_temp) {
-    max_temp += 1.0;
+/**
+ * @brief Reads `count` numbers from the query arguments.
+ *
+ * @return 1 on success, 0 if an argument is missing or not a number.
+ */
+static int parse_query_numbers(const ProgramOptions *options, int first,
+                               int count, double *numbers) {
+  for (int i = 0; i < count; i++) {
+    if (first + i >= options->num_batch_inputs) {
+      printf("Error: Query %s needs %d numbers\n",
+             options->batch_inputs[first - 1], count);
+      return 0;
+    }
+    const char *text = options->batch_inputs[first + i];
+    char *end;
+    numbers[i] = strtod(text, &end);
+    if (end == text || *end != '\0') {
+      printf("Error: Not a number: %s\n", text);
+      return 0;
+    }
   }
+  return 1;
+}
 
-  // Place SVG rectangles
-  // A style attribute on the SVG ensures the correct trajectory orientation
-  // instead of changing the iteration direction
-  for (int i = 0; i < resolution; i++) {
-    for (int j = 0; j < resolution; j++) {
-      if (matrix[i * resolution + j] == -DBL_MAX) {
-        fprintf(file,
-                "<rect x=\"%d\" y=\"%d\" width=\"%d\" height=\"%d\" "
-                "fill=\"rgb(0,0,0)\" />\n",
-                j * cell_size, i * cell_size, cell_size, cell_size);
-      } else {
-        // Normalize temperature to [0,1] for color intensity
-        double norm_temp =
-            (matrix[i * resolution + j] - min_temp) / (max_temp - min_temp);
-        int red = (int)(255 * norm_temp);
-        int blue = (int)(255 * (1 - norm_temp));
-        int green = 0;
+/**
+ * @brief Whether a parsed query number lies in [min, max], which also makes
+ * its conversion to size_t defined (NaN and inf are rejected).
+ */
+static int number_in_range(double value, double min, double max) {
+  return isfinite(value) && value >= min && value <= max;
+}
 
-        fprintf(file,
-                "<rect x=\"%d\" y=\"%d\" width=\"%d\" height=\"%d\" "
-                "fill=\"rgb(%d,%d,%d)\" />\n",
-                j * cell_size, i * cell_size, cell_size, cell_size, red, green,
-                blue);
+/**
+ * @brief Prints the matches of a query as CSV (time steps counted from 1,
+ * like in the report) and their average temperature.
+ */
+static void print_query_results(const Trajectory *trajectory,
+                                const SpatialResults *results,
+                                double seconds) {
+  double temperature_sum = 0;
+  for (size_t i = 0; i < results->length; i++) {
+    temperature_sum += trajectory->temperature[results->matches[i].step];
+  }
+  printf("%zu matches in %.1f us", results->length, seconds * 1e6);
+  if (results->length > 0) {
+    printf(", average temperature %.2f",
+           temperature_sum / results->length);
+  }
+  printf("\ntime step,x,y,temperature,distance\n");
+  for (size_t i = 0; i < results->length; i++) {
+    size_t step = results->matches[i].step;
+    printf("%zu,%.6f,%.6f,%.2f,%.6f\n", step + 1, trajectory->x[step],
+           trajectory->y[step], trajectory->temperature[step],
+           results->matches[i].distance);
+  }
+}
+
+/**
+ * @brief "--query FILE QUERY...": builds the spatial index over the
+ * trajectory and answers the queries given after the options:
+ *   box MIN_X MIN_Y MAX_X MAX_Y   segments that cross the box
+ *   radius X Y R                  segments that pass within R of (X, Y)
+ *   nearest X Y K [FIRST_STEP]    the K closest time steps (from FIRST_STEP)
+ *
+ * @return The exit code.
+ */
+int run_query(const ProgramOptions *options) {
+  if (options->num_batch_inputs == 0) {
+    printf("Error: --query needs at least one query: box MIN_X MIN_Y MAX_X "
+           "MAX_Y, radius X Y R or nearest X Y K [FIRST_STEP]\n");
+    return 1;
+  }
+  Trajectory trajectory;
+  trajectory_init(&trajectory);
+  if (!load_query_trajectory(options, &trajectory)) {
+    trajectory_free(&trajectory);
+    return 1;
+  }
+
+  double start = monotonic_seconds();
+  SpatialIndex index;
+  if (!spatial_index_build(&index, trajectory.x, trajectory.y,
+                           trajectory.length)) {
+    printf("Error: Could not build the spatial index of %zu time steps\n",
+           trajectory.length);
+    trajectory_free(&trajectory);
+    return 1;
+  }
+  printf("Spatial index over %zu time steps built in %.1f ms (%.2f MiB)\n",
+         trajectory.length, (monotonic_seconds() - start) * 1e3,
+         spatial_index_memory_usage(&index) / (1024.0 * 1024.0));
+
+  int exit_code = 0;
+  SpatialResults results;
+  spatial_results_init(&results);
+  for (int i = 0; i < options->num_batch_inputs && exit_code == 0;) {
+    const char *query = options->batch_inputs[i++];
+    double args[4];
+    int success = 0;
+    start = monotonic_seconds();
+    if (strcmp(query, "box") == 0 && parse_query_numbers(options, i, 4, args)) {
+      i += 4;
+      printf("\nbox %g %g %g %g: ", args[0], args[1], args[2], args[3]);
+      start = monotonic_seconds();
+      success = spatial_query_box(&index, args[0], args[1], args[2], args[3],
+                                  &results);
+    } else if (strcmp(query, "radius") == 0 &&
+               parse_query_numbers(options, i, 3, args)) {
+      i += 3;
+      printf("\nradius %g around (%g, %g): ", args[2], args[0], args[1]);
+      start = monotonic_seconds();
+      success =
+          spatial_query_radius(&index, args[0], args[1], args[2], &results);
+    } else if (strcmp(query, "nearest") == 0 &&
+               parse_query_numbers(options, i, 3, args)) {
+      i += 3;
+      // Optional first time step (counted from 1)
+      args[3] = 1;
+      if (i < options->num_batch_inputs &&
+          is_number(options->batch_inputs[i])) {
+        args[3] = atof(options->batch_inputs[i++]);
+      }
+      double length = (double)trajectory.length;
+      if (!number_in_range(args[2], 1, length) ||
+          !number_in_range(args[3], 1, length)) {
+        printf("Error: nearest needs K and FIRST_STEP between 1 and %zu\n",
+               trajectory.length);
+        exit_code = 1;
+        break;
+      }
+      printf("\n%g nearest to (%g, %g) from time step %g: ", args[2],
+             args[0], args[1], args[3]);
+      start = monotonic_seconds();
+      success = spatial_query_nearest(&index, args[0], args[1],
+                                      (size_t)args[2], (size_t)args[3] - 1,
+                                      &results);
+    } else {
+      if (strcmp(query, "box") != 0 && strcmp(query, "radius") != 0 &&
+          strcmp(query, "nearest") != 0) {
+        printf("Error: Unknown query: %s\n", query);
       }
+      exit_code = 1;
+      break;
+    }
+    double seconds = monotonic_seconds() - start;
+    if (!success) {
+      printf("Error: Out of memory\n");
+      exit_code = 1;
+      break;
     }
+    print_query_results(&trajectory, &results, seconds);
   }
 
-  fprintf(file, "</svg>\n");
-  fclose(file);
-  printf("SVG file saved as %s\n", filename);
+  spatial_results_free(&results);
+  spatial_index_free(&index);
+  trajectory_free(&trajectory);
+  return exit_code;
 }
 
-void checkInput(int *cursor_position, int option_state[], int len_options) {
-  char ch;
+/**
+ * @brief "--compile FILE...": analyzes every file and writes the flight
+ * database next to it ("data/flight.csv" -> "data/flight.flightdb").
+ *
+ * @return The exit code.
+ */
+int run_compile(const ProgramOptions *options) {
+  if (options->num_batch_inputs == 0) {
+    printf("Error: --compile needs at least one input file\n");
+    return 1;
+  }
+  int exit_code = 0;
+  for (int i = 0; i < options->num_batch_inputs; i++) {
+    const char *input = options->batch_inputs[i];
+    const char *name = path_basename(input);
+    char output[1024];
+    if (snprintf(output, sizeof(output), "%.*s.flightdb",
+                 (int)(name - input + stem_length(name)),
+                 input) >= (int)sizeof(output)) {
+      printf("Error: Path too long: %s\n", input);
+      exit_code = 1;
+      continue;
+    }
 
-  while (1) {
-    ch = getch();
-    // printf("Key pressed (ASCII %d): %c\n", ch, ch);
-    if (ch == 43) { // ASCII Code for '+'
-      if (*cursor_position > 0) {
-        (*cursor_position)--;
-      }
+    double start = monotonic_seconds();
+    FlightState state;
+    Trajectory trajectory;
+    trajectory_init(&trajectory);
+    if (!analyze_file(input, options, &state, &trajectory)) {
+      trajectory_free(&trajectory);
+      exit_code = 1;
+      continue;
+    }
+    double analysis_seconds = monotonic_seconds() - start;
+    start = monotonic_seconds();
+    if (flight_database_save(output, &trajectory, &state)) {
+      printf("%s: %zu time steps analyzed in %.1f ms, %s written in %.1f "
+             "ms\n",
+             input, trajectory.length, analysis_seconds * 1e3, output,
+             (monotonic_seconds() - start) * 1e3);
+    } else {
+      printf("Error: Could not write %s\n", output);
+      exit_code = 1;
+    }
+    trajectory_free(&trajectory);
+  }
+  return exit_code;
+}
+
+/**
+ * @brief "--convert FILE...": writes the telemetry file of every CSV file
+ * next to it ("data/flight.csv" -> "data/flight.tlm").
+ *
+ * @return The exit code.
+ */
+int run_convert(const ProgramOptions *options) {
+  if (options->num_batch_inputs == 0) {
+    printf("Error: --convert needs at least one input file\n");
+    return 1;
+  }
+  int exit_code = 0;
+  for (int i = 0; i < options->num_batch_inputs; i++) {
+    const char *input = options->batch_inputs[i];
+    const char *name = path_basename(input);
+    char output[1024];
+    if (snprintf(output, sizeof(output), "%.*s.tlm",
+                 (int)(name - input + stem_length(name)),
+                 input) >= (int)sizeof(output)) {
+      printf("Error: Path too long: %s\n", input);
+      exit_code = 1;
+      continue;
+    }
+    MappedFile csv;
+    if (!map_file(input, &csv)) {
+      printf("Error: Could not read file %s\n", input);
+      exit_code = 1;
+      continue;
+    }
+    double start = monotonic_seconds();
+    size_t rows, malformed_rows;
+    int converted = telemetry_convert(&csv, output, &rows, &malformed_rows);
+    double seconds = monotonic_seconds() - start;
+    size_t csv_size = csv.size;
+    unmap_file(&csv);
+    MappedFile telemetry;
+    if (!converted || !map_file(output, &telemetry)) {
+      printf("Error: Could not write %s\n", output);
+      exit_code = 1;
+      continue;
+    }
+    printf("%s: %zu time steps, %zu -> %zu bytes (%.1f -> %.1f bytes per "
+           "step, %.2fx) in %.1f ms -> %s\n",
+           input, rows, csv_size, telemetry.size,
+           rows > 0 ? (double)csv_size / rows : 0.0,
+           rows > 0 ? (double)telemetry.size / rows : 0.0,
+           telemetry.size > 0 ? (double)csv_size / telemetry.size : 0.0,
+           seconds * 1e3, output);
+    if (malformed_rows > 0) {
+      printf("Skipped %zu malformed rows.\n", malformed_rows);
+    }
+    unmap_file(&telemetry);
+  }
+  return exit_code;
+}
+
+/**
+ * @brief "--database FILE [window FIRST LAST]...": prints the metrics of the
+ * whole flight and of every time window (steps counted from 1, inclusive)
+ * from a compiled flight, without parsing or integrating.
+ *
+ * @return The exit code.
+ */
+int run_database(const ProgramOptions *options) {
+  double start = monotonic_seconds();
+  FlightDatabase database;
+  if (!flight_database_open(&database, options->database)) {
+    printf("Error: Could not open flight database %s\n", options->database);
+    return 1;
+  }
+  printf("%s: %zu time steps, opened in %.1f us\n\n", options->database,
+         database.trajectory.length, (monotonic_seconds() - start) * 1e6);
+  print_metrics(&database.state);
+
+  int exit_code = 0;
+  if (options->num_batch_inputs > 0) {
+    printf("\nfirst step,last step,top speed,distance,max. distance to "
+           "start,temperature avg,temperature variance,min. temperature,"
+           "max. temperature\n");
+  }
+  for (int i = 0; i < options->num_batch_inputs;) {
+    double steps[2];
+    if (strcmp(options->batch_inputs[i++], "window") != 0) {
+      printf("Error: Unknown query: %s\n", options->batch_inputs[i - 1]);
+      exit_code = 1;
       break;
-    } else if (ch == 45) { // ASCII Code for '-'
-      if (*cursor_position < len_options - 1) {
-        (*cursor_position)++;
-      }
+    }
+    if (!parse_query_numbers(options, i, 2, steps)) {
+      exit_code = 1;
       break;
-    } else if (ch == 13) { // ASCII Code for TODO
-      // Enter pressed, toggle current option.
-      option_state[*cursor_position] = !option_state[*cursor_position];
+    }
+    i += 2;
+    FlightWindow window;
+    start = monotonic_seconds();
+    double length = (double)database.trajectory.length;
+    if (!number_in_range(steps[0], 1, length) ||
+        !number_in_range(steps[1], steps[0], length) ||
+        !flight_database_window(&database, (size_t)steps[0] - 1,
+                                (size_t)steps[1] - 1, &window)) {
+      printf("Error: window %g %g is not within time steps 1 to %zu "
+             "(window FIRST LAST, FIRST <= LAST)\n",
+             steps[0], steps[1], database.trajectory.length);
+      exit_code = 1;
       break;
     }
-    // else {
-    //   printf("Unexpected character: %c (ASCII %d)\n", ch, ch);
-    // }
+    double seconds = monotonic_seconds() - start;
+    printf("%zu,%zu,%lf,%lf,%lf,%lf,%lf,%lf,%lf (%.2f us)\n",
+           (size_t)steps[0], (size_t)steps[1], window.max_speed,
+           window.distance, window.max_distance, window.temperature_mean,
+           window.temperature_variance, window.min_temperature,
+           window.max_temperature, seconds * 1e6);
   }
+  flight_database_close(&database);
+  return exit_code;
 }
 
-#define LEN_CLI_OPTIONS 4 // Compile-time constant
+// One line of windows.csv
+static void write_window(OutputBuffer *out, const WindowMetrics *metrics) {
+  output_buffer_int(out, (long long)metrics->first_step + 1);
+  output_buffer_puts(out, ",");
+  output_buffer_int(out, (long long)metrics->last_step + 1);
+  const double values[] = {metrics->temperature_mean,
+                           metrics->temperature_variance,
+                           metrics->min_temperature,
+                           metrics->max_temperature,
+                           metrics->max_speed,
+                           metrics->distance};
+  for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+    output_buffer_puts(out, ",");
+    output_buffer_fixed(out, values[i], 6);
+  }
+  output_buffer_puts(out, "\n");
+}
 
-void print_interface(char *options[], int option_state[], int cursor_position) {
-  printf("--- MISSION CONTROL PANEL ---\n\n");
-  for (int i = 0; i < LEN_CLI_OPTIONS; i++) {
-    printf(cursor_position == i ? " ? " : "   ");
-    printf(option_state[i] == 1 ? "[X]" : "[ ]");
-    printf(" %s\n", options[i]);
+/**
+ * @brief "--rolling FILE": streams over the input (CSV or telemetry file)
+ * without keeping the trajectory and writes the metrics of a window of the
+ * last `window_size` time steps every `window_stride` steps to windows.csv.
+ * A flight shorter than one window gets a single window over all time steps.
+ *
+ * @return The exit code.
+ */
+int run_rolling(const ProgramOptions *options) {
+  size_t size = options->window_size;
+  size_t stride = options->window_stride;
+  if (stride == 0) {
+    stride = size >= 10 ? size / 10 : 1;
   }
-  printf("\nControls: +/- [Enter]\n");
+  MappedFile csv;
+  if (!map_file(options->rolling_input, &csv)) {
+    printf("Error: Could not read file %s\n", options->rolling_input);
+    return 1;
+  }
+  TelemetryChunk *chunk = malloc(sizeof(*chunk));
+  ChunkKinematics *kinematics = malloc(sizeof(*kinematics));
+  double *speeds = malloc(CHUNK_SIZE * sizeof(double));
+  SlidingWindow window;
+  int window_created = sliding_window_init(&window, size);
+  OutputBuffer out;
+  if (!chunk || !kinematics || !speeds || !window_created ||
+      !output_buffer_open(&out, "windows.csv")) {
+    printf("Error: Could not write windows.csv\n");
+    free(chunk);
+    free(kinematics);
+    free(speeds);
+    if (window_created) {
+      sliding_window_free(&window);
+    }
+    unmap_file(&csv);
+    return 1;
+  }
+
+  double start = monotonic_seconds();
+  output_buffer_puts(&out, "first step,last step,temperature avg,"
+                           "temperature variance,min. temperature,max. "
+                           "temperature,top speed,distance\n");
+  size_t num_windows = 0;
+  WindowMetrics metrics;
+  FlightState state;
+  flight_state_init(&state);
+  CsvParser parser;
+  csv_parser_init(&parser, csv.data, csv.size);
+  TelemetryReader reader;
+  int binary = telemetry_open(&reader, csv.data, csv.size);
+  while ((binary ? telemetry_read_chunk(&reader, chunk)
+                 : csv_read_chunk(&parser, chunk)) > 0) {
+    // Leaves the segment lengths in kinematics->lengths
+    integrate_chunk(&state, chunk, kinematics);
+    batch_length(kinematics->velocity_x, kinematics->velocity_y, speeds,
+                 chunk->length);
+    for (size_t i = 0; i < chunk->length; i++) {
+      sliding_window_add(&window, chunk->temperature[i], speeds[i],
+                         kinematics->lengths[i]);
+      if (window.steps >= size && (window.steps - size) % stride == 0) {
+        sliding_window_metrics(&window, &metrics);
+        write_window(&out, &metrics);
+        num_windows++;
+      }
+    }
+  }
+  if (num_windows == 0 && window.steps > 0) {
+    sliding_window_metrics(&window, &metrics);
+    write_window(&out, &metrics);
+    num_windows++;
+  }
+  int success = output_buffer_close(&out);
+  double seconds = monotonic_seconds() - start;
+
+  if (success) {
+    printf("%zu windows of %zu time steps (every %zu steps) saved as "
+           "windows.csv: %zu time steps in %.1f ms (%.1f ns/step)\n",
+           num_windows, size, stride, window.steps, seconds * 1e3,
+           window.steps > 0 ? seconds * 1e9 / window.steps : 0.0);
+  } else {
+    printf("Error: Could not write windows.csv\n");
+  }
+  size_t malformed_rows =
+      binary ? reader.malformed_rows : parser.malformed_rows;
+  if (malformed_rows > 0) {
+    printf("Skipped %zu malformed rows.\n", malformed_rows);
+  }
+  free(chunk);
+  free(kinematics);
+  free(speeds);
+  sliding_window_free(&window);
+  unmap_file(&csv);
+  return success ? 0 : 1;
 }
 
-void cli(int option_state[]) {
-  char *options[LEN_CLI_OPTIONS] = {"Print Trajectory", "Print Metrics",
-                                    "Generate LaTeX Report", "Liftoff!"};
-  int cursor_position = 0;
-  while (option_state[LEN_CLI_OPTIONS - 1] != 1) { // Check for "liftoff!"
-    print_interface(options, option_state, cursor_position);
-    checkInput(&cursor_position, option_state, LEN_CLI_OPTIONS);
-    system("cls");
+/**
+ * @brief Writes one line per ship with its metrics to fleet.csv.
+ *
+ * @return 1 on success, 0 if the file could not be written.
+ */
+static int save_fleet_summary(const BatchFile *files,
+                              const ShipResult *results, size_t num_ships) {
+  FILE *out = fopen("fleet.csv", "w");
+  if (!out) {
+    return 0;
   }
+  fprintf(out, "file,time_steps,malformed_rows,top_speed,max_distance,"
+               "total_distance,min_temperature,max_temperature,"
+               "avg_temperature,temperature_variance\n");
+  for (size_t i = 0; i < num_ships; i++) {
+    const ShipResult *ship = &results[i];
+    fprintf(out, "%s,%zu,%zu,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f\n",
+            files[i].input, ship->time_steps, ship->malformed_rows,
+            ship->max_speed, ship->max_distance, ship->total_distance,
+            ship->temperature_stats.min, ship->temperature_stats.max,
+            ship->temperature_stats.mean,
+            running_stats_variance(&ship->temperature_stats));
+  }
+  return fclose(out) == 0;
 }
 
-void get_filepath(char *filePath) {
-  while (1) {
-    printf("Enter filename: ");
-    scanf("%1023s", filePath);
-    if (_access(filePath, 0) != -1) {
+/**
+ * @brief Analyzes the flights of many ships together ("--fleet"), one ship
+ * per input file: the metrics of every ship go to fleet.csv, the fleet
+ * metrics are printed and the temperatures of all ships are combined in one
+ * temperature map.
+ *
+ * @return The exit code.
+ */
+int run_fleet(const ProgramOptions *options) {
+  if (options->num_batch_inputs == 0) {
+    printf("Error: --fleet needs at least one input file or directory\n");
+    return 1;
+  }
+  if (!integrator_is_default(&options->integrator) ||
+      options->integrator.fast_heading) {
+    printf("Error: --fleet only supports the semi-implicit integrator "
+           "without substeps\n");
+    return 1;
+  }
+  char **directory_files;
+  size_t num_directory_files;
+  BatchFile *files;
+  size_t num_ships;
+  if (!collect_batch_inputs(options, &directory_files, &num_directory_files,
+                            &files, &num_ships)) {
+    free_file_list(directory_files, num_directory_files);
+    free(files);
+    return 1;
+  }
+  MappedFile *inputs = calloc(num_ships, sizeof(*inputs));
+  ShipResult *results = malloc(num_ships * sizeof(*results));
+  size_t num_mapped = 0;
+  int exit_code = !inputs || !results;
+  if (exit_code) {
+    printf("Error: Not enough memory for %zu ships\n", num_ships);
+  }
+  for (; !exit_code && num_mapped < num_ships; num_mapped++) {
+    if (!map_file(files[num_mapped].input, &inputs[num_mapped])) {
+      printf("Error: Could not read file %s\n", files[num_mapped].input);
+      exit_code = 1;
+      break;
+    }
+    // The ships are parsed row by row in lockstep, from CSV only
+    TelemetryReader reader;
+    if (telemetry_open(&reader, inputs[num_mapped].data,
+                       inputs[num_mapped].size)) {
+      printf("Error: %s is a telemetry file, --fleet needs CSV files\n",
+             files[num_mapped].input);
+      unmap_file(&inputs[num_mapped]);
+      exit_code = 1;
       break;
-    } else {
-      printf("File does not exist: %s\n\n", filePath);
     }
   }
-  system("cls");
+
+  Heatmap heatmap;
+  if (options->has_bounds) {
+    heatmap_init(&heatmap, options->resolution, options->bounds[0],
+                 options->bounds[1], options->bounds[2], options->bounds[3]);
+  } else {
+    heatmap_init_auto(&heatmap, options->resolution);
+  }
+  if (!exit_code) {
+    double start = monotonic_seconds();
+    if (!fleet_analyze(inputs, num_ships, &heatmap, results)) {
+      printf("Error: Out of memory\n");
+      exit_code = 1;
+    }
+    double seconds = monotonic_seconds() - start;
+
+    FlightState fleet;
+    flight_state_init(&fleet);
+    size_t ship_steps = 0, max_steps = 0;
+    for (size_t i = 0; !exit_code && i < num_ships; i++) {
+      const ShipResult *ship = &results[i];
+      ship_steps += ship->time_steps;
+      max_steps = ship->time_steps > max_steps ? ship->time_steps : max_steps;
+      fleet.max_speed = fmax(fleet.max_speed, ship->max_speed);
+      fleet.max_distance = fmax(fleet.max_distance, ship->max_distance);
+      fleet.total_distance += ship->total_distance;
+      running_stats_merge(&fleet.temperature_stats, &ship->temperature_stats);
+    }
+    if (!exit_code) {
+      printf("%zu ships, %zu time steps (longest flight %zu) in %.1f ms: "
+             "%.0f ship-steps/s\n",
+             num_ships, ship_steps, max_steps, seconds * 1e3,
+             ship_steps / (seconds > 0 ? seconds : 1e-9));
+      printf("Fleet top speed: %lf\n", fleet.max_speed);
+      printf("Fleet max. temperature: %lf\nFleet min. temperature: %lf\n",
+             fleet.temperature_stats.max, fleet.temperature_stats.min);
+      printf("Fleet temperature avg: %lf\n", fleet.temperature_stats.mean);
+      printf("Fleet temperature variance: %lf\n",
+             running_stats_variance(&fleet.temperature_stats));
+      printf("Fleet max. Euclidean distance to start: %lf\n",
+             fleet.max_distance);
+      printf("Fleet total distance: %lf\n", fleet.total_distance);
+      if (save_fleet_summary(files, results, num_ships)) {
+        printf("Saved the metrics of every ship as fleet.csv\n");
+      } else {
+        printf("Error: Could not write fleet.csv\n");
+        exit_code = 1;
+      }
+      if (!save_temperature_map(&heatmap, "", 0, options->heatmap_levels,
+                                1)) {
+        exit_code = 1;
+      }
+      print_points_outside(&heatmap);
+    }
+  }
+  heatmap_free(&heatmap);
+  for (size_t i = 0; i < num_mapped; i++) {
+    unmap_file(&inputs[i]);
+  }
+  free(inputs);
+  free(results);
+  free_file_list(directory_files, num_directory_files);
+  free(files);
+  return exit_code;
 }
 
-void resolution_input(int *matrix_resolution) {
-  printf("Enter desired resolution: ");
-  if (scanf("%d", matrix_resolution) != 1) {
-    *matrix_resolution = 25; // Default value
-    printf("No input provided, using default value: %d\n", *matrix_resolution);
-    system("pause");
-    system("cls");
+/**
+ * @brief Parses the command line options. Arguments that are not options
+ * (the inputs of "--batch", the queries of "--query") are moved to the front
+ * of argv, after the program name.
+ *
+ * @param options Receives the options, initialized with the defaults.
+ * @return 1 if all options are valid, 0 otherwise.
+ */
+int parse_arguments(int argc, char *argv[], ProgramOptions *options) {
+  options->batch_inputs = (const char **)argv + 1;
+  options->num_batch_inputs = 0;
+  for (int i = 1; i < argc; i++) {
+    if (argv[i][0] != '-' || is_number(argv[i])) {
+      argv[1 + options->num_batch_inputs++] = argv[i];
+    } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+      options->batch_output = argv[++i];
+    } else if (strcmp(argv[i], "--query") == 0 && i + 1 < argc) {
+      options->query_input = argv[++i];
+    } else if (strcmp(argv[i], "--rolling") == 0 && i + 1 < argc) {
+      options->rolling_input = argv[++i];
+    } else if ((strcmp(argv[i], "--window") == 0 ||
+                strcmp(argv[i], "--stride") == 0) &&
+               i + 1 < argc) {
+      long long steps = atoll(argv[i + 1]);
+      if (steps < 1) {
+        printf("Error: %s needs a positive number of time steps\n", argv[i]);
+        return 0;
+      }
+      if (strcmp(argv[i++], "--window") == 0) {
+        options->window_size = (size_t)steps;
+      } else {
+        options->window_stride = (size_t)steps;
+      }
+    } else if (strcmp(argv[i], "--compile") == 0) {
+      options->compile = 1;
+    } else if (strcmp(argv[i], "--convert") == 0) {
+      options->convert = 1;
+    } else if (strcmp(argv[i], "--fleet") == 0) {
+      options->fleet = 1;
+    } else if (strcmp(argv[i], "--database") == 0 && i + 1 < argc) {
+      options->database = argv[++i];
+    } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+      options->num_jobs = atoi(argv[++i]);
+      if (options->num_jobs < 1) {
+        printf("Error: --jobs needs a positive number\n");
+        return 0;
+      }
+    } else if (strcmp(argv[i], "--report") == 0) {
+      options->batch_report = 1;
+    } else if (strcmp(argv[i], "--report-points") == 0 && i + 1 < argc) {
+      // 0 keeps every time step
+      long long points = atoll(argv[++i]);
+      if (points < 0 || (points > 0 && points < 3)) {
+        printf("Error: --report-points needs 0 or a number of at least 3\n");
+        return 0;
+      }
+      options->report_points = (size_t)points;
+    } else if ((strcmp(argv[i], "--update") == 0 ||
+                strcmp(argv[i], "--follow") == 0) &&
+               i + 1 < argc) {
+      options->follow = strcmp(argv[i], "--follow") == 0;
+      options->input = argv[++i];
+    } else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+      options->checkpoint = argv[++i];
+    } else if (strcmp(argv[i], "--resolution") == 0 && i + 1 < argc) {
+      options->resolution = atoi(argv[++i]);
+      if (!valid_resolution(options->resolution)) {
+        printf("Error: --resolution needs a number between 1 and %d\n",
+               HEATMAP_MAX_RESOLUTION);
+        return 0;
+      }
+    } else if (strcmp(argv[i], "--poll-ms") == 0 && i + 1 < argc) {
+      options->poll_interval_ms = atoi(argv[++i]);
+      if (options->poll_interval_ms < 1) {
+        printf("Error: --poll-ms needs a positive number\n");
+        return 0;
+      }
+    } else if (strcmp(argv[i], "--levels") == 0 && i + 1 < argc) {
+      // "all" (0) saves every level down to a single cell
+      const char *levels = argv[++i];
+      options->heatmap_levels = strcmp(levels, "all") == 0 ? 0 : atoi(levels);
+      if (options->heatmap_levels < 1 && strcmp(levels, "all") != 0) {
+        printf("Error: --levels needs a positive number or \"all\"\n");
+        return 0;
+      }
+    } else if (strcmp(argv[i], "--svg-tolerance") == 0 && i + 1 < argc) {
+      options->svg_tolerance = atof(argv[++i]);
+      if (options->svg_tolerance < 0) {
+        printf("Error: --svg-tolerance can't be negative\n");
+        return 0;
+      }
+    } else if (strcmp(argv[i], "--raster") == 0 && i + 1 < argc) {
+      options->raster_size = atoi(argv[++i]);
+      if (options->raster_size < 1 || options->raster_size > RASTER_MAX_SIZE) {
+        printf("Error: --raster needs a size between 1 and %d pixels\n",
+               RASTER_MAX_SIZE);
+        return 0;
+      }
+    } else if (strcmp(argv[i], "--bounds") == 0 && i + 4 < argc) {
+      for (int j = 0; j < 4; j++) {
+        options->bounds[j] = atof(argv[++i]);
+      }
+      options->has_bounds = 1;
+    } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      options->num_threads = atoi(argv[++i]);
+      if (options->num_threads < 1) {
+        printf("Error: --threads needs a positive number\n");
+        return 0;
+      }
+    } else if (strcmp(argv[i], "--integrator") == 0 && i + 1 < argc) {
+      if (!integrator_from_name(argv[++i], &options->integrator.scheme)) {
+        printf("Error: --integrator needs one of semi-implicit, euler, rk4, "
+               "adaptive, exact\n");
+        return 0;
+      }
+    } else if (strcmp(argv[i], "--substeps") == 0 && i + 1 < argc) {
+      options->integrator.substeps = atoi(argv[++i]);
+      if (options->integrator.substeps < 1 ||
+          options->integrator.substeps > INTEGRATOR_MAX_SUBSTEPS) {
+        printf("Error: --substeps needs a number between 1 and %d\n",
+               INTEGRATOR_MAX_SUBSTEPS);
+        return 0;
+      }
+    } else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+      options->integrator.tolerance = atof(argv[++i]);
+      if (!(options->integrator.tolerance > 0)) {
+        printf("Error: --tolerance needs a positive number\n");
+        return 0;
+      }
+    } else if (strcmp(argv[i], "--fast-heading") == 0) {
+      options->integrator.fast_heading = 1;
+    } else if (strcmp(argv[i], "--no-simd") == 0) {
+      // Reproduces the results of the per-step functions bit for bit
+      simd_set_backend(SIMD_SCALAR);
+    } else if (strcmp(argv[i], "--pipeline") == 0) {
+      options->pipeline = 1;
+    } else if (strcmp(argv[i], "--compact") == 0 && i + 1 < argc) {
+      // "double" is the default storage, not a compact format
+      if (!compact_format_from_name(argv[++i], &options->compact) ||
+          options->compact == COMPACT_NONE) {
+        printf("Error: --compact needs float32, fixed16 or fixed32\n");
+        return 0;
+      }
+    } else if (strcmp(argv[i], "--profile") == 0) {
+      options->profile = 1;
+    } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+      options->profile = 1;
+      options->trace_file = argv[++i];
+    } else {
+      printf("Unknown option: %s\n", argv[i]);
+      printf("Usage: %s [--threads N] [--resolution N] "
+             "[--bounds MIN_X MIN_Y MAX_X MAX_Y] [--levels N|all] "
+             "[--svg-tolerance T] [--raster N] [--report-points N] "
+             "[--no-simd] [--pipeline] [--compact float32|fixed16|fixed32] "
+             "[--profile] [--trace FILE]\n",
+             argv[0]);
+      printf("       %s --update|--follow FILE [--checkpoint FILE] "
+             "[--resolution N] [--bounds MIN_X MIN_Y MAX_X MAX_Y] "
+             "[--levels N|all] [--poll-ms N] [--no-simd] [--profile] "
+             "[--trace FILE]\n",
+             argv[0]);
+      printf("       %s --batch OUTPUT_DIR [--jobs N] [--report] "
+             "[--report-points N] [--threads N] [--resolution N] "
+             "[--levels N|all] [--svg-tolerance T] [--raster N] [--no-simd] "
+             "FILE|DIRECTORY...\n",
+             argv[0]);
+      printf("       %s --query FILE|trajectory.bin [--threads N] "
+             "box MIN_X MIN_Y MAX_X MAX_Y | radius X Y R | "
+             "nearest X Y K [FIRST_STEP]...\n",
+             argv[0]);
+      printf("       %s --rolling FILE [--window N] [--stride N]\n",
+             argv[0]);
+      printf("       %s --fleet [--resolution N] "
+             "[--bounds MIN_X MIN_Y MAX_X MAX_Y] [--levels N|all] "
+             "[--no-simd] FILE|DIRECTORY...\n",
+             argv[0]);
+      printf("       %s --compile [--threads N] FILE...\n", argv[0]);
+      printf("       %s --convert FILE...\n", argv[0]);
+      printf("       %s --database FILE.flightdb "
+             "[window FIRST_STEP LAST_STEP]...\n",
+             argv[0]);
+      printf("Integrator (all modes): [--integrator semi-implicit|euler|rk4|"
+             "adaptive|exact] [--substeps N] [--tolerance T] "
+             "[--fast-heading]\n");
+      return 0;
+    }
   }
+  return 1;
 }
 
-int main() {
+int main(int argc, char *argv[]) {
   // Initialize all options as 0 (off/false)
   int option_state[LEN_CLI_OPTIONS] = {0};
   char spaceship_data_filename[1024];
-  int matrix_resolution;
+  ProgramOptions options = {1, NULL, "analysis.checkpoint", 0, 5, 25, 0,
+                            {0, 0, 0, 0}, 1, SVG_DEFAULT_TOLERANCE, 0,
+                            NULL, NULL, 0, NULL, 0, 0, NULL,
+                            NULL, WINDOW_DEFAULT_SIZE, 0, 0, 0, 0,
+                            REPORT_DEFAULT_MAX_POINTS, 0, COMPACT_NONE, 0,
+                            NULL,
+                            {INTEGRATOR_SEMI_IMPLICIT_EULER, 1,
+                             INTEGRATOR_DEFAULT_TOLERANCE, 0}};
+
+  if (!parse_arguments(argc, argv, &options)) {
+    return 1;
+  }
+  if (options.integrator.fast_heading &&
+      !integrator_is_default(&options.integrator)) {
+    printf("Error: --fast-heading only works with the semi-implicit "
+           "integrator without substeps\n");
+    return 1;
+  }
+  // Shared by all analysis threads, like the SIMD backend
+  integrator_set(&options.integrator);
+  if ((options.input != NULL) + (options.batch_output != NULL) +
+          (options.query_input != NULL) + options.compile + options.convert +
+          (options.database != NULL) + (options.rolling_input != NULL) +
+          options.fleet >
+      1) {
+    printf("Error: Only one of --batch, --update/--follow, --query, "
+           "--compile, --convert, --database, --rolling and --fleet can be "
+           "used\n");
+    return 1;
+  }
+  if (options.rolling_input) {
+    return run_rolling(&options);
+  }
+  if (options.fleet) {
+    return run_fleet(&options);
+  }
+  if (options.query_input) {
+    return run_query(&options);
+  }
+  if (options.compile) {
+    return run_compile(&options);
+  }
+  if (options.convert) {
+    return run_convert(&options);
+  }
+  if (options.database) {
+    return run_database(&options);
+  }
+  if (options.profile && options.batch_output) {
+    // The profiler only measures a single thread
+    printf("Error: --profile can't be combined with --batch\n");
+    return 1;
+  }
+  if (options.input) {
+    if (options.profile && !profiler_enable(options.trace_file)) {
+      return 1;
+    }
+    int exit_code = run_incremental(&options);
+    profiler_report();
+    return exit_code;
+  }
+  int matrix_resolution = options.resolution;
 
-  get_filepath(spaceship_data_filename);
-  cli(option_state);
+  if (options.batch_output) {
+    return run_batch(&options);
+  }
+  if (options.num_batch_inputs > 0) {
+    printf("Error: Input files on the command line need --batch DIR\n");
+    return 1;
+  }
+  if (options.pipeline && (options.num_threads > 1 || options.profile)) {
+    // The pipeline has its own threads and reports its own timings
+    printf("Error: --pipeline can't be combined with --threads or "
+           "--profile\n");
+    return 1;
+  }
+  if (options.compact != COMPACT_NONE &&
+      (options.num_threads > 1 || options.pipeline)) {
+    // The compact trajectory is filled by the serial analysis
+    printf("Error: --compact can't be combined with --threads or "
+           "--pipeline\n");
+    return 1;
+  }
+  if (!get_filepath(spaceship_data_filename)) {
+    return 1;
+  }
+  if (!cli(option_state)) {
+    return 1;
+  }
 
   // Only ask for matrix resolution if needed
   if (option_state[0] || option_state[2]) {
@@ -433,89 +1927,204 @@ int main() {
 
   // const char *spaceship_data_filename = "spaceship_data_angabe.csv";
 
-  FILE *csv = fopen(spaceship_data_filename, "r");
-  FILE *out = fopen("positions.csv", "w");
-  Vec2D positions[100];
-  double temperatures[100];
-
-  double temperature_matrix[matrix_resolution][matrix_resolution];
-
-  double max_speed = 0;
-
-  double max_distance = 0;
-  double total_distance = 0;
-
-  double max_temperature;
-  double min_temperature;
-  int temperature_set = 0;
-
-  double variance = 0;
-  double average = 0;
-
-  fprintf(out, "x,y,rotation\n");
-
-  if (csv != NULL) {
-    Vec2D current_position = {0, 0};
-    Vec2D current_velocity = {0, 0};
-    double current_rotation = 0;
-
-    double temperature_array[100];
-    int num_of_timesteps = 0;
-
-    while (feof(csv) == 0) {
-      positions[num_of_timesteps] = current_position;
-
-      double rotation;
-      double acceleration;
-      double temperature;
-
-      temperatures[num_of_timesteps] = temperature;
+  // Measure from here, the menu would dominate the total time
+  if (options.profile && !profiler_enable(options.trace_file)) {
+    return 1;
+  }
+  // A compiled flight replaces the analysis
+  MappedFile csv;
+  int csv_mapped = 0;
+  int loaded;
+  Trajectory trajectory;
+  trajectory_init(&trajectory);
+
+  FlightState state;
+  flight_state_init(&state);
+
+  if (has_extension(spaceship_data_filename, ".flightdb")) {
+    loaded =
+        open_flight_database(spaceship_data_filename, &state, &trajectory);
+  } else {
+    csv_mapped = loaded = map_file(spaceship_data_filename, &csv);
+    if (!csv_mapped) {
+      printf("Error: Could not read file %s\n", spaceship_data_filename);
+    }
+  }
 
-      fscanf(csv, "%lf,%lf,%lf\n", &acceleration, &rotation, &temperature);
+  // With "--compact" the analysis stores the steps in reduced precision, the
+  // trajectory stays empty until an output needs the whole flight
+  CompactTrajectory compact_trajectory;
+  int compact = csv_mapped && options.compact != COMPACT_NONE;
+  if (compact && !compact_trajectory_init(&compact_trajectory,
+                                          options.compact)) {
+    printf("Error: Not enough memory, storing the trajectory in double "
+           "precision\n");
+    compact = 0;
+  }
 
-      rotate(rotation, current_rotation, &current_rotation);
-      accelerate(current_velocity, acceleration, current_rotation,
-                 &current_velocity);
-      translate(current_velocity, current_position, &current_position,
-                &total_distance);
+  // The pipeline writes the positions and fills the heatmap while it reads
+  int pipelined = csv_mapped && options.pipeline;
+  Heatmap heatmap;
+  int heatmap_built = 0;
+  if (pipelined) {
+    if (options.has_bounds) {
+      heatmap_init(&heatmap, matrix_resolution, options.bounds[0],
+                   options.bounds[1], options.bounds[2], options.bounds[3]);
+    } else {
+      heatmap_init_auto(&heatmap, matrix_resolution);
+    }
+  }
 
-      log_data(current_position, temperature, &temperature_set, &max_distance,
-               &max_temperature, &min_temperature);
+  if (csv_mapped) {
+    size_t malformed_rows = 0;
+    int success;
+    PROFILE_BEGIN(analysis_scope, PROFILE_ANALYSIS);
+    if (pipelined) {
+      Pipeline pipeline;
+      success = pipeline_analyze(&pipeline, &csv, &state, &trajectory,
+                                 option_state[3] ? "positions.csv" : NULL,
+                                 &heatmap, &malformed_rows);
+      heatmap_built = !pipeline.stages[PIPELINE_HEATMAP].failed;
+      pipeline_report(&pipeline);
+    } else if (options.num_threads > 1) {
+      success = analyze_parallel(&csv, options.num_threads, &state,
+                                 &trajectory, &malformed_rows);
+    } else {
+      success = analyze_serial(&csv, &state, &trajectory,
+                               compact ? &compact_trajectory : NULL,
+                               &malformed_rows);
+    }
+    size_t time_steps = compact ? compact_trajectory.length : trajectory.length;
+    PROFILE_END(analysis_scope, time_steps, csv.size, 0);
+    if (!success && compact) {
+      printf("Error: Could not store the time steps as %s after %zu time "
+             "steps (out of memory or not a finite number).\n",
+             compact_format_name(options.compact), time_steps);
+    } else if (!success) {
+      printf("Error: Out of memory after %zu time steps.\n", time_steps);
+    }
+    if (malformed_rows > 0) {
+      printf("Skipped %zu malformed rows.\n\n", malformed_rows);
+    }
+    unmap_file(&csv);
+  }
 
-      fprintf(out, "%.15lf,%.15lf,%.15lf\n", current_position.x,
-              current_position.y, current_rotation);
-      temperature_array[num_of_timesteps] = temperature;
-      num_of_timesteps++;
-      double current_speed = calculate_speed(current_velocity);
-      if (current_speed > max_speed) {
-        max_speed = current_speed;
+  if (loaded) {
+    if (option_state[1]) {
+      print_metrics(&state);
+    }
+    if (compact) {
+      print_compact_stats(&compact_trajectory);
+    }
+    size_t time_steps = compact ? compact_trajectory.length : trajectory.length;
+    // All outputs are generated from the trajectory in memory
+    if (compact) {
+      // The file is meant to be mapped at full precision
+      printf("trajectory.bin is not written with --compact.\n");
+    } else {
+      PROFILE_BEGIN(save_scope, PROFILE_TRAJECTORY_SAVE);
+      if (!trajectory_save(&trajectory, "trajectory.bin")) {
+        printf("Error: Could not write trajectory.bin\n");
+      }
+      PROFILE_END(save_scope, trajectory.length, 0,
+                  64 + trajectory.length * TRAJECTORY_NUM_COLUMNS *
+                           sizeof(double));
+    }
+    if (option_state[3] && !pipelined) {
+      PROFILE_BEGIN(positions_scope, PROFILE_POSITIONS_CSV);
+      FILE *out = fopen("positions.csv", "w");
+      if (out) {
+        fprintf(out, "x,y,rotation\n");
+        if (compact) {
+          compact_trajectory_write_csv(&compact_trajectory, out);
+        } else {
+          trajectory_write_csv(&trajectory, out);
+        }
+        PROFILE_END(positions_scope, time_steps, 0, ftell(out));
+        fclose(out);
+      } else {
+        PROFILE_END(positions_scope, 0, 0, 0);
+        printf("Error: Could not open file positions.csv for writing.\n");
+      }
+    }
+    SvgStats stats;
+    PROFILE_BEGIN(line_scope, PROFILE_SVG_LINE);
+    int svg_saved =
+        compact ? compact_trajectory_save_svg("line.svg", &compact_trajectory,
+                                              state.max_distance,
+                                              options.svg_tolerance, &stats)
+                : save_trajectory_svg("line.svg", &trajectory,
+                                      state.max_distance,
+                                      options.svg_tolerance, &stats);
+    PROFILE_END(line_scope, time_steps, 0, svg_saved ? stats.bytes : 0);
+    print_svg_stats("line.svg", svg_saved, "points", &stats, 1);
+    if (!pipelined) {
+      const double *bounds = options.has_bounds ? options.bounds : NULL;
+      PROFILE_BEGIN(heatmap_scope, PROFILE_HEATMAP);
+      heatmap_built =
+          compact ? compact_trajectory_heatmap(&heatmap, &compact_trajectory,
+                                               matrix_resolution, bounds)
+                  : heatmap_from_trajectory(&heatmap, &trajectory,
+                                            matrix_resolution, bounds);
+      PROFILE_END(heatmap_scope, time_steps, 0, 0);
+    }
+    if (heatmap_built) {
+      save_temperature_map(&heatmap, "", option_state[0],
+                           options.heatmap_levels, 1);
+      if (options.has_bounds) {
+        print_points_outside(&heatmap);
       }
+    } else {
+      printf("Error: Not enough memory for the temperature map.\n");
+    }
+    size_t stored_bytes = compact
+                              ? compact_trajectory_memory_usage(
+                                    &compact_trajectory)
+                              : trajectory_memory_usage(&trajectory);
+    // The images and the report read the compact trajectory block by block
+    TrajectoryBlocks blocks;
+    CompactBlockReader reader;
+    int readable = 1;
+    if (compact) {
+      readable = compact_block_reader_init(&reader, &compact_trajectory);
+      compact_trajectory_blocks(&reader, &blocks);
+      if (!readable && (options.raster_size > 0 || option_state[2])) {
+        printf("Error: Not enough memory to decode the trajectory for the "
+               "images and the report.\n");
+      }
+    } else {
+      trajectory_blocks(&trajectory, &blocks);
+    }
+    if (options.raster_size > 0 && readable) {
+      PROFILE_BEGIN(raster_scope, PROFILE_RASTER);
+      size_t raster_bytes =
+          save_raster_images(options.raster_size, &blocks, state.max_distance,
+                             heatmap_built ? &heatmap : NULL);
+      PROFILE_END(raster_scope, time_steps, 0, raster_bytes);
+      (void)raster_bytes; // Only used while profiling
+    }
+    heatmap_free(&heatmap);
+
+    if (option_state[2] && readable) {
+      generate_latex_report(
+          "report.tex", &blocks, matrix_resolution, options.report_points,
+          options.raster_size > 0, state.total_distance, state.max_distance,
+          state.temperature_stats.max, state.temperature_stats.min,
+          state.temperature_stats.mean,
+          running_stats_variance(&state.temperature_stats), state.max_speed);
+    }
+    if (compact) {
+      compact_block_reader_free(&reader);
+      compact_trajectory_free(&compact_trajectory);
     }
 
-    variance = Variance(temperature_array, num_of_timesteps);
-    average = Average(temperature_array, num_of_timesteps);
-    if (option_state[1]) {
-      printf("Top Speed: %lf\n", max_speed);
-      printf("Max. Temperature: %lf\nMin. Temperature: %lf\n", max_temperature,
-             min_temperature);
-      printf("Temperature avg: %lf\n", average);
-      printf("Temperature variance: %lf\n\n", variance);
-      printf("Max. Euclidean distance to start: %lf\n", max_distance);
-      printf("Total distance: %lf\n", total_distance);
-    }
-    save_svg(positions, max_distance);
-    temperature_map(positions, temperatures, 100, matrix_resolution,
-                    temperature_matrix, option_state[0]);
-    save_temperature_map_svg(*temperature_matrix, matrix_resolution);
-  }
-  fclose(csv);
-  fclose(out);
-
-  if (option_state[2]) {
-    generate_latex_report("report.tex", spaceship_data_filename,
-                          matrix_resolution, total_distance, max_distance,
-                          max_temperature, min_temperature, average, variance,
-                          max_speed);
-  }
-  system("pause");
-}
\ No newline at end of file
+    printf("Memory used: %.2f MiB for %zu time steps (%.2f MiB input "
+           "buffer)\n",
+           (stored_bytes + sizeof(TelemetryChunk)) / (1024.0 * 1024.0),
+           time_steps, sizeof(TelemetryChunk) / (1024.0 * 1024.0));
+  }
+  trajectory_free(&trajectory);
+  profiler_report();
+
+  wait_for_key();
+}
@@ -0,0 +1,104 @@
+// madvise() is not part of strict ISO C builds (-std=c11)
+#define _DEFAULT_SOURCE
+
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @brief Maps a whole file into memory (read only).
+ *
+ * @param filename Path of the file to map.
+ * @param file Receives the address and size of the mapping. Empty files are
+ * represented by a NULL pointer and a size of 0.
+ * @return 1 on success, 0 if the file could not be opened or mapped.
+ */
+int map_file(const char *filename, MappedFile *file) {
+  file->data = NULL;
+  file->size = 0;
+#ifdef _WIN32
+  file->file_handle = NULL;
+  file->mapping_handle = NULL;
+
+  HANDLE handle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (handle == INVALID_HANDLE_VALUE) {
+    return 0;
+  }
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(handle, &size)) {
+    CloseHandle(handle);
+    return 0;
+  }
+  file->file_handle = handle;
+  if (size.QuadPart == 0) {
+    return 1;
+  }
+
+  HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (!mapping) {
+    unmap_file(file);
+    return 0;
+  }
+  file->mapping_handle = mapping;
+  file->data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (!file->data) {
+    unmap_file(file);
+    return 0;
+  }
+  file->size = (size_t)size.QuadPart;
+#else
+  int fd = open(filename, O_RDONLY);
+  if (fd == -1) {
+    return 0;
+  }
+  struct stat info;
+  if (fstat(fd, &info) == -1) {
+    close(fd);
+    return 0;
+  }
+  if (info.st_size > 0) {
+    void *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      close(fd);
+      return 0;
+    }
+    // The file is read front to back exactly once
+    madvise(data, info.st_size, MADV_SEQUENTIAL);
+    file->data = data;
+    file->size = info.st_size;
+  }
+  // The mapping stays valid after closing the descriptor
+  close(fd);
+#endif
+  return 1;
+}
+
+void unmap_file(MappedFile *file) {
+#ifdef _WIN32
+  if (file->data) {
+    UnmapViewOfFile(file->data);
+  }
+  if (file->mapping_handle) {
+    CloseHandle(file->mapping_handle);
+  }
+  if (file->file_handle) {
+    CloseHandle(file->file_handle);
+  }
+  file->file_handle = NULL;
+  file->mapping_handle = NULL;
+#else
+  if (file->data) {
+    munmap((void *)file->data, file->size);
+  }
+#endif
+  file->data = NULL;
+  file->size = 0;
+}
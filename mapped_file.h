@@ -0,0 +1,18 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <stddef.h>
+
+typedef struct MappedFile {
+  const char *data;
+  size_t size;
+#ifdef _WIN32
+  void *file_handle;
+  void *mapping_handle;
+#endif
+} MappedFile;
+
+int map_file(const char *filename, MappedFile *file);
+void unmap_file(MappedFile *file);
+
+#endif // MAPPED_FILE_H
@@ -0,0 +1,197 @@
+#include "output_buffer.h"
+#include "profiler.h"
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Longest number written by output_buffer_int()/output_buffer_fixed() without
+// falling back to snprintf
+#define MAX_NUMBER_LENGTH 48
+
+/**
+ * @brief Opens `filename` for writing.
+ *
+ * @return 1 on success, 0 if the file could not be opened or the buffer could
+ * not be allocated.
+ */
+int output_buffer_open(OutputBuffer *out, const char *filename) {
+  out->data = malloc(OUTPUT_BUFFER_SIZE);
+  out->file = out->data ? fopen(filename, "wb") : NULL;
+  out->sink = NULL;
+  out->sink_context = NULL;
+  out->used = 0;
+  out->bytes_written = 0;
+  out->failed = 0;
+  if (!out->file) {
+    free(out->data);
+    out->data = NULL;
+    return 0;
+  }
+  PROFILE_ALLOCATION(OUTPUT_BUFFER_SIZE);
+  return 1;
+}
+
+/**
+ * @brief Hands output to the sink instead of a file, e.g. to keep it in
+ * memory. The sink is called with blocks of up to OUTPUT_BUFFER_SIZE bytes
+ * (or a single larger write) and is not called again after it failed.
+ *
+ * @return 1 on success, 0 if the buffer could not be allocated.
+ */
+int output_buffer_open_sink(OutputBuffer *out, OutputSink sink,
+                            void *context) {
+  out->data = malloc(OUTPUT_BUFFER_SIZE);
+  out->file = NULL;
+  out->sink = sink;
+  out->sink_context = context;
+  out->used = 0;
+  out->bytes_written = 0;
+  out->failed = 0;
+  if (!out->data) {
+    return 0;
+  }
+  PROFILE_ALLOCATION(OUTPUT_BUFFER_SIZE);
+  return 1;
+}
+
+static void emit(OutputBuffer *out, const char *data, size_t length) {
+  if (length == 0 || out->failed) {
+    return;
+  }
+  if (out->sink) {
+    out->failed = !out->sink(out->sink_context, data, length);
+  } else if (fwrite(data, 1, length, out->file) != length) {
+    out->failed = 1;
+  }
+}
+
+static void flush(OutputBuffer *out) {
+  emit(out, out->data, out->used);
+  out->used = 0;
+}
+
+/**
+ * @brief Makes sure that `length` more bytes fit into the buffer.
+ *
+ * @return 1 if they fit, 0 if the text is larger than the whole buffer.
+ */
+static int reserve(OutputBuffer *out, size_t length) {
+  if (OUTPUT_BUFFER_SIZE - out->used < length) {
+    flush(out);
+  }
+  return length <= OUTPUT_BUFFER_SIZE;
+}
+
+void output_buffer_write(OutputBuffer *out, const char *text, size_t length) {
+  out->bytes_written += length;
+  if (!reserve(out, length)) {
+    emit(out, text, length);
+    return;
+  }
+  memcpy(out->data + out->used, text, length);
+  out->used += length;
+}
+
+void output_buffer_puts(OutputBuffer *out, const char *text) {
+  output_buffer_write(out, text, strlen(text));
+}
+
+/**
+ * @brief Formats with vsnprintf, meant for headers and other rare output.
+ */
+void output_buffer_printf(OutputBuffer *out, const char *format, ...) {
+  char text[1024];
+  va_list arguments;
+  va_start(arguments, format);
+  int length = vsnprintf(text, sizeof(text), format, arguments);
+  va_end(arguments);
+  if (length < 0 || (size_t)length >= sizeof(text)) {
+    out->failed = 1; // Longer than any header this program writes
+    return;
+  }
+  output_buffer_write(out, text, (size_t)length);
+}
+
+/**
+ * @brief Writes the decimal digits of `value`, padded with zeros to at least
+ * `min_digits` digits, right-aligned before `end`.
+ *
+ * @return Pointer to the first digit.
+ */
+static char *format_digits(uint64_t value, int min_digits, char *end) {
+  char *p = end;
+  do {
+    *--p = (char)('0' + value % 10);
+    value /= 10;
+    min_digits--;
+  } while (value > 0 || min_digits > 0);
+  return p;
+}
+
+void output_buffer_int(OutputBuffer *out, long long value) {
+  char text[MAX_NUMBER_LENGTH];
+  char *end = text + sizeof(text);
+  uint64_t magnitude =
+      value < 0 ? (uint64_t)0 - (uint64_t)value : (uint64_t)value;
+  char *begin = format_digits(magnitude, 1, end);
+  if (value < 0) {
+    *--begin = '-';
+  }
+  output_buffer_write(out, begin, (size_t)(end - begin));
+}
+
+/**
+ * @brief Writes `value` with `decimals` digits after the decimal point, like
+ * printf("%.*f"), without going through printf for ordinary numbers.
+ *
+ * The value is rounded after scaling it to an integer, so the last digit can
+ * differ from printf for numbers exactly halfway between two outputs.
+ */
+void output_buffer_fixed(OutputBuffer *out, double value, int decimals) {
+  static const double powers_of_ten[] = {1e0, 1e1, 1e2, 1e3, 1e4,
+                                         1e5, 1e6, 1e7, 1e8, 1e9};
+  int in_range = decimals >= 0 && decimals <= 9;
+  double scaled = in_range ? fabs(value) * powers_of_ten[decimals] : 0.0;
+  if (!in_range || !(scaled < 9e15)) {
+    // Also catches NaN and infinity
+    char text[512];
+    int length = snprintf(text, sizeof(text), "%.*f", decimals, value);
+    output_buffer_write(out, text, length > 0 ? (size_t)length : 0);
+    return;
+  }
+
+  uint64_t digits = (uint64_t)llround(scaled);
+  char text[MAX_NUMBER_LENGTH];
+  char *end = text + sizeof(text);
+  char *begin;
+  if (decimals > 0) {
+    uint64_t divisor = (uint64_t)powers_of_ten[decimals];
+    begin = format_digits(digits % divisor, decimals, end);
+    *--begin = '.';
+    begin = format_digits(digits / divisor, 1, begin);
+  } else {
+    begin = format_digits(digits, 1, end);
+  }
+  if (value < 0 && digits > 0) {
+    *--begin = '-';
+  }
+  output_buffer_write(out, begin, (size_t)(end - begin));
+}
+
+/**
+ * @brief Writes the remaining output and closes the file (a sink is only
+ * handed the remaining output).
+ *
+ * @return 1 if all output was written, 0 otherwise.
+ */
+int output_buffer_close(OutputBuffer *out) {
+  flush(out);
+  int closed = out->file ? fclose(out->file) == 0 : 1;
+  int success = closed && !out->failed;
+  free(out->data);
+  out->data = NULL;
+  out->file = NULL;
+  return success;
+}
@@ -0,0 +1,36 @@
+#ifndef OUTPUT_BUFFER_H
+#define OUTPUT_BUFFER_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+
+// Receives the output of a buffer opened with output_buffer_open_sink() in
+// blocks, returns 0 to report an error
+typedef int (*OutputSink)(void *context, const char *data, size_t length);
+
+// Collects formatted output in a large buffer and hands it to stdio (or a
+// sink) in OUTPUT_BUFFER_SIZE blocks. Errors are sticky and reported by
+// output_buffer_close().
+typedef struct OutputBuffer {
+  FILE *file;
+  OutputSink sink;
+  void *sink_context;
+  char *data;
+  size_t used;
+  size_t bytes_written; // Including the bytes still in the buffer
+  int failed;
+} OutputBuffer;
+
+int output_buffer_open(OutputBuffer *out, const char *filename);
+int output_buffer_open_sink(OutputBuffer *out, OutputSink sink,
+                            void *context);
+void output_buffer_write(OutputBuffer *out, const char *text, size_t length);
+void output_buffer_puts(OutputBuffer *out, const char *text);
+void output_buffer_printf(OutputBuffer *out, const char *format, ...);
+void output_buffer_int(OutputBuffer *out, long long value);
+void output_buffer_fixed(OutputBuffer *out, double value, int decimals);
+int output_buffer_close(OutputBuffer *out);
+
+#endif // OUTPUT_BUFFER_H
@@ -0,0 +1,11 @@
+#ifndef PARALLEL_ANALYSIS_H
+#define PARALLEL_ANALYSIS_H
+
+#include "csv_parser.h"
+#include "flight.h"
+#include "trajectory.h"
+
+int analyze_parallel(const MappedFile *csv, int num_threads, FlightState *state,
+                     Trajectory *trajectory, size_t *malformed_rows);
+
+#endif // PARALLEL_ANALYSIS_H
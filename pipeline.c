@@ -0,0 +1,263 @@
+/**
+ * Pipelined analysis: reading, integrating and the streaming outputs run on
+ * separate threads and overlap.
+ *
+ * The batches are allocated once and circulate through the stages; a stage
+ * pops a batch from its queue, works on it and pushes it to the next stage.
+ * Only the integrator touches the flight state and the trajectory, and the
+ * output stages take the positions from the batch, so no stage shares data
+ * with another one except through the queues. The end of the input is a batch
+ * with a length of 0, which every stage forwards before it exits.
+ */
+
+#include "pipeline.h"
+#include "csv_parser.h"
+#include "telemetry_file.h"
+#include "timing.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static const char *const STAGE_NAMES[PIPELINE_NUM_STAGES] = {
+    "read", "integrate", "positions", "heatmap"};
+
+static int integrate_batch(Pipeline *pipeline, PipelineBatch *batch) {
+  if (!process_chunk(pipeline->state, &batch->chunk, &batch->kinematics,
+                     pipeline->trajectory)) {
+    // Without the time steps the outputs would be incomplete: stop reading
+    atomic_store(&pipeline->failed, 1);
+    return 0;
+  }
+  return 1;
+}
+
+static int write_positions(Pipeline *pipeline, PipelineBatch *batch) {
+  const ChunkKinematics *k = &batch->kinematics;
+  for (size_t i = 0; i < batch->chunk.length; i++) {
+    output_buffer_printf(&pipeline->positions, "%.15lf,%.15lf,%.15lf\n",
+                         k->x[i], k->y[i], k->rotation[i]);
+  }
+  return !pipeline->positions.failed;
+}
+
+static int add_to_heatmap(Pipeline *pipeline, PipelineBatch *batch) {
+  const ChunkKinematics *k = &batch->kinematics;
+  for (size_t i = 0; i < batch->chunk.length; i++) {
+    if (!heatmap_add(pipeline->heatmap, k->x[i], k->y[i],
+                     batch->chunk.temperature[i])) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// Thread of every stage after the reader
+static void *stage_main(void *argument) {
+  PipelineStage *stage = argument;
+  Pipeline *pipeline = stage->pipeline;
+  while (1) {
+    PipelineBatch *batch = spsc_queue_pop(stage->input,
+                                          &stage->starved_seconds);
+    if (batch->chunk.length > 0 && !stage->failed &&
+        !atomic_load(&pipeline->failed)) {
+      double start = monotonic_seconds();
+      stage->failed = !stage->work(pipeline, batch);
+      stage->busy_seconds += monotonic_seconds() - start;
+      stage->batches++;
+    }
+    int end = batch->chunk.length == 0;
+    spsc_queue_push(stage->output, batch, &stage->blocked_seconds);
+    if (end) {
+      return NULL;
+    }
+  }
+}
+
+/**
+ * @brief Connects the active stages in their order, the last one returns the
+ * batches to the reader.
+ */
+static void connect_stages(Pipeline *pipeline) {
+  PipelineStage *previous = NULL;
+  for (int s = 0; s < PIPELINE_NUM_STAGES; s++) {
+    PipelineStage *stage = &pipeline->stages[s];
+    if (!stage->active) {
+      continue;
+    }
+    stage->input = &pipeline->queues[s];
+    if (previous) {
+      previous->output = stage->input;
+    }
+    previous = stage;
+  }
+  previous->output = &pipeline->queues[PIPELINE_READ];
+}
+
+static int create_queues(Pipeline *pipeline) {
+  int success = 1;
+  for (int s = 0; s < PIPELINE_NUM_STAGES; s++) {
+    // The reader's queue holds all batches at the start
+    size_t capacity =
+        s == PIPELINE_READ ? PIPELINE_NUM_BATCHES : PIPELINE_QUEUE_CAPACITY;
+    success = spsc_queue_init(&pipeline->queues[s], capacity) && success;
+  }
+  pipeline->batches = malloc(PIPELINE_NUM_BATCHES * sizeof(PipelineBatch));
+  if (!success || !pipeline->batches) {
+    return 0;
+  }
+  for (int i = 0; i < PIPELINE_NUM_BATCHES; i++) {
+    spsc_queue_try_push(&pipeline->queues[PIPELINE_READ],
+                        &pipeline->batches[i]);
+  }
+  return 1;
+}
+
+/**
+ * @brief Reads the input into batches on the calling thread until the input
+ * ends or a stage failed, then sends the end marker.
+ */
+static void read_input(Pipeline *pipeline, const MappedFile *input,
+                       size_t *malformed_rows) {
+  PipelineStage *stage = &pipeline->stages[PIPELINE_READ];
+  CsvParser parser;
+  csv_parser_init(&parser, input->data, input->size);
+  TelemetryReader reader;
+  int binary = telemetry_open(&reader, input->data, input->size);
+  while (1) {
+    PipelineBatch *batch =
+        spsc_queue_pop(stage->input, &stage->starved_seconds);
+    double start = monotonic_seconds();
+    size_t rows = 0;
+    if (!atomic_load(&pipeline->failed)) {
+      rows = binary ? telemetry_read_chunk(&reader, &batch->chunk)
+                    : csv_read_chunk(&parser, &batch->chunk);
+    }
+    batch->chunk.length = rows;
+    stage->busy_seconds += monotonic_seconds() - start;
+    stage->batches += rows > 0;
+    spsc_queue_push(stage->output, batch, &stage->blocked_seconds);
+    if (rows == 0) {
+      break;
+    }
+  }
+  *malformed_rows = binary ? reader.malformed_rows : parser.malformed_rows;
+}
+
+/**
+ * @brief Analyzes the spaceship data in a pipeline of threads and streams the
+ * positions and the heatmap while the data is read.
+ *
+ * @param pipeline Receives the statistics of the stages; the `failed` flag of
+ * an output stage tells whether its output is complete.
+ * @param input The memory mapped spaceship data file, CSV or telemetry file.
+ * @param state Integrator state and metrics.
+ * @param trajectory Receives every time step.
+ * @param positions_file The positions CSV to write, or NULL.
+ * @param heatmap An initialized heatmap to add every time step to.
+ * @param malformed_rows Receives the number of skipped rows.
+ * @return 1 on success, 0 if the memory ran out or the threads could not be
+ * started.
+ */
+int pipeline_analyze(Pipeline *pipeline, const MappedFile *input,
+                     FlightState *state, Trajectory *trajectory,
+                     const char *positions_file, Heatmap *heatmap,
+                     size_t *malformed_rows) {
+  double start = monotonic_seconds();
+  *pipeline = (Pipeline){0};
+  atomic_init(&pipeline->failed, 0);
+  pipeline->state = state;
+  pipeline->trajectory = trajectory;
+  pipeline->heatmap = heatmap;
+  *malformed_rows = 0;
+
+  int (*const work[PIPELINE_NUM_STAGES])(Pipeline *, PipelineBatch *) = {
+      NULL, integrate_batch, write_positions, add_to_heatmap};
+  for (int s = 0; s < PIPELINE_NUM_STAGES; s++) {
+    pipeline->stages[s].active = s != PIPELINE_POSITIONS || positions_file;
+    pipeline->stages[s].work = work[s];
+    pipeline->stages[s].pipeline = pipeline;
+  }
+  if (positions_file) {
+    if (output_buffer_open(&pipeline->positions, positions_file)) {
+      output_buffer_puts(&pipeline->positions, "x,y,rotation\n");
+    } else {
+      printf("Error: Could not open file %s for writing.\n", positions_file);
+      pipeline->stages[PIPELINE_POSITIONS].failed = 1;
+    }
+  }
+  connect_stages(pipeline);
+
+  int success = create_queues(pipeline);
+  int started = PIPELINE_READ + 1;
+  for (; success && started < PIPELINE_NUM_STAGES; started++) {
+    PipelineStage *stage = &pipeline->stages[started];
+    if (stage->active &&
+        pthread_create(&stage->thread, NULL, stage_main, stage) != 0) {
+      printf("Error: Could not start the %s thread\n", STAGE_NAMES[started]);
+      atomic_store(&pipeline->failed, 1);
+      break;
+    }
+  }
+  if (started == PIPELINE_NUM_STAGES) {
+    read_input(pipeline, input, malformed_rows);
+  } else if (success) {
+    // Shuts down the threads that are already running: the last of them
+    // leaves the end marker in the queue of the stage that didn't start
+    PipelineBatch *batch = &pipeline->batches[0];
+    batch->chunk.length = 0;
+    spsc_queue_push(pipeline->stages[PIPELINE_READ].output, batch,
+                    &pipeline->stages[PIPELINE_READ].blocked_seconds);
+  }
+  for (int s = PIPELINE_READ + 1; s < started; s++) {
+    if (pipeline->stages[s].active) {
+      pthread_join(pipeline->stages[s].thread, NULL);
+    }
+  }
+  success = success && started == PIPELINE_NUM_STAGES &&
+            !pipeline->stages[PIPELINE_INTEGRATE].failed;
+
+  if (pipeline->positions.file &&
+      !output_buffer_close(&pipeline->positions)) {
+    printf("Error: Could not write %s\n", positions_file);
+    pipeline->stages[PIPELINE_POSITIONS].failed = 1;
+  }
+  for (int s = 0; s < PIPELINE_NUM_STAGES; s++) {
+    spsc_queue_free(&pipeline->queues[s]);
+  }
+  free(pipeline->batches);
+  pipeline->batches = NULL;
+  pipeline->seconds = monotonic_seconds() - start;
+  return success;
+}
+
+/**
+ * @brief Prints the time every stage worked and waited, and how full the
+ * queue in front of it was. The stage with the most busy time limits the
+ * throughput of the pipeline.
+ */
+void pipeline_report(const Pipeline *pipeline) {
+  printf("\n--- PIPELINE (%.3f ms in total) ---\n", pipeline->seconds * 1e3);
+  printf("%-10s %7s %11s %11s %11s %9s %9s %11s\n", "stage", "batches",
+         "busy ms", "starved ms", "blocked ms", "avg queue", "max queue",
+         "full pushes");
+  int bottleneck = PIPELINE_READ;
+  for (int s = 0; s < PIPELINE_NUM_STAGES; s++) {
+    const PipelineStage *stage = &pipeline->stages[s];
+    if (!stage->active) {
+      continue;
+    }
+    // The occupancy of the queue in front of the stage, the reader's queue
+    // holds the free batches
+    const SpscQueue *queue = &pipeline->queues[s];
+    printf("%-10s %7llu %11.3f %11.3f %11.3f %9.2f %9zu %11llu\n",
+           STAGE_NAMES[s], (unsigned long long)stage->batches,
+           stage->busy_seconds * 1e3, stage->starved_seconds * 1e3,
+           stage->blocked_seconds * 1e3,
+           queue->pushes > 0 ? (double)queue->occupancy_sum / queue->pushes
+                             : 0.0,
+           queue->max_occupancy, (unsigned long long)queue->full_pushes);
+    if (stage->busy_seconds > pipeline->stages[bottleneck].busy_seconds) {
+      bottleneck = s;
+    }
+  }
+  printf("Bottleneck: %s\n", STAGE_NAMES[bottleneck]);
+}
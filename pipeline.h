@@ -0,0 +1,71 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "flight.h"
+#include "heatmap.h"
+#include "mapped_file.h"
+#include "output_buffer.h"
+#include "spsc_queue.h"
+#include "trajectory.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define PIPELINE_NUM_BATCHES 16  // Batches in flight between all stages
+#define PIPELINE_QUEUE_CAPACITY 4 // Batches waiting in front of a stage
+
+// One chunk of rows on its way through the stages. The integrator fills in
+// the kinematics, the output stages only read them.
+typedef struct PipelineBatch {
+  TelemetryChunk chunk; // A length of 0 marks the end of the input
+  ChunkKinematics kinematics;
+} PipelineBatch;
+
+typedef enum PipelineStageId {
+  PIPELINE_READ,
+  PIPELINE_INTEGRATE,
+  PIPELINE_POSITIONS,
+  PIPELINE_HEATMAP,
+  PIPELINE_NUM_STAGES
+} PipelineStageId;
+
+typedef struct Pipeline Pipeline;
+
+typedef struct PipelineStage {
+  Pipeline *pipeline;
+  int active;
+  int (*work)(Pipeline *pipeline, PipelineBatch *batch);
+  SpscQueue *input;
+  SpscQueue *output;
+  pthread_t thread;
+  int failed;
+  uint64_t batches;
+  double busy_seconds;
+  double starved_seconds; // Waiting for a batch from the previous stage
+  double blocked_seconds; // Waiting for room in the next stage's queue
+} PipelineStage;
+
+// Reader -> integrator -> positions CSV (optional) -> heatmap -> back to the
+// reader. Every stage runs on its own thread (the reader on the calling
+// thread), and the stages hand batches on through SPSC queues. The last queue
+// returns the batches to the reader, so at most PIPELINE_NUM_BATCHES batches
+// are in flight and a slow stage holds back the reader (backpressure).
+struct Pipeline {
+  PipelineStage stages[PIPELINE_NUM_STAGES];
+  SpscQueue queues[PIPELINE_NUM_STAGES]; // queues[i] feeds the i-th stage
+  PipelineBatch *batches;
+  atomic_int failed; // Set by a failing stage, the others skip their work
+  FlightState *state;
+  Trajectory *trajectory;
+  Heatmap *heatmap;
+  OutputBuffer positions;
+  double seconds; // Wall time of the whole run
+};
+
+int pipeline_analyze(Pipeline *pipeline, const MappedFile *input,
+                     FlightState *state, Trajectory *trajectory,
+                     const char *positions_file, Heatmap *heatmap,
+                     size_t *malformed_rows);
+void pipeline_report(const Pipeline *pipeline);
+
+#endif // PIPELINE_H
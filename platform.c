@@ -0,0 +1,297 @@
+#include "platform.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <conio.h>
+#include <direct.h>
+#include <io.h>
+#include <sys/stat.h>
+#include <windows.h>
+// After windows.h
+#include <psapi.h>
+#else
+#include <dirent.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @brief Reads a single key press without waiting for Enter. Enter is
+ * reported as '\r' (13) on all platforms. When the input is not a terminal,
+ * the next input character is returned.
+ */
+int read_key(void) {
+#ifdef _WIN32
+  return getch();
+#else
+  if (!isatty(STDIN_FILENO)) {
+    return getchar();
+  }
+  struct termios original, raw;
+  tcgetattr(STDIN_FILENO, &original);
+  raw = original;
+  raw.c_lflag &= ~(ICANON | ECHO);
+  raw.c_iflag &= ~ICRNL; // Keep Enter as '\r' like getch()
+  tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+  int key = getchar();
+  tcsetattr(STDIN_FILENO, TCSANOW, &original);
+  return key;
+#endif
+}
+
+void clear_screen(void) {
+#ifdef _WIN32
+  system("cls");
+#else
+  if (isatty(STDOUT_FILENO)) {
+    printf("\033[H\033[2J");
+    fflush(stdout);
+  }
+#endif
+}
+
+/**
+ * @brief Waits for a key press before the console window closes. Does
+ * nothing if the input is not a terminal, so that scripts don't block.
+ */
+void wait_for_key(void) {
+#ifdef _WIN32
+  system("pause");
+#else
+  if (isatty(STDIN_FILENO)) {
+    printf("Press any key to continue . . .");
+    fflush(stdout);
+    read_key();
+    printf("\n");
+  }
+#endif
+}
+
+int file_exists(const char *path) {
+#ifdef _WIN32
+  return _access(path, 0) != -1;
+#else
+  return access(path, F_OK) != -1;
+#endif
+}
+
+int is_directory(const char *path) {
+#ifdef _WIN32
+  struct _stat64 info;
+  return _stat64(path, &info) == 0 && (info.st_mode & _S_IFDIR);
+#else
+  struct stat info;
+  return stat(path, &info) == 0 && S_ISDIR(info.st_mode);
+#endif
+}
+
+/**
+ * @brief Creates a directory (not its parents).
+ *
+ * @return 1 if the directory was created or already exists, 0 otherwise.
+ */
+int make_directory(const char *path) {
+#ifdef _WIN32
+  if (_mkdir(path) == 0) {
+    return 1;
+  }
+#else
+  if (mkdir(path, 0777) == 0) {
+    return 1;
+  }
+#endif
+  return is_directory(path);
+}
+
+/**
+ * @brief Writes "directory/name" to the buffer.
+ *
+ * @return 1 on success, 0 if the buffer is too small.
+ */
+int join_path(char *buffer, size_t size, const char *directory,
+              const char *name) {
+  size_t length = strlen(directory);
+  int needs_separator = length > 0 && directory[length - 1] != '/' &&
+                        directory[length - 1] != '\\';
+  int written = snprintf(buffer, size, "%s%s%s", directory,
+                         needs_separator ? "/" : "", name);
+  return written >= 0 && (size_t)written < size;
+}
+
+/**
+ * @brief The file name part of a path ("data/flight.csv" -> "flight.csv").
+ */
+const char *path_basename(const char *path) {
+  const char *name = path;
+  for (const char *c = path; *c; c++) {
+    if (*c == '/' || *c == '\\') {
+      name = c + 1;
+    }
+  }
+  return name;
+}
+
+static int has_extension(const char *name, const char *extension) {
+  size_t name_length = strlen(name);
+  size_t extension_length = strlen(extension);
+  if (name_length < extension_length) {
+    return 0;
+  }
+  const char *suffix = name + name_length - extension_length;
+  for (size_t i = 0; i < extension_length; i++) {
+    if (tolower((unsigned char)suffix[i]) !=
+        tolower((unsigned char)extension[i])) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// Appends a copy of "directory/name" to the list
+static int append_file(char ***files, size_t *num_files, size_t *capacity,
+                       const char *directory, const char *name) {
+  if (*num_files == *capacity) {
+    size_t new_capacity = *capacity ? 2 * *capacity : 64;
+    char **grown = realloc(*files, new_capacity * sizeof(*grown));
+    if (!grown) {
+      return 0;
+    }
+    *files = grown;
+    *capacity = new_capacity;
+  }
+  size_t size = strlen(directory) + strlen(name) + 2;
+  char *path = malloc(size);
+  if (!path) {
+    return 0;
+  }
+  join_path(path, size, directory, name);
+  (*files)[(*num_files)++] = path;
+  return 1;
+}
+
+static int compare_paths(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/**
+ * @brief Lists the regular files of a directory whose name ends with the
+ * extension (case insensitive). Subdirectories are not searched.
+ *
+ * @param path The directory.
+ * @param extension E.g. ".csv", "" for all files.
+ * @param files Receives the paths ("path/name"), sorted by name. Free with
+ * free_file_list().
+ * @param num_files Receives the number of files.
+ * @return 1 on success, 0 if the directory can't be read or the memory ran
+ * out.
+ */
+int list_directory(const char *path, const char *extension, char ***files,
+                   size_t *num_files) {
+  size_t capacity = 0;
+  int success = 1;
+  *files = NULL;
+  *num_files = 0;
+
+#ifdef _WIN32
+  char pattern[4096];
+  if (!join_path(pattern, sizeof(pattern), path, "*")) {
+    return 0;
+  }
+  WIN32_FIND_DATAA entry;
+  HANDLE search = FindFirstFileA(pattern, &entry);
+  if (search == INVALID_HANDLE_VALUE) {
+    return GetLastError() == ERROR_FILE_NOT_FOUND;
+  }
+  do {
+    if (!(entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) &&
+        has_extension(entry.cFileName, extension) &&
+        !append_file(files, num_files, &capacity, path, entry.cFileName)) {
+      success = 0;
+      break;
+    }
+  } while (FindNextFileA(search, &entry));
+  FindClose(search);
+#else
+  DIR *directory = opendir(path);
+  if (!directory) {
+    return 0;
+  }
+  struct dirent *entry;
+  while ((entry = readdir(directory)) != NULL) {
+    if (!has_extension(entry->d_name, extension)) {
+      continue;
+    }
+    if (!append_file(files, num_files, &capacity, path, entry->d_name)) {
+      success = 0;
+      break;
+    }
+    // d_type is not reliable on every file system, so ask stat()
+    struct stat info;
+    if (stat((*files)[*num_files - 1], &info) != 0 ||
+        !S_ISREG(info.st_mode)) {
+      free((*files)[--*num_files]);
+    }
+  }
+  closedir(directory);
+#endif
+
+  if (!success) {
+    free_file_list(*files, *num_files);
+    *files = NULL;
+    *num_files = 0;
+    return 0;
+  }
+  qsort(*files, *num_files, sizeof(**files), compare_paths);
+  return 1;
+}
+
+void free_file_list(char **files, size_t num_files) {
+  for (size_t i = 0; i < num_files; i++) {
+    free(files[i]);
+  }
+  free(files);
+}
+
+/**
+ * @brief Number of logical processors, at least 1.
+ */
+int cpu_count(void) {
+#ifdef _WIN32
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#else
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count > 0 ? (int)count : 1;
+#endif
+}
+
+/**
+ * @brief Largest amount of physical memory (resident set size) the process
+ * has used so far, in bytes. 0 if unknown.
+ */
+size_t peak_memory_usage(void) {
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS counters;
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &counters,
+                           sizeof(counters))) {
+    return counters.PeakWorkingSetSize;
+  }
+  return 0;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+#ifdef __APPLE__
+  return (size_t)usage.ru_maxrss; // Bytes
+#else
+  return (size_t)usage.ru_maxrss * 1024; // KiB
+#endif
+#endif
+}
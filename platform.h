@@ -0,0 +1,25 @@
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#include <stddef.h>
+
+// Console
+int read_key(void);
+void clear_screen(void);
+void wait_for_key(void);
+
+// File system
+int file_exists(const char *path);
+int is_directory(const char *path);
+int make_directory(const char *path);
+int list_directory(const char *path, const char *extension, char ***files,
+                   size_t *num_files);
+void free_file_list(char **files, size_t num_files);
+int join_path(char *buffer, size_t size, const char *directory,
+              const char *name);
+const char *path_basename(const char *path);
+
+int cpu_count(void);
+size_t peak_memory_usage(void);
+
+#endif // PLATFORM_H
@@ -0,0 +1,216 @@
+#include "profiler.h"
+#include "timing.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#if PROFILING
+
+#define MAX_DEPTH 16               // Nested scopes
+#define MAX_TRACE_EVENTS (1 << 20) // About 40 MiB, later events are dropped
+
+static const char *STAGE_NAMES[PROFILE_NUM_STAGES] = {
+    "analysis", "parse", "integrate", "stats", "store", "trajectory.bin",
+    "positions.csv", "line.svg", "heatmap", "heatmap svg", "png images",
+    "report.tex", "checkpoint"};
+
+// Stages that run inside PROFILE_ANALYSIS are indented in the report
+static const int STAGE_DEPTH[PROFILE_NUM_STAGES] = {0, 1, 1, 1, 1, 0, 0,
+                                                    0, 0, 0, 0, 0, 0};
+
+typedef struct StageTotals {
+  uint64_t calls;
+  double seconds;
+  uint64_t rows;
+  uint64_t bytes_in;
+  uint64_t bytes_out;
+  uint64_t allocations;
+  uint64_t allocated_bytes;
+} StageTotals;
+
+// One finished scope for the Chrome trace
+typedef struct TraceEvent {
+  ProfileStage stage;
+  double start;
+  double duration;
+  uint64_t rows;
+  uint64_t bytes; // In plus out
+} TraceEvent;
+
+int profiling_enabled = 0;
+
+static double profile_start;
+static StageTotals totals[PROFILE_NUM_STAGES];
+static ProfileStage open_stages[MAX_DEPTH];
+static int depth = 0;
+static uint64_t other_allocations = 0; // Outside of any scope
+static uint64_t other_allocated_bytes = 0;
+static const char *trace_file = NULL;
+static TraceEvent *events = NULL;
+static size_t num_events = 0;
+static size_t dropped_events = 0;
+
+/**
+ * @brief Starts collecting timings. Only the thread that runs the pipeline
+ * may use the profiler, the worker threads of the parallel analysis are
+ * measured as part of the enclosing scope.
+ *
+ * @param trace_filename Chrome trace JSON written by profiler_report(), or
+ * NULL.
+ * @return 1 on success, 0 if the trace buffer could not be allocated.
+ */
+int profiler_enable(const char *trace_filename) {
+  if (trace_filename) {
+    events = malloc(MAX_TRACE_EVENTS * sizeof(*events));
+    if (!events) {
+      return 0;
+    }
+    trace_file = trace_filename;
+  }
+  profile_start = monotonic_seconds();
+  profiling_enabled = 1;
+  return 1;
+}
+
+void profile_begin(ProfileScope *scope, ProfileStage stage) {
+  scope->stage = stage;
+  if (depth < MAX_DEPTH) {
+    open_stages[depth] = stage;
+  }
+  depth++;
+  scope->start = monotonic_seconds();
+}
+
+/**
+ * @brief Ends a scope started with profile_begin() and adds its duration and
+ * counters to the totals of its stage.
+ *
+ * @param rows Number of time steps processed in the scope.
+ * @param bytes_in Bytes read, e.g. consumed CSV input.
+ * @param bytes_out Bytes written, e.g. the size of an output file.
+ */
+void profile_end(ProfileScope *scope, uint64_t rows, uint64_t bytes_in,
+                 uint64_t bytes_out) {
+  double end = monotonic_seconds();
+  StageTotals *stage = &totals[scope->stage];
+  stage->calls++;
+  stage->seconds += end - scope->start;
+  stage->rows += rows;
+  stage->bytes_in += bytes_in;
+  stage->bytes_out += bytes_out;
+  if (depth > 0) {
+    depth--;
+  }
+
+  if (events) {
+    if (num_events < MAX_TRACE_EVENTS) {
+      TraceEvent *event = &events[num_events++];
+      event->stage = scope->stage;
+      event->start = scope->start - profile_start;
+      event->duration = end - scope->start;
+      event->rows = rows;
+      event->bytes = bytes_in + bytes_out;
+    } else {
+      dropped_events++;
+    }
+  }
+}
+
+/**
+ * @brief Counts a heap allocation for the innermost open scope.
+ */
+void profile_allocation(size_t bytes) {
+  if (depth > 0 && depth <= MAX_DEPTH) {
+    StageTotals *stage = &totals[open_stages[depth - 1]];
+    stage->allocations++;
+    stage->allocated_bytes += bytes;
+  } else {
+    other_allocations++;
+    other_allocated_bytes += bytes;
+  }
+}
+
+/**
+ * @brief Writes the finished scopes as "complete" events of the Chrome trace
+ * event format, which chrome://tracing and Perfetto can display.
+ */
+static int write_trace(const char *filename) {
+  FILE *file = fopen(filename, "w");
+  if (!file) {
+    return 0;
+  }
+  fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+  for (size_t i = 0; i < num_events; i++) {
+    const TraceEvent *event = &events[i];
+    fprintf(file,
+            "{\"name\": \"%s\", \"cat\": \"pipeline\", \"ph\": \"X\", "
+            "\"pid\": 1, \"tid\": 1, \"ts\": %.3f, \"dur\": %.3f, "
+            "\"args\": {\"rows\": %llu, \"bytes\": %llu}}%s\n",
+            STAGE_NAMES[event->stage], event->start * 1e6,
+            event->duration * 1e6, (unsigned long long)event->rows,
+            (unsigned long long)event->bytes,
+            i + 1 < num_events ? "," : "");
+  }
+  fprintf(file, "]}\n");
+  return fclose(file) == 0;
+}
+
+/**
+ * @brief Prints the time, rows, bytes and allocations of every stage that
+ * ran, and writes the trace file if one was requested.
+ */
+void profiler_report(void) {
+  if (!profiling_enabled) {
+    return;
+  }
+  double total = monotonic_seconds() - profile_start;
+  printf("\n--- PROFILE (%.3f ms in total) ---\n", total * 1e3);
+  printf("%-18s %7s %11s %6s %11s %11s %11s %7s %11s\n", "stage", "calls",
+         "ms", "%", "rows", "MiB in", "MiB out", "allocs", "MiB alloc");
+  for (int s = 0; s < PROFILE_NUM_STAGES; s++) {
+    const StageTotals *stage = &totals[s];
+    if (stage->calls == 0) {
+      continue;
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "%*s%s", 2 * STAGE_DEPTH[s], "",
+             STAGE_NAMES[s]);
+    printf("%-18s %7llu %11.3f %6.1f %11llu %11.2f %11.2f %7llu %11.2f\n",
+           name, (unsigned long long)stage->calls, stage->seconds * 1e3,
+           total > 0 ? 100.0 * stage->seconds / total : 0.0,
+           (unsigned long long)stage->rows, stage->bytes_in / 1048576.0,
+           stage->bytes_out / 1048576.0,
+           (unsigned long long)stage->allocations,
+           stage->allocated_bytes / 1048576.0);
+  }
+  if (other_allocations > 0) {
+    printf("%-18s %7s %11s %6s %11s %11s %11s %7llu %11.2f\n", "(other)", "",
+           "", "", "", "", "", (unsigned long long)other_allocations,
+           other_allocated_bytes / 1048576.0);
+  }
+
+  if (trace_file) {
+    if (write_trace(trace_file)) {
+      printf("Trace with %zu events saved as %s", num_events, trace_file);
+      if (dropped_events > 0) {
+        printf(" (%zu events dropped)", dropped_events);
+      }
+      printf("\n");
+    } else {
+      printf("Error: Could not write %s\n", trace_file);
+    }
+    free(events);
+    events = NULL;
+  }
+}
+
+#else
+
+int profiler_enable(const char *trace_filename) {
+  (void)trace_filename;
+  printf("Error: Profiling was disabled at compile time (PROFILING=0)\n");
+  return 0;
+}
+
+void profiler_report(void) {}
+
+#endif
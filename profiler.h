@@ -0,0 +1,69 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Compile with -DPROFILING=0 to remove all instrumentation
+#ifndef PROFILING
+#define PROFILING 1
+#endif
+
+typedef enum ProfileStage {
+  PROFILE_ANALYSIS,
+  PROFILE_PARSE, // Per chunk, inside PROFILE_ANALYSIS
+  PROFILE_INTEGRATE,
+  PROFILE_STATS,
+  PROFILE_STORE,
+  PROFILE_TRAJECTORY_SAVE,
+  PROFILE_POSITIONS_CSV,
+  PROFILE_SVG_LINE,
+  PROFILE_HEATMAP,
+  PROFILE_SVG_HEATMAP,
+  PROFILE_RASTER, // line.png and temperature_map.png, on all threads
+  PROFILE_REPORT,
+  PROFILE_CHECKPOINT,
+  PROFILE_NUM_STAGES
+} ProfileStage;
+
+// A running measurement, see PROFILE_BEGIN()
+typedef struct ProfileScope {
+  ProfileStage stage;
+  double start;
+} ProfileScope;
+
+int profiler_enable(const char *trace_filename);
+void profiler_report(void);
+
+#if PROFILING
+extern int profiling_enabled;
+
+void profile_begin(ProfileScope *scope, ProfileStage stage);
+void profile_end(ProfileScope *scope, uint64_t rows, uint64_t bytes_in,
+                 uint64_t bytes_out);
+void profile_allocation(size_t bytes);
+
+// Scoped timers: PROFILE_BEGIN(scope, stage) ... PROFILE_END(scope, ...) in
+// the same block. Unless --profile is given they cost one branch each, the
+// arguments of PROFILE_END() are only evaluated while profiling.
+#define PROFILE_BEGIN(scope, stage)                                           \
+  ProfileScope scope;                                                         \
+  if (profiling_enabled)                                                      \
+  profile_begin(&scope, stage)
+#define PROFILE_END(scope, rows, bytes_in, bytes_out)                         \
+  do {                                                                        \
+    if (profiling_enabled)                                                    \
+      profile_end(&scope, rows, bytes_in, bytes_out);                         \
+  } while (0)
+#define PROFILE_ALLOCATION(bytes)                                             \
+  do {                                                                        \
+    if (profiling_enabled)                                                    \
+      profile_allocation(bytes);                                              \
+  } while (0)
+#else
+#define PROFILE_BEGIN(scope, stage) ((void)0)
+#define PROFILE_END(scope, rows, bytes_in, bytes_out) ((void)0)
+#define PROFILE_ALLOCATION(bytes) ((void)0)
+#endif
+
+#endif // PROFILER_H
@@ -0,0 +1,543 @@
+/**
+ * Raster images of the trajectory and the temperature map.
+ *
+ * The image is split into RASTER_TILE_SIZE x RASTER_TILE_SIZE tiles, which are
+ * rendered independently on a thread pool: every tile has its own coverage
+ * buffer and writes only its own pixels, so the result doesn't depend on the
+ * number of threads. The path is drawn as anti-aliased segments of constant
+ * width, the coverage of a pixel falls off linearly over one pixel at the
+ * edge of the stroke, and overlapping segments keep the highest coverage so
+ * that joints aren't drawn darker.
+ *
+ * With binning, the segments are first sorted into lists per tile by their
+ * bounding boxes, so a tile only visits the segments that may cross it.
+ * Without it, every tile tests every segment.
+ *
+ * A trajectory that is read in several blocks is drawn block by block into
+ * the coverage of the whole image, which is turned into colors at the end.
+ * Since overlapping segments keep the highest coverage, the order doesn't
+ * change the result.
+ */
+
+#include "raster.h"
+#include "svg_writer.h"
+#include "timing.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Colors of line.svg: orange stroke, white page
+static const unsigned char LINE_COLOR[3] = {255, 165, 0};
+static const unsigned char BACKGROUND_COLOR[3] = {255, 255, 255};
+
+typedef struct TrajectoryJob {
+  RgbImage *image;
+  const Trajectory *trajectory;
+  double start_x; // Path point before the first step of the trajectory
+  double start_y;
+  float *coverage; // Of the whole image, NULL for one buffer per tile
+  double offset;
+  double scale; // Pixels per path unit
+  double half_width;
+  int tiles_x;
+  int tiles_y;
+  // Segments of tile t: segments[bin_start[t]] to segments[bin_start[t + 1]],
+  // NULL without binning
+  const size_t *bin_start;
+  const size_t *segments;
+  size_t *tile_elements; // Per tile
+} TrajectoryJob;
+
+static void run_tiles(ThreadPool *pool, size_t num_tiles, TaskFunction function,
+                      void *context) {
+  if (pool) {
+    thread_pool_run(pool, num_tiles, function, context);
+    return;
+  }
+  for (size_t i = 0; i < num_tiles; i++) {
+    function(context, i);
+  }
+}
+
+// Pixel coordinates of point i of the path, which starts at the start point
+// (the origin for a whole trajectory). The y-axis points down, like in
+// line.svg.
+static void path_point(const TrajectoryJob *job, size_t i, double *x,
+                       double *y) {
+  double path_x = i > 0 ? job->trajectory->x[i - 1] : job->start_x;
+  double path_y = i > 0 ? job->trajectory->y[i - 1] : job->start_y;
+  *x = (path_x + job->offset) * job->scale;
+  *y = (job->offset - path_y) * job->scale;
+}
+
+/**
+ * @brief The tiles touched by the bounding box of segment k (from point k to
+ * k + 1) including the stroke width.
+ *
+ * @param range Receives the first and last tile in x and y direction.
+ * @return 0 if the segment is outside the image.
+ */
+static int segment_tiles(const TrajectoryJob *job, size_t k, int range[4]) {
+  double ax, ay, bx, by;
+  path_point(job, k, &ax, &ay);
+  path_point(job, k + 1, &bx, &by);
+  double margin = job->half_width + 2; // Covers the pixels of draw_segment()
+  double min_x = fmin(ax, bx) - margin, max_x = fmax(ax, bx) + margin;
+  double min_y = fmin(ay, by) - margin, max_y = fmax(ay, by) + margin;
+  if (!(max_x >= 0 && max_y >= 0 && min_x < job->image->width &&
+        min_y < job->image->height)) {
+    return 0;
+  }
+  range[0] = min_x > 0 ? (int)(min_x / RASTER_TILE_SIZE) : 0;
+  range[1] = (int)fmin(max_x / RASTER_TILE_SIZE, job->tiles_x - 1);
+  range[2] = min_y > 0 ? (int)(min_y / RASTER_TILE_SIZE) : 0;
+  range[3] = (int)fmin(max_y / RASTER_TILE_SIZE, job->tiles_y - 1);
+  return 1;
+}
+
+/**
+ * @brief Sorts the segments into per tile lists: counts them per tile, turns
+ * the counts into list offsets and fills in the lists.
+ *
+ * @return 1 on success, 0 if the memory ran out.
+ */
+static int sort_into_tiles(TrajectoryJob *job, size_t num_segments,
+                           size_t **bin_start, size_t **segments) {
+  size_t num_tiles = (size_t)job->tiles_x * job->tiles_y;
+  size_t *start = calloc(num_tiles + 1, sizeof(*start));
+  size_t *next = malloc(num_tiles * sizeof(*next));
+  if (!start || !next) {
+    free(start);
+    free(next);
+    return 0;
+  }
+  int range[4];
+  for (size_t k = 0; k < num_segments; k++) {
+    if (segment_tiles(job, k, range)) {
+      for (int ty = range[2]; ty <= range[3]; ty++) {
+        for (int tx = range[0]; tx <= range[1]; tx++) {
+          start[(size_t)ty * job->tiles_x + tx + 1]++;
+        }
+      }
+    }
+  }
+  for (size_t t = 0; t < num_tiles; t++) {
+    start[t + 1] += start[t];
+    next[t] = start[t];
+  }
+  size_t *lists = malloc((start[num_tiles] + 1) * sizeof(*lists));
+  if (!lists) {
+    free(start);
+    free(next);
+    return 0;
+  }
+  for (size_t k = 0; k < num_segments; k++) {
+    if (segment_tiles(job, k, range)) {
+      for (int ty = range[2]; ty <= range[3]; ty++) {
+        for (int tx = range[0]; tx <= range[1]; tx++) {
+          lists[next[(size_t)ty * job->tiles_x + tx]++] = k;
+        }
+      }
+    }
+  }
+  free(next);
+  *bin_start = start;
+  *segments = lists;
+  return 1;
+}
+
+/**
+ * @brief Adds the coverage of segment k to the pixels of a tile.
+ *
+ * @param coverage Coverage of the tile's first pixel.
+ * @param stride Distance of the coverage rows.
+ * @return 1 if the segment's bounding box overlaps the tile.
+ */
+static int draw_segment(const TrajectoryJob *job, size_t k, int x0, int y0,
+                        int width, int height, float *coverage,
+                        size_t stride) {
+  double ax, ay, bx, by;
+  path_point(job, k, &ax, &ay);
+  path_point(job, k + 1, &bx, &by);
+  double reach = job->half_width + 0.5; // Coverage ends here
+  double first_x = fmax(floor(fmin(ax, bx) - reach), x0);
+  double last_x = fmin(ceil(fmax(ax, bx) + reach), x0 + width - 1);
+  double first_y = fmax(floor(fmin(ay, by) - reach), y0);
+  double last_y = fmin(ceil(fmax(ay, by) + reach), y0 + height - 1);
+  if (!(first_x <= last_x && first_y <= last_y)) {
+    return 0;
+  }
+  double dx = bx - ax, dy = by - ay;
+  double length2 = dx * dx + dy * dy;
+  for (int y = (int)first_y; y <= (int)last_y; y++) {
+    double py = y + 0.5 - ay;
+    for (int x = (int)first_x; x <= (int)last_x; x++) {
+      double px = x + 0.5 - ax;
+      // Distance of the pixel center from the segment
+      double t = length2 > 0 ? (px * dx + py * dy) / length2 : 0;
+      t = t < 0 ? 0 : (t > 1 ? 1 : t);
+      double ex = px - t * dx, ey = py - t * dy;
+      double distance2 = ex * ex + ey * ey;
+      if (distance2 >= reach * reach) {
+        continue;
+      }
+      float value = (float)fmin(reach - sqrt(distance2), 1.0);
+      float *pixel = &coverage[(size_t)(y - y0) * stride + (x - x0)];
+      if (value > *pixel) {
+        *pixel = value;
+      }
+    }
+  }
+  return 1;
+}
+
+// Position and size of a tile in pixels
+static void tile_area(const TrajectoryJob *job, size_t tile, int *x0, int *y0,
+                      int *width, int *height) {
+  const RgbImage *image = job->image;
+  *x0 = (int)(tile % job->tiles_x) * RASTER_TILE_SIZE;
+  *y0 = (int)(tile / job->tiles_x) * RASTER_TILE_SIZE;
+  *width = image->width - *x0 < RASTER_TILE_SIZE ? image->width - *x0
+                                                 : RASTER_TILE_SIZE;
+  *height = image->height - *y0 < RASTER_TILE_SIZE ? image->height - *y0
+                                                   : RASTER_TILE_SIZE;
+}
+
+// Blends the line color over the background by the coverage of a tile
+static void color_tile(RgbImage *image, int x0, int y0, int width, int height,
+                       const float *coverage, size_t stride) {
+  for (int y = 0; y < height; y++) {
+    unsigned char *row =
+        image->pixels + ((size_t)(y0 + y) * image->width + x0) * 3;
+    for (int x = 0; x < width; x++) {
+      float alpha = coverage[(size_t)y * stride + x];
+      for (int c = 0; c < 3; c++) {
+        row[3 * x + c] = (unsigned char)(BACKGROUND_COLOR[c] * (1 - alpha) +
+                                         LINE_COLOR[c] * alpha + 0.5f);
+      }
+    }
+  }
+}
+
+static void render_trajectory_tile(void *context, size_t tile) {
+  const TrajectoryJob *job = context;
+  int x0, y0, width, height;
+  tile_area(job, tile, &x0, &y0, &width, &height);
+  float tile_coverage[RASTER_TILE_SIZE * RASTER_TILE_SIZE] = {0};
+  float *coverage = tile_coverage;
+  size_t stride = RASTER_TILE_SIZE;
+  if (job->coverage) {
+    stride = (size_t)job->image->width;
+    coverage = job->coverage + (size_t)y0 * stride + x0;
+  }
+
+  size_t drawn = 0;
+  if (job->bin_start) {
+    for (size_t i = job->bin_start[tile]; i < job->bin_start[tile + 1]; i++) {
+      drawn += draw_segment(job, job->segments[i], x0, y0, width, height,
+                            coverage, stride);
+    }
+  } else {
+    for (size_t k = 0; k < job->trajectory->length; k++) {
+      drawn += draw_segment(job, k, x0, y0, width, height, coverage, stride);
+    }
+  }
+  job->tile_elements[tile] += drawn;
+
+  // The coverage of the whole image is colored after the last block
+  if (!job->coverage) {
+    color_tile(job->image, x0, y0, width, height, coverage, stride);
+  }
+}
+
+static void color_coverage_tile(void *context, size_t tile) {
+  const TrajectoryJob *job = context;
+  int x0, y0, width, height;
+  tile_area(job, tile, &x0, &y0, &width, &height);
+  size_t stride = (size_t)job->image->width;
+  color_tile(job->image, x0, y0, width, height,
+             job->coverage + (size_t)y0 * stride + x0, stride);
+}
+
+/**
+ * @brief Sets up drawing into a new square image, framed like line.svg.
+ *
+ * @return 1 on success, 0 if the memory ran out.
+ */
+static int init_trajectory_job(TrajectoryJob *job, RgbImage *image, int size,
+                               double offset) {
+  if (!rgb_image_init(image, size, size)) {
+    return 0;
+  }
+  job->image = image;
+  job->trajectory = NULL;
+  job->start_x = 0;
+  job->start_y = 0;
+  job->coverage = NULL;
+  job->offset = offset > 0 ? offset : 1;
+  job->scale = size / (2 * job->offset);
+  job->half_width =
+      fmax(RASTER_LINE_WIDTH * job->scale, RASTER_MIN_LINE_WIDTH) / 2;
+  job->tiles_x = (size + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+  job->tiles_y = job->tiles_x;
+  job->bin_start = NULL;
+  job->segments = NULL;
+  size_t num_tiles = (size_t)job->tiles_x * job->tiles_y;
+  job->tile_elements = calloc(num_tiles, sizeof(size_t));
+  if (!job->tile_elements) {
+    rgb_image_free(image);
+    return 0;
+  }
+  return 1;
+}
+
+/**
+ * @brief Draws the segments of job->trajectory, after sorting them into tiles
+ * if `bin_segments` is set.
+ *
+ * @return 1 on success, 0 if the memory ran out.
+ */
+static int draw_trajectory(TrajectoryJob *job, int bin_segments,
+                           ThreadPool *pool) {
+  size_t *bin_start = NULL, *segments = NULL;
+  if (bin_segments && !sort_into_tiles(job, job->trajectory->length,
+                                       &bin_start, &segments)) {
+    return 0;
+  }
+  job->bin_start = bin_start;
+  job->segments = segments;
+  run_tiles(pool, (size_t)job->tiles_x * job->tiles_y, render_trajectory_tile,
+            job);
+  job->bin_start = NULL;
+  job->segments = NULL;
+  free(bin_start);
+  free(segments);
+  return 1;
+}
+
+// Sums up the segments drawn per tile
+static size_t sum_tile_elements(const TrajectoryJob *job) {
+  size_t sum = 0;
+  for (size_t t = 0; t < (size_t)job->tiles_x * job->tiles_y; t++) {
+    sum += job->tile_elements[t];
+  }
+  return sum;
+}
+
+/**
+ * @brief Draws the flight path into a square image, framed like line.svg.
+ *
+ * @param image Receives the image, free it with rgb_image_free().
+ * @param size Width and height in pixels.
+ * @param trajectory The position after each time step (the path starts at the
+ * origin).
+ * @param offset Half the width of the drawn area in path units, centered on
+ * the origin.
+ * @param bin_segments Sort the segments into tiles first, instead of testing
+ * every segment in every tile.
+ * @param pool Threads for the tiles, NULL for the calling thread.
+ * @param stats Receives the size, number of segments and render time.
+ * @return 1 on success, 0 if the memory ran out.
+ */
+int render_trajectory(RgbImage *image, int size, const Trajectory *trajectory,
+                      double offset, int bin_segments, ThreadPool *pool,
+                      RasterStats *stats) {
+  double start = monotonic_seconds();
+  TrajectoryJob job;
+  if (!init_trajectory_job(&job, image, size, offset)) {
+    return 0;
+  }
+  job.trajectory = trajectory;
+  if (!draw_trajectory(&job, bin_segments, pool)) {
+    free(job.tile_elements);
+    rgb_image_free(image);
+    return 0;
+  }
+
+  stats->width = size;
+  stats->height = size;
+  stats->elements = trajectory->length;
+  stats->tile_elements = sum_tile_elements(&job);
+  free(job.tile_elements);
+  stats->render_seconds = monotonic_seconds() - start;
+  return 1;
+}
+
+/**
+ * @brief Draws the flight path of a trajectory that is read block by block,
+ * with binning, see render_trajectory(). The coverage of the whole image is
+ * kept between the blocks, a single block is drawn directly.
+ *
+ * @return 1 on success, 0 if the memory ran out.
+ */
+int render_trajectory_blocks(RgbImage *image, int size,
+                             const TrajectoryBlocks *blocks, double offset,
+                             ThreadPool *pool, RasterStats *stats) {
+  size_t num_blocks = trajectory_blocks_count(blocks);
+  if (num_blocks <= 1) {
+    Trajectory empty;
+    trajectory_init(&empty);
+    const Trajectory *trajectory =
+        num_blocks > 0 ? trajectory_blocks_read(blocks, 0) : &empty;
+    return render_trajectory(image, size, trajectory, offset, 1, pool, stats);
+  }
+
+  double start = monotonic_seconds();
+  TrajectoryJob job;
+  if (!init_trajectory_job(&job, image, size, offset)) {
+    return 0;
+  }
+  job.coverage = calloc((size_t)size * size, sizeof(float));
+  int success = job.coverage != NULL;
+  for (size_t b = 0; success && b < num_blocks; b++) {
+    job.trajectory = trajectory_blocks_read(blocks, b);
+    success = draw_trajectory(&job, 1, pool);
+    // The next block continues from the last point
+    job.start_x = job.trajectory->x[job.trajectory->length - 1];
+    job.start_y = job.trajectory->y[job.trajectory->length - 1];
+  }
+  if (success) {
+    run_tiles(pool, (size_t)job.tiles_x * job.tiles_y, color_coverage_tile,
+              &job);
+    stats->width = size;
+    stats->height = size;
+    stats->elements = blocks->length;
+    stats->tile_elements = sum_tile_elements(&job);
+    stats->render_seconds = monotonic_seconds() - start;
+  } else {
+    rgb_image_free(image);
+  }
+  free(job.coverage);
+  free(job.tile_elements);
+  return success;
+}
+
+typedef struct HeatmapJob {
+  RgbImage *image;
+  const unsigned char *colors; // Per cell, rows from the top
+  int resolution;
+  int cell_pixels;
+  int tiles_x;
+} HeatmapJob;
+
+static void render_heatmap_tile(void *context, size_t tile) {
+  const HeatmapJob *job = context;
+  RgbImage *image = job->image;
+  int x0 = (int)(tile % job->tiles_x) * RASTER_TILE_SIZE;
+  int y0 = (int)(tile / job->tiles_x) * RASTER_TILE_SIZE;
+  for (int y = y0; y < y0 + RASTER_TILE_SIZE && y < image->height; y++) {
+    const unsigned char *cells =
+        job->colors + (size_t)(y / job->cell_pixels) * job->resolution * 3;
+    unsigned char *row = image->pixels + (size_t)y * image->width * 3;
+    for (int x = x0; x < x0 + RASTER_TILE_SIZE && x < image->width; x++) {
+      memcpy(row + 3 * x, cells + 3 * (x / job->cell_pixels), 3);
+    }
+  }
+}
+
+/**
+ * @brief Draws the temperature map with the colors of temperature_map.svg and
+ * north up. The finest zoom level with at most `size` cells per side is drawn
+ * with square cells of a whole number of pixels, so the image can be a bit
+ * smaller than `size`.
+ *
+ * @param image Receives the image, free it with rgb_image_free().
+ * @param pool Threads for the tiles, NULL for the calling thread.
+ * @param stats Receives the size, number of cells and render time.
+ * @return 1 on success, 0 if the memory ran out.
+ */
+int render_temperature_map(RgbImage *image, int size, const Heatmap *heatmap,
+                           ThreadPool *pool, RasterStats *stats) {
+  double start = monotonic_seconds();
+  HeatmapPyramid pyramid;
+  if (!heatmap_build_pyramid(heatmap, 0, &pyramid)) {
+    return 0;
+  }
+  int l = 0;
+  while (l + 1 < pyramid.num_levels && pyramid.levels[l].resolution > size) {
+    l++;
+  }
+  const HeatmapLevel *level = &pyramid.levels[l];
+  int resolution = level->resolution;
+  int cell_pixels = size / resolution > 0 ? size / resolution : 1;
+  unsigned char *colors = calloc((size_t)resolution * resolution, 3);
+  if (!colors || !rgb_image_init(image, resolution * cell_pixels,
+                                 resolution * cell_pixels)) {
+    free(colors);
+    heatmap_pyramid_free(&pyramid);
+    return 0;
+  }
+
+  double min_temp, max_temp;
+  temperature_range(level, &min_temp, &max_temp);
+  for (size_t i = 0; i < level->num_cells; i++) {
+    const HeatmapCell *cell = &level->cells[i];
+    if (cell->x < 0 || cell->x >= resolution || cell->y < 0 ||
+        cell->y >= resolution) {
+      continue;
+    }
+    int red, blue;
+    temperature_color(cell, min_temp, max_temp, &red, &blue);
+    size_t row = (size_t)(resolution - 1 - cell->y);
+    unsigned char *color = colors + (row * resolution + cell->x) * 3;
+    color[0] = (unsigned char)red;
+    color[2] = (unsigned char)blue;
+  }
+
+  HeatmapJob job = {image, colors, resolution, cell_pixels,
+                    (image->width + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE};
+  run_tiles(pool, (size_t)job.tiles_x * job.tiles_x, render_heatmap_tile,
+            &job);
+
+  stats->width = image->width;
+  stats->height = image->height;
+  stats->elements = level->num_cells;
+  stats->tile_elements = level->num_cells;
+  free(colors);
+  heatmap_pyramid_free(&pyramid);
+  stats->render_seconds = monotonic_seconds() - start;
+  return 1;
+}
+
+/**
+ * @brief Renders the flight path block by block with binning, see
+ * render_trajectory_blocks(), and saves it as PNG, or as PPM if the filename
+ * ends in ".ppm".
+ *
+ * @return 1 on success, 0 if the memory ran out or the file could not be
+ * written.
+ */
+int save_trajectory_raster(const char *filename, int size,
+                           const TrajectoryBlocks *blocks, double offset,
+                           ThreadPool *pool, RasterStats *stats) {
+  double start = monotonic_seconds();
+  RgbImage image;
+  if (!render_trajectory_blocks(&image, size, blocks, offset, pool, stats)) {
+    return 0;
+  }
+  int success = write_image(&image, filename, &stats->bytes);
+  rgb_image_free(&image);
+  stats->seconds = monotonic_seconds() - start;
+  return success;
+}
+
+/**
+ * @brief Renders the temperature map and saves it as PNG, or as PPM if the
+ * filename ends in ".ppm".
+ *
+ * @return 1 on success, 0 if the memory ran out or the file could not be
+ * written.
+ */
+int save_temperature_map_raster(const char *filename, int size,
+                                const Heatmap *heatmap, ThreadPool *pool,
+                                RasterStats *stats) {
+  double start = monotonic_seconds();
+  RgbImage image;
+  if (!render_temperature_map(&image, size, heatmap, pool, stats)) {
+    return 0;
+  }
+  int success = write_image(&image, filename, &stats->bytes);
+  rgb_image_free(&image);
+  stats->seconds = monotonic_seconds() - start;
+  return success;
+}
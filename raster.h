@@ -0,0 +1,40 @@
+#ifndef RASTER_H
+#define RASTER_H
+
+#include "heatmap.h"
+#include "image_writer.h"
+#include "thread_pool.h"
+#include "trajectory.h"
+#include <stddef.h>
+
+#define RASTER_TILE_SIZE 64       // Pixels, a tile is rendered by one thread
+#define RASTER_MAX_SIZE 16384     // Pixels per side
+#define RASTER_LINE_WIDTH 5.0     // Path units, like the stroke of line.svg
+#define RASTER_MIN_LINE_WIDTH 1.0 // Pixels
+
+typedef struct RasterStats {
+  int width;
+  int height;
+  size_t elements;      // Path segments or occupied heatmap cells
+  size_t tile_elements; // Segments drawn, summed over all tiles
+  size_t bytes;
+  double render_seconds;
+  double seconds; // Rendering and encoding
+} RasterStats;
+
+int render_trajectory(RgbImage *image, int size, const Trajectory *trajectory,
+                      double offset, int bin_segments, ThreadPool *pool,
+                      RasterStats *stats);
+int render_trajectory_blocks(RgbImage *image, int size,
+                             const TrajectoryBlocks *blocks, double offset,
+                             ThreadPool *pool, RasterStats *stats);
+int render_temperature_map(RgbImage *image, int size, const Heatmap *heatmap,
+                           ThreadPool *pool, RasterStats *stats);
+int save_trajectory_raster(const char *filename, int size,
+                           const TrajectoryBlocks *blocks, double offset,
+                           ThreadPool *pool, RasterStats *stats);
+int save_temperature_map_raster(const char *filename, int size,
+                                const Heatmap *heatmap, ThreadPool *pool,
+                                RasterStats *stats);
+
+#endif // RASTER_H
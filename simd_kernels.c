@@ -0,0 +1,640 @@
+/**
+ * Batch kernels for the per-step math of the integrator, working on whole
+ * columns (struct of arrays) instead of single Vec2D values.
+ *
+ * The backend is picked at runtime from the features of the CPU (AVX2+FMA,
+ * SSE2 or plain C). The length kernels give bit-identical results on all
+ * backends (sqrt and the products are correctly rounded either way). The
+ * vectorized sincos uses a Cody-Waite range reduction and the fdlibm kernel
+ * polynomials, its results differ from libm by at most a few ulp for angles
+ * up to SINCOS_MAX_ANGLE; larger angles are handed to libm.
+ *
+ * batch_heading() is an alternative to batch_sincos() for accumulated angles,
+ * see there.
+ */
+
+#include "simd_kernels.h"
+#include <math.h>
+#include <stdatomic.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+#define SINCOS_MAX_ANGLE 1e5
+#define HEADING_MAX_POLYNOMIAL_DELTA 0.785398163397448 // pi/4
+#define HEADING_RENORMALIZE_INTERVAL 64
+
+// pi/2 split into parts of 33 bits, so k * part is exact for |k| < 2^20
+static const double PIO2_1 = 1.57079632673412561417e+00;
+static const double PIO2_2 = 6.07710050630396597660e-11;
+static const double PIO2_3 = 2.02226624871116645580e-21;
+static const double TWO_OVER_PI = 6.36619772367581382433e-01;
+
+// fdlibm __kernel_sin / __kernel_cos coefficients for |r| <= pi/4
+static const double S1 = -1.66666666666666324348e-01;
+static const double S2 = 8.33333333332248946124e-03;
+static const double S3 = -1.98412698298579493134e-04;
+static const double S4 = 2.75573137070700676789e-06;
+static const double S5 = -2.50507602534068634195e-08;
+static const double S6 = 1.58969099521155010221e-10;
+static const double C1 = 4.16666666666666019037e-02;
+static const double C2 = -1.38888888888741095749e-03;
+static const double C3 = 2.48015872894767294178e-05;
+static const double C4 = -2.75573143513906633035e-07;
+static const double C5 = 2.08757232129817482790e-09;
+static const double C6 = -1.13596475577881948265e-11;
+
+static void sincos_scalar(const double *angles, double *sines,
+                          double *cosines, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    sines[i] = sin(angles[i]);
+    cosines[i] = cos(angles[i]);
+  }
+}
+
+static void length_scalar(const double *x, const double *y, double *lengths,
+                          size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    lengths[i] = sqrt(x[i] * x[i] + y[i] * y[i]);
+  }
+}
+
+static void segment_lengths_scalar(const double *x, const double *y,
+                                   double start_x, double start_y,
+                                   double *lengths, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    double dx = x[i] - (i > 0 ? x[i - 1] : start_x);
+    double dy = y[i] - (i > 0 ? y[i - 1] : start_y);
+    lengths[i] = sqrt(dx * dx + dy * dy);
+  }
+}
+
+// One time step of every ship, the same operations as the default integrator
+// and running_stats_add(). Steps with `active` 0 don't move the ship and
+// don't count, their temperature must not lower the minimum or raise the
+// maximum (e.g. the last temperature of the ship).
+static void ships_step_scalar(const ShipLanes *ships, const double *a,
+                              const double *sines, const double *cosines,
+                              const double *temperature, const double *active,
+                              size_t first, size_t n) {
+  for (size_t i = first; i < n; i++) {
+    double vx = ships->velocity_x[i] + cosines[i] * a[i];
+    double vy = ships->velocity_y[i] + sines[i] * a[i];
+    double x = ships->x[i] + vx * active[i];
+    double y = ships->y[i] + vy * active[i];
+    double dx = x - ships->x[i], dy = y - ships->y[i];
+    double speed = sqrt(vx * vx + vy * vy);
+    double distance = sqrt(x * x + y * y);
+    ships->velocity_x[i] = vx;
+    ships->velocity_y[i] = vy;
+    ships->x[i] = x;
+    ships->y[i] = y;
+    ships->max_speed[i] =
+        speed > ships->max_speed[i] ? speed : ships->max_speed[i];
+    ships->max_distance[i] =
+        distance > ships->max_distance[i] ? distance : ships->max_distance[i];
+    ships->total_distance[i] += sqrt(dx * dx + dy * dy);
+
+    double t = temperature[i];
+    double count = ships->temperature_count[i] + active[i];
+    double delta = (t - ships->temperature_mean[i]) * active[i];
+    double mean = ships->temperature_mean[i] + delta / (count > 1 ? count : 1);
+    ships->temperature_count[i] = count;
+    ships->temperature_mean[i] = mean;
+    ships->temperature_m2[i] += delta * (t - mean);
+    ships->min_temperature[i] =
+        t < ships->min_temperature[i] ? t : ships->min_temperature[i];
+    ships->max_temperature[i] =
+        t > ships->max_temperature[i] ? t : ships->max_temperature[i];
+  }
+}
+
+#ifdef SIMD_X86
+
+static __m128d select_sse2(__m128d mask, __m128d if_set, __m128d if_clear) {
+  return _mm_or_pd(_mm_and_pd(mask, if_set), _mm_andnot_pd(mask, if_clear));
+}
+
+__attribute__((target("sse2"))) static void
+sincos_sse2(const double *angles, double *sines, double *cosines, size_t n) {
+  const __m128d sign_bit = _mm_set1_pd(-0.0);
+  // Adding and subtracting 1.5 * 2^52 rounds to the nearest integer
+  const __m128d round_magic = _mm_set1_pd(6755399441055744.0);
+  size_t i = 0;
+
+  for (; i + 2 <= n; i += 2) {
+    __m128d x = _mm_loadu_pd(angles + i);
+    __m128d too_large = _mm_cmpgt_pd(_mm_andnot_pd(sign_bit, x),
+                                     _mm_set1_pd(SINCOS_MAX_ANGLE));
+    if (_mm_movemask_pd(too_large)) {
+      sincos_scalar(angles + i, sines + i, cosines + i, 2);
+      continue;
+    }
+
+    __m128d k = _mm_sub_pd(
+        _mm_add_pd(_mm_mul_pd(x, _mm_set1_pd(TWO_OVER_PI)), round_magic),
+        round_magic);
+    __m128d r = _mm_sub_pd(x, _mm_mul_pd(k, _mm_set1_pd(PIO2_1)));
+    r = _mm_sub_pd(r, _mm_mul_pd(k, _mm_set1_pd(PIO2_2)));
+    r = _mm_sub_pd(r, _mm_mul_pd(k, _mm_set1_pd(PIO2_3)));
+
+    __m128d z = _mm_mul_pd(r, r);
+    __m128d ps = _mm_add_pd(_mm_mul_pd(z, _mm_set1_pd(S6)), _mm_set1_pd(S5));
+    ps = _mm_add_pd(_mm_mul_pd(z, ps), _mm_set1_pd(S4));
+    ps = _mm_add_pd(_mm_mul_pd(z, ps), _mm_set1_pd(S3));
+    ps = _mm_add_pd(_mm_mul_pd(z, ps), _mm_set1_pd(S2));
+    ps = _mm_add_pd(_mm_mul_pd(z, ps), _mm_set1_pd(S1));
+    __m128d s = _mm_add_pd(r, _mm_mul_pd(_mm_mul_pd(z, r), ps));
+
+    __m128d pc = _mm_add_pd(_mm_mul_pd(z, _mm_set1_pd(C6)), _mm_set1_pd(C5));
+    pc = _mm_add_pd(_mm_mul_pd(z, pc), _mm_set1_pd(C4));
+    pc = _mm_add_pd(_mm_mul_pd(z, pc), _mm_set1_pd(C3));
+    pc = _mm_add_pd(_mm_mul_pd(z, pc), _mm_set1_pd(C2));
+    pc = _mm_add_pd(_mm_mul_pd(z, pc), _mm_set1_pd(C1));
+    __m128d c = _mm_add_pd(
+        _mm_sub_pd(_mm_set1_pd(1.0), _mm_mul_pd(_mm_set1_pd(0.5), z)),
+        _mm_mul_pd(_mm_mul_pd(z, z), pc));
+
+    // Quadrant bits of k, widened to 64 bit lane masks
+    __m128i quadrant = _mm_cvtpd_epi32(k);
+    quadrant = _mm_unpacklo_epi32(quadrant, quadrant);
+    __m128d odd = _mm_castsi128_pd(
+        _mm_cmpeq_epi32(_mm_and_si128(quadrant, _mm_set1_epi32(1)),
+                        _mm_set1_epi32(1)));
+    __m128i bit1 = _mm_and_si128(quadrant, _mm_set1_epi32(2));
+    __m128d sin_sign = _mm_and_pd(
+        _mm_castsi128_pd(_mm_cmpeq_epi32(bit1, _mm_set1_epi32(2))), sign_bit);
+    __m128i bit_cos = _mm_and_si128(_mm_add_epi32(quadrant, _mm_set1_epi32(1)),
+                                    _mm_set1_epi32(2));
+    __m128d cos_sign = _mm_and_pd(
+        _mm_castsi128_pd(_mm_cmpeq_epi32(bit_cos, _mm_set1_epi32(2))),
+        sign_bit);
+
+    _mm_storeu_pd(sines + i, _mm_xor_pd(select_sse2(odd, c, s), sin_sign));
+    _mm_storeu_pd(cosines + i, _mm_xor_pd(select_sse2(odd, s, c), cos_sign));
+  }
+  sincos_scalar(angles + i, sines + i, cosines + i, n - i);
+}
+
+__attribute__((target("sse2"))) static void
+length_sse2(const double *x, const double *y, double *lengths, size_t n) {
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128d vx = _mm_loadu_pd(x + i);
+    __m128d vy = _mm_loadu_pd(y + i);
+    __m128d sum = _mm_add_pd(_mm_mul_pd(vx, vx), _mm_mul_pd(vy, vy));
+    _mm_storeu_pd(lengths + i, _mm_sqrt_pd(sum));
+  }
+  length_scalar(x + i, y + i, lengths + i, n - i);
+}
+
+__attribute__((target("sse2"))) static void
+segment_lengths_sse2(const double *x, const double *y, double start_x,
+                     double start_y, double *lengths, size_t n) {
+  if (n == 0) {
+    return;
+  }
+  segment_lengths_scalar(x, y, start_x, start_y, lengths, 1);
+  size_t i = 1;
+  for (; i + 2 <= n; i += 2) {
+    __m128d dx = _mm_sub_pd(_mm_loadu_pd(x + i), _mm_loadu_pd(x + i - 1));
+    __m128d dy = _mm_sub_pd(_mm_loadu_pd(y + i), _mm_loadu_pd(y + i - 1));
+    __m128d sum = _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy));
+    _mm_storeu_pd(lengths + i, _mm_sqrt_pd(sum));
+  }
+  if (i < n) {
+    segment_lengths_scalar(x + i, y + i, x[i - 1], y[i - 1], lengths + i,
+                           n - i);
+  }
+}
+
+// No FMA either, like ships_step_scalar()
+__attribute__((target("sse2"))) static void
+ships_step_sse2(const ShipLanes *ships, const double *a, const double *sines,
+                const double *cosines, const double *temperature,
+                const double *active, size_t n) {
+  const __m128d one = _mm_set1_pd(1.0);
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128d act = _mm_loadu_pd(active + i);
+    __m128d acceleration = _mm_loadu_pd(a + i);
+    __m128d vx = _mm_add_pd(
+        _mm_loadu_pd(ships->velocity_x + i),
+        _mm_mul_pd(_mm_loadu_pd(cosines + i), acceleration));
+    __m128d vy =
+        _mm_add_pd(_mm_loadu_pd(ships->velocity_y + i),
+                   _mm_mul_pd(_mm_loadu_pd(sines + i), acceleration));
+    __m128d old_x = _mm_loadu_pd(ships->x + i);
+    __m128d old_y = _mm_loadu_pd(ships->y + i);
+    __m128d x = _mm_add_pd(old_x, _mm_mul_pd(vx, act));
+    __m128d y = _mm_add_pd(old_y, _mm_mul_pd(vy, act));
+    __m128d dx = _mm_sub_pd(x, old_x), dy = _mm_sub_pd(y, old_y);
+    __m128d speed = _mm_sqrt_pd(
+        _mm_add_pd(_mm_mul_pd(vx, vx), _mm_mul_pd(vy, vy)));
+    __m128d distance =
+        _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(x, x), _mm_mul_pd(y, y)));
+    __m128d segment = _mm_sqrt_pd(
+        _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)));
+    _mm_storeu_pd(ships->velocity_x + i, vx);
+    _mm_storeu_pd(ships->velocity_y + i, vy);
+    _mm_storeu_pd(ships->x + i, x);
+    _mm_storeu_pd(ships->y + i, y);
+    _mm_storeu_pd(ships->max_speed + i,
+                  _mm_max_pd(speed, _mm_loadu_pd(ships->max_speed + i)));
+    _mm_storeu_pd(ships->max_distance + i,
+                  _mm_max_pd(distance, _mm_loadu_pd(ships->max_distance + i)));
+    _mm_storeu_pd(ships->total_distance + i,
+                  _mm_add_pd(_mm_loadu_pd(ships->total_distance + i),
+                             segment));
+
+    __m128d t = _mm_loadu_pd(temperature + i);
+    __m128d count = _mm_add_pd(_mm_loadu_pd(ships->temperature_count + i), act);
+    __m128d mean = _mm_loadu_pd(ships->temperature_mean + i);
+    __m128d delta = _mm_mul_pd(_mm_sub_pd(t, mean), act);
+    mean = _mm_add_pd(mean, _mm_div_pd(delta, _mm_max_pd(count, one)));
+    _mm_storeu_pd(ships->temperature_count + i, count);
+    _mm_storeu_pd(ships->temperature_mean + i, mean);
+    _mm_storeu_pd(ships->temperature_m2 + i,
+                  _mm_add_pd(_mm_loadu_pd(ships->temperature_m2 + i),
+                             _mm_mul_pd(delta, _mm_sub_pd(t, mean))));
+    _mm_storeu_pd(ships->min_temperature + i,
+                  _mm_min_pd(t, _mm_loadu_pd(ships->min_temperature + i)));
+    _mm_storeu_pd(ships->max_temperature + i,
+                  _mm_max_pd(t, _mm_loadu_pd(ships->max_temperature + i)));
+  }
+  ships_step_scalar(ships, a, sines, cosines, temperature, active, i, n);
+}
+
+__attribute__((target("avx2,fma"))) static void
+sincos_avx2(const double *angles, double *sines, double *cosines, size_t n) {
+  const __m256d sign_bit = _mm256_set1_pd(-0.0);
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    __m256d x = _mm256_loadu_pd(angles + i);
+    __m256d too_large =
+        _mm256_cmp_pd(_mm256_andnot_pd(sign_bit, x),
+                      _mm256_set1_pd(SINCOS_MAX_ANGLE), _CMP_GT_OQ);
+    if (_mm256_movemask_pd(too_large)) {
+      sincos_scalar(angles + i, sines + i, cosines + i, 4);
+      continue;
+    }
+
+    __m256d k = _mm256_round_pd(
+        _mm256_mul_pd(x, _mm256_set1_pd(TWO_OVER_PI)),
+        _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256d r = _mm256_fnmadd_pd(k, _mm256_set1_pd(PIO2_1), x);
+    r = _mm256_fnmadd_pd(k, _mm256_set1_pd(PIO2_2), r);
+    r = _mm256_fnmadd_pd(k, _mm256_set1_pd(PIO2_3), r);
+
+    __m256d z = _mm256_mul_pd(r, r);
+    __m256d ps = _mm256_fmadd_pd(z, _mm256_set1_pd(S6), _mm256_set1_pd(S5));
+    ps = _mm256_fmadd_pd(z, ps, _mm256_set1_pd(S4));
+    ps = _mm256_fmadd_pd(z, ps, _mm256_set1_pd(S3));
+    ps = _mm256_fmadd_pd(z, ps, _mm256_set1_pd(S2));
+    ps = _mm256_fmadd_pd(z, ps, _mm256_set1_pd(S1));
+    __m256d s = _mm256_fmadd_pd(_mm256_mul_pd(z, r), ps, r);
+
+    __m256d pc = _mm256_fmadd_pd(z, _mm256_set1_pd(C6), _mm256_set1_pd(C5));
+    pc = _mm256_fmadd_pd(z, pc, _mm256_set1_pd(C4));
+    pc = _mm256_fmadd_pd(z, pc, _mm256_set1_pd(C3));
+    pc = _mm256_fmadd_pd(z, pc, _mm256_set1_pd(C2));
+    pc = _mm256_fmadd_pd(z, pc, _mm256_set1_pd(C1));
+    __m256d c = _mm256_fmadd_pd(
+        _mm256_mul_pd(z, z), pc,
+        _mm256_fnmadd_pd(_mm256_set1_pd(0.5), z, _mm256_set1_pd(1.0)));
+
+    // Quadrant bits of k, widened to 64 bit lane masks
+    __m256i quadrant = _mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(k));
+    __m256i one = _mm256_set1_epi64x(1);
+    __m256i two = _mm256_set1_epi64x(2);
+    __m256d odd = _mm256_castsi256_pd(
+        _mm256_cmpeq_epi64(_mm256_and_si256(quadrant, one), one));
+    __m256d sin_sign = _mm256_and_pd(
+        _mm256_castsi256_pd(
+            _mm256_cmpeq_epi64(_mm256_and_si256(quadrant, two), two)),
+        sign_bit);
+    __m256d cos_sign = _mm256_and_pd(
+        _mm256_castsi256_pd(_mm256_cmpeq_epi64(
+            _mm256_and_si256(_mm256_add_epi64(quadrant, one), two), two)),
+        sign_bit);
+
+    _mm256_storeu_pd(sines + i,
+                     _mm256_xor_pd(_mm256_blendv_pd(s, c, odd), sin_sign));
+    _mm256_storeu_pd(cosines + i,
+                     _mm256_xor_pd(_mm256_blendv_pd(c, s, odd), cos_sign));
+  }
+  sincos_scalar(angles + i, sines + i, cosines + i, n - i);
+}
+
+// No FMA in the length kernels: x * x + y * y must round exactly like the
+// scalar calculate_speed()/calculate_distance()
+__attribute__((target("avx2"))) static void
+length_avx2(const double *x, const double *y, double *lengths, size_t n) {
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d vx = _mm256_loadu_pd(x + i);
+    __m256d vy = _mm256_loadu_pd(y + i);
+    __m256d sum =
+        _mm256_add_pd(_mm256_mul_pd(vx, vx), _mm256_mul_pd(vy, vy));
+    _mm256_storeu_pd(lengths + i, _mm256_sqrt_pd(sum));
+  }
+  length_scalar(x + i, y + i, lengths + i, n - i);
+}
+
+__attribute__((target("avx2"))) static void
+segment_lengths_avx2(const double *x, const double *y, double start_x,
+                     double start_y, double *lengths, size_t n) {
+  if (n == 0) {
+    return;
+  }
+  segment_lengths_scalar(x, y, start_x, start_y, lengths, 1);
+  size_t i = 1;
+  for (; i + 4 <= n; i += 4) {
+    __m256d dx =
+        _mm256_sub_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(x + i - 1));
+    __m256d dy =
+        _mm256_sub_pd(_mm256_loadu_pd(y + i), _mm256_loadu_pd(y + i - 1));
+    __m256d sum =
+        _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy));
+    _mm256_storeu_pd(lengths + i, _mm256_sqrt_pd(sum));
+  }
+  if (i < n) {
+    segment_lengths_scalar(x + i, y + i, x[i - 1], y[i - 1], lengths + i,
+                           n - i);
+  }
+}
+
+__attribute__((target("avx2"))) static void
+ships_step_avx2(const ShipLanes *ships, const double *a, const double *sines,
+                const double *cosines, const double *temperature,
+                const double *active, size_t n) {
+  const __m256d one = _mm256_set1_pd(1.0);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d act = _mm256_loadu_pd(active + i);
+    __m256d acceleration = _mm256_loadu_pd(a + i);
+    __m256d vx = _mm256_add_pd(
+        _mm256_loadu_pd(ships->velocity_x + i),
+        _mm256_mul_pd(_mm256_loadu_pd(cosines + i), acceleration));
+    __m256d vy = _mm256_add_pd(
+        _mm256_loadu_pd(ships->velocity_y + i),
+        _mm256_mul_pd(_mm256_loadu_pd(sines + i), acceleration));
+    __m256d old_x = _mm256_loadu_pd(ships->x + i);
+    __m256d old_y = _mm256_loadu_pd(ships->y + i);
+    __m256d x = _mm256_add_pd(old_x, _mm256_mul_pd(vx, act));
+    __m256d y = _mm256_add_pd(old_y, _mm256_mul_pd(vy, act));
+    __m256d dx = _mm256_sub_pd(x, old_x), dy = _mm256_sub_pd(y, old_y);
+    __m256d speed = _mm256_sqrt_pd(
+        _mm256_add_pd(_mm256_mul_pd(vx, vx), _mm256_mul_pd(vy, vy)));
+    __m256d distance = _mm256_sqrt_pd(
+        _mm256_add_pd(_mm256_mul_pd(x, x), _mm256_mul_pd(y, y)));
+    __m256d segment = _mm256_sqrt_pd(
+        _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)));
+    _mm256_storeu_pd(ships->velocity_x + i, vx);
+    _mm256_storeu_pd(ships->velocity_y + i, vy);
+    _mm256_storeu_pd(ships->x + i, x);
+    _mm256_storeu_pd(ships->y + i, y);
+    _mm256_storeu_pd(
+        ships->max_speed + i,
+        _mm256_max_pd(speed, _mm256_loadu_pd(ships->max_speed + i)));
+    _mm256_storeu_pd(
+        ships->max_distance + i,
+        _mm256_max_pd(distance, _mm256_loadu_pd(ships->max_distance + i)));
+    _mm256_storeu_pd(ships->total_distance + i,
+                     _mm256_add_pd(_mm256_loadu_pd(ships->total_distance + i),
+                                   segment));
+
+    __m256d t = _mm256_loadu_pd(temperature + i);
+    __m256d count =
+        _mm256_add_pd(_mm256_loadu_pd(ships->temperature_count + i), act);
+    __m256d mean = _mm256_loadu_pd(ships->temperature_mean + i);
+    __m256d delta = _mm256_mul_pd(_mm256_sub_pd(t, mean), act);
+    mean = _mm256_add_pd(mean,
+                         _mm256_div_pd(delta, _mm256_max_pd(count, one)));
+    _mm256_storeu_pd(ships->temperature_count + i, count);
+    _mm256_storeu_pd(ships->temperature_mean + i, mean);
+    __m256d m2 = _mm256_loadu_pd(ships->temperature_m2 + i);
+    _mm256_storeu_pd(ships->temperature_m2 + i,
+                     _mm256_add_pd(m2, _mm256_mul_pd(delta,
+                                                     _mm256_sub_pd(t, mean))));
+    _mm256_storeu_pd(
+        ships->min_temperature + i,
+        _mm256_min_pd(t, _mm256_loadu_pd(ships->min_temperature + i)));
+    _mm256_storeu_pd(
+        ships->max_temperature + i,
+        _mm256_max_pd(t, _mm256_loadu_pd(ships->max_temperature + i)));
+  }
+  ships_step_scalar(ships, a, sines, cosines, temperature, active, i, n);
+}
+
+#endif // SIMD_X86
+
+// -1 until the first call of simd_get_backend() or simd_set_backend(), atomic
+// so that analyses on several threads can start at the same time
+static atomic_int active_backend = -1;
+
+/**
+ * @brief The fastest backend supported by the CPU running the program.
+ */
+SimdBackend simd_detect_backend(void) {
+#ifdef SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    return SIMD_AVX2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return SIMD_SSE2;
+  }
+#endif
+  return SIMD_SCALAR;
+}
+
+SimdBackend simd_get_backend(void) {
+  int backend = atomic_load_explicit(&active_backend, memory_order_relaxed);
+  if (backend < 0) {
+    int detected = simd_detect_backend();
+    // Keeps a backend set by simd_set_backend() in the meantime
+    if (atomic_compare_exchange_strong(&active_backend, &backend, detected)) {
+      backend = detected;
+    }
+  }
+  return (SimdBackend)backend;
+}
+
+/**
+ * @brief Selects the backend used by the batch kernels, e.g. SIMD_SCALAR to
+ * reproduce the results of the per-step functions exactly. Backends the CPU
+ * doesn't support are replaced by the best supported one.
+ */
+void simd_set_backend(SimdBackend backend) {
+  SimdBackend supported = simd_detect_backend();
+  atomic_store(&active_backend, backend > supported ? supported : backend);
+}
+
+const char *simd_backend_name(SimdBackend backend) {
+  switch (backend) {
+  case SIMD_AVX2:
+    return "AVX2";
+  case SIMD_SSE2:
+    return "SSE2";
+  default:
+    return "scalar";
+  }
+}
+
+/**
+ * @brief Computes sin and cos of every angle.
+ */
+void batch_sincos(const double *angles, double *sines, double *cosines,
+                  size_t n) {
+  switch (simd_get_backend()) {
+#ifdef SIMD_X86
+  case SIMD_AVX2:
+    sincos_avx2(angles, sines, cosines, n);
+    return;
+  case SIMD_SSE2:
+    sincos_sse2(angles, sines, cosines, n);
+    return;
+#endif
+  default:
+    sincos_scalar(angles, sines, cosines, n);
+  }
+}
+
+/**
+ * @brief Computes the length of every vector (x[i], y[i]), e.g. the speed for
+ * a velocity column or the distance to the origin for a position column.
+ */
+void batch_length(const double *x, const double *y, double *lengths,
+                  size_t n) {
+  switch (simd_get_backend()) {
+#ifdef SIMD_X86
+  case SIMD_AVX2:
+    length_avx2(x, y, lengths, n);
+    return;
+  case SIMD_SSE2:
+    length_sse2(x, y, lengths, n);
+    return;
+#endif
+  default:
+    length_scalar(x, y, lengths, n);
+  }
+}
+
+/**
+ * @brief Computes the length of every path segment, the segment i goes from
+ * point i - 1 (or the start point for i = 0) to point i.
+ */
+void batch_segment_lengths(const double *x, const double *y, double start_x,
+                           double start_y, double *lengths, size_t n) {
+  switch (simd_get_backend()) {
+#ifdef SIMD_X86
+  case SIMD_AVX2:
+    segment_lengths_avx2(x, y, start_x, start_y, lengths, n);
+    return;
+  case SIMD_SSE2:
+    segment_lengths_sse2(x, y, start_x, start_y, lengths, n);
+    return;
+#endif
+  default:
+    segment_lengths_scalar(x, y, start_x, start_y, lengths, n);
+  }
+}
+
+/**
+ * @brief Advances n ships by one time step, one SIMD lane per ship and
+ * without branches: velocity, position, top speed, max. distance to the
+ * start, total distance and the temperature moments and extremes. On the
+ * scalar backend the results of every ship are identical to those of
+ * integrate_chunk() and running_stats_add() for that ship alone, the other
+ * backends differ at most by the rounding of their sincos.
+ *
+ * @param sines sin of the rotation of every ship after the step.
+ * @param cosines cos of the rotation of every ship after the step.
+ * @param active 1 for ships that have this time step, 0 for ships whose
+ * flight is shorter (acceleration 0, temperature the last one).
+ */
+void batch_ships_step(const ShipLanes *ships, const double *acceleration,
+                      const double *sines, const double *cosines,
+                      const double *temperature, const double *active,
+                      size_t n) {
+  switch (simd_get_backend()) {
+#ifdef SIMD_X86
+  case SIMD_AVX2:
+    ships_step_avx2(ships, acceleration, sines, cosines, temperature, active,
+                    n);
+    return;
+  case SIMD_SSE2:
+    ships_step_sse2(ships, acceleration, sines, cosines, temperature, active,
+                    n);
+    return;
+#endif
+  default:
+    ships_step_scalar(ships, acceleration, sines, cosines, temperature,
+                      active, 0, n);
+  }
+}
+
+/**
+ * @brief sin and cos of the running angle start_angle + deltas[0] + ... +
+ * deltas[i] for every i, without evaluating sin and cos of the (growing)
+ * accumulated angle.
+ *
+ * The heading is kept as the unit vector (cos, sin) of the start angle and
+ * turned by every delta with a complex multiplication. sin and cos of the
+ * deltas come from batch_sincos(), except on the scalar backend: there deltas
+ * up to pi/4 are evaluated with the fdlibm kernel polynomials directly, which
+ * needs no range reduction and is several times faster than libm.
+ *
+ * Every HEADING_RENORMALIZE_INTERVAL steps the vector is scaled back to
+ * length 1 (one Newton step). The rounding errors only add up within a call,
+ * the difference to sin and cos of the accumulated angle is dominated by the
+ * rounding of that sum.
+ *
+ * @param deltas Change of the angle of every step.
+ * @param start_angle The angle before the first step.
+ */
+void batch_heading(const double *deltas, double start_angle, double *sines,
+                   double *cosines, size_t n) {
+  // Rotation of every step, independent of each other
+  if (simd_get_backend() != SIMD_SCALAR) {
+    batch_sincos(deltas, sines, cosines, n);
+  } else {
+    for (size_t i = 0; i < n; i++) {
+      double d = deltas[i];
+      if (fabs(d) > HEADING_MAX_POLYNOMIAL_DELTA) {
+        sines[i] = sin(d);
+        cosines[i] = cos(d);
+        continue;
+      }
+      double z = d * d;
+      double sine_poly =
+          S1 + z * (S2 + z * (S3 + z * (S4 + z * (S5 + z * S6))));
+      double cosine_poly =
+          C1 + z * (C2 + z * (C3 + z * (C4 + z * (C5 + z * C6))));
+      sines[i] = d + d * z * sine_poly;
+      cosines[i] = 1.0 - 0.5 * z + z * z * cosine_poly;
+    }
+  }
+
+  // Chain of rotations
+  double c = cos(start_angle), s = sin(start_angle);
+  for (size_t block = 0; block < n; block += HEADING_RENORMALIZE_INTERVAL) {
+    size_t end = block + HEADING_RENORMALIZE_INTERVAL < n
+                     ? block + HEADING_RENORMALIZE_INTERVAL
+                     : n;
+    for (size_t i = block; i < end; i++) {
+      double turned_c = c * cosines[i] - s * sines[i];
+      s = s * cosines[i] + c * sines[i];
+      c = turned_c;
+      sines[i] = s;
+      cosines[i] = c;
+    }
+    double scale = 1.5 - 0.5 * (c * c + s * s);
+    c *= scale;
+    s *= scale;
+  }
+}
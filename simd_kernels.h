@@ -0,0 +1,43 @@
+#ifndef SIMD_KERNELS_H
+#define SIMD_KERNELS_H
+
+#include <stddef.h>
+
+typedef enum SimdBackend { SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2 } SimdBackend;
+
+// Integrator state and metrics of independent ships, one array element (SIMD
+// lane) per ship
+typedef struct ShipLanes {
+  double *velocity_x;
+  double *velocity_y;
+  double *x;
+  double *y;
+  double *max_speed;
+  double *max_distance;
+  double *total_distance;
+  // Welford's running moments and the extremes of the temperature
+  double *temperature_count;
+  double *temperature_mean;
+  double *temperature_m2;
+  double *min_temperature;
+  double *max_temperature;
+} ShipLanes;
+
+SimdBackend simd_detect_backend(void);
+SimdBackend simd_get_backend(void);
+void simd_set_backend(SimdBackend backend);
+const char *simd_backend_name(SimdBackend backend);
+
+void batch_sincos(const double *angles, double *sines, double *cosines,
+                  size_t n);
+void batch_heading(const double *deltas, double start_angle, double *sines,
+                   double *cosines, size_t n);
+void batch_length(const double *x, const double *y, double *lengths, size_t n);
+void batch_segment_lengths(const double *x, const double *y, double start_x,
+                           double start_y, double *lengths, size_t n);
+void batch_ships_step(const ShipLanes *ships, const double *acceleration,
+                      const double *sines, const double *cosines,
+                      const double *temperature, const double *active,
+                      size_t n);
+
+#endif // SIMD_KERNELS_H
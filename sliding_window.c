@@ -0,0 +1,169 @@
+/**
+ * Rolling metrics for the windowed analysis.
+ *
+ * The extremes come from monotonic deques: a new value removes every value
+ * from the back that it beats (they can never be the extreme of a later
+ * window), and the front is dropped once it leaves the window, so the front
+ * is always the extreme and every step is pushed and popped once. The moments
+ * and the distance are running sums; the sums are recomputed from the stored
+ * values once per window length, so rounding errors of the additions and
+ * subtractions can't pile up over a long flight.
+ */
+
+#include "sliding_window.h"
+#include <stdlib.h>
+
+static int deque_init(MonotonicDeque *deque, size_t size) {
+  deque->entries = malloc(size * sizeof(*deque->entries));
+  deque->first = 0;
+  deque->length = 0;
+  return deque->entries != NULL;
+}
+
+// Index into a ring, for positions below 2 * size (no division)
+static size_t ring_index(size_t position, size_t size) {
+  return position >= size ? position - size : position;
+}
+
+/**
+ * @brief Adds a step to the back of a deque and drops the step that left the
+ * window from the front.
+ *
+ * @param maximum 1 to keep the maximum at the front, 0 for the minimum.
+ */
+static void deque_push(MonotonicDeque *deque, size_t size, size_t step,
+                       double value, int maximum) {
+  while (deque->length > 0) {
+    const DequeEntry *last =
+        &deque->entries[ring_index(deque->first + deque->length - 1, size)];
+    if (maximum ? last->value > value : last->value < value) {
+      break;
+    }
+    deque->length--;
+  }
+  if (deque->length > 0 && deque->entries[deque->first].step + size <= step) {
+    deque->first = ring_index(deque->first + 1, size);
+    deque->length--;
+  }
+  DequeEntry *entry =
+      &deque->entries[ring_index(deque->first + deque->length, size)];
+  entry->step = step;
+  entry->value = value;
+  deque->length++;
+}
+
+static double deque_front(const MonotonicDeque *deque) {
+  return deque->entries[deque->first].value;
+}
+
+/**
+ * @brief Creates an empty window.
+ *
+ * @param size Number of time steps in the window, at least 1.
+ * @return 1 on success, 0 if the memory could not be allocated.
+ */
+int sliding_window_init(SlidingWindow *window, size_t size) {
+  window->size = size;
+  window->steps = 0;
+  window->slot = 0;
+  window->temperature = malloc(size * sizeof(double));
+  window->distance = malloc(size * sizeof(double));
+  int success = deque_init(&window->min_temperature, size);
+  success = deque_init(&window->max_temperature, size) && success;
+  success = deque_init(&window->max_speed, size) && success;
+  window->reference = 0;
+  window->temperature_sum = 0;
+  window->temperature_squares = 0;
+  window->distance_sum = 0;
+  window->steps_since_resum = 0;
+  if (!success || !window->temperature || !window->distance) {
+    sliding_window_free(window);
+    return 0;
+  }
+  return 1;
+}
+
+// Exact sums of the values in the window
+static void resum(SlidingWindow *window) {
+  size_t count = window->steps < window->size ? window->steps : window->size;
+  window->temperature_sum = 0;
+  window->temperature_squares = 0;
+  window->distance_sum = 0;
+  for (size_t i = 0; i < count; i++) {
+    double deviation = window->temperature[i] - window->reference;
+    window->temperature_sum += deviation;
+    window->temperature_squares += deviation * deviation;
+    window->distance_sum += window->distance[i];
+  }
+  window->steps_since_resum = 0;
+}
+
+/**
+ * @brief Adds the next time step; the oldest one leaves a full window.
+ *
+ * @param distance Length of the path segment of the step.
+ */
+void sliding_window_add(SlidingWindow *window, double temperature,
+                        double speed, double distance) {
+  size_t step = window->steps++;
+  size_t slot = window->slot;
+  window->slot = ring_index(slot + 1, window->size);
+  if (step == 0) {
+    window->reference = temperature;
+  }
+  if (step >= window->size) {
+    double deviation = window->temperature[slot] - window->reference;
+    window->temperature_sum -= deviation;
+    window->temperature_squares -= deviation * deviation;
+    window->distance_sum -= window->distance[slot];
+  }
+  window->temperature[slot] = temperature;
+  window->distance[slot] = distance;
+
+  if (++window->steps_since_resum >= window->size) {
+    // Also moves the reference to the current level of the temperature
+    window->reference = temperature;
+    resum(window);
+  } else {
+    double deviation = temperature - window->reference;
+    window->temperature_sum += deviation;
+    window->temperature_squares += deviation * deviation;
+    window->distance_sum += distance;
+  }
+
+  deque_push(&window->min_temperature, window->size, step, temperature, 0);
+  deque_push(&window->max_temperature, window->size, step, temperature, 1);
+  deque_push(&window->max_speed, window->size, step, speed, 1);
+}
+
+/**
+ * @brief The metrics of the steps in the window: the last `size` steps, or
+ * all steps added so far. The window must not be empty.
+ */
+void sliding_window_metrics(const SlidingWindow *window,
+                            WindowMetrics *metrics) {
+  size_t count = window->steps < window->size ? window->steps : window->size;
+  double mean = window->temperature_sum / count;
+  double variance = window->temperature_squares / count - mean * mean;
+  metrics->last_step = window->steps - 1;
+  metrics->first_step = window->steps - count;
+  metrics->temperature_mean = window->reference + mean;
+  metrics->temperature_variance = variance > 0 ? variance : 0;
+  metrics->min_temperature = deque_front(&window->min_temperature);
+  metrics->max_temperature = deque_front(&window->max_temperature);
+  metrics->max_speed = deque_front(&window->max_speed);
+  metrics->distance = window->distance_sum;
+}
+
+void sliding_window_free(SlidingWindow *window) {
+  free(window->temperature);
+  free(window->distance);
+  free(window->min_temperature.entries);
+  free(window->max_temperature.entries);
+  free(window->max_speed.entries);
+  window->temperature = NULL;
+  window->distance = NULL;
+  window->min_temperature.entries = NULL;
+  window->max_temperature.entries = NULL;
+  window->max_speed.entries = NULL;
+}
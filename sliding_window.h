@@ -0,0 +1,60 @@
+#ifndef SLIDING_WINDOW_H
+#define SLIDING_WINDOW_H
+
+#include <stddef.h>
+
+#define WINDOW_DEFAULT_SIZE 1000 // Time steps
+
+typedef struct DequeEntry {
+  size_t step;
+  double value;
+} DequeEntry;
+
+// Steps whose values decrease (max) or increase (min) from the oldest to the
+// newest, in a ring of `size` entries
+typedef struct MonotonicDeque {
+  DequeEntry *entries;
+  size_t first;
+  size_t length;
+} MonotonicDeque;
+
+// Rolling metrics over the last `size` time steps. Adding a step takes
+// amortized O(1) time for any window size.
+typedef struct SlidingWindow {
+  size_t size;
+  size_t steps; // Time steps added so far
+  // The values of the last `size` steps, step i at index i % size
+  double *temperature;
+  double *distance;
+  size_t slot; // Index of the next step
+  MonotonicDeque min_temperature;
+  MonotonicDeque max_temperature;
+  MonotonicDeque max_speed;
+  // Sums over the window, temperatures relative to the reference
+  double reference;
+  double temperature_sum;
+  double temperature_squares;
+  double distance_sum;
+  size_t steps_since_resum;
+} SlidingWindow;
+
+// Metrics of the time steps [first_step, last_step]
+typedef struct WindowMetrics {
+  size_t first_step;
+  size_t last_step;
+  double temperature_mean;
+  double temperature_variance;
+  double min_temperature;
+  double max_temperature;
+  double max_speed;
+  double distance; // Path length
+} WindowMetrics;
+
+int sliding_window_init(SlidingWindow *window, size_t size);
+void sliding_window_add(SlidingWindow *window, double temperature,
+                        double speed, double distance);
+void sliding_window_metrics(const SlidingWindow *window,
+                            WindowMetrics *metrics);
+void sliding_window_free(SlidingWindow *window);
+
+#endif // SLIDING_WINDOW_H
@@ -0,0 +1,586 @@
+/**
+ * Spatial index over the positions of a trajectory.
+ *
+ * The segments are sorted along a Hilbert curve through the centers of their
+ * bounding boxes (16 bits per axis, radix sort) and packed bottom-up into an
+ * R-tree: SPATIAL_NODE_SIZE consecutive segments form a leaf,
+ * SPATIAL_NODE_SIZE consecutive nodes a parent. Unlike STR packing this needs
+ * no sorting per level, the build is O(n), and the Hilbert order keeps
+ * neighbouring segments in the same nodes wherever the flight crosses its
+ * own path. Long segments (fast flights) are no problem, each segment is in
+ * exactly one leaf.
+ *
+ * Memory: 4 bytes per segment for the entries, about 3 bytes for the nodes,
+ * and 16 bytes per segment temporarily while building.
+ */
+
+#include "spatial_index.h"
+#include "profiler.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HILBERT_BITS 16
+#define MAX_STACK 1024 // Depth of the tree times SPATIAL_NODE_SIZE
+
+static void segment_start(const SpatialIndex *index, size_t segment,
+                          double *x, double *y) {
+  *x = segment > 0 ? index->x[segment - 1] : 0.0;
+  *y = segment > 0 ? index->y[segment - 1] : 0.0;
+}
+
+/**
+ * @brief Position of (x, y) along the Hilbert curve through a 2^16 x 2^16
+ * grid.
+ */
+static uint32_t hilbert_index(uint32_t x, uint32_t y) {
+  const uint32_t side = 1u << HILBERT_BITS;
+  uint32_t d = 0;
+  for (uint32_t s = side / 2; s > 0; s /= 2) {
+    uint32_t rx = (x & s) > 0;
+    uint32_t ry = (y & s) > 0;
+    d += s * s * ((3 * rx) ^ ry);
+    // Rotate the quadrant so that the curve continues
+    if (ry == 0) {
+      if (rx == 1) {
+        x = side - 1 - x;
+        y = side - 1 - y;
+      }
+      uint32_t swap = x;
+      x = y;
+      y = swap;
+    }
+  }
+  return d;
+}
+
+static uint32_t quantize(double value, double min, double scale) {
+  double q = (value - min) * scale;
+  return q > 0 ? (q < 65535.0 ? (uint32_t)q : 65535u) : 0u;
+}
+
+/**
+ * @brief Sorts the keys by their upper 32 bits (LSD radix sort, stable).
+ * The sorted keys end up in `keys` again.
+ */
+static void radix_sort_upper(uint64_t *keys, uint64_t *buffer, size_t n) {
+  for (int shift = 32; shift < 64; shift += 8) {
+    size_t offsets[256] = {0};
+    for (size_t i = 0; i < n; i++) {
+      offsets[(keys[i] >> shift) & 0xFF]++;
+    }
+    size_t sum = 0;
+    for (int b = 0; b < 256; b++) {
+      size_t count = offsets[b];
+      offsets[b] = sum;
+      sum += count;
+    }
+    for (size_t i = 0; i < n; i++) {
+      buffer[offsets[(keys[i] >> shift) & 0xFF]++] = keys[i];
+    }
+    uint64_t *swap = keys;
+    keys = buffer;
+    buffer = swap;
+  }
+}
+
+static void extend_node(SpatialNode *node, double min_x, double min_y,
+                        double max_x, double max_y) {
+  node->min_x = fmin(node->min_x, min_x);
+  node->min_y = fmin(node->min_y, min_y);
+  node->max_x = fmax(node->max_x, max_x);
+  node->max_y = fmax(node->max_y, max_y);
+}
+
+static void empty_node(SpatialNode *node, size_t first, size_t count) {
+  node->min_x = INFINITY;
+  node->min_y = INFINITY;
+  node->max_x = -INFINITY;
+  node->max_y = -INFINITY;
+  node->first = first;
+  node->count = count;
+}
+
+/**
+ * @brief Sorts the segments along the Hilbert curve and stores the order in
+ * index->entries.
+ */
+static int sort_segments(SpatialIndex *index) {
+  size_t n = index->num_points;
+  uint64_t *keys = malloc(n * sizeof(*keys));
+  uint64_t *buffer = malloc(n * sizeof(*buffer));
+  index->entries = malloc(n * sizeof(*index->entries));
+  if (!keys || !buffer || !index->entries) {
+    free(keys);
+    free(buffer);
+    return 0;
+  }
+  PROFILE_ALLOCATION(n * (2 * sizeof(*keys) + sizeof(*index->entries)));
+
+  // Bounds of the segment centers (twice the centers, to save a division)
+  double min_x = INFINITY, min_y = INFINITY;
+  double max_x = -INFINITY, max_y = -INFINITY;
+  for (size_t i = 0; i < n; i++) {
+    double start_x, start_y;
+    segment_start(index, i, &start_x, &start_y);
+    double center_x = start_x + index->x[i], center_y = start_y + index->y[i];
+    min_x = fmin(min_x, center_x);
+    min_y = fmin(min_y, center_y);
+    max_x = fmax(max_x, center_x);
+    max_y = fmax(max_y, center_y);
+  }
+  double scale_x = max_x > min_x ? 65535.0 / (max_x - min_x) : 0.0;
+  double scale_y = max_y > min_y ? 65535.0 / (max_y - min_y) : 0.0;
+
+  for (size_t i = 0; i < n; i++) {
+    double start_x, start_y;
+    segment_start(index, i, &start_x, &start_y);
+    uint32_t qx = quantize(start_x + index->x[i], min_x, scale_x);
+    uint32_t qy = quantize(start_y + index->y[i], min_y, scale_y);
+    keys[i] = (uint64_t)hilbert_index(qx, qy) << 32 | i;
+  }
+  radix_sort_upper(keys, buffer, n);
+  for (size_t i = 0; i < n; i++) {
+    index->entries[i] = (uint32_t)keys[i];
+  }
+  free(keys);
+  free(buffer);
+  return 1;
+}
+
+/**
+ * @brief Builds the index over the points (x[i], y[i]).
+ *
+ * @param index Receives the index. Free with spatial_index_free().
+ * @param x, y Position columns, at most SPATIAL_MAX_POINTS points. They are
+ * not copied.
+ * @return 1 on success, 0 if there are too many points or the memory ran out.
+ */
+int spatial_index_build(SpatialIndex *index, const double *x, const double *y,
+                        size_t num_points) {
+  memset(index, 0, sizeof(*index));
+  index->x = x;
+  index->y = y;
+  index->num_points = num_points;
+  if (num_points == 0) {
+    return 1;
+  }
+  if (num_points > SPATIAL_MAX_POINTS || !sort_segments(index)) {
+    spatial_index_free(index);
+    return 0;
+  }
+
+  // Number of nodes on all levels
+  size_t num_nodes = 0;
+  size_t level_size = num_points;
+  do {
+    level_size = (level_size + SPATIAL_NODE_SIZE - 1) / SPATIAL_NODE_SIZE;
+    num_nodes += level_size;
+  } while (level_size > 1);
+  index->nodes = malloc(num_nodes * sizeof(*index->nodes));
+  if (!index->nodes) {
+    spatial_index_free(index);
+    return 0;
+  }
+  PROFILE_ALLOCATION(num_nodes * sizeof(*index->nodes));
+  index->num_nodes = num_nodes;
+  index->num_leaves = (num_points + SPATIAL_NODE_SIZE - 1) / SPATIAL_NODE_SIZE;
+
+  // Leaves over the sorted segments
+  for (size_t leaf = 0; leaf < index->num_leaves; leaf++) {
+    SpatialNode *node = &index->nodes[leaf];
+    size_t first = leaf * SPATIAL_NODE_SIZE;
+    size_t count = num_points - first < SPATIAL_NODE_SIZE ? num_points - first
+                                                          : SPATIAL_NODE_SIZE;
+    empty_node(node, first, count);
+    for (size_t e = first; e < first + count; e++) {
+      size_t segment = index->entries[e];
+      double start_x, start_y;
+      segment_start(index, segment, &start_x, &start_y);
+      double end_x = x[segment], end_y = y[segment];
+      extend_node(node, fmin(start_x, end_x), fmin(start_y, end_y),
+                  fmax(start_x, end_x), fmax(start_y, end_y));
+    }
+  }
+
+  // Every further level over the previous one
+  size_t level_first = 0, level_count = index->num_leaves;
+  size_t next = index->num_leaves;
+  while (level_count > 1) {
+    size_t next_first = next;
+    for (size_t child = 0; child < level_count; child += SPATIAL_NODE_SIZE) {
+      SpatialNode *node = &index->nodes[next++];
+      size_t count = level_count - child < SPATIAL_NODE_SIZE
+                         ? level_count - child
+                         : SPATIAL_NODE_SIZE;
+      empty_node(node, level_first + child, count);
+      for (size_t c = node->first; c < node->first + count; c++) {
+        const SpatialNode *children = &index->nodes[c];
+        extend_node(node, children->min_x, children->min_y, children->max_x,
+                    children->max_y);
+      }
+    }
+    level_first = next_first;
+    level_count = next - next_first;
+  }
+  return 1;
+}
+
+size_t spatial_index_memory_usage(const SpatialIndex *index) {
+  return index->num_points * sizeof(*index->entries) +
+         index->num_nodes * sizeof(*index->nodes);
+}
+
+void spatial_index_free(SpatialIndex *index) {
+  free(index->entries);
+  free(index->nodes);
+  index->entries = NULL;
+  index->nodes = NULL;
+  index->num_nodes = 0;
+  index->num_leaves = 0;
+}
+
+void spatial_results_init(SpatialResults *results) {
+  results->matches = NULL;
+  results->length = 0;
+  results->capacity = 0;
+}
+
+void spatial_results_free(SpatialResults *results) {
+  free(results->matches);
+  spatial_results_init(results);
+}
+
+static int reserve_matches(SpatialResults *results, size_t capacity) {
+  if (capacity <= results->capacity) {
+    return 1;
+  }
+  SpatialMatch *grown = realloc(results->matches, capacity * sizeof(*grown));
+  if (!grown) {
+    return 0;
+  }
+  results->matches = grown;
+  results->capacity = capacity;
+  return 1;
+}
+
+static int add_match(SpatialResults *results, size_t step, double distance) {
+  if (results->length == results->capacity &&
+      !reserve_matches(results,
+                       results->capacity ? 2 * results->capacity : 64)) {
+    return 0;
+  }
+  results->matches[results->length].step = step;
+  results->matches[results->length].distance = distance;
+  results->length++;
+  return 1;
+}
+
+static int compare_steps(const void *a, const void *b) {
+  size_t step_a = ((const SpatialMatch *)a)->step;
+  size_t step_b = ((const SpatialMatch *)b)->step;
+  return (step_a > step_b) - (step_a < step_b);
+}
+
+static int compare_distances(const void *a, const void *b) {
+  const SpatialMatch *match_a = a, *match_b = b;
+  if (match_a->distance != match_b->distance) {
+    return match_a->distance < match_b->distance ? -1 : 1;
+  }
+  return compare_steps(a, b);
+}
+
+// Squared distance of (x, y) to the box of the node, 0 inside
+static double node_distance2(const SpatialNode *node, double x, double y) {
+  double dx = fmax(fmax(node->min_x - x, x - node->max_x), 0.0);
+  double dy = fmax(fmax(node->min_y - y, y - node->max_y), 0.0);
+  return dx * dx + dy * dy;
+}
+
+static double segment_distance(const SpatialIndex *index, size_t segment,
+                               double x, double y) {
+  double start_x, start_y;
+  segment_start(index, segment, &start_x, &start_y);
+  double dx = index->x[segment] - start_x, dy = index->y[segment] - start_y;
+  double length2 = dx * dx + dy * dy;
+  double t = length2 > 0
+                 ? ((x - start_x) * dx + (y - start_y) * dy) / length2
+                 : 0.0;
+  t = fmin(fmax(t, 0.0), 1.0);
+  return hypot(start_x + t * dx - x, start_y + t * dy - y);
+}
+
+/**
+ * @brief Whether the segment touches the box (borders included), by clipping
+ * it against the four sides (Liang-Barsky).
+ */
+static int segment_crosses_box(const SpatialIndex *index, size_t segment,
+                               double min_x, double min_y, double max_x,
+                               double max_y) {
+  double start_x, start_y;
+  segment_start(index, segment, &start_x, &start_y);
+  double delta[2] = {index->x[segment] - start_x,
+                     index->y[segment] - start_y};
+  double start[2] = {start_x, start_y};
+  double min[2] = {min_x, min_y}, max[2] = {max_x, max_y};
+  double t_enter = 0.0, t_leave = 1.0;
+  for (int axis = 0; axis < 2; axis++) {
+    if (delta[axis] == 0.0) {
+      if (start[axis] < min[axis] || start[axis] > max[axis]) {
+        return 0;
+      }
+      continue;
+    }
+    double t0 = (min[axis] - start[axis]) / delta[axis];
+    double t1 = (max[axis] - start[axis]) / delta[axis];
+    t_enter = fmax(t_enter, fmin(t0, t1));
+    t_leave = fmin(t_leave, fmax(t0, t1));
+  }
+  return t_enter <= t_leave;
+}
+
+/**
+ * @brief Finds all segments that cross the box (borders included).
+ *
+ * @param results Receives the end points of the segments (segment i ends at
+ * time step i) sorted by time step, with distance 0. Previous results are
+ * cleared.
+ * @return 1 on success, 0 if the memory ran out.
+ */
+int spatial_query_box(const SpatialIndex *index, double min_x, double min_y,
+                      double max_x, double max_y, SpatialResults *results) {
+  results->length = 0;
+  if (index->num_nodes == 0) {
+    return 1;
+  }
+  size_t stack[MAX_STACK];
+  size_t depth = 0;
+  stack[depth++] = index->num_nodes - 1;
+  while (depth > 0) {
+    const SpatialNode *node = &index->nodes[stack[--depth]];
+    if (node->min_x > max_x || node->max_x < min_x || node->min_y > max_y ||
+        node->max_y < min_y) {
+      continue;
+    }
+    if (node < index->nodes + index->num_leaves) {
+      for (size_t e = node->first; e < node->first + node->count; e++) {
+        size_t segment = index->entries[e];
+        if (segment_crosses_box(index, segment, min_x, min_y, max_x, max_y) &&
+            !add_match(results, segment, 0.0)) {
+          return 0;
+        }
+      }
+    } else {
+      for (size_t c = 0; c < node->count; c++) {
+        stack[depth++] = node->first + c;
+      }
+    }
+  }
+  if (results->length > 0) {
+    qsort(results->matches, results->length, sizeof(*results->matches),
+          compare_steps);
+  }
+  return 1;
+}
+
+/**
+ * @brief Finds all segments that pass within `radius` of (x, y).
+ *
+ * @param results Receives the end points of the segments (segment i ends at
+ * time step i) sorted by time step, with the smallest distance of the
+ * segment to (x, y). Previous results are cleared.
+ * @return 1 on success, 0 if the memory ran out.
+ */
+int spatial_query_radius(const SpatialIndex *index, double x, double y,
+                         double radius, SpatialResults *results) {
+  results->length = 0;
+  if (index->num_nodes == 0) {
+    return 1;
+  }
+  double radius2 = radius * radius;
+  size_t stack[MAX_STACK];
+  size_t depth = 0;
+  stack[depth++] = index->num_nodes - 1;
+  while (depth > 0) {
+    const SpatialNode *node = &index->nodes[stack[--depth]];
+    if (node_distance2(node, x, y) > radius2) {
+      continue;
+    }
+    if (node < index->nodes + index->num_leaves) {
+      for (size_t e = node->first; e < node->first + node->count; e++) {
+        size_t segment = index->entries[e];
+        double distance = segment_distance(index, segment, x, y);
+        if (distance <= radius && !add_match(results, segment, distance)) {
+          return 0;
+        }
+      }
+    } else {
+      for (size_t c = 0; c < node->count; c++) {
+        stack[depth++] = node->first + c;
+      }
+    }
+  }
+  if (results->length > 0) {
+    qsort(results->matches, results->length, sizeof(*results->matches),
+          compare_steps);
+  }
+  return 1;
+}
+
+// Entry of the priority queue of the nearest neighbour search
+typedef struct QueuedNode {
+  double distance2;
+  size_t node;
+} QueuedNode;
+
+// Min-heap on the distance
+typedef struct NodeQueue {
+  QueuedNode *entries;
+  size_t length;
+  size_t capacity;
+} NodeQueue;
+
+static int queue_push(NodeQueue *queue, double distance2, size_t node) {
+  if (queue->length == queue->capacity) {
+    size_t capacity = queue->capacity ? 2 * queue->capacity : 256;
+    QueuedNode *grown = realloc(queue->entries, capacity * sizeof(*grown));
+    if (!grown) {
+      return 0;
+    }
+    queue->entries = grown;
+    queue->capacity = capacity;
+  }
+  QueuedNode entry = {distance2, node};
+  QueuedNode *heap = queue->entries;
+  size_t i = queue->length++;
+  while (i > 0 && heap[(i - 1) / 2].distance2 > distance2) {
+    heap[i] = heap[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  heap[i] = entry;
+  return 1;
+}
+
+static QueuedNode queue_pop(NodeQueue *queue) {
+  QueuedNode *heap = queue->entries;
+  QueuedNode top = heap[0];
+  QueuedNode last = heap[--queue->length];
+  size_t length = queue->length;
+  size_t i = 0;
+  for (;;) {
+    size_t child = 2 * i + 1;
+    if (child >= length) {
+      break;
+    }
+    if (child + 1 < length &&
+        heap[child + 1].distance2 < heap[child].distance2) {
+      child++;
+    }
+    if (heap[child].distance2 >= last.distance2) {
+      break;
+    }
+    heap[i] = heap[child];
+    i = child;
+  }
+  if (length > 0) {
+    heap[i] = last;
+  }
+  return top;
+}
+
+// The k best matches so far as a max-heap on the distance
+static void replace_farthest(SpatialMatch *best, size_t k,
+                             SpatialMatch match) {
+  size_t i = 0;
+  for (;;) {
+    size_t child = 2 * i + 1;
+    if (child >= k) {
+      break;
+    }
+    if (child + 1 < k && best[child + 1].distance > best[child].distance) {
+      child++;
+    }
+    if (best[child].distance <= match.distance) {
+      break;
+    }
+    best[i] = best[child];
+    i = child;
+  }
+  best[i] = match;
+}
+
+static void insert_match(SpatialMatch *best, size_t i, SpatialMatch match) {
+  while (i > 0 && best[(i - 1) / 2].distance < match.distance) {
+    best[i] = best[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  best[i] = match;
+}
+
+/**
+ * @brief Finds the k points closest to (x, y), considering only time steps
+ * from `first_step` on (e.g. the closest approach to the origin after step
+ * k). Best-first search: nodes are visited in the order of their distance
+ * and the search stops when no node can contain a closer point.
+ *
+ * @param results Receives up to k points sorted by distance. Previous
+ * results are cleared.
+ * @return 1 on success, 0 if the memory ran out.
+ */
+int spatial_query_nearest(const SpatialIndex *index, double x, double y,
+                          size_t k, size_t first_step,
+                          SpatialResults *results) {
+  results->length = 0;
+  if (index->num_nodes == 0 || k == 0 || first_step >= index->num_points) {
+    return 1;
+  }
+  if (k > index->num_points - first_step) {
+    k = index->num_points - first_step;
+  }
+  if (!reserve_matches(results, k)) {
+    return 0;
+  }
+
+  SpatialMatch *best = results->matches;
+  size_t found = 0;
+  NodeQueue queue = {NULL, 0, 0};
+  size_t root = index->num_nodes - 1;
+  int success =
+      queue_push(&queue, node_distance2(&index->nodes[root], x, y), root);
+  while (success && queue.length > 0) {
+    QueuedNode entry = queue_pop(&queue);
+    double bound = found == k ? best[0].distance : INFINITY;
+    if (entry.distance2 > bound * bound) {
+      break;
+    }
+    const SpatialNode *node = &index->nodes[entry.node];
+    if (entry.node < index->num_leaves) {
+      for (size_t e = node->first; e < node->first + node->count; e++) {
+        size_t step = index->entries[e];
+        if (step < first_step) {
+          continue;
+        }
+        SpatialMatch match = {step,
+                              hypot(index->x[step] - x, index->y[step] - y)};
+        if (found < k) {
+          insert_match(best, found++, match);
+        } else if (match.distance < best[0].distance) {
+          replace_farthest(best, k, match);
+        }
+      }
+    } else {
+      for (size_t c = node->first; c < node->first + node->count; c++) {
+        double distance2 = node_distance2(&index->nodes[c], x, y);
+        if ((found < k || distance2 <= best[0].distance * best[0].distance) &&
+            !queue_push(&queue, distance2, c)) {
+          success = 0;
+          break;
+        }
+      }
+    }
+  }
+  free(queue.entries);
+  results->length = found;
+  qsort(best, found, sizeof(*best), compare_distances);
+  return success;
+}
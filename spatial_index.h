@@ -0,0 +1,64 @@
+#ifndef SPATIAL_INDEX_H
+#define SPATIAL_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SPATIAL_NODE_SIZE 16 // Children per node
+#define SPATIAL_MAX_POINTS UINT32_MAX
+
+// Bounding box of a group of segments. Leaves cover entries[first, first +
+// count), inner nodes cover nodes[first, first + count).
+typedef struct SpatialNode {
+  double min_x;
+  double min_y;
+  double max_x;
+  double max_y;
+  size_t first;
+  size_t count;
+} SpatialNode;
+
+// Packed R-tree over the segments of a trajectory. Segment i goes from point
+// i - 1 to point i, segment 0 from the start position (origin) to point 0.
+// Every point is the end point of its segment, so the same tree answers point
+// and segment queries. The tree refers to the position columns, which must
+// outlive it.
+typedef struct SpatialIndex {
+  const double *x;
+  const double *y;
+  size_t num_points;
+  uint32_t *entries; // Segment numbers in Hilbert curve order
+  SpatialNode *nodes; // Leaves first, the root last
+  size_t num_nodes;
+  size_t num_leaves;
+} SpatialIndex;
+
+// A time step found by a query
+typedef struct SpatialMatch {
+  size_t step;     // Index into the position columns
+  double distance; // Of the point or segment to the query point
+} SpatialMatch;
+
+typedef struct SpatialResults {
+  SpatialMatch *matches;
+  size_t length;
+  size_t capacity;
+} SpatialResults;
+
+int spatial_index_build(SpatialIndex *index, const double *x, const double *y,
+                        size_t num_points);
+size_t spatial_index_memory_usage(const SpatialIndex *index);
+void spatial_index_free(SpatialIndex *index);
+
+void spatial_results_init(SpatialResults *results);
+void spatial_results_free(SpatialResults *results);
+
+int spatial_query_box(const SpatialIndex *index, double min_x, double min_y,
+                      double max_x, double max_y, SpatialResults *results);
+int spatial_query_radius(const SpatialIndex *index, double x, double y,
+                         double radius, SpatialResults *results);
+int spatial_query_nearest(const SpatialIndex *index, double x, double y,
+                          size_t k, size_t first_step,
+                          SpatialResults *results);
+
+#endif // SPATIAL_INDEX_H
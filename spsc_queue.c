@@ -0,0 +1,137 @@
+/**
+ * Single-producer/single-consumer ring buffer.
+ *
+ * head and tail count the pops and pushes since the start and are only
+ * reduced to a slot index with the mask, so a full queue (tail - head ==
+ * capacity) can be told apart from an empty one (tail == head). The producer
+ * publishes an item with a release store of tail after writing the slot, the
+ * consumer acquires tail before reading it; the same holds for head in the
+ * other direction, so a slot is never reused before it has been read.
+ */
+
+#include "spsc_queue.h"
+#include "timing.h"
+#include <stdlib.h>
+
+/**
+ * @brief Creates an empty queue.
+ *
+ * @param capacity Maximum number of items, rounded up to a power of two.
+ * @return 1 on success, 0 if the memory could not be allocated.
+ */
+int spsc_queue_init(SpscQueue *queue, size_t capacity) {
+  size_t size = 1;
+  while (size < capacity) {
+    size *= 2;
+  }
+  queue->slots = malloc(size * sizeof(*queue->slots));
+  queue->mask = size - 1;
+  atomic_init(&queue->tail, 0);
+  atomic_init(&queue->head, 0);
+  queue->cached_head = 0;
+  queue->cached_tail = 0;
+  queue->pushes = 0;
+  queue->full_pushes = 0;
+  queue->occupancy_sum = 0;
+  queue->max_occupancy = 0;
+  queue->empty_pops = 0;
+  return queue->slots != NULL;
+}
+
+void spsc_queue_free(SpscQueue *queue) {
+  free(queue->slots);
+  queue->slots = NULL;
+}
+
+/**
+ * @brief Appends an item unless the queue is full. Producer thread only.
+ *
+ * @return 1 if the item was added, 0 if the queue is full.
+ */
+int spsc_queue_try_push(SpscQueue *queue, void *item) {
+  size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+  if (tail - queue->cached_head > queue->mask) {
+    queue->cached_head =
+        atomic_load_explicit(&queue->head, memory_order_acquire);
+    if (tail - queue->cached_head > queue->mask) {
+      return 0;
+    }
+  }
+  queue->slots[tail & queue->mask] = item;
+  atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+
+  size_t occupancy = tail + 1 - queue->cached_head;
+  queue->pushes++;
+  queue->occupancy_sum += occupancy;
+  if (occupancy > queue->max_occupancy) {
+    queue->max_occupancy = occupancy;
+  }
+  return 1;
+}
+
+/**
+ * @brief Removes the oldest item. Consumer thread only.
+ *
+ * @return The item, NULL if the queue is empty.
+ */
+void *spsc_queue_try_pop(SpscQueue *queue) {
+  size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+  if (head == queue->cached_tail) {
+    queue->cached_tail =
+        atomic_load_explicit(&queue->tail, memory_order_acquire);
+    if (head == queue->cached_tail) {
+      return NULL;
+    }
+  }
+  void *item = queue->slots[head & queue->mask];
+  atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+  return item;
+}
+
+// Gives the other stages time to make progress while waiting
+static void back_off(int *attempts) {
+  if (++*attempts < SPSC_YIELDS_BEFORE_SLEEP) {
+    yield_thread();
+  } else {
+    sleep_milliseconds(1);
+  }
+}
+
+/**
+ * @brief Appends an item, waiting while the queue is full.
+ *
+ * @param waited Incremented by the seconds spent waiting.
+ */
+void spsc_queue_push(SpscQueue *queue, void *item, double *waited) {
+  if (spsc_queue_try_push(queue, item)) {
+    return;
+  }
+  queue->full_pushes++;
+  double start = monotonic_seconds();
+  int attempts = 0;
+  while (!spsc_queue_try_push(queue, item)) {
+    back_off(&attempts);
+  }
+  *waited += monotonic_seconds() - start;
+}
+
+/**
+ * @brief Removes the oldest item, waiting while the queue is empty. Items
+ * must not be NULL.
+ *
+ * @param waited Incremented by the seconds spent waiting.
+ */
+void *spsc_queue_pop(SpscQueue *queue, double *waited) {
+  void *item = spsc_queue_try_pop(queue);
+  if (item) {
+    return item;
+  }
+  queue->empty_pops++;
+  double start = monotonic_seconds();
+  int attempts = 0;
+  while (!(item = spsc_queue_try_pop(queue))) {
+    back_off(&attempts);
+  }
+  *waited += monotonic_seconds() - start;
+  return item;
+}
@@ -0,0 +1,40 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SPSC_CACHE_LINE 64
+#define SPSC_YIELDS_BEFORE_SLEEP 1000 // Waiting: yield first, then sleep 1 ms
+
+// Bounded lock-free queue of pointers from exactly one producer thread to
+// exactly one consumer thread. The producer's and the consumer's fields are on
+// separate cache lines, and each side caches the other side's index, so the
+// shared index is only read when the queue looks full or empty.
+typedef struct SpscQueue {
+  void **slots;
+  size_t mask; // Capacity - 1, the capacity is a power of two
+  // Producer side
+  _Alignas(SPSC_CACHE_LINE) atomic_size_t tail; // Next slot to write
+  size_t cached_head;
+  uint64_t pushes;
+  uint64_t full_pushes;   // Pushes that had to wait (backpressure)
+  // Items in the queue after every push, counting items the consumer may
+  // already have taken
+  uint64_t occupancy_sum;
+  size_t max_occupancy;
+  // Consumer side
+  _Alignas(SPSC_CACHE_LINE) atomic_size_t head; // Next slot to read
+  size_t cached_tail;
+  uint64_t empty_pops; // Pops that had to wait for an item
+} SpscQueue;
+
+int spsc_queue_init(SpscQueue *queue, size_t capacity);
+void spsc_queue_free(SpscQueue *queue);
+int spsc_queue_try_push(SpscQueue *queue, void *item);
+void *spsc_queue_try_pop(SpscQueue *queue);
+void spsc_queue_push(SpscQueue *queue, void *item, double *waited);
+void *spsc_queue_pop(SpscQueue *queue, double *waited);
+
+#endif // SPSC_QUEUE_H
@@ -0,0 +1,256 @@
+#include "statistics.h"
+#include <math.h>
+#include <stdlib.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+void running_stats_init(RunningStats *stats) {
+  stats->count = 0;
+  stats->mean = 0.0;
+  stats->m2 = 0.0;
+  stats->min = 0.0;
+  stats->max = 0.0;
+}
+
+/**
+ * @brief Adds a value using Welford's online algorithm.
+ *
+ * Unlike the `sumOfSquares / n - mean * mean` formula the update doesn't
+ * subtract two large, nearly equal numbers, so the variance stays accurate
+ * for long series.
+ */
+void running_stats_add(RunningStats *stats, double value) {
+  if (stats->count == 0) {
+    stats->min = value;
+    stats->max = value;
+  }
+  // Both checks are independent: the first value is the minimum and the
+  // maximum at the same time
+  if (value < stats->min) {
+    stats->min = value;
+  }
+  if (value > stats->max) {
+    stats->max = value;
+  }
+
+  stats->count++;
+  double delta = value - stats->mean;
+  stats->mean += delta / stats->count;
+  stats->m2 += delta * (value - stats->mean);
+}
+
+/**
+ * @brief Combines the statistics of two disjoint series (Chan et al.), e.g.
+ * of two chunks of the same flight.
+ *
+ * @param stats Receives the statistics of both series.
+ * @param other The statistics to add to `stats`.
+ */
+void running_stats_merge(RunningStats *stats, const RunningStats *other) {
+  if (other->count == 0) {
+    return;
+  }
+  if (stats->count == 0) {
+    *stats = *other;
+    return;
+  }
+
+  double count = (double)stats->count + (double)other->count;
+  double delta = other->mean - stats->mean;
+  stats->mean += delta * other->count / count;
+  stats->m2 += other->m2 + delta * delta * stats->count * other->count / count;
+  stats->count += other->count;
+  if (other->min < stats->min) {
+    stats->min = other->min;
+  }
+  if (other->max > stats->max) {
+    stats->max = other->max;
+  }
+}
+
+/**
+ * @brief The population variance of all added values.
+ */
+double running_stats_variance(const RunningStats *stats) {
+  if (stats->count <= 1) {
+    // Variance cannot be calculated for 0 or 1 values
+    return 0.0;
+  }
+  return stats->m2 / stats->count;
+}
+
+void tdigest_init(TDigest *digest) {
+  digest->num_centroids = 0;
+  digest->num_buffered = 0;
+  digest->total_weight = 0.0;
+  digest->min = INFINITY;
+  digest->max = -INFINITY;
+}
+
+static int compare_centroids(const void *a, const void *b) {
+  double mean_a = ((const Centroid *)a)->mean;
+  double mean_b = ((const Centroid *)b)->mean;
+  return (mean_a > mean_b) - (mean_a < mean_b);
+}
+
+// Scale function k1: small centroids near the tails, large ones in the middle
+static double tdigest_scale(double q) {
+  return TDIGEST_COMPRESSION / (2 * M_PI) * asin(2 * q - 1);
+}
+
+static double tdigest_inverse_scale(double k) {
+  return (sin(k * (2 * M_PI) / TDIGEST_COMPRESSION) + 1) / 2;
+}
+
+/**
+ * @brief Merges the buffered values and `extra` centroids into the digest,
+ * compressing neighbouring centroids as long as the scale function allows it.
+ */
+static void tdigest_compress(TDigest *digest, const Centroid *extra,
+                             size_t num_extra) {
+  if (digest->num_buffered == 0 && num_extra == 0) {
+    return;
+  }
+
+  Centroid merged[TDIGEST_MAX_CENTROIDS * 2 + TDIGEST_BUFFER_SIZE * 2];
+  size_t count = 0;
+  double total = 0.0;
+  for (size_t i = 0; i < digest->num_centroids; i++) {
+    merged[count++] = digest->centroids[i];
+    total += digest->centroids[i].weight;
+  }
+  for (size_t i = 0; i < num_extra; i++) {
+    merged[count++] = extra[i];
+    total += extra[i].weight;
+  }
+  for (size_t i = 0; i < digest->num_buffered; i++) {
+    merged[count].mean = digest->buffer[i];
+    merged[count].weight = 1.0;
+    count++;
+    total += 1.0;
+  }
+  qsort(merged, count, sizeof(Centroid), compare_centroids);
+
+  size_t num_centroids = 0;
+  Centroid current = merged[0];
+  double weight_so_far = 0.0;
+  double q_limit = tdigest_inverse_scale(tdigest_scale(0.0) + 1);
+
+  for (size_t i = 1; i < count; i++) {
+    double proposed = current.weight + merged[i].weight;
+    if ((weight_so_far + proposed) / total <= q_limit) {
+      // Weighted mean of both centroids
+      current.mean += (merged[i].mean - current.mean) * merged[i].weight /
+                      proposed;
+      current.weight = proposed;
+    } else {
+      digest->centroids[num_centroids++] = current;
+      weight_so_far += current.weight;
+      q_limit =
+          tdigest_inverse_scale(tdigest_scale(weight_so_far / total) + 1);
+      current = merged[i];
+    }
+  }
+  digest->centroids[num_centroids++] = current;
+
+  digest->num_centroids = num_centroids;
+  digest->num_buffered = 0;
+  digest->total_weight = total;
+}
+
+/**
+ * @brief Adds a value to the digest. Values are buffered and merged in
+ * batches, so the memory use stays constant.
+ */
+void tdigest_add(TDigest *digest, double value) {
+  if (value < digest->min) {
+    digest->min = value;
+  }
+  if (value > digest->max) {
+    digest->max = value;
+  }
+  if (digest->num_buffered == TDIGEST_BUFFER_SIZE) {
+    tdigest_compress(digest, NULL, 0);
+  }
+  digest->buffer[digest->num_buffered++] = value;
+}
+
+/**
+ * @brief Adds all values summarized by `other` to `digest`.
+ */
+void tdigest_merge(TDigest *digest, const TDigest *other) {
+  if (other->num_centroids == 0 && other->num_buffered == 0) {
+    return;
+  }
+  if (other->min < digest->min) {
+    digest->min = other->min;
+  }
+  if (other->max > digest->max) {
+    digest->max = other->max;
+  }
+
+  Centroid extra[TDIGEST_MAX_CENTROIDS + TDIGEST_BUFFER_SIZE];
+  size_t num_extra = 0;
+  for (size_t i = 0; i < other->num_centroids; i++) {
+    extra[num_extra++] = other->centroids[i];
+  }
+  for (size_t i = 0; i < other->num_buffered; i++) {
+    extra[num_extra].mean = other->buffer[i];
+    extra[num_extra].weight = 1.0;
+    num_extra++;
+  }
+  tdigest_compress(digest, extra, num_extra);
+}
+
+/**
+ * @brief Estimates the q-quantile (0 <= q <= 1) of all added values, e.g.
+ * q = 0.5 for the median.
+ *
+ * The buffered values are merged into a copy, so the digest only compresses
+ * every TDIGEST_BUFFER_SIZE values, whether or not quantiles were read in
+ * between (checkpoints of split and full runs stay identical).
+ *
+ * @return The estimate, NAN if no values were added.
+ */
+double tdigest_quantile(const TDigest *original, double q) {
+  TDigest copy = *original;
+  TDigest *digest = &copy;
+  tdigest_compress(digest, NULL, 0);
+  if (digest->num_centroids == 0) {
+    return NAN;
+  }
+  if (q <= 0.0) {
+    return digest->min;
+  }
+  if (q >= 1.0) {
+    return digest->max;
+  }
+
+  const Centroid *centroids = digest->centroids;
+  size_t n = digest->num_centroids;
+  double index = q * digest->total_weight;
+
+  // Interpolate between the centers of neighbouring centroids, the tails are
+  // interpolated towards the exact min/max
+  double cumulative = 0.0;
+  for (size_t i = 0; i < n; i++) {
+    double center = cumulative + centroids[i].weight / 2;
+    if (index < center) {
+      if (i == 0) {
+        return digest->min +
+               (centroids[0].mean - digest->min) * index / center;
+      }
+      double previous_center = cumulative - centroids[i - 1].weight / 2;
+      double t = (index - previous_center) / (center - previous_center);
+      return centroids[i - 1].mean +
+             t * (centroids[i].mean - centroids[i - 1].mean);
+    }
+    cumulative += centroids[i].weight;
+  }
+
+  double last_center = digest->total_weight - centroids[n - 1].weight / 2;
+  double t = (index - last_center) / (digest->total_weight - last_center);
+  return centroids[n - 1].mean + t * (digest->max - centroids[n - 1].mean);
+}
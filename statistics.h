@@ -0,0 +1,43 @@
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+#include <stddef.h>
+
+typedef struct RunningStats {
+  size_t count;
+  double mean;
+  double m2; // Sum of squared differences from the mean
+  double min;
+  double max;
+} RunningStats;
+
+#define TDIGEST_COMPRESSION 100
+#define TDIGEST_MAX_CENTROIDS (2 * TDIGEST_COMPRESSION)
+#define TDIGEST_BUFFER_SIZE 512
+
+typedef struct Centroid {
+  double mean;
+  double weight;
+} Centroid;
+
+typedef struct TDigest {
+  size_t num_centroids;
+  size_t num_buffered;
+  double total_weight; // Weight of the centroids, excluding the buffer
+  double min;
+  double max;
+  Centroid centroids[TDIGEST_MAX_CENTROIDS];
+  double buffer[TDIGEST_BUFFER_SIZE];
+} TDigest;
+
+void running_stats_init(RunningStats *stats);
+void running_stats_add(RunningStats *stats, double value);
+void running_stats_merge(RunningStats *stats, const RunningStats *other);
+double running_stats_variance(const RunningStats *stats);
+
+void tdigest_init(TDigest *digest);
+void tdigest_add(TDigest *digest, double value);
+void tdigest_merge(TDigest *digest, const TDigest *other);
+double tdigest_quantile(const TDigest *digest, double q);
+
+#endif // STATISTICS_H
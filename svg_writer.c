@@ -0,0 +1,369 @@
+#include "svg_writer.h"
+#include "output_buffer.h"
+#include "profiler.h"
+#include "timing.h"
+#include <float.h>
+#include <stdlib.h>
+
+#define COORDINATE_DECIMALS 3
+#define HEATMAP_CELL_SIZE 20
+
+/**
+ * @brief Squared distance of point p from the segment a-b.
+ */
+static double segment_distance2(double px, double py, double ax, double ay,
+                                double bx, double by) {
+  double dx = bx - ax;
+  double dy = by - ay;
+  double length2 = dx * dx + dy * dy;
+  double t = length2 > 0 ? ((px - ax) * dx + (py - ay) * dy) / length2 : 0;
+  t = t < 0 ? 0 : t > 1 ? 1 : t;
+  double ex = ax + t * dx - px;
+  double ey = ay + t * dy - py;
+  return ex * ex + ey * ey;
+}
+
+/**
+ * @brief Removes points that deviate less than `tolerance` from the
+ * simplified path.
+ *
+ * A linear pass first drops points closer than `tolerance` to the previously
+ * kept point, then Ramer-Douglas-Peucker (with an explicit stack, so long
+ * paths can't overflow the call stack) keeps the points that deviate more than
+ * `tolerance` from the segment between their neighbours. The first and last
+ * point are always kept.
+ *
+ * @param x X coordinates, compacted in place.
+ * @param y Y coordinates, compacted in place.
+ * @param n Number of points.
+ * @param tolerance Maximum deviation, 0 keeps every point.
+ * @return The number of remaining points.
+ */
+size_t simplify_polyline(double *x, double *y, size_t n, double tolerance) {
+  if (n < 3 || !(tolerance > 0)) {
+    return n;
+  }
+  double tolerance2 = tolerance * tolerance;
+
+  size_t m = 1;
+  for (size_t i = 1; i < n - 1; i++) {
+    double dx = x[i] - x[m - 1];
+    double dy = y[i] - y[m - 1];
+    if (dx * dx + dy * dy > tolerance2) {
+      x[m] = x[i];
+      y[m] = y[i];
+      m++;
+    }
+  }
+  x[m] = x[n - 1];
+  y[m] = y[n - 1];
+  m++;
+
+  // The intervals on the stack don't overlap and contain at least 3 points,
+  // so there are never more than m / 2 of them
+  unsigned char *keep = calloc(m, 1);
+  size_t *stack = malloc(m * sizeof(*stack));
+  if (!keep || !stack) {
+    free(keep);
+    free(stack);
+    return m; // Only the first pass
+  }
+  PROFILE_ALLOCATION(m);
+  PROFILE_ALLOCATION(m * sizeof(*stack));
+  keep[0] = keep[m - 1] = 1;
+  size_t top = 0;
+  stack[top++] = 0;
+  stack[top++] = m - 1;
+  while (top > 0) {
+    size_t last = stack[--top];
+    size_t first = stack[--top];
+    double max_distance2 = 0;
+    size_t farthest = first;
+    for (size_t i = first + 1; i < last; i++) {
+      double distance2 =
+          segment_distance2(x[i], y[i], x[first], y[first], x[last], y[last]);
+      if (distance2 > max_distance2) {
+        max_distance2 = distance2;
+        farthest = i;
+      }
+    }
+    if (max_distance2 > tolerance2) {
+      keep[farthest] = 1;
+      if (farthest - first > 1) {
+        stack[top++] = first;
+        stack[top++] = farthest;
+      }
+      if (last - farthest > 1) {
+        stack[top++] = farthest;
+        stack[top++] = last;
+      }
+    }
+  }
+
+  size_t kept = 0;
+  for (size_t i = 0; i < m; i++) {
+    if (keep[i]) {
+      x[kept] = x[i];
+      y[kept] = y[i];
+      kept++;
+    }
+  }
+  free(keep);
+  free(stack);
+  return kept;
+}
+
+/**
+ * @brief Writes points of the polyline, each preceded by a space except the
+ * very first point of the path.
+ */
+static void write_points(OutputBuffer *out, const double *x, const double *y,
+                         size_t first, size_t n) {
+  for (size_t i = first; i < n; i++) {
+    if (i > 0) {
+      output_buffer_write(out, " ", 1);
+    }
+    output_buffer_fixed(out, x[i], COORDINATE_DECIMALS);
+    output_buffer_write(out, ",", 1);
+    output_buffer_fixed(out, y[i], COORDINATE_DECIMALS);
+  }
+}
+
+/**
+ * @brief Writes the flight path as a single SVG polyline, reading and
+ * simplifying one block of time steps at a time.
+ *
+ * Every block is simplified together with the last point written before it,
+ * so consecutive pieces share their end points and the drawn path still stays
+ * within `tolerance` of every time step. For a single block the result is
+ * the same as simplifying the whole path at once.
+ *
+ * @param out An open output buffer, closed by this function.
+ * @param blocks The position after each time step (the path starts at the
+ * origin).
+ * @param offset Offset value to position the path within the visible area.
+ * @param tolerance Points deviating less than this from the drawn path are
+ * dropped, see simplify_polyline().
+ * @param stats Receives the number of points, output size and write time.
+ * @return 1 on success, 0 if the memory ran out or the output could not be
+ * written.
+ */
+int write_trajectory_blocks_svg(OutputBuffer *out,
+                                const TrajectoryBlocks *blocks, double offset,
+                                double tolerance, SvgStats *stats) {
+  double start = monotonic_seconds();
+  size_t n = blocks->block_size + 1;
+  double *x = malloc(n * sizeof(*x));
+  double *y = malloc(n * sizeof(*y));
+  if (!x || !y) {
+    free(x);
+    free(y);
+    output_buffer_close(out);
+    return 0;
+  }
+  PROFILE_ALLOCATION(n * sizeof(*x));
+  PROFILE_ALLOCATION(n * sizeof(*y));
+
+  output_buffer_printf(out,
+                       "<svg width=\"%f\" height=\"%f\" version=\"1.1\" "
+                       "xmlns=\"http://www.w3.org/2000/svg\">\n",
+                       2 * offset, 2 * offset);
+  output_buffer_puts(out, "<polyline fill=\"none\" stroke=\"orange\" "
+                          "stroke-width=\"5\" stroke-linejoin=\"round\" "
+                          "points=\"");
+  // Invert y-axis coordinates: SVGs positive y points downwards
+  // Offset values: to keep the elements within the visible area
+  x[0] = offset;
+  y[0] = offset;
+  size_t num_blocks = trajectory_blocks_count(blocks);
+  size_t written = 0;
+  if (num_blocks == 0) {
+    write_points(out, x, y, 0, 1);
+    written = 1;
+  }
+  for (size_t b = 0; b < num_blocks; b++) {
+    const Trajectory *steps = trajectory_blocks_read(blocks, b);
+    for (size_t i = 0; i < steps->length; i++) {
+      x[i + 1] = steps->x[i] + offset;
+      y[i + 1] = -steps->y[i] + offset;
+    }
+    size_t m = simplify_polyline(x, y, steps->length + 1, tolerance);
+    // The first point was written with the previous block
+    write_points(out, x, y, b > 0 ? 1 : 0, m);
+    written += b > 0 ? m - 1 : m;
+    x[0] = x[m - 1];
+    y[0] = y[m - 1];
+  }
+  output_buffer_puts(out, "\"/>\n</svg>\n");
+  free(x);
+  free(y);
+
+  stats->input_elements = blocks->length + 1;
+  stats->elements = written;
+  stats->bytes = out->bytes_written;
+  int success = output_buffer_close(out);
+  stats->seconds = monotonic_seconds() - start;
+  return success;
+}
+
+/**
+ * @brief Writes the flight path as a single SVG polyline, see
+ * write_trajectory_blocks_svg().
+ *
+ * @param out An open output buffer, closed by this function.
+ * @param trajectory The position after each time step (the path starts at the
+ * origin).
+ * @return 1 on success, 0 if the output could not be written.
+ */
+int write_trajectory_svg(OutputBuffer *out, const Trajectory *trajectory,
+                         double offset, double tolerance, SvgStats *stats) {
+  TrajectoryBlocks blocks;
+  trajectory_blocks(trajectory, &blocks);
+  return write_trajectory_blocks_svg(out, &blocks, offset, tolerance, stats);
+}
+
+/**
+ * @brief Saves the flight path as SVG file, see write_trajectory_svg().
+ *
+ * @return 1 on success, 0 if the file could not be written.
+ */
+int save_trajectory_svg(const char *filename, const Trajectory *trajectory,
+                        double offset, double tolerance, SvgStats *stats) {
+  OutputBuffer out;
+  if (!output_buffer_open(&out, filename)) {
+    return 0;
+  }
+  return write_trajectory_svg(&out, trajectory, offset, tolerance, stats);
+}
+
+/**
+ * @brief The lowest and highest average temperature of the cells, the color
+ * scale of temperature_color().
+ */
+void temperature_range(const HeatmapLevel *level, double *min_temp,
+                       double *max_temp) {
+  const HeatmapCell *cells = level->cells;
+  *min_temp = DBL_MAX;
+  *max_temp = -DBL_MAX;
+
+  // Find min/max of the average temperatures
+  for (size_t i = 0; i < level->num_cells; i++) {
+    double temp = cells[i].sum / (double)cells[i].count;
+    if (temp < *min_temp)
+      *min_temp = temp;
+    if (temp > *max_temp)
+      *max_temp = temp;
+  }
+
+  // Prevent division by zero (when calculating normalized temperature)
+  if (*max_temp == *min_temp) {
+    *max_temp += 1.0;
+  }
+}
+
+/**
+ * @brief Color of a cell: blue for the lowest and red for the highest average
+ * temperature.
+ */
+void temperature_color(const HeatmapCell *cell, double min_temp,
+                       double max_temp, int *red, int *blue) {
+  // Normalize temperature to [0,1] for color intensity
+  double norm_temp =
+      (cell->sum / (double)cell->count - min_temp) / (max_temp - min_temp);
+  *red = (int)(255 * norm_temp);
+  *blue = (int)(255 * (1 - norm_temp));
+}
+
+/**
+ * @brief Writes the temperature map in SVG format.
+ *
+ * Cells without measurements are covered by a black background. Neighbouring
+ * cells of the same color in an SVG row are merged into one rectangle, so the
+ * file size only grows with the number of color changes.
+ *
+ * @param out An open output buffer, closed by this function.
+ * @param level Occupied cells of the map with their temperature sums and
+ * counts, sorted by x and y index.
+ * @param stats Receives the number of rectangles, output size and write
+ * time.
+ * @return 1 on success, 0 if the output could not be written.
+ */
+int write_temperature_map_svg(OutputBuffer *out, const HeatmapLevel *level,
+                              SvgStats *stats) {
+  double start = monotonic_seconds();
+  const HeatmapCell *cells = level->cells;
+
+  // calculate required svg width/height
+  long long size = (long long)level->resolution * HEATMAP_CELL_SIZE;
+  output_buffer_printf(
+      out,
+      "<svg width=\"%lld\" height=\"%lld\" "
+      "xmlns=\"http://www.w3.org/2000/svg\" "
+      "style=\"transform:rotate(-90deg)\">\n"
+      "<rect x=\"0\" y=\"0\" width=\"%lld\" height=\"%lld\" "
+      "fill=\"rgb(0,0,0)\" />\n",
+      size, size, size, size);
+
+  double min_temp, max_temp;
+  temperature_range(level, &min_temp, &max_temp);
+
+  // Place SVG rectangles, row = x index, column = y index
+  // A style attribute on the SVG ensures the correct trajectory orientation
+  // instead of changing the iteration direction
+  size_t rects = 0;
+  size_t i = 0;
+  while (i < level->num_cells) {
+    int red, blue;
+    temperature_color(&cells[i], min_temp, max_temp, &red, &blue);
+    size_t run = 1;
+    while (i + run < level->num_cells && cells[i + run].x == cells[i].x &&
+           cells[i + run].y == cells[i].y + (int64_t)run) {
+      int next_red, next_blue;
+      temperature_color(&cells[i + run], min_temp, max_temp, &next_red,
+                        &next_blue);
+      if (next_red != red || next_blue != blue) {
+        break;
+      }
+      run++;
+    }
+
+    output_buffer_puts(out, "<rect x=\"");
+    output_buffer_int(out, cells[i].y * HEATMAP_CELL_SIZE);
+    output_buffer_puts(out, "\" y=\"");
+    output_buffer_int(out, cells[i].x * HEATMAP_CELL_SIZE);
+    output_buffer_puts(out, "\" width=\"");
+    output_buffer_int(out, (long long)run * HEATMAP_CELL_SIZE);
+    output_buffer_puts(out, "\" height=\"");
+    output_buffer_int(out, HEATMAP_CELL_SIZE);
+    output_buffer_puts(out, "\" fill=\"rgb(");
+    output_buffer_int(out, red);
+    output_buffer_puts(out, ",0,");
+    output_buffer_int(out, blue);
+    output_buffer_puts(out, ")\" />\n");
+    rects++;
+    i += run;
+  }
+  output_buffer_puts(out, "</svg>\n");
+
+  stats->input_elements = level->num_cells;
+  stats->elements = rects;
+  stats->bytes = out->bytes_written;
+  int success = output_buffer_close(out);
+  stats->seconds = monotonic_seconds() - start;
+  return success;
+}
+
+/**
+ * @brief Saves the temperature map as SVG file, see
+ * write_temperature_map_svg().
+ *
+ * @return 1 on success, 0 if the file could not be written.
+ */
+int save_temperature_map_svg(const char *filename, const HeatmapLevel *level,
+                             SvgStats *stats) {
+  OutputBuffer out;
+  if (!output_buffer_open(&out, filename)) {
+    return 0;
+  }
+  return write_temperature_map_svg(&out, level, stats);
+}
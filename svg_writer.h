@@ -0,0 +1,37 @@
+#ifndef SVG_WRITER_H
+#define SVG_WRITER_H
+
+#include "heatmap.h"
+#include "output_buffer.h"
+#include "trajectory.h"
+#include <stddef.h>
+
+// Default trajectory simplification: deviations below 0.1 units are hidden by
+// the 5 unit wide stroke
+#define SVG_DEFAULT_TOLERANCE 0.1
+
+typedef struct SvgStats {
+  size_t input_elements; // Path points or occupied heatmap cells
+  size_t elements;       // Points or rectangles written
+  size_t bytes;
+  double seconds;
+} SvgStats;
+
+size_t simplify_polyline(double *x, double *y, size_t n, double tolerance);
+int write_trajectory_blocks_svg(OutputBuffer *out,
+                                const TrajectoryBlocks *blocks, double offset,
+                                double tolerance, SvgStats *stats);
+int write_trajectory_svg(OutputBuffer *out, const Trajectory *trajectory,
+                         double offset, double tolerance, SvgStats *stats);
+int save_trajectory_svg(const char *filename, const Trajectory *trajectory,
+                        double offset, double tolerance, SvgStats *stats);
+void temperature_range(const HeatmapLevel *level, double *min_temp,
+                       double *max_temp);
+void temperature_color(const HeatmapCell *cell, double min_temp,
+                       double max_temp, int *red, int *blue);
+int write_temperature_map_svg(OutputBuffer *out, const HeatmapLevel *level,
+                              SvgStats *stats);
+int save_temperature_map_svg(const char *filename, const HeatmapLevel *level,
+                             SvgStats *stats);
+
+#endif // SVG_WRITER_H
@@ -0,0 +1,55 @@
+#include "synthetic_flight.h"
+#include "output_buffer.h"
+#include <stdio.h>
+
+/**
+ * @brief SplitMix64: a small generator whose sequence only depends on the
+ * seed, unlike rand(), which differs between C libraries.
+ */
+static uint64_t next_random(uint64_t *state) {
+  uint64_t z = (*state += UINT64_C(0x9E3779B97F4A7C15));
+  z = (z ^ (z >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+  z = (z ^ (z >> 27)) * UINT64_C(0x94D049BB133111EB);
+  return z ^ (z >> 31);
+}
+
+// Uniformly distributed in [-1, 1)
+static double random_signed(uint64_t *state) {
+  return (double)(next_random(state) >> 11) * 0x1p-52 - 1.0;
+}
+
+/**
+ * @brief Writes a synthetic spaceship data file: one "acceleration,rotation,
+ * temperature" row per time step, in the format of the provided files.
+ *
+ * Acceleration and rotation are noise around 0 with the value range of the
+ * provided files, the temperature drifts around 20 degrees. The file only
+ * depends on `rows` and `seed`, so benchmarks of different versions read the
+ * same input.
+ *
+ * @param filename The file to create.
+ * @param rows Number of time steps.
+ * @param seed Any number, 0 included.
+ * @return 1 on success, 0 if the file could not be written.
+ */
+int generate_flight_csv(const char *filename, uint64_t rows, uint64_t seed) {
+  OutputBuffer out;
+  if (!output_buffer_open(&out, filename)) {
+    return 0;
+  }
+  uint64_t state = seed;
+  double temperature = 20.0;
+  for (uint64_t i = 0; i < rows; i++) {
+    // Sums of two uniform numbers: small values are more likely
+    double acceleration = random_signed(&state) + random_signed(&state);
+    double rotation = 1.5 * (random_signed(&state) + random_signed(&state));
+    temperature += 0.02 * (20.0 - temperature) + random_signed(&state);
+    output_buffer_fixed(&out, acceleration, 9);
+    output_buffer_write(&out, ",", 1);
+    output_buffer_fixed(&out, rotation, 9);
+    output_buffer_write(&out, ",", 1);
+    output_buffer_fixed(&out, temperature, 6);
+    output_buffer_write(&out, "\n", 1);
+  }
+  return output_buffer_close(&out);
+}
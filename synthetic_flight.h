@@ -0,0 +1,8 @@
+#ifndef SYNTHETIC_FLIGHT_H
+#define SYNTHETIC_FLIGHT_H
+
+#include <stdint.h>
+
+int generate_flight_csv(const char *filename, uint64_t rows, uint64_t seed);
+
+#endif // SYNTHETIC_FLIGHT_H
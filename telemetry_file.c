@@ -0,0 +1,419 @@
+/**
+ * Compact binary telemetry files, converted from the spaceship data CSV.
+ *
+ * File format (native byte order, like the flight database):
+ *   16 byte header: magic "SPCTELEM", uint32 version, uint32 sizeof(double)
+ *   blocks of up to CHUNK_SIZE rows, each with a 64 byte header (uint32
+ *     rows, uint32 bytes of each column, then the minimum and the maximum of
+ *     each column as doubles) followed by the compressed acceleration,
+ *     rotation and temperature columns.
+ *
+ * The columns are compressed like the values of Gorilla (Pelkonen et al.,
+ * 2015): the first value of a block is stored as is, every further value as
+ * the XOR with the previous one. A "0" bit stands for the same value, "10"
+ * for an XOR whose set bits fit into the window of the previous XOR (only
+ * the window is stored), "11" for a new window: 5 bits leading zeros, 6 bits
+ * length - 1 and the bits of the window. The bits are stored most significant
+ * first, so the streams themselves don't depend on the byte order.
+ *
+ * Blocks can be decoded on their own, and the block headers allow skipping
+ * blocks without decoding them, e.g. if their temperature range is of no
+ * interest. The decoded values are exactly the values of the CSV parser.
+ */
+
+#include "telemetry_file.h"
+#include "csv_parser.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TELEMETRY_MAGIC "SPCTELEM"
+#define TELEMETRY_VERSION 1
+// Worst case of a column: 64 bits for the first value, 2 + 5 + 6 + 64 bits
+// for every further one
+#define MAX_COLUMN_BYTES                                                      \
+  ((64 + (CHUNK_SIZE - 1) * 77 + 7) / 8 + TELEMETRY_COLUMN_PADDING)
+
+static uint64_t double_bits(double value) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+static double bits_double(uint64_t bits) {
+  double value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+// Number of zero bits above the highest set bit, x must not be 0
+static int leading_zeros(uint64_t x) {
+#if defined(__GNUC__)
+  return __builtin_clzll(x);
+#else
+  int n = 0;
+  for (; !(x >> 63); x <<= 1) {
+    n++;
+  }
+  return n;
+#endif
+}
+
+// Number of zero bits below the lowest set bit, x must not be 0
+static int trailing_zeros(uint64_t x) {
+#if defined(__GNUC__)
+  return __builtin_ctzll(x);
+#else
+  int n = 0;
+  for (; !(x & 1); x >>= 1) {
+    n++;
+  }
+  return n;
+#endif
+}
+
+typedef struct BitWriter {
+  unsigned char *data;
+  size_t length;    // Complete bytes
+  uint64_t pending; // The last `num_pending` bits are not written yet
+  int num_pending;
+} BitWriter;
+
+// Appends the lowest n bits of value, n <= 32
+static void write_bits(BitWriter *writer, uint64_t value, int n) {
+  writer->pending = (writer->pending << n) | value;
+  writer->num_pending += n;
+  while (writer->num_pending >= 8) {
+    writer->num_pending -= 8;
+    writer->data[writer->length++] =
+        (unsigned char)(writer->pending >> writer->num_pending);
+  }
+}
+
+// Appends the lowest n bits of value, n <= 64
+static void write_long(BitWriter *writer, uint64_t value, int n) {
+  if (n > 32) {
+    write_bits(writer, value >> 32, n - 32);
+    write_bits(writer, value & 0xffffffffu, 32);
+  } else {
+    write_bits(writer, value, n);
+  }
+}
+
+/**
+ * @brief Compresses a column of n >= 1 values.
+ *
+ * @param data Receives the bits, padded with TELEMETRY_COLUMN_PADDING zero
+ * bytes. Must have room for MAX_COLUMN_BYTES.
+ * @return The number of bytes written.
+ */
+static size_t encode_column(const double *values, size_t n,
+                            unsigned char *data) {
+  BitWriter writer = {data, 0, 0, 0};
+  uint64_t previous = double_bits(values[0]);
+  write_long(&writer, previous, 64);
+  int leading = -1, trailing = 0; // Window of the last XOR, -1: none yet
+  for (size_t i = 1; i < n; i++) {
+    uint64_t bits = double_bits(values[i]);
+    uint64_t xor = bits ^ previous;
+    previous = bits;
+    if (xor == 0) {
+      write_bits(&writer, 0, 1);
+      continue;
+    }
+    int new_leading = leading_zeros(xor);
+    int new_trailing = trailing_zeros(xor);
+    if (new_leading > 31) {
+      new_leading = 31; // Only 5 bits
+    }
+    if (leading >= 0 && new_leading >= leading && new_trailing >= trailing) {
+      write_bits(&writer, 2, 2);
+      write_long(&writer, xor >> trailing, 64 - leading - trailing);
+    } else {
+      leading = new_leading;
+      trailing = new_trailing;
+      int meaningful = 64 - leading - trailing;
+      write_bits(&writer, 3, 2);
+      write_bits(&writer, (uint64_t)leading, 5);
+      write_bits(&writer, (uint64_t)(meaningful - 1), 6);
+      write_long(&writer, xor >> trailing, meaningful);
+    }
+  }
+  if (writer.num_pending > 0) {
+    writer.data[writer.length++] =
+        (unsigned char)(writer.pending << (8 - writer.num_pending));
+  }
+  memset(writer.data + writer.length, 0, TELEMETRY_COLUMN_PADDING);
+  return writer.length + TELEMETRY_COLUMN_PADDING;
+}
+
+static uint64_t load_big_endian(const unsigned char *p) {
+  return (uint64_t)p[0] << 56 | (uint64_t)p[1] << 48 | (uint64_t)p[2] << 40 |
+         (uint64_t)p[3] << 32 | (uint64_t)p[4] << 24 | (uint64_t)p[5] << 16 |
+         (uint64_t)p[6] << 8 | (uint64_t)p[7];
+}
+
+// Reads n bits (1 <= n <= 64) at the bit position and advances it
+static uint64_t read_bits(const unsigned char *data, size_t *position,
+                          int n) {
+  const unsigned char *p = data + (*position >> 3);
+  int shift = (int)(*position & 7);
+  uint64_t word = load_big_endian(p) << shift;
+  if (shift + n > 64) {
+    word |= (uint64_t)p[8] >> (8 - shift);
+  }
+  *position += (size_t)n;
+  return word >> (64 - n);
+}
+
+/**
+ * @brief Decompresses a column of n values.
+ *
+ * @return 1 on success, 0 if the bits are not a valid column.
+ */
+static int decode_column(const unsigned char *data, size_t bytes, size_t n,
+                         double *values) {
+  // Every value starts before the padding, so a value (at most 77 bits) never
+  // reads beyond it
+  size_t limit = (bytes - TELEMETRY_COLUMN_PADDING) * 8;
+  size_t position = 0;
+  uint64_t previous = read_bits(data, &position, 64);
+  values[0] = bits_double(previous);
+  int meaningful = 0, trailing = 0;
+  for (size_t i = 1; i < n; i++) {
+    if (position >= limit) {
+      return 0;
+    }
+    uint64_t control = read_bits(data, &position, 1);
+    if (control == 0) {
+      values[i] = values[i - 1];
+      continue;
+    }
+    if (read_bits(data, &position, 1)) {
+      int leading = (int)read_bits(data, &position, 5);
+      meaningful = (int)read_bits(data, &position, 6) + 1;
+      trailing = 64 - leading - meaningful;
+      if (trailing < 0) {
+        return 0;
+      }
+    } else if (meaningful == 0) {
+      return 0; // No window yet
+    }
+    previous ^= read_bits(data, &position, meaningful) << trailing;
+    values[i] = bits_double(previous);
+  }
+  return position <= limit;
+}
+
+/**
+ * @brief Writes one block: the header and the compressed columns of a chunk.
+ *
+ * @param data Receives the block, must have room for
+ * TELEMETRY_BLOCK_HEADER_SIZE + TELEMETRY_NUM_COLUMNS * MAX_COLUMN_BYTES.
+ * @return The size of the block in bytes.
+ */
+static size_t encode_block(const TelemetryChunk *chunk, unsigned char *data) {
+  const double *columns[TELEMETRY_NUM_COLUMNS] = {
+      chunk->acceleration, chunk->rotation, chunk->temperature};
+  uint32_t counts[1 + TELEMETRY_NUM_COLUMNS] = {(uint32_t)chunk->length};
+  double min[TELEMETRY_NUM_COLUMNS], max[TELEMETRY_NUM_COLUMNS];
+  size_t size = TELEMETRY_BLOCK_HEADER_SIZE;
+  for (int c = 0; c < TELEMETRY_NUM_COLUMNS; c++) {
+    min[c] = max[c] = columns[c][0];
+    for (size_t i = 1; i < chunk->length; i++) {
+      if (columns[c][i] < min[c]) {
+        min[c] = columns[c][i];
+      }
+      if (columns[c][i] > max[c]) {
+        max[c] = columns[c][i];
+      }
+    }
+    size_t bytes = encode_column(columns[c], chunk->length, data + size);
+    counts[1 + c] = (uint32_t)bytes;
+    size += bytes;
+  }
+  memcpy(data, counts, sizeof(counts));
+  memcpy(data + sizeof(counts), min, sizeof(min));
+  memcpy(data + sizeof(counts) + sizeof(min), max, sizeof(max));
+  return size;
+}
+
+/**
+ * @brief Checks the header of a telemetry file and prepares reading its
+ * blocks.
+ *
+ * @param data The whole file, e.g. mapped.
+ * @return 1 if it is a telemetry file, 0 if it is not (e.g. a CSV file). A
+ * telemetry file of another version is reported and has no blocks.
+ */
+int telemetry_open(TelemetryReader *reader, const char *data, size_t size) {
+  if (size < TELEMETRY_HEADER_SIZE ||
+      memcmp(data, TELEMETRY_MAGIC, 8) != 0) {
+    return 0;
+  }
+  uint32_t version, double_size;
+  memcpy(&version, data + 8, sizeof(version));
+  memcpy(&double_size, data + 12, sizeof(double_size));
+  if (version != TELEMETRY_VERSION || double_size != sizeof(double)) {
+    printf("Warning: Unsupported telemetry file (version %u, %u byte "
+           "doubles)\n",
+           (unsigned)version, (unsigned)double_size);
+    telemetry_reader_init(reader, data + size, 0);
+    return 1;
+  }
+  telemetry_reader_init(reader, data + TELEMETRY_HEADER_SIZE,
+                        size - TELEMETRY_HEADER_SIZE);
+  return 1;
+}
+
+/**
+ * @brief Prepares reading a range of whole blocks, e.g. a slice of the file
+ * for one thread.
+ */
+void telemetry_reader_init(TelemetryReader *reader, const char *blocks,
+                           size_t size) {
+  reader->cursor = blocks;
+  reader->end = blocks + size;
+  reader->malformed_rows = 0;
+}
+
+/**
+ * @brief Reads the header of the next block without decoding its columns.
+ *
+ * @return 1 if a block was read, 0 at the end of the data or if the block
+ * header doesn't fit the rest of the data. The cursor then stays at the
+ * corrupt block.
+ */
+int telemetry_next_block(TelemetryReader *reader, TelemetryBlock *block) {
+  size_t remaining = (size_t)(reader->end - reader->cursor);
+  if (remaining == 0) {
+    return 0;
+  }
+  const unsigned char *data = (const unsigned char *)reader->cursor;
+  uint32_t counts[1 + TELEMETRY_NUM_COLUMNS];
+  int ok = remaining >= TELEMETRY_BLOCK_HEADER_SIZE;
+  size_t size = TELEMETRY_BLOCK_HEADER_SIZE;
+  if (ok) {
+    memcpy(counts, data, sizeof(counts));
+    memcpy(block->min, data + sizeof(counts), sizeof(block->min));
+    memcpy(block->max, data + sizeof(counts) + sizeof(block->min),
+           sizeof(block->max));
+    block->rows = counts[0];
+    ok = block->rows >= 1 && block->rows <= CHUNK_SIZE;
+  }
+  for (int c = 0; ok && c < TELEMETRY_NUM_COLUMNS; c++) {
+    block->columns[c] = data + size;
+    block->column_bytes[c] = counts[1 + c];
+    ok = counts[1 + c] >= TELEMETRY_COLUMN_PADDING + 8 &&
+         counts[1 + c] <= remaining - size;
+    size += counts[1 + c];
+  }
+  if (!ok) {
+    return 0;
+  }
+  reader->cursor += size;
+  return 1;
+}
+
+/**
+ * @brief Decodes one column of a block.
+ *
+ * @param values Receives block->rows values.
+ * @return 1 on success, 0 if the column is corrupt.
+ */
+int telemetry_decode_column(const TelemetryBlock *block,
+                            TelemetryColumn column, double *values) {
+  return decode_column(block->columns[column], block->column_bytes[column],
+                       block->rows, values);
+}
+
+/**
+ * @brief Decodes the next block into a chunk, the binary counterpart of
+ * csv_read_chunk(). Corrupt blocks are reported and skipped; after a corrupt
+ * block header the rest of the data is skipped.
+ *
+ * @return The number of rows read, 0 once the end of the data is reached.
+ */
+size_t telemetry_read_chunk(TelemetryReader *reader, TelemetryChunk *chunk) {
+  TelemetryBlock block;
+  chunk->length = 0;
+  while (telemetry_next_block(reader, &block)) {
+    if (telemetry_decode_column(&block, TELEMETRY_ACCELERATION,
+                                chunk->acceleration) &&
+        telemetry_decode_column(&block, TELEMETRY_ROTATION,
+                                chunk->rotation) &&
+        telemetry_decode_column(&block, TELEMETRY_TEMPERATURE,
+                                chunk->temperature)) {
+      chunk->length = block.rows;
+      break;
+    }
+    reader->malformed_rows += block.rows;
+    printf("Warning: Skipping a corrupt telemetry block of %zu rows\n",
+           block.rows);
+  }
+  if (chunk->length == 0 && reader->cursor < reader->end) {
+    printf("Warning: Skipping %zu bytes of corrupt telemetry data\n",
+           (size_t)(reader->end - reader->cursor));
+    reader->cursor = reader->end;
+  }
+  return chunk->length;
+}
+
+/**
+ * @brief Converts spaceship data from CSV into a telemetry file, one block
+ * per chunk of CHUNK_SIZE rows. The file is written to "<filename>.tmp"
+ * first and then renamed.
+ *
+ * @param rows Receives the number of rows written.
+ * @param malformed_rows Receives the number of skipped CSV rows.
+ * @return 1 on success, 0 if the memory or the file could not be written.
+ */
+int telemetry_convert(const MappedFile *csv, const char *filename,
+                      size_t *rows, size_t *malformed_rows) {
+  *rows = 0;
+  *malformed_rows = 0;
+  char temporary[1024];
+  if (snprintf(temporary, sizeof(temporary), "%s.tmp", filename) >=
+      (int)sizeof(temporary)) {
+    return 0;
+  }
+  TelemetryChunk *chunk = malloc(sizeof(*chunk));
+  unsigned char *block = malloc(TELEMETRY_BLOCK_HEADER_SIZE +
+                                TELEMETRY_NUM_COLUMNS * MAX_COLUMN_BYTES);
+  FILE *file = chunk && block ? fopen(temporary, "wb") : NULL;
+  if (!file) {
+    free(chunk);
+    free(block);
+    return 0;
+  }
+
+  unsigned char header[TELEMETRY_HEADER_SIZE];
+  uint32_t version = TELEMETRY_VERSION;
+  uint32_t double_size = sizeof(double);
+  memcpy(header, TELEMETRY_MAGIC, 8);
+  memcpy(header + 8, &version, sizeof(version));
+  memcpy(header + 12, &double_size, sizeof(double_size));
+  int ok = fwrite(header, 1, sizeof(header), file) == sizeof(header);
+
+  CsvParser parser;
+  csv_parser_init(&parser, csv->data, csv->size);
+  while (ok && csv_read_chunk(&parser, chunk) > 0) {
+    size_t size = encode_block(chunk, block);
+    ok = fwrite(block, 1, size, file) == size;
+    *rows += chunk->length;
+  }
+  *malformed_rows = parser.malformed_rows;
+  free(chunk);
+  free(block);
+
+  ok = (fclose(file) == 0) && ok;
+#ifdef _WIN32
+  remove(filename); // rename() doesn't replace existing files on Windows
+#endif
+  if (!ok || rename(temporary, filename) != 0) {
+    remove(temporary);
+    return 0;
+  }
+  return 1;
+}
@@ -0,0 +1,46 @@
+#ifndef TELEMETRY_FILE_H
+#define TELEMETRY_FILE_H
+
+#include "mapped_file.h"
+#include "trajectory.h"
+#include <stddef.h>
+
+#define TELEMETRY_HEADER_SIZE 16
+#define TELEMETRY_BLOCK_HEADER_SIZE 64
+#define TELEMETRY_NUM_COLUMNS 3
+// Zero bytes after every column, so that the decoder can always load 8 bytes
+#define TELEMETRY_COLUMN_PADDING 16
+
+typedef enum TelemetryColumn {
+  TELEMETRY_ACCELERATION,
+  TELEMETRY_ROTATION,
+  TELEMETRY_TEMPERATURE
+} TelemetryColumn;
+
+// One block of a telemetry file: up to CHUNK_SIZE rows, every column
+// compressed on its own, pointing into the mapped file
+typedef struct TelemetryBlock {
+  size_t rows;
+  double min[TELEMETRY_NUM_COLUMNS];
+  double max[TELEMETRY_NUM_COLUMNS];
+  const unsigned char *columns[TELEMETRY_NUM_COLUMNS];
+  size_t column_bytes[TELEMETRY_NUM_COLUMNS]; // Including the padding
+} TelemetryBlock;
+
+typedef struct TelemetryReader {
+  const char *cursor; // Next block header
+  const char *end;
+  size_t malformed_rows; // Rows of corrupt blocks
+} TelemetryReader;
+
+int telemetry_open(TelemetryReader *reader, const char *data, size_t size);
+void telemetry_reader_init(TelemetryReader *reader, const char *blocks,
+                           size_t size);
+int telemetry_next_block(TelemetryReader *reader, TelemetryBlock *block);
+int telemetry_decode_column(const TelemetryBlock *block,
+                            TelemetryColumn column, double *values);
+size_t telemetry_read_chunk(TelemetryReader *reader, TelemetryChunk *chunk);
+int telemetry_convert(const MappedFile *csv, const char *filename,
+                      size_t *rows, size_t *malformed_rows);
+
+#endif // TELEMETRY_FILE_H
@@ -0,0 +1,125 @@
+#include "thread_pool.h"
+#include <stdlib.h>
+
+/**
+ * @brief Executes tasks of the current job until none are left. Must be
+ * called with the pool lock held, returns with the lock held.
+ */
+static void work_on_tasks(ThreadPool *pool) {
+  while (pool->next_task < pool->num_tasks) {
+    size_t task_index = pool->next_task++;
+    TaskFunction function = pool->function;
+    void *context = pool->context;
+
+    pthread_mutex_unlock(&pool->lock);
+    function(context, task_index);
+    pthread_mutex_lock(&pool->lock);
+
+    pool->tasks_finished++;
+    if (pool->tasks_finished == pool->num_tasks) {
+      pthread_cond_broadcast(&pool->work_done);
+    }
+  }
+}
+
+static void *worker_main(void *argument) {
+  ThreadPool *pool = argument;
+  unsigned long seen_generation = 0;
+
+  pthread_mutex_lock(&pool->lock);
+  while (1) {
+    while (!pool->shutdown && pool->generation == seen_generation) {
+      pthread_cond_wait(&pool->work_available, &pool->lock);
+    }
+    if (pool->shutdown) {
+      break;
+    }
+    seen_generation = pool->generation;
+    work_on_tasks(pool);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+/**
+ * @brief Starts `num_threads` worker threads that wait for jobs. Since the
+ * thread calling thread_pool_run() works on the tasks as well, a pool with
+ * 0 worker threads is valid and runs everything on the caller.
+ *
+ * @return 1 on success, 0 if the threads could not be created.
+ */
+int thread_pool_create(ThreadPool *pool, int num_threads) {
+  if (num_threads < 0) {
+    num_threads = 0;
+  }
+  pool->threads = malloc((num_threads + 1) * sizeof(*pool->threads));
+  if (!pool->threads) {
+    return 0;
+  }
+  pool->num_threads = 0;
+  pool->function = NULL;
+  pool->context = NULL;
+  pool->num_tasks = 0;
+  pool->next_task = 0;
+  pool->tasks_finished = 0;
+  pool->generation = 0;
+  pool->shutdown = 0;
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->work_available, NULL);
+  pthread_cond_init(&pool->work_done, NULL);
+
+  for (int i = 0; i < num_threads; i++) {
+    if (pthread_create(&pool->threads[i], NULL, worker_main, pool) != 0) {
+      thread_pool_destroy(pool);
+      return 0;
+    }
+    pool->num_threads++;
+  }
+  return 1;
+}
+
+/**
+ * @brief Calls `function(context, i)` for every i in [0, num_tasks) on the
+ * worker threads and waits until all tasks have finished. The calling thread
+ * helps with the work.
+ */
+void thread_pool_run(ThreadPool *pool, size_t num_tasks, TaskFunction function,
+                     void *context) {
+  if (num_tasks == 0) {
+    return;
+  }
+  pthread_mutex_lock(&pool->lock);
+  pool->function = function;
+  pool->context = context;
+  pool->num_tasks = num_tasks;
+  pool->next_task = 0;
+  pool->tasks_finished = 0;
+  pool->generation++;
+  pthread_cond_broadcast(&pool->work_available);
+
+  work_on_tasks(pool);
+  while (pool->tasks_finished < pool->num_tasks) {
+    pthread_cond_wait(&pool->work_done, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * @brief Stops and joins all worker threads.
+ */
+void thread_pool_destroy(ThreadPool *pool) {
+  pthread_mutex_lock(&pool->lock);
+  pool->shutdown = 1;
+  pthread_cond_broadcast(&pool->work_available);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (int i = 0; i < pool->num_threads; i++) {
+    pthread_join(pool->threads[i], NULL);
+  }
+  free(pool->threads);
+  pool->threads = NULL;
+  pool->num_threads = 0;
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->work_available);
+  pthread_cond_destroy(&pool->work_done);
+}
@@ -0,0 +1,30 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+typedef void (*TaskFunction)(void *context, size_t task_index);
+
+typedef struct ThreadPool {
+  pthread_t *threads;
+  int num_threads;
+  pthread_mutex_t lock;
+  pthread_cond_t work_available;
+  pthread_cond_t work_done;
+  // The job currently being executed, guarded by `lock`
+  TaskFunction function;
+  void *context;
+  size_t num_tasks;
+  size_t next_task;
+  size_t tasks_finished;
+  unsigned long generation; // Incremented for every job
+  int shutdown;
+} ThreadPool;
+
+int thread_pool_create(ThreadPool *pool, int num_threads);
+void thread_pool_run(ThreadPool *pool, size_t num_tasks, TaskFunction function,
+                     void *context);
+void thread_pool_destroy(ThreadPool *pool);
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,48 @@
+// clock_gettime(), nanosleep() and sched_yield() are POSIX, not part of strict
+// ISO C builds (-std=c11)
+#define _POSIX_C_SOURCE 200809L
+
+#include "timing.h"
+
+#ifdef _WIN32
+#include <windows.h>
+
+/**
+ * @brief Seconds since an arbitrary starting point, only useful for measuring
+ * durations. Unaffected by changes of the system time.
+ */
+double monotonic_seconds(void) {
+  LARGE_INTEGER frequency, counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  return (double)counter.QuadPart / (double)frequency.QuadPart;
+}
+
+void sleep_milliseconds(int milliseconds) { Sleep((DWORD)milliseconds); }
+
+// Lets other threads run, e.g. while waiting for another pipeline stage
+void yield_thread(void) { SwitchToThread(); }
+#else
+#include <sched.h>
+#include <time.h>
+
+/**
+ * @brief Seconds since an arbitrary starting point, only useful for measuring
+ * durations. Unaffected by changes of the system time.
+ */
+double monotonic_seconds(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+void sleep_milliseconds(int milliseconds) {
+  struct timespec duration;
+  duration.tv_sec = milliseconds / 1000;
+  duration.tv_nsec = (long)(milliseconds % 1000) * 1000000L;
+  nanosleep(&duration, NULL);
+}
+
+// Lets other threads run, e.g. while waiting for another pipeline stage
+void yield_thread(void) { sched_yield(); }
+#endif
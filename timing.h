@@ -0,0 +1,8 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+double monotonic_seconds(void);
+void sleep_milliseconds(int milliseconds);
+void yield_thread(void);
+
+#endif // TIMING_H
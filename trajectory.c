@@ -0,0 +1,303 @@
+/**
+ * Columnar trajectory store.
+ *
+ * Binary file format (all numbers little endian):
+ *   64 byte header: magic "SPCTRAJ1", uint32 version, uint32 number of
+ *                   columns, uint64 number of rows, zero padding
+ *   columns:        x, y, rotation, velocity x, velocity y, temperature, each
+ *                   as `rows` consecutive IEEE 754 doubles
+ *
+ * The columns start at multiples of 8 bytes, so a mapped file can be used in
+ * place without copying.
+ */
+
+#include "trajectory.h"
+#include "profiler.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_CAPACITY 1024
+#define FILE_MAGIC "SPCTRAJ1"
+#define FILE_VERSION 1
+#define HEADER_SIZE 64
+#define CSV_BUFFER_SIZE (1 << 20)
+
+/**
+ * @brief Pointers to all column pointers, in file order.
+ */
+static void get_columns(Trajectory *trajectory,
+                        double **columns[TRAJECTORY_NUM_COLUMNS]) {
+  columns[0] = &trajectory->x;
+  columns[1] = &trajectory->y;
+  columns[2] = &trajectory->rotation;
+  columns[3] = &trajectory->velocity_x;
+  columns[4] = &trajectory->velocity_y;
+  columns[5] = &trajectory->temperature;
+}
+
+static int is_little_endian(void) {
+  const uint16_t one = 1;
+  return *(const uint8_t *)&one == 1;
+}
+
+void trajectory_init(Trajectory *trajectory) {
+  double **columns[TRAJECTORY_NUM_COLUMNS];
+  get_columns(trajectory, columns);
+  for (int c = 0; c < TRAJECTORY_NUM_COLUMNS; c++) {
+    *columns[c] = NULL;
+  }
+  trajectory->length = 0;
+  trajectory->capacity = 0;
+  trajectory->mapping.data = NULL;
+  trajectory->mapping.size = 0;
+}
+
+/**
+ * @brief Makes sure the trajectory can hold at least `capacity` time steps.
+ *
+ * @param trajectory The trajectory to grow.
+ * @param capacity Minimum number of time steps to reserve memory for.
+ * @return 1 on success, 0 if the memory could not be allocated or the
+ * trajectory is a read only mapping.
+ */
+int trajectory_reserve(Trajectory *trajectory, size_t capacity) {
+  if (trajectory->mapping.data) {
+    return 0;
+  }
+  if (capacity <= trajectory->capacity) {
+    return 1;
+  }
+
+  double **columns[TRAJECTORY_NUM_COLUMNS];
+  get_columns(trajectory, columns);
+  for (int c = 0; c < TRAJECTORY_NUM_COLUMNS; c++) {
+    double *column = realloc(*columns[c], capacity * sizeof(double));
+    if (!column) {
+      // Columns that were already grown keep their bigger allocation, the
+      // capacity stays the old one
+      return 0;
+    }
+    *columns[c] = column;
+    PROFILE_ALLOCATION(capacity * sizeof(double));
+  }
+  trajectory->capacity = capacity;
+  return 1;
+}
+
+/**
+ * @brief Sets the number of time steps, doubling the capacity whenever it
+ * runs out. New time steps are uninitialized.
+ *
+ * @return 1 on success, 0 if the memory could not be allocated.
+ */
+int trajectory_resize(Trajectory *trajectory, size_t length) {
+  if (length > trajectory->capacity) {
+    size_t new_capacity =
+        trajectory->capacity ? trajectory->capacity : INITIAL_CAPACITY;
+    while (new_capacity < length) {
+      new_capacity *= 2;
+    }
+    if (!trajectory_reserve(trajectory, new_capacity)) {
+      return 0;
+    }
+  }
+  trajectory->length = length;
+  return 1;
+}
+
+/**
+ * @brief Number of bytes currently allocated by the trajectory columns.
+ */
+size_t trajectory_memory_usage(const Trajectory *trajectory) {
+  return trajectory->capacity * TRAJECTORY_NUM_COLUMNS * sizeof(double);
+}
+
+void trajectory_free(Trajectory *trajectory) {
+  if (trajectory->mapping.data) {
+    unmap_file(&trajectory->mapping);
+  } else {
+    double **columns[TRAJECTORY_NUM_COLUMNS];
+    get_columns(trajectory, columns);
+    for (int c = 0; c < TRAJECTORY_NUM_COLUMNS; c++) {
+      free(*columns[c]);
+    }
+  }
+  trajectory_init(trajectory);
+}
+
+static void put_u32(unsigned char *bytes, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    bytes[i] = (unsigned char)(value >> (8 * i));
+  }
+}
+
+static void put_u64(unsigned char *bytes, uint64_t value) {
+  for (int i = 0; i < 8; i++) {
+    bytes[i] = (unsigned char)(value >> (8 * i));
+  }
+}
+
+static uint32_t get_u32(const unsigned char *bytes) {
+  uint32_t value = 0;
+  for (int i = 3; i >= 0; i--) {
+    value = (value << 8) | bytes[i];
+  }
+  return value;
+}
+
+static uint64_t get_u64(const unsigned char *bytes) {
+  uint64_t value = 0;
+  for (int i = 7; i >= 0; i--) {
+    value = (value << 8) | bytes[i];
+  }
+  return value;
+}
+
+/**
+ * @brief Saves the trajectory in the binary columnar format.
+ *
+ * @return 1 on success, 0 if the file could not be written.
+ */
+int trajectory_save(const Trajectory *trajectory, const char *filename) {
+  FILE *file = fopen(filename, "wb");
+  if (!file) {
+    return 0;
+  }
+
+  unsigned char header[HEADER_SIZE] = {0};
+  memcpy(header, FILE_MAGIC, 8);
+  put_u32(header + 8, FILE_VERSION);
+  put_u32(header + 12, TRAJECTORY_NUM_COLUMNS);
+  put_u64(header + 16, trajectory->length);
+  int success = fwrite(header, 1, HEADER_SIZE, file) == HEADER_SIZE;
+
+  double **columns[TRAJECTORY_NUM_COLUMNS];
+  get_columns((Trajectory *)trajectory, columns);
+  for (int c = 0; success && c < TRAJECTORY_NUM_COLUMNS; c++) {
+    const double *column = *columns[c];
+    if (is_little_endian()) {
+      success = fwrite(column, sizeof(double), trajectory->length, file) ==
+                trajectory->length;
+      continue;
+    }
+    for (size_t i = 0; success && i < trajectory->length; i++) {
+      uint64_t bits;
+      unsigned char bytes[8];
+      memcpy(&bits, &column[i], sizeof(bits));
+      put_u64(bytes, bits);
+      success = fwrite(bytes, 1, 8, file) == 8;
+    }
+  }
+
+  if (fclose(file) != 0) {
+    success = 0;
+  }
+  return success;
+}
+
+/**
+ * @brief Maps a trajectory file into memory. The columns are used in place,
+ * so the trajectory is read only until trajectory_free() is called.
+ *
+ * @return 1 on success, 0 if the file could not be mapped or is not a valid
+ * trajectory file (or the host is big endian).
+ */
+int trajectory_load(Trajectory *trajectory, const char *filename) {
+  trajectory_init(trajectory);
+  if (!is_little_endian()) {
+    return 0;
+  }
+
+  MappedFile file;
+  if (!map_file(filename, &file)) {
+    return 0;
+  }
+  const unsigned char *header = (const unsigned char *)file.data;
+  if (file.size < HEADER_SIZE || memcmp(header, FILE_MAGIC, 8) != 0 ||
+      get_u32(header + 8) != FILE_VERSION ||
+      get_u32(header + 12) != TRAJECTORY_NUM_COLUMNS) {
+    unmap_file(&file);
+    return 0;
+  }
+  uint64_t rows = get_u64(header + 16);
+  if (rows > (file.size - HEADER_SIZE) / (TRAJECTORY_NUM_COLUMNS * 8)) {
+    unmap_file(&file);
+    return 0;
+  }
+
+  double **columns[TRAJECTORY_NUM_COLUMNS];
+  get_columns(trajectory, columns);
+  for (int c = 0; c < TRAJECTORY_NUM_COLUMNS; c++) {
+    *columns[c] = (double *)(file.data + HEADER_SIZE + c * rows * 8);
+  }
+  trajectory->length = rows;
+  trajectory->capacity = rows;
+  trajectory->mapping = file;
+  return 1;
+}
+
+/**
+ * @brief Writes the position and rotation of every time step in the format of
+ * positions.csv (without the header line). The lines are formatted into a
+ * large buffer that is written in one piece whenever it is full.
+ *
+ * @return 1 on success, 0 if the memory or the output failed.
+ */
+int trajectory_write_csv(const Trajectory *trajectory, FILE *out) {
+  char *buffer = malloc(CSV_BUFFER_SIZE);
+  if (!buffer) {
+    return 0;
+  }
+
+  int success = 1;
+  size_t used = 0;
+  for (size_t i = 0; success && i < trajectory->length; i++) {
+    // A line is at most 3 * 25 characters for positions below 1e9
+    if (CSV_BUFFER_SIZE - used < 256) {
+      success = fwrite(buffer, 1, used, out) == used;
+      used = 0;
+    }
+    int length = snprintf(buffer + used, CSV_BUFFER_SIZE - used,
+                          "%.15lf,%.15lf,%.15lf\n", trajectory->x[i],
+                          trajectory->y[i], trajectory->rotation[i]);
+    if (length < 0 || (size_t)length >= CSV_BUFFER_SIZE - used) {
+      // Very large numbers: flush and format directly
+      success = fwrite(buffer, 1, used, out) == used &&
+                fprintf(out, "%.15lf,%.15lf,%.15lf\n", trajectory->x[i],
+                        trajectory->y[i], trajectory->rotation[i]) > 0;
+      used = 0;
+      continue;
+    }
+    used += (size_t)length;
+  }
+  if (success && used > 0) {
+    success = fwrite(buffer, 1, used, out) == used;
+  }
+  free(buffer);
+  return success;
+}
+
+static const Trajectory *read_whole_trajectory(void *context, size_t block) {
+  (void)block;
+  return context;
+}
+
+/**
+ * @brief Reads a trajectory in memory as a single block.
+ */
+void trajectory_blocks(const Trajectory *trajectory, TrajectoryBlocks *blocks) {
+  blocks->length = trajectory->length;
+  blocks->block_size = trajectory->length > 0 ? trajectory->length : 1;
+  blocks->read = read_whole_trajectory;
+  blocks->context = (void *)trajectory;
+}
+
+size_t trajectory_blocks_count(const TrajectoryBlocks *blocks) {
+  return (blocks->length + blocks->block_size - 1) / blocks->block_size;
+}
+
+const Trajectory *trajectory_blocks_read(const TrajectoryBlocks *blocks,
+                                         size_t block) {
+  return blocks->read(blocks->context, block);
+}
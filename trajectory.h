@@ -0,0 +1,67 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include "mapped_file.h"
+#include <stddef.h>
+#include <stdio.h>
+
+typedef struct Vector2D {
+  double x;
+  double y;
+} Vec2D;
+
+#define CHUNK_SIZE 4096 // Number of csv rows read and integrated at once
+
+typedef struct TelemetryChunk {
+  size_t length;
+  double acceleration[CHUNK_SIZE];
+  double rotation[CHUNK_SIZE];
+  double temperature[CHUNK_SIZE];
+} TelemetryChunk;
+
+// State after every time step, stored column by column. The columns either
+// live on the heap or point into a mapped trajectory file (read only).
+typedef struct Trajectory {
+  double *x;
+  double *y;
+  double *rotation;
+  double *velocity_x;
+  double *velocity_y;
+  double *temperature;
+  size_t length;
+  size_t capacity;
+  MappedFile mapping;
+} Trajectory;
+
+#define TRAJECTORY_NUM_COLUMNS 6
+
+// Returns the time steps of one block, valid until the next call
+typedef const Trajectory *(*TrajectoryBlockReader)(void *context,
+                                                   size_t block);
+
+// A trajectory read one block of time steps at a time, so that the outputs
+// can also be generated from storage that decodes its blocks on demand, such
+// as a CompactTrajectory. Every block but the last has block_size steps.
+typedef struct TrajectoryBlocks {
+  size_t length;
+  size_t block_size;
+  TrajectoryBlockReader read;
+  void *context;
+} TrajectoryBlocks;
+
+void trajectory_init(Trajectory *trajectory);
+int trajectory_reserve(Trajectory *trajectory, size_t capacity);
+int trajectory_resize(Trajectory *trajectory, size_t length);
+size_t trajectory_memory_usage(const Trajectory *trajectory);
+void trajectory_free(Trajectory *trajectory);
+
+int trajectory_save(const Trajectory *trajectory, const char *filename);
+int trajectory_load(Trajectory *trajectory, const char *filename);
+int trajectory_write_csv(const Trajectory *trajectory, FILE *out);
+
+void trajectory_blocks(const Trajectory *trajectory, TrajectoryBlocks *blocks);
+size_t trajectory_blocks_count(const TrajectoryBlocks *blocks);
+const Trajectory *trajectory_blocks_read(const TrajectoryBlocks *blocks,
+                                         size_t block);
+
+#endif // TRAJECTORY_H